@@ -0,0 +1,500 @@
+// Headless batch conversion for retropad: parses the --convert command line, collects
+// the files, and converts them on a pool of worker threads that pull the next file
+// from a shared counter. Each file streams through a fixed pair of buffers into a
+// temporary file beside it, which replaces the original only once it is complete.
+#include "batch.h"
+#include "core/convert.h"
+#include "core/hash.h"
+#include "core/platform.h"
+#include <stdarg.h>
+#include <stdlib.h>
+#include <strsafe.h>
+
+#define BATCH_PATH_CHARS 1024
+#define BATCH_MAX_THREADS 64
+#define BATCH_LINE_CHARS (BATCH_PATH_CHARS + 256)
+#define TEMP_SUFFIX L".retropad-tmp"
+
+typedef enum ConvertOutcome {
+    OUTCOME_CONVERTED = 0,
+    OUTCOME_UNCHANGED,
+    OUTCOME_SKIPPED,
+    OUTCOME_FAILED,
+    OUTCOME_COUNT
+} ConvertOutcome;
+
+typedef struct BatchOptions {
+    TextEncoding from;                  // 0 detects
+    const TextCodePage *fromCodePage;   // for an ANSI source named on the command line
+    const TextCodePage *fallback;       // system code page, for files that turn out not to be UTF-8
+    TextConvertTarget to;
+    unsigned threads;
+} BatchOptions;
+
+typedef struct BatchFiles {
+    WCHAR **paths;
+    size_t count;
+    size_t capacity;
+} BatchFiles;
+
+typedef struct BatchRun {
+    const BatchOptions *options;
+    BatchFiles files;
+    volatile LONG next;             // index of the next file to hand out
+    CRITICAL_SECTION lock;          // output and the totals below
+    HANDLE out;
+    BOOL console;
+    size_t outcomes[OUTCOME_COUNT];
+    ULONGLONG bytesIn;
+} BatchRun;
+
+typedef struct BatchWorker {
+    BatchRun *run;
+    PlatformThread *thread;
+    uint8_t *input;                 // TEXT_CONVERT_BLOCK
+    uint8_t *output;                // TextConvertBound(TEXT_CONVERT_BLOCK)
+} BatchWorker;
+
+typedef struct ConvertReport {
+    ConvertOutcome outcome;
+    WCHAR reason[128];
+    TextEncoding from;
+    const TextCodePage *fromCodePage;
+    ULONGLONG bytesIn;
+    ULONGLONG bytesOut;
+    uint64_t nanos;
+} ConvertReport;
+
+static const WCHAR *const g_outcomeLabels[OUTCOME_COUNT] = {L"converted", L"unchanged", L"skipped", L"FAILED"};
+
+// --- Output ---
+
+// A GUI-subsystem program has no console of its own; borrow the one it was started
+// from unless the output is redirected
+static HANDLE OpenOutput(BOOL *console) {
+    HANDLE out = GetStdHandle(STD_OUTPUT_HANDLE);
+    if ((!out || out == INVALID_HANDLE_VALUE) && AttachConsole(ATTACH_PARENT_PROCESS)) {
+        out = CreateFileW(L"CONOUT$", GENERIC_READ | GENERIC_WRITE, FILE_SHARE_WRITE, NULL, OPEN_EXISTING, 0, NULL);
+    }
+    DWORD mode = 0;
+    *console = out && out != INVALID_HANDLE_VALUE && GetConsoleMode(out, &mode);
+    return out;
+}
+
+// Console output is written as UTF-16; redirected output as UTF-8
+static void WriteLine(HANDLE out, BOOL console, const WCHAR *text) {
+    if (!out || out == INVALID_HANDLE_VALUE) return;
+    DWORD written = 0;
+    size_t length = wcslen(text);
+    if (console) {
+        WriteConsoleW(out, text, (DWORD)length, &written, NULL);
+        return;
+    }
+    uint8_t bytes[BATCH_LINE_CHARS * 3];     // three bytes per unit at most
+    if (length > BATCH_LINE_CHARS) length = BATCH_LINE_CHARS;
+    size_t size = TextEncodeUtf8((const TextChar *)text, length, TEXT_EOL_CRLF, bytes);
+    WriteFile(out, bytes, (DWORD)size, &written, NULL);
+}
+
+static void Print(HANDLE out, BOOL console, const WCHAR *format, ...) {
+    WCHAR line[BATCH_LINE_CHARS];
+    va_list args;
+    va_start(args, format);
+    StringCchVPrintfW(line, ARRAYSIZE(line), format, args);
+    va_end(args);
+    WriteLine(out, console, line);
+}
+
+static void EncodingLabel(TextEncoding encoding, const TextCodePage *codePage, WCHAR *out, size_t outLen) {
+    switch (encoding) {
+    case ENC_UTF16LE:
+        StringCchCopyW(out, outLen, L"UTF-16 LE");
+        break;
+    case ENC_UTF16BE:
+        StringCchCopyW(out, outLen, L"UTF-16 BE");
+        break;
+    case ENC_ANSI:
+        if (codePage) {
+            StringCchPrintfW(out, outLen, L"%S", codePage->name);
+        } else {
+            StringCchCopyW(out, outLen, L"Latin-1");
+        }
+        break;
+    default:
+        StringCchCopyW(out, outLen, L"UTF-8");
+        break;
+    }
+}
+
+static double MegabytesPerSecond(ULONGLONG bytes, uint64_t nanos) {
+    return nanos ? (double)bytes / 1e6 / ((double)nanos / 1e9) : 0.0;
+}
+
+static void ReportFile(BatchRun *run, const WCHAR *path, const ConvertReport *report) {
+    EnterCriticalSection(&run->lock);
+    run->outcomes[report->outcome]++;
+    run->bytesIn += report->bytesIn;
+    if (report->outcome == OUTCOME_CONVERTED || report->outcome == OUTCOME_UNCHANGED) {
+        WCHAR from[64], to[64];
+        EncodingLabel(report->from, report->fromCodePage, from, ARRAYSIZE(from));
+        EncodingLabel(run->options->to.encoding, run->options->to.codePage, to, ARRAYSIZE(to));
+        Print(run->out, run->console, L"%-9s %s -> %s, %.1f MB, %.0f MB/s  %s\r\n", g_outcomeLabels[report->outcome],
+              from, to, (double)report->bytesIn / 1e6, MegabytesPerSecond(report->bytesIn, report->nanos), path);
+    } else {
+        Print(run->out, run->console, L"%-9s %s: %s\r\n", g_outcomeLabels[report->outcome], path, report->reason);
+    }
+    LeaveCriticalSection(&run->lock);
+}
+
+// --- Converting one file ---
+
+typedef enum StreamResult {
+    STREAM_DONE = 0,
+    STREAM_NOT_UTF8,        // detection guessed UTF-8 wrong; start again as ANSI
+    STREAM_STOPPED          // report says why
+} StreamResult;
+
+static void Fail(ConvertReport *report, ConvertOutcome outcome, const WCHAR *format, ...) {
+    report->outcome = outcome;
+    va_list args;
+    va_start(args, format);
+    StringCchVPrintfW(report->reason, ARRAYSIZE(report->reason), format, args);
+    va_end(args);
+}
+
+static BOOL WriteAll(HANDLE file, const uint8_t *data, size_t size) {
+    DWORD written = 0;
+    return size == 0 || (WriteFile(file, data, (DWORD)size, &written, NULL) && written == size);
+}
+
+// Reads `in` block by block through a converter into `out`. Equal hashes and sizes
+// of what was read and written mean the file is already in the target form.
+static StreamResult StreamFile(BatchWorker *worker, HANDLE in, HANDLE out, TextEncoding from,
+                               const TextCodePage *fromCodePage, ConvertReport *report) {
+    const BatchOptions *options = worker->run->options;
+    TextConverter converter;
+    if (!TextConverterInit(&converter, from, fromCodePage, &options->to)) {
+        Fail(report, OUTCOME_FAILED, L"not enough memory");
+        return STREAM_STOPPED;
+    }
+    HashState inHash, outHash;
+    HashBegin(&inHash);
+    HashBegin(&outHash);
+    StreamResult result = STREAM_DONE;
+    for (BOOL first = TRUE, last = FALSE; !last; first = FALSE) {
+        DWORD got = 0;
+        if (!ReadFile(in, worker->input, TEXT_CONVERT_BLOCK, &got, NULL)) {
+            Fail(report, OUTCOME_FAILED, L"read error %lu", GetLastError());
+            result = STREAM_STOPPED;
+            break;
+        }
+        last = got < TEXT_CONVERT_BLOCK;
+        if (first && from == 0 && TextConvertLooksBinary(worker->input, got)) {
+            Fail(report, OUTCOME_SKIPPED, L"binary file");
+            result = STREAM_STOPPED;
+            break;
+        }
+        HashUpdate(&inHash, worker->input, got);
+        size_t size = TextConvertStep(&converter, worker->input, got, last, worker->output);
+        if (size == TEXT_ERROR) {
+            result = STREAM_NOT_UTF8;
+            break;
+        }
+        HashUpdate(&outHash, worker->output, size);
+        if (!WriteAll(out, worker->output, size)) {
+            Fail(report, OUTCOME_FAILED, L"write error %lu", GetLastError());
+            result = STREAM_STOPPED;
+            break;
+        }
+    }
+
+    if (result == STREAM_DONE) {
+        WCHAR to[64];
+        EncodingLabel(options->to.encoding, options->to.codePage, to, ARRAYSIZE(to));
+        report->from = converter.from;
+        report->fromCodePage = converter.fromCodePage;
+        report->bytesIn = inHash.length;
+        report->bytesOut = outHash.length;
+        if (converter.invalid > 0) {
+            Fail(report, OUTCOME_FAILED, L"%zu invalid byte sequences; left unchanged", converter.invalid);
+            result = STREAM_STOPPED;
+        } else if (converter.unmapped > 0) {
+            Fail(report, OUTCOME_FAILED, L"%zu characters can't be written in %s; left unchanged", converter.unmapped, to);
+            result = STREAM_STOPPED;
+        } else {
+            BOOL same = inHash.length == outHash.length && HashEnd(&inHash) == HashEnd(&outHash);
+            report->outcome = same ? OUTCOME_UNCHANGED : OUTCOME_CONVERTED;
+        }
+    }
+    TextConverterFree(&converter);
+    return result;
+}
+
+static BOOL Rewind(HANDLE file, BOOL truncate) {
+    LARGE_INTEGER zero = {0};
+    return SetFilePointerEx(file, zero, NULL, FILE_BEGIN) && (!truncate || SetEndOfFile(file));
+}
+
+static void ConvertFile(BatchWorker *worker, const WCHAR *path, ConvertReport *report) {
+    const BatchOptions *options = worker->run->options;
+    ZeroMemory(report, sizeof(*report));
+    uint64_t start = PlatformNowNanos();
+
+    WCHAR temp[BATCH_PATH_CHARS];
+    if (FAILED(StringCchPrintfW(temp, ARRAYSIZE(temp), L"%s%s", path, TEMP_SUFFIX))) {
+        Fail(report, OUTCOME_FAILED, L"path too long");
+        return;
+    }
+    HANDLE in = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (in == INVALID_HANDLE_VALUE) {
+        Fail(report, OUTCOME_FAILED, L"can't open (error %lu)", GetLastError());
+        return;
+    }
+    HANDLE out = CreateFileW(temp, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS,
+                             FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (out == INVALID_HANDLE_VALUE) {
+        Fail(report, OUTCOME_FAILED, L"can't create %s (error %lu)", temp, GetLastError());
+        CloseHandle(in);
+        return;
+    }
+
+    StreamResult result = StreamFile(worker, in, out, options->from, options->fromCodePage, report);
+    if (result == STREAM_NOT_UTF8) {
+        if (!options->fallback) {
+            Fail(report, OUTCOME_FAILED, L"not UTF-8, and the system code page has no built-in table; use --from");
+        } else if (!Rewind(in, FALSE) || !Rewind(out, TRUE)) {
+            Fail(report, OUTCOME_FAILED, L"seek error %lu", GetLastError());
+        } else {
+            StreamFile(worker, in, out, ENC_ANSI, options->fallback, report);
+        }
+    }
+    CloseHandle(out);
+    CloseHandle(in);
+
+    if (report->outcome == OUTCOME_CONVERTED &&
+        !MoveFileExW(temp, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        Fail(report, OUTCOME_FAILED, L"can't replace the file (error %lu)", GetLastError());
+    }
+    if (report->outcome != OUTCOME_CONVERTED) DeleteFileW(temp);
+    report->nanos = PlatformNowNanos() - start;
+}
+
+static void WorkerMain(void *param) {
+    BatchWorker *worker = (BatchWorker *)param;
+    BatchRun *run = worker->run;
+    for (;;) {
+        size_t index = (size_t)(InterlockedIncrement(&run->next) - 1);
+        if (index >= run->files.count) break;
+        ConvertReport report;
+        ConvertFile(worker, run->files.paths[index], &report);
+        ReportFile(run, run->files.paths[index], &report);
+    }
+}
+
+// --- Command line ---
+
+static BOOL AddFile(BatchFiles *files, const WCHAR *path) {
+    if (files->count == files->capacity) {
+        size_t capacity = files->capacity ? files->capacity * 2 : 256;
+        WCHAR **grown = (WCHAR **)realloc(files->paths, capacity * sizeof(WCHAR *));
+        if (!grown) return FALSE;
+        files->paths = grown;
+        files->capacity = capacity;
+    }
+    size_t length = wcslen(path);
+    WCHAR *copy = (WCHAR *)malloc((length + 1) * sizeof(WCHAR));
+    if (!copy) return FALSE;
+    memcpy(copy, path, (length + 1) * sizeof(WCHAR));
+    files->paths[files->count++] = copy;
+    return TRUE;
+}
+
+static BOOL EndsWith(const WCHAR *text, const WCHAR *suffix) {
+    size_t length = wcslen(text), suffixLength = wcslen(suffix);
+    return length >= suffixLength && lstrcmpiW(text + length - suffixLength, suffix) == 0;
+}
+
+// Adds a file, or every file under a folder; links to other folders aren't followed
+static BOOL CollectFiles(BatchFiles *files, const WCHAR *path) {
+    DWORD attributes = GetFileAttributesW(path);
+    if (attributes == INVALID_FILE_ATTRIBUTES || !(attributes & FILE_ATTRIBUTE_DIRECTORY)) {
+        return EndsWith(path, TEMP_SUFFIX) || AddFile(files, path);
+    }
+    WCHAR pattern[BATCH_PATH_CHARS];
+    if (FAILED(StringCchPrintfW(pattern, ARRAYSIZE(pattern), L"%s\\*", path))) return AddFile(files, path);
+    WIN32_FIND_DATAW found;
+    HANDLE find = FindFirstFileW(pattern, &found);
+    if (find == INVALID_HANDLE_VALUE) return TRUE;
+    BOOL ok = TRUE;
+    do {
+        if (wcscmp(found.cFileName, L".") == 0 || wcscmp(found.cFileName, L"..") == 0) continue;
+        BOOL folder = (found.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+        if (folder && (found.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT)) continue;
+        WCHAR child[BATCH_PATH_CHARS];
+        if (FAILED(StringCchPrintfW(child, ARRAYSIZE(child), L"%s\\%s", path, found.cFileName))) continue;
+        ok = folder ? CollectFiles(files, child) : EndsWith(child, TEMP_SUFFIX) || AddFile(files, child);
+    } while (ok && FindNextFileW(find, &found));
+    FindClose(find);
+    return ok;
+}
+
+static void FreeFiles(BatchFiles *files) {
+    for (size_t i = 0; i < files->count; ++i) free(files->paths[i]);
+    free(files->paths);
+}
+
+// utf8, utf8-bom, utf16 (LE), utf16be, ansi (the system code page), latin1, cpNNNN;
+// the source also takes auto
+static BOOL ParseEncoding(const WCHAR *name, BOOL source, TextEncoding *encoding, const TextCodePage **codePage,
+                          bool *bom) {
+    *codePage = NULL;
+    *bom = false;
+    if (source && lstrcmpiW(name, L"auto") == 0) {
+        *encoding = 0;
+    } else if (lstrcmpiW(name, L"utf8") == 0 || lstrcmpiW(name, L"utf-8") == 0) {
+        *encoding = ENC_UTF8;
+    } else if (lstrcmpiW(name, L"utf8-bom") == 0) {
+        *encoding = ENC_UTF8;
+        *bom = true;
+    } else if (lstrcmpiW(name, L"utf16") == 0 || lstrcmpiW(name, L"utf16le") == 0) {
+        *encoding = ENC_UTF16LE;
+    } else if (lstrcmpiW(name, L"utf16be") == 0) {
+        *encoding = ENC_UTF16BE;
+    } else {
+        unsigned id = 0;
+        if (lstrcmpiW(name, L"ansi") == 0) {
+            id = GetACP();
+        } else if (lstrcmpiW(name, L"latin1") == 0) {
+            id = 28591;
+        } else if ((name[0] == L'c' || name[0] == L'C') && (name[1] == L'p' || name[1] == L'P')) {
+            id = (unsigned)wcstoul(name + 2, NULL, 10);
+        }
+        *codePage = TextFindCodePage(id);
+        if (!*codePage) return FALSE;
+        *encoding = ENC_ANSI;
+    }
+    return TRUE;
+}
+
+static BOOL ParseEol(const WCHAR *name, int *eol) {
+    static const WCHAR *const names[] = {L"crlf", L"lf", L"cr"};   // by TextEol
+    for (int i = 0; i < 3; ++i) {
+        if (lstrcmpiW(name, names[i]) == 0) {
+            *eol = i;
+            return TRUE;
+        }
+    }
+    if (lstrcmpiW(name, L"keep") != 0) return FALSE;
+    *eol = TEXT_CONVERT_KEEP_EOL;
+    return TRUE;
+}
+
+static int Usage(HANDLE out, BOOL console, const WCHAR *problem) {
+    if (problem) Print(out, console, L"retropad --convert: %s\r\n", problem);
+    WriteLine(out, console,
+              L"usage: retropad --convert --to <encoding> [--from <encoding>] [--eol crlf|lf|cr|keep]\r\n"
+              L"                [--threads N] <files or folders>...\r\n"
+              L"encodings: utf8, utf8-bom, utf16, utf16be, ansi, latin1, cpNNNN (built-in code pages);\r\n"
+              L"--from also takes auto (the default: BOM, else UTF-8, else the system code page)\r\n");
+    return 2;
+}
+
+int BatchConvertMain(int argc, LPWSTR *argv) {
+    BatchRun run;
+    ZeroMemory(&run, sizeof(run));
+    run.out = OpenOutput(&run.console);
+
+    BatchOptions options;
+    ZeroMemory(&options, sizeof(options));
+    options.to.eol = TEXT_CONVERT_KEEP_EOL;
+    options.fallback = TextFindCodePage(GetACP());
+    BOOL haveTarget = FALSE;
+    int paths = 0;
+    for (int i = 0; i < argc; ++i) {
+        const WCHAR *arg = argv[i];
+        const WCHAR *value = i + 1 < argc ? argv[i + 1] : NULL;
+        bool bom = false;
+        if (lstrcmpiW(arg, L"--to") == 0 && value) {
+            if (!ParseEncoding(value, FALSE, &options.to.encoding, &options.to.codePage, &bom)) {
+                return Usage(run.out, run.console, L"unknown target encoding");
+            }
+            options.to.bom = bom;
+            haveTarget = TRUE;
+            ++i;
+        } else if (lstrcmpiW(arg, L"--from") == 0 && value) {
+            if (!ParseEncoding(value, TRUE, &options.from, &options.fromCodePage, &bom)) {
+                return Usage(run.out, run.console, L"unknown source encoding");
+            }
+            ++i;
+        } else if (lstrcmpiW(arg, L"--eol") == 0 && value) {
+            if (!ParseEol(value, &options.to.eol)) return Usage(run.out, run.console, L"unknown line ending");
+            ++i;
+        } else if (lstrcmpiW(arg, L"--threads") == 0 && value) {
+            options.threads = (unsigned)wcstoul(value, NULL, 10);
+            ++i;
+        } else if (arg[0] == L'-' && arg[1] == L'-') {
+            return Usage(run.out, run.console, L"unknown option");
+        } else {
+            argv[paths++] = argv[i];
+        }
+    }
+    if (!haveTarget) return Usage(run.out, run.console, L"--to is required");
+    if (paths == 0) return Usage(run.out, run.console, L"no files given");
+
+    for (int i = 0; i < paths; ++i) {
+        if (!CollectFiles(&run.files, argv[i])) {
+            Print(run.out, run.console, L"retropad --convert: not enough memory for the file list\r\n");
+            FreeFiles(&run.files);
+            return 1;
+        }
+    }
+
+    // One worker per processor by default, never more than there are files
+    unsigned threads = options.threads ? options.threads : PlatformCpuCount();
+    if (threads > BATCH_MAX_THREADS) threads = BATCH_MAX_THREADS;
+    if (threads > run.files.count) threads = (unsigned)run.files.count;
+    if (threads == 0) threads = 1;
+    BatchWorker workers[BATCH_MAX_THREADS];
+    ZeroMemory(workers, sizeof(workers));
+    run.options = &options;
+    InitializeCriticalSection(&run.lock);
+    uint64_t start = PlatformNowNanos();
+
+    unsigned ready = 0;
+    for (unsigned i = 0; i < threads; ++i) {
+        BatchWorker *worker = &workers[ready];
+        worker->run = &run;
+        worker->input = (uint8_t *)malloc(TEXT_CONVERT_BLOCK);
+        worker->output = (uint8_t *)malloc(TextConvertBound(TEXT_CONVERT_BLOCK));
+        if (!worker->input || !worker->output) {
+            free(worker->input);
+            free(worker->output);
+            break;
+        }
+        ++ready;
+    }
+    // Worker 0 runs on this thread; the rest get their own, and any that can't
+    // start just leave their share to the others
+    for (unsigned i = 1; i < ready; ++i) workers[i].thread = PlatformThreadStart(WorkerMain, &workers[i]);
+    if (ready > 0) {
+        WorkerMain(&workers[0]);
+    } else {
+        Print(run.out, run.console, L"retropad --convert: not enough memory\r\n");
+    }
+    for (unsigned i = 0; i < ready; ++i) {
+        if (workers[i].thread) PlatformThreadJoin(workers[i].thread);
+        free(workers[i].input);
+        free(workers[i].output);
+    }
+    uint64_t nanos = PlatformNowNanos() - start;
+    DeleteCriticalSection(&run.lock);
+
+    size_t failed = run.outcomes[OUTCOME_FAILED] + (ready == 0 ? run.files.count : 0);
+    Print(run.out, run.console,
+          L"%zu files: %zu converted, %zu unchanged, %zu skipped, %zu failed; %.1f MB in %.2f s (%.0f MB/s, %u threads)\r\n",
+          run.files.count, run.outcomes[OUTCOME_CONVERTED], run.outcomes[OUTCOME_UNCHANGED],
+          run.outcomes[OUTCOME_SKIPPED], failed, (double)run.bytesIn / 1e6, (double)nanos / 1e9,
+          MegabytesPerSecond(run.bytesIn, nanos), ready);
+    FreeFiles(&run.files);
+    return failed > 0 ? 1 : 0;
+}
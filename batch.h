@@ -0,0 +1,13 @@
+// Headless batch conversion for retropad:
+//   retropad --convert --to <encoding> [--from <encoding>] [--eol crlf|lf|cr|keep]
+//            [--threads N] <files or folders>...
+// Rewrites each file (folders recursively) in place, streaming it through
+// core/convert.h on a bounded pool of worker threads, and prints one line per file
+// plus totals to the console. No window is created.
+#pragma once
+
+#include <windows.h>
+
+// argv holds the arguments after --convert. Returns the process exit code: 0 when
+// every file converted (or was already right), 1 when any failed, 2 for bad usage.
+int BatchConvertMain(int argc, LPWSTR *argv);
@@ -0,0 +1,542 @@
+// Throughput benchmarks for the retropad text core. Run with `make bench`.
+// Usage: bench_textcore [max-size]   (size accepts K/M/G suffixes, default 2G)
+// Sizes grow from 1 KB by 16x up to max-size; MB/s is 10^6 input bytes per second.
+#include "textcore.h"
+#include "codepage.h"
+#include "docstore.h"
+#include "textstats.h"
+#include "lineops.h"
+#include "hash.h"
+#include "diff.h"
+#include "highlight.h"
+#include "hexdump.h"
+#include "jobs.h"
+#include "platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct BenchBuffers {
+    uint8_t *utf8;
+    TextChar *decoded;
+    TextChar *normalized;
+    TextChar *replaced;
+} BenchBuffers;
+
+static size_t ParseSize(const char *arg) {
+    char *end = NULL;
+    double value = strtod(arg, &end);
+    if (end && (*end == 'k' || *end == 'K')) value *= 1024.0;
+    if (end && (*end == 'm' || *end == 'M')) value *= 1024.0 * 1024.0;
+    if (end && (*end == 'g' || *end == 'G')) value *= 1024.0 * 1024.0 * 1024.0;
+    return (size_t)value;
+}
+
+// Log-like corpus with LF endings; unless asciiOnly, about one line in twelve
+// carries non-ASCII text
+static void FillCorpus(uint8_t *dst, size_t size, bool asciiOnly) {
+    static const char *const levels[] = {"INFO ", "DEBUG", "WARN ", "ERROR"};
+    char line[160];
+    size_t pos = 0;
+    unsigned seed = 12345;
+    unsigned lineNo = 0;
+    while (pos < size) {
+        seed = seed * 1103515245u + 12345u;
+        int len = snprintf(line, sizeof(line), "2026-10-18 12:%02u:%02u.%03u %s [worker-%02u] request %u completed in %u ms%s\n",
+                           (seed >> 8) % 60, (seed >> 14) % 60, (seed >> 4) % 1000, levels[(seed >> 20) & 3],
+                           (seed >> 24) % 16, lineNo, (seed >> 10) % 500,
+                           (!asciiOnly && lineNo % 12 == 0) ? " caf\xC3\xA9 \xE2\x82\xAC" : "");
+        size_t copy = (size_t)len < size - pos ? (size_t)len : size - pos;
+        memcpy(dst + pos, line, copy);
+        pos += copy;
+        ++lineNo;
+    }
+}
+
+static void Report(const char *name, size_t bytes, unsigned iterations, uint64_t nanos) {
+    double mbps = (double)bytes * iterations / ((double)nanos / 1e9) / 1e6;
+    printf("  %-18s %10.1f MB/s\n", name, mbps);
+}
+
+static void FormatSize(size_t size, char *out, size_t outLen) {
+    if (size >= (1u << 30)) snprintf(out, outLen, "%zu GB", size >> 30);
+    else if (size >= (1u << 20)) snprintf(out, outLen, "%zu MB", size >> 20);
+    else snprintf(out, outLen, "%zu KB", size >> 10);
+}
+
+static unsigned IterationsFor(size_t size) {
+    // Aim for roughly 256 MB of work per measurement on small inputs
+    size_t target = (size_t)256 << 20;
+    return size >= target ? 1u : (unsigned)(target / size);
+}
+
+static void BenchStore(const char *name, const uint8_t *data, size_t size, unsigned iters) {
+    static const TextChar needle[] = {'t', 'i', 'm', 'e', 'o', 'u', 't', '!'};
+    char label[32];
+    uint64_t loadNanos = 0;
+    DocStore *store = NULL;
+    for (unsigned i = 0; i < iters; ++i) {
+        DocStoreDestroy(store);
+        store = DocStoreCreate();
+        uint64_t start = PlatformNowNanos();
+        if (!store || !DocStoreLoad(store, data, size, ENC_UTF8)) {
+            printf("  %s: store load failed\n", name);
+            DocStoreDestroy(store);
+            return;
+        }
+        loadNanos += PlatformNowNanos() - start;
+    }
+    snprintf(label, sizeof(label), "store load %s", name);
+    Report(label, size, iters, loadNanos);
+
+    size_t pos = 0;
+    volatile size_t sink = 0;
+    uint64_t start = PlatformNowNanos();
+    for (unsigned i = 0; i < iters; ++i) sink += DocStoreFind(store, needle, 8, TEXT_FIND_DOWN | TEXT_FIND_MATCH_CASE, 0, &pos);
+    snprintf(label, sizeof(label), "store find %s", name);
+    Report(label, size, iters, PlatformNowNanos() - start);
+    start = PlatformNowNanos();
+    for (unsigned i = 0; i < iters; ++i) sink += DocStoreFind(store, needle, 8, TEXT_FIND_DOWN, 0, &pos);
+    snprintf(label, sizeof(label), "store nocase %s", name);
+    Report(label, size, iters, PlatformNowNanos() - start);
+
+    // Counts after a keystroke: one chunk recounted, the rest only added up
+    static const TextChar key[] = {'x'};
+    TextStats textStats;
+    DocStoreGetTextStats(store, &textStats);
+    start = PlatformNowNanos();
+    for (unsigned i = 0; i < iters; ++i) {
+        DocStoreInsert(store, DocStoreLength(store) / 2, key, 1);
+        DocStoreGetTextStats(store, &textStats);
+    }
+    printf("  store %-12s %10.2f us per edit and stats refresh (%zu words)\n", name,
+           (double)(PlatformNowNanos() - start) / 1e3 / iters, textStats.words);
+    (void)sink;
+
+    DocStoreStats stats;
+    DocStoreGetStats(store, &stats);
+    printf("  store %-12s %10.2f bytes/char (%zu of %zu chunks wide)\n", name,
+           (double)stats.bytes / (double)(stats.length ? stats.length : 1), stats.wideChunks, stats.chunks);
+
+    // Pack everything but 1MB, then search through the packed chunks
+    start = PlatformNowNanos();
+    bool packed = DocStoreSetBudget(store, (size_t)1 << 20);
+    snprintf(label, sizeof(label), "store pack %s", name);
+    Report(label, size, 1, PlatformNowNanos() - start);
+    start = PlatformNowNanos();
+    for (unsigned i = 0; i < iters; ++i) sink += DocStoreFind(store, needle, 8, TEXT_FIND_DOWN | TEXT_FIND_MATCH_CASE, 0, &pos);
+    snprintf(label, sizeof(label), "packed find %s", name);
+    Report(label, size, iters, PlatformNowNanos() - start);
+    DocStoreGetStats(store, &stats);
+    if (packed && stats.packedChunks) {
+        printf("  packed %-11s %10.2f raw/packed, %zu MB -> %zu MB, %.1f us per chunk decompress\n", name,
+               (double)stats.packedSourceBytes / (double)stats.packedBytes, stats.packedSourceBytes >> 20,
+               stats.packedBytes >> 20, (double)stats.decompressNanos / 1e3 / (double)(stats.decompressions ? stats.decompressions : 1));
+    }
+    DocStoreDestroy(store);
+}
+
+// Line operations over the corpus lines (about 80 units each), with all processors
+static void BenchLineOps(const TextChar *text, size_t length, unsigned iters) {
+    static const struct { const char *name; TextLineOp op; } cases[] = {
+        {"sort lines", TEXT_LINES_SORT},
+        {"sort lines nocase", TEXT_LINES_SORT_NOCASE},
+        {"dedupe lines", TEXT_LINES_DEDUPE},
+    };
+    size_t lines = 0;
+    for (size_t i = 0; i < length; ++i) lines += text[i] == '\n';
+    for (size_t c = 0; c < sizeof(cases) / sizeof(cases[0]); ++c) {
+        uint64_t start = PlatformNowNanos();
+        for (unsigned i = 0; i < iters; ++i) {
+            size_t n = 0;
+            free(TextLinesApply(text, length, cases[c].op, 0, &n));
+        }
+        uint64_t nanos = PlatformNowNanos() - start;
+        Report(cases[c].name, length * sizeof(TextChar), iters, nanos);
+        printf("  %-18s %10.2f M lines/s (%zu lines)\n", "", (double)lines * iters / ((double)nanos / 1e9) / 1e6, lines);
+    }
+}
+
+// Load throughput by thread count; the scaling column is against one thread
+// A copy with one character changed in every 100000th line, diffed against the original
+static void BenchDiff(const TextChar *text, size_t length, unsigned iters) {
+    TextChar *edited = (TextChar *)malloc((length ? length : 1) * sizeof(TextChar));
+    if (!edited) return;
+    memcpy(edited, text, length * sizeof(TextChar));
+    size_t lines = 0;
+    for (size_t i = 0; i < length; ++i) {
+        if (text[i] != '\n') continue;
+        if (++lines % 100000 == 0 && i + 1 < length && edited[i + 1] != '\r') edited[i + 1] ^= 1;
+    }
+    size_t hunks = 0;
+    uint64_t start = PlatformNowNanos();
+    for (unsigned i = 0; i < iters; ++i) {
+        TextDiff diff;
+        if (TextDiffLines(text, length, edited, length, 0, &diff)) hunks = diff.count;
+        TextDiffFree(&diff);
+    }
+    uint64_t nanos = PlatformNowNanos() - start;
+    Report("diff", 2 * length * sizeof(TextChar), iters, nanos);
+    printf("  %-18s %10.1f ms per compare (%zu lines, %zu hunks)\n", "", (double)nanos / iters / 1e6, lines, hunks);
+    free(edited);
+}
+
+// A 60-line screen in the middle of the text, first cold and then after an edit on
+// it: with checkpoints in place the cost stays near a screen at any file size
+static void BenchHighlight(const TextChar *text, size_t length) {
+    DocStore *store = DocStoreCreate();
+    Highlighter *highlighter = HighlighterCreate(HIGHLIGHT_LOG);
+    if (!store || !highlighter || !DocStoreAppend(store, text, length)) {
+        HighlighterDestroy(highlighter);
+        DocStoreDestroy(store);
+        return;
+    }
+    size_t top = DocStoreLineCount(store) / 2;
+    const HighlightRun *runs;
+    uint64_t start = PlatformNowNanos();
+    for (size_t line = top; line < top + 60; ++line) HighlighterLine(highlighter, store, line, &runs);
+    uint64_t coldNanos = PlatformNowNanos() - start;
+
+    size_t pos = DocStoreLineStart(store, top + 10);
+    static const TextChar typed[] = {'x'};
+    DocStoreInsert(store, pos, typed, 1);
+    HighlighterStats before, after;
+    HighlighterGetStats(highlighter, &before);
+    start = PlatformNowNanos();
+    HighlighterEdit(highlighter, store, top + 10, top + 10, top + 10);
+    for (size_t line = top; line < top + 60; ++line) HighlighterLine(highlighter, store, line, &runs);
+    uint64_t editNanos = PlatformNowNanos() - start;
+    HighlighterGetStats(highlighter, &after);
+    printf("  %-18s %10.1f us cold screen, %.1f us after an edit (%llu lines tokenized)\n", "highlight",
+           (double)coldNanos / 1e3, (double)editNanos / 1e3,
+           (unsigned long long)(after.linesTokenized - before.linesTokenized));
+    HighlighterDestroy(highlighter);
+    DocStoreDestroy(store);
+}
+
+static void BenchParallelLoad(const uint8_t *data, size_t size, unsigned iters) {
+    unsigned cpus = PlatformCpuCount();
+    uint64_t single = 0;
+    for (unsigned threads = 1;; threads *= 2) {
+        if (threads > cpus) threads = cpus;
+        uint64_t nanos = 0;
+        for (unsigned i = 0; i < iters; ++i) {
+            DocStore *store = DocStoreCreate();
+            uint64_t start = PlatformNowNanos();
+            bool ok = store && DocStoreLoadParallel(store, data, size, ENC_UTF8, NULL, threads);
+            nanos += PlatformNowNanos() - start;
+            DocStoreDestroy(store);
+            if (!ok) {
+                printf("  parallel load failed\n");
+                return;
+            }
+        }
+        if (threads == 1) single = nanos;
+        char label[32];
+        snprintf(label, sizeof(label), "load %u thread%s", threads, threads == 1 ? "" : "s");
+        double mbps = (double)size * iters / 1048576.0 / ((double)(nanos ? nanos : 1) / 1e9);
+        printf("  %-18s %10.1f MB/s %6.2fx\n", label, mbps, (double)single / (double)(nanos ? nanos : 1));
+        if (threads == cpus) break;
+    }
+}
+
+// Loading as separate passes (detect, decode, measure and rewrite line endings,
+// count lines, copy into the store) against the fused single-pass store load, with
+// the bytes each one reads and writes per input byte
+static void BenchLoadPasses(const uint8_t *data, size_t size, unsigned iters, BenchBuffers *b) {
+    uint64_t stagedNanos = 0, fusedNanos = 0;
+    uint64_t stagedBytes = 0, fusedBytes = 0;
+    for (unsigned i = 0; i < iters; ++i) {
+        DocStore *store = DocStoreCreate();
+        if (!store) return;
+        uint64_t start = PlatformNowNanos();
+        TextEncoding encoding = TextDetectEncoding(data, size);
+        size_t decoded = TextDecode(data, size, encoding, b->decoded);
+        size_t normalized = TextNormalizeLineEndings(b->decoded, decoded, NULL);
+        TextNormalizeLineEndings(b->decoded, decoded, b->normalized);
+        size_t lines = 1;
+        for (size_t j = 0; j < normalized; ++j) lines += b->normalized[j] == '\n';
+        bool ok = DocStoreAppend(store, b->normalized, normalized);
+        stagedNanos += PlatformNowNanos() - start;
+        DocStoreStats stats;
+        DocStoreGetStats(store, &stats);
+        uint64_t wide = decoded * sizeof(TextChar), wideNormalized = normalized * sizeof(TextChar);
+        stagedBytes += 2 * (uint64_t)size + wide + 2 * wide + 3 * wideNormalized + stats.rawBytes;
+        DocStoreDestroy(store);
+
+        store = DocStoreCreate();
+        if (!store) return;
+        start = PlatformNowNanos();
+        ok = ok && DocStoreLoadDetect(store, data, size, NULL, 1) == encoding && DocStoreLineCount(store) == lines;
+        fusedNanos += PlatformNowNanos() - start;
+        DocStoreGetStats(store, &stats);
+        fusedBytes += size + stats.rawBytes;
+        DocStoreDestroy(store);
+        if (!ok) {
+            printf("  load passes: staged and fused loads disagree\n");
+            return;
+        }
+    }
+    double perByte = (double)size * iters;
+    printf("  %-18s %10.1f MB/s  6 passes %6.2f bytes touched/byte\n", "load staged",
+           perByte / 1048576.0 / ((double)stagedNanos / 1e9), (double)stagedBytes / perByte);
+    printf("  %-18s %10.1f MB/s  1 pass   %6.2f bytes touched/byte\n", "load fused",
+           perByte / 1048576.0 / ((double)fusedNanos / 1e9), (double)fusedBytes / perByte);
+}
+
+static void RunSize(size_t size, BenchBuffers *b) {
+    char label[32];
+    FormatSize(size, label, sizeof(label));
+    printf("%s corpus\n", label);
+
+    unsigned iters = IterationsFor(size);
+    volatile size_t sink = 0;
+
+    uint64_t start = PlatformNowNanos();
+    size_t decodedLen = 0;
+    for (unsigned i = 0; i < iters; ++i) decodedLen = TextDecode(b->utf8, size, ENC_UTF8, b->decoded);
+    Report("decode utf-8", size, iters, PlatformNowNanos() - start);
+
+    // The same bytes read as Windows-1252, against a plain per-byte table lookup
+    const TextCodePage *cp1252 = TextFindCodePage(1252);
+    start = PlatformNowNanos();
+    for (unsigned i = 0; i < iters; ++i) sink += TextDecodeCodePage(cp1252, b->utf8, size, b->replaced);
+    Report("decode cp1252", size, iters, PlatformNowNanos() - start);
+
+    start = PlatformNowNanos();
+    for (unsigned i = 0; i < iters; ++i) {
+        for (size_t j = 0; j < size; ++j) {
+            uint8_t c = b->utf8[j];
+            b->replaced[j] = c < 0x80 ? c : cp1252->high[c - 0x80];
+        }
+        sink += b->replaced[size - 1];
+    }
+    Report("decode cp1252 base", size, iters, PlatformNowNanos() - start);
+
+    start = PlatformNowNanos();
+    for (unsigned i = 0; i < iters; ++i) sink += TextEncodeCodePage(cp1252, b->replaced, size, TEXT_EOL_CRLF, (uint8_t *)b->normalized, NULL);
+    Report("encode cp1252", size, iters, PlatformNowNanos() - start);
+
+    start = PlatformNowNanos();
+    for (unsigned i = 0; i < iters; ++i) sink += TextIsValidUtf8(b->utf8, size);
+    Report("validate utf-8", size, iters, PlatformNowNanos() - start);
+
+    start = PlatformNowNanos();
+    for (unsigned i = 0; i < iters; ++i) sink += (size_t)HashBytes(b->utf8, size);
+    Report("hash", size, iters, PlatformNowNanos() - start);
+
+    // Byte pattern that never occurs, against memchr on its first byte and a compare
+    static const uint8_t bytes[] = {'t', 'i', 'm', 'e', 'o', 'u', 't', '!'};
+    start = PlatformNowNanos();
+    for (unsigned i = 0; i < iters; ++i) sink += HexFind(b->utf8, size, bytes, sizeof(bytes));
+    Report("hex find", size, iters, PlatformNowNanos() - start);
+    start = PlatformNowNanos();
+    for (unsigned i = 0; i < iters; ++i) {
+        for (const uint8_t *p = b->utf8; (p = (const uint8_t *)memchr(p, bytes[0], size - (size_t)(p - b->utf8)));) {
+            if ((size_t)(p - b->utf8) + sizeof(bytes) <= size && memcmp(p, bytes, sizeof(bytes)) == 0) break;
+            if (++p == b->utf8 + size) break;
+        }
+    }
+    Report("hex find base", size, iters, PlatformNowNanos() - start);
+
+    size_t wideBytes = decodedLen * sizeof(TextChar);
+    start = PlatformNowNanos();
+    size_t normalizedLen = 0;
+    for (unsigned i = 0; i < iters; ++i) normalizedLen = TextNormalizeLineEndings(b->decoded, decodedLen, b->normalized);
+    Report("normalize", wideBytes, iters, PlatformNowNanos() - start);
+
+    TextStats textStats;
+    start = PlatformNowNanos();
+    for (unsigned i = 0; i < iters; ++i) TextStatsWide(b->normalized, normalizedLen, &textStats);
+    Report("stats", normalizedLen * sizeof(TextChar), iters, PlatformNowNanos() - start);
+    start = PlatformNowNanos();
+    for (unsigned i = 0; i < iters; ++i) TextStatsNarrow(b->utf8, size, &textStats);
+    Report("stats latin-1", size, iters, PlatformNowNanos() - start);
+    sink += textStats.words;
+
+    // Needle that never occurs, so every search scans the whole document
+    static const TextChar needle[] = {'t', 'i', 'm', 'e', 'o', 'u', 't', '!'};
+    size_t pos = 0;
+    start = PlatformNowNanos();
+    for (unsigned i = 0; i < iters; ++i) sink += TextFind(b->normalized, normalizedLen, needle, 8, TEXT_FIND_DOWN | TEXT_FIND_MATCH_CASE, 0, &pos);
+    Report("find", normalizedLen * sizeof(TextChar), iters, PlatformNowNanos() - start);
+
+    start = PlatformNowNanos();
+    for (unsigned i = 0; i < iters; ++i) sink += TextFind(b->normalized, normalizedLen, needle, 8, TEXT_FIND_DOWN, 0, &pos);
+    Report("find nocase", normalizedLen * sizeof(TextChar), iters, PlatformNowNanos() - start);
+
+    static const TextChar from[] = {'r', 'e', 'q', 'u', 'e', 's', 't'};
+    static const TextChar to[] = {'r', 'e', 'q'};
+    size_t count = 0;
+    start = PlatformNowNanos();
+    for (unsigned i = 0; i < iters; ++i) sink += TextReplaceAll(b->normalized, normalizedLen, from, 7, to, 3, TEXT_FIND_MATCH_CASE, b->replaced, &count);
+    Report("replace all", normalizedLen * sizeof(TextChar), iters, PlatformNowNanos() - start);
+    (void)sink;
+
+    BenchLineOps(b->normalized, normalizedLen, iters > 16 ? 16 : iters);
+    BenchDiff(b->normalized, normalizedLen, iters > 16 ? 16 : iters);
+    BenchHighlight(b->normalized, normalizedLen);
+    BenchLoadPasses(b->utf8, size, iters, b);
+    if (size >= (1u << 20)) BenchParallelLoad(b->utf8, size, iters);
+    BenchStore("mixed", b->utf8, size, iters);
+    FillCorpus(b->utf8, size, true);
+    BenchStore("ascii", b->utf8, size, iters);
+}
+
+typedef struct BenchSlice {
+    const uint8_t *data;
+    size_t size;
+    uint64_t hash;
+} BenchSlice;
+
+static void BenchEmptyJob(JobContext *context, void *arg) {
+    (void)context;
+    (void)arg;
+}
+
+static void BenchHashSlice(JobContext *context, void *arg) {
+    (void)context;
+    BenchSlice *slice = (BenchSlice *)arg;
+    slice->hash = HashBytes(slice->data, slice->size);
+}
+
+// Stands in for a huge job split the way the app should split one: it spawns its
+// slices as children, so idle workers steal them and interactive jobs get in between
+static void BenchSplitJob(JobContext *context, void *arg) {
+    BenchSlice *slices = (BenchSlice *)arg;
+    for (size_t i = 0; slices[i].data; i++) JobSpawn(context, JOB_BULK, BenchHashSlice, NULL, &slices[i]);
+}
+
+static void ReportWaits(const char *name, const JobPoolStats *stats, JobPriority priority) {
+    uint64_t jobs = stats->completed[priority] + stats->skipped[priority];
+    printf("  %-18s %10.1f us mean wait %10.1f us max\n", name,
+           jobs ? (double)stats->waitNanos[priority] / (double)jobs / 1e3 : 0.0,
+           (double)stats->maxWaitNanos[priority] / 1e3);
+}
+
+// Job pool: throughput of thousands of empty jobs, a few huge jobs (hashing 16 MB each)
+// against running them one after another, and interactive wait while bulk slices run
+static void BenchJobs(void) {
+    enum { TINY = 200000, SLICE = 1 << 20, HUGE_SLICES = 16 };
+    unsigned cpus = PlatformCpuCount();
+    unsigned huge = cpus < 2 ? 2 : cpus;
+    size_t bytes = (size_t)huge * HUGE_SLICES * SLICE;
+    uint8_t *data = (uint8_t *)malloc(bytes);
+    BenchSlice *slices = (BenchSlice *)calloc((size_t)huge * (HUGE_SLICES + 1), sizeof(BenchSlice));
+    JobPool *pool = JobPoolCreate(0, NULL, NULL);
+    if (!data || !slices || !pool) {
+        printf("job pool\n  skipped: setup failed\n");
+        free(data);
+        free(slices);
+        JobPoolDestroy(pool);
+        return;
+    }
+    FillCorpus(data, bytes, false);
+    JobPoolStats stats;
+    JobPoolGetStats(pool, &stats);
+    printf("job pool (%u workers)\n", stats.workers);
+
+    uint64_t start = PlatformNowNanos();
+    for (unsigned i = 0; i < TINY; i++) JobSubmit(pool, JOB_INTERACTIVE, NULL, BenchEmptyJob, NULL, NULL);
+    JobPoolWait(pool);
+    uint64_t nanos = PlatformNowNanos() - start;
+    printf("  %-18s %10.1f jobs/s %8.2f us/job\n", "tiny jobs", TINY / ((double)nanos / 1e9), (double)nanos / TINY / 1e3);
+    JobPoolGetStats(pool, &stats);
+    ReportWaits("tiny wait", &stats, JOB_INTERACTIVE);
+
+    // Huge jobs whole: one 16 MB hash per job
+    uint64_t sink = 0;
+    for (unsigned i = 0; i < huge; i++) {
+        slices[i].data = data + (size_t)i * HUGE_SLICES * SLICE;
+        slices[i].size = (size_t)HUGE_SLICES * SLICE;
+    }
+    start = PlatformNowNanos();
+    for (unsigned i = 0; i < huge; i++) sink += HashBytes(slices[i].data, slices[i].size);
+    uint64_t serial = PlatformNowNanos() - start;
+    start = PlatformNowNanos();
+    for (unsigned i = 0; i < huge; i++) JobSubmit(pool, JOB_BULK, NULL, BenchHashSlice, NULL, &slices[i]);
+    JobPoolWait(pool);
+    nanos = PlatformNowNanos() - start;
+    for (unsigned i = 0; i < huge; i++) sink -= slices[i].hash;
+    printf("  %-18s %10.1f MB/s %6.2fx\n", "huge jobs", (double)bytes / 1e6 / ((double)nanos / 1e9),
+           (double)serial / (double)(nanos ? nanos : 1));
+    if (sink) printf("  huge jobs hashed differently\n");
+
+    // The same bytes as split jobs of 1 MB slices, with interactive jobs queued behind them
+    JobPoolDestroy(pool);
+    pool = JobPoolCreate(0, NULL, NULL);
+    if (!pool) {
+        free(data);
+        free(slices);
+        return;
+    }
+    for (unsigned i = 0; i < huge; i++) {
+        BenchSlice *split = slices + (size_t)i * (HUGE_SLICES + 1);
+        for (size_t j = 0; j < HUGE_SLICES; j++) {
+            split[j].data = data + ((size_t)i * HUGE_SLICES + j) * SLICE;
+            split[j].size = SLICE;
+        }
+        split[HUGE_SLICES].data = NULL;
+    }
+    start = PlatformNowNanos();
+    for (unsigned i = 0; i < huge; i++) JobSubmit(pool, JOB_BULK, NULL, BenchSplitJob, NULL, slices + (size_t)i * (HUGE_SLICES + 1));
+    for (unsigned i = 0; i < 1000; i++) JobSubmit(pool, JOB_INTERACTIVE, NULL, BenchEmptyJob, NULL, NULL);
+    JobPoolWait(pool);
+    nanos = PlatformNowNanos() - start;
+    JobPoolGetStats(pool, &stats);
+    printf("  %-18s %10.1f MB/s %6.2fx %8llu steals\n", "split jobs", (double)bytes / 1e6 / ((double)nanos / 1e9),
+           (double)serial / (double)(nanos ? nanos : 1), (unsigned long long)stats.steals);
+    ReportWaits("interactive wait", &stats, JOB_INTERACTIVE);
+    ReportWaits("bulk wait", &stats, JOB_BULK);
+
+    JobPoolDestroy(pool);
+    free(slices);
+    free(data);
+}
+
+int main(int argc, char **argv) {
+    size_t maxSize = (size_t)2 << 30;
+    if (argc > 1) maxSize = ParseSize(argv[1]);
+    if (maxSize < 1024) maxSize = 1024;
+
+    BenchJobs();
+
+    for (size_t size = 1024;; size *= 16) {
+        if (size > maxSize) size = maxSize;
+        // utf8 + decoded + normalized (CRLF grows ~1%) + replaced + a mostly wide store
+        uint64_t needed = (uint64_t)size * 9 + ((uint64_t)size >> 1);
+        uint64_t avail = PlatformAvailableMemory();
+        if (avail && needed > avail) {
+            char label[32];
+            FormatSize(size, label, sizeof(label));
+            printf("%s corpus\n  skipped: needs ~%llu MB, %llu MB available\n", label,
+                   (unsigned long long)(needed >> 20), (unsigned long long)(avail >> 20));
+            if (size == maxSize) break;
+            continue;
+        }
+
+
+        BenchBuffers b;
+        b.utf8 = (uint8_t *)malloc(size);
+        b.decoded = (TextChar *)malloc(size * sizeof(TextChar));
+        b.normalized = (TextChar *)malloc(size * sizeof(TextChar) * 2);
+        b.replaced = (TextChar *)malloc(size * sizeof(TextChar) * 2);
+        if (!b.utf8 || !b.decoded || !b.normalized || !b.replaced) {
+            printf("allocation failed at %zu bytes\n", size);
+            free(b.utf8);
+            free(b.decoded);
+            free(b.normalized);
+            free(b.replaced);
+            break;
+        }
+
+        FillCorpus(b.utf8, size, false);
+        RunSize(size, &b);
+        free(b.utf8);
+        free(b.decoded);
+        free(b.normalized);
+        free(b.replaced);
+        if (size == maxSize) break;
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,123 @@
+// Table-driven single-byte code page codec for retropad.
+#include "codepage.h"
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CODEPAGE_SSE2 1
+#endif
+
+extern const TextCodePage g_textCodePages[];
+extern const size_t g_textCodePageCount;
+
+size_t TextCodePageCount(void) {
+    return g_textCodePageCount;
+}
+
+const TextCodePage *TextCodePageAt(size_t index) {
+    return index < g_textCodePageCount ? &g_textCodePages[index] : NULL;
+}
+
+const TextCodePage *TextFindCodePage(unsigned id) {
+    for (size_t i = 0; i < g_textCodePageCount; ++i) {
+        if (g_textCodePages[i].id == id) return &g_textCodePages[i];
+    }
+    return NULL;
+}
+
+// Length of the all-ASCII prefix of data[0..size), widened into dst as it goes
+static size_t WidenAscii(const uint8_t *data, size_t size, TextChar *dst) {
+    size_t i = 0;
+#ifdef CODEPAGE_SSE2
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= size; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+        if (_mm_movemask_epi8(v)) break;
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_unpacklo_epi8(v, zero));
+        _mm_storeu_si128((__m128i *)(dst + i + 8), _mm_unpackhi_epi8(v, zero));
+    }
+#else
+    for (; i + 8 <= size; i += 8) {
+        uint64_t v;
+        memcpy(&v, data + i, sizeof(v));
+        if (v & 0x8080808080808080ull) break;
+        for (size_t j = 0; j < 8; ++j) dst[i + j] = data[i + j];
+    }
+#endif
+    return i;
+}
+
+// Length of the all-ASCII prefix of text[0..length), narrowed into dst as it goes;
+// with stopCr it also ends before a block holding a CR
+static size_t NarrowAscii(const TextChar *text, size_t length, uint8_t *dst, bool stopCr) {
+    size_t i = 0;
+#ifdef CODEPAGE_SSE2
+    const __m128i high = _mm_set1_epi16((short)0xFF80);
+    const __m128i cr = _mm_set1_epi16('\r');
+    for (; i + 16 <= length; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(text + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(text + i + 8));
+        __m128i any = _mm_and_si128(_mm_or_si128(a, b), high);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(any, _mm_setzero_si128())) != 0xFFFF) break;
+        if (stopCr && _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi16(a, cr), _mm_cmpeq_epi16(b, cr)))) break;
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(a, b));
+    }
+#else
+    for (; i + 4 <= length; i += 4) {
+        if ((text[i] | text[i + 1] | text[i + 2] | text[i + 3]) >= 0x80) break;
+        if (stopCr && (text[i] == '\r' || text[i + 1] == '\r' || text[i + 2] == '\r' || text[i + 3] == '\r')) break;
+        for (size_t j = 0; j < 4; ++j) dst[i + j] = (uint8_t)text[i + j];
+    }
+#endif
+    return i;
+}
+
+size_t TextDecodeCodePage(const TextCodePage *codePage, const uint8_t *data, size_t size, TextChar *dst) {
+    const uint16_t *high = codePage->high;
+    size_t i = 0;
+    while (i < size) {
+        i += WidenAscii(data + i, size - i, dst + i);
+        // Scalar through the block that stopped the fast path
+        size_t stop = size - i < 16 ? size : i + 16;
+        for (; i < stop; ++i) {
+            uint8_t b = data[i];
+            dst[i] = b < 0x80 ? b : high[b - 0x80];
+        }
+    }
+    return size;
+}
+
+size_t TextEncodeCodePage(const TextCodePage *codePage, const TextChar *text, size_t length, TextEol eol,
+                          uint8_t *dst, size_t *unmappedOut) {
+    bool convert = eol != TEXT_EOL_CRLF;
+    size_t unmapped = 0;
+    size_t out = 0;
+    size_t i = 0;
+    while (i < length) {
+        size_t run = NarrowAscii(text + i, length - i, dst + out, convert);
+        i += run;
+        out += run;
+        size_t stop = length - i < 16 ? length : i + 16;
+        for (; i < stop; ++i) {
+            TextChar c = text[i];
+            if (c == '\r' && convert && i + 1 < length && text[i + 1] == '\n') {
+                dst[out++] = eol == TEXT_EOL_LF ? '\n' : '\r';
+                ++i;
+                continue;
+            }
+            if (c < 0x80) {
+                dst[out++] = (uint8_t)c;
+                continue;
+            }
+            uint8_t block = codePage->pages[c >> 8];
+            uint8_t b = block ? codePage->blocks[block - 1][c & 0xFF] : 0;
+            if (!b) {
+                b = '?';
+                ++unmapped;
+            }
+            dst[out++] = b;
+        }
+    }
+    if (unmappedOut) *unmappedOut = unmapped;
+    return out;
+}
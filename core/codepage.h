@@ -0,0 +1,32 @@
+// Built-in single-byte code pages for retropad: Windows 1250-1258, DOS 437/850 and
+// the ISO-8859 sets Windows knows (28591-28599, 28603, 28605). Decoding and encoding
+// run off static tables (codepages.c, generated by gen_tables.py), so they work and
+// test the same off-Windows. Bytes a code page leaves undefined decode to the
+// character with the same value (U+0080..U+00FF), as Windows does for 1252, so they
+// survive a round trip (or to U+F780..U+F7FF when that character is taken). Nothing
+// here allocates.
+#pragma once
+
+#include "textcore.h"
+
+typedef struct TextCodePage {
+    unsigned id;                    // Windows code page number
+    const char *name;               // display name, ASCII
+    const uint16_t *high;           // Unicode for bytes 0x80..0xFF
+    const uint8_t *pages;           // character's high byte -> 1-based block, 0 = unmapped
+    const uint8_t (*blocks)[256];   // byte for the character's low byte, 0 = unmapped
+} TextCodePage;
+
+size_t TextCodePageCount(void);
+const TextCodePage *TextCodePageAt(size_t index);
+// NULL when the code page isn't built in (e.g. the DBCS pages)
+const TextCodePage *TextFindCodePage(unsigned id);
+
+// One unit per byte; returns `size`. ASCII runs are widened 16 bytes at a time.
+size_t TextDecodeCodePage(const TextCodePage *codePage, const uint8_t *data, size_t size, TextChar *dst);
+
+// One byte per unit, except that each CRLF is written as `eol` (so `length` bytes
+// always suffice); returns the bytes written. Characters the code page can't represent
+// are written as '?' and counted in *unmappedOut when it isn't NULL.
+size_t TextEncodeCodePage(const TextCodePage *codePage, const TextChar *text, size_t length, TextEol eol,
+                          uint8_t *dst, size_t *unmappedOut);
@@ -0,0 +1,185 @@
+// Streaming re-encoding for retropad's batch conversion.
+#include "convert.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define STAGE_BYTES (TEXT_CONVERT_BLOCK + sizeof(((TextConverter *)0)->carry))
+#define WIDE_UNITS (STAGE_BYTES + 1)        // one extra for the unit held back
+#define LINES_UNITS (2 * WIDE_UNITS)        // every lone CR or LF may become CRLF
+
+bool TextConverterInit(TextConverter *c, TextEncoding from, const TextCodePage *fromCodePage,
+                       const TextConvertTarget *to) {
+    memset(c, 0, sizeof(*c));
+    c->from = from;
+    c->fromCodePage = fromCodePage;
+    c->to = *to;
+    c->stage = (uint8_t *)malloc(STAGE_BYTES);
+    c->wide = (TextChar *)malloc(WIDE_UNITS * sizeof(TextChar));
+    c->lines = (TextChar *)malloc(LINES_UNITS * sizeof(TextChar));
+    if (!c->stage || !c->wide || !c->lines) {
+        TextConverterFree(c);
+        return false;
+    }
+    return true;
+}
+
+void TextConverterFree(TextConverter *c) {
+    free(c->stage);
+    free(c->wide);
+    free(c->lines);
+    c->stage = NULL;
+    c->wide = NULL;
+    c->lines = NULL;
+}
+
+size_t TextConvertBound(size_t size) {
+    // UTF-8 output is the largest: three bytes for each unit of LINES_UNITS, plus a BOM
+    return 6 * (size + sizeof(((TextConverter *)0)->carry) + 1) + 4;
+}
+
+bool TextConvertLooksBinary(const uint8_t *data, size_t size) {
+    if (TextBomLength(data, size, ENC_UTF16LE) || TextBomLength(data, size, ENC_UTF16BE)) return false;
+    return memchr(data, 0, size) != NULL;
+}
+
+// Settles the source encoding from the first block and skips its BOM
+static size_t StartInput(TextConverter *c, const uint8_t *data, size_t size) {
+    c->started = true;
+    if (c->from == 0) {
+        static const TextEncoding marked[] = {ENC_UTF8, ENC_UTF16LE, ENC_UTF16BE};
+        for (size_t i = 0; i < 3; ++i) {
+            if (TextBomLength(data, size, marked[i])) {
+                c->from = marked[i];
+                break;
+            }
+        }
+        if (c->from == 0) {
+            c->from = ENC_UTF8;
+            c->detecting = true;
+        }
+    }
+    return c->from == ENC_ANSI ? 0 : TextBomLength(data, size, c->from);
+}
+
+// Bytes of data[0..size) up to the last character that is complete; what follows
+// waits for the next block
+static size_t CompletePart(TextEncoding encoding, const uint8_t *data, size_t size) {
+    if (encoding == ENC_UTF16LE || encoding == ENC_UTF16BE) return size & ~(size_t)1;
+    if (encoding != ENC_UTF8) return size;
+    for (size_t back = 1; back <= 4 && back <= size; ++back) {
+        uint8_t lead = data[size - back];
+        if ((lead & 0xC0) == 0x80) continue;
+        size_t need = lead >= 0xF0 ? 4 : lead >= 0xE0 ? 3 : lead >= 0xC0 ? 2 : 1;
+        return back < need ? size - back : size;
+    }
+    return size;
+}
+
+static size_t CountInvalidUtf8(const uint8_t *data, size_t size) {
+    size_t invalid = 0;
+    for (size_t i = 0; i < size;) {
+        uint32_t cp;
+        bool valid;
+        i += TextDecodeUtf8Char(data + i, size - i, &cp, &valid);
+        invalid += !valid;
+    }
+    return invalid;
+}
+
+static size_t WriteBom(const TextConverter *c, uint8_t *dst) {
+    switch (c->to.encoding) {
+    case ENC_UTF8:
+        if (!c->to.bom) return 0;
+        dst[0] = 0xEF;
+        dst[1] = 0xBB;
+        dst[2] = 0xBF;
+        return 3;
+    case ENC_UTF16LE:
+        dst[0] = 0xFF;
+        dst[1] = 0xFE;
+        return 2;
+    case ENC_UTF16BE:
+        dst[0] = 0xFE;
+        dst[1] = 0xFF;
+        return 2;
+    default:
+        return 0;
+    }
+}
+
+// text[0..length) with CRLF as `eol`, two bytes per unit in the target's byte order
+static size_t EncodeUtf16(const TextChar *text, size_t length, TextEol eol, bool bigEndian, uint8_t *dst) {
+    uint8_t *out = dst;
+    for (size_t i = 0; i < length; ++i) {
+        TextChar c = text[i];
+        if (c == '\r' && i + 1 < length && text[i + 1] == '\n' && eol != TEXT_EOL_CRLF) {
+            c = eol == TEXT_EOL_LF ? '\n' : '\r';
+            ++i;
+        }
+        out[bigEndian] = (uint8_t)c;
+        out[!bigEndian] = (uint8_t)(c >> 8);
+        out += 2;
+    }
+    return (size_t)(out - dst);
+}
+
+size_t TextConvertStep(TextConverter *c, const uint8_t *data, size_t size, bool last, uint8_t *dst) {
+    size_t out = 0;
+    if (!c->started) {
+        size_t bom = StartInput(c, data, size);
+        data += bom;
+        size -= bom;
+        out += WriteBom(c, dst);
+    }
+
+    // Carry + block, cut where a character would be split
+    memcpy(c->stage, c->carry, c->carryLength);
+    memcpy(c->stage + c->carryLength, data, size);
+    size_t staged = c->carryLength + size;
+    size_t split = last ? staged : CompletePart(c->from, c->stage, staged);
+    c->carryLength = staged - split;
+    memcpy(c->carry, c->stage + split, c->carryLength);
+
+    if (c->from == ENC_UTF8 && !TextIsValidUtf8(c->stage, split)) {
+        if (c->detecting) return TEXT_ERROR;
+        c->invalid += CountInvalidUtf8(c->stage, split);
+    }
+    if ((c->from == ENC_UTF16LE || c->from == ENC_UTF16BE) && (split & 1)) c->invalid++;   // odd final byte
+
+    size_t units = c->held != 0;
+    c->wide[0] = c->held;
+    if (c->from == ENC_ANSI && c->fromCodePage) {
+        units += TextDecodeCodePage(c->fromCodePage, c->stage, split, c->wide + units);
+    } else {
+        units += TextDecodeRaw(c->stage, split, c->from, c->wide + units);
+    }
+    TextChar tail = units > 0 ? c->wide[units - 1] : 0;
+    c->held = !last && (tail == '\r' || (tail >= 0xD800 && tail < 0xDC00)) ? tail : 0;
+    units -= c->held != 0;
+    TextCountEol(c->wide, units, &c->eol);
+
+    // Line endings become CRLF first, then each CRLF is written as the target's
+    const TextChar *text = c->wide;
+    TextEol eol = TEXT_EOL_CRLF;
+    if (c->to.eol != TEXT_CONVERT_KEEP_EOL) {
+        units = TextNormalizeLineEndings(c->wide, units, c->lines);
+        text = c->lines;
+        eol = (TextEol)c->to.eol;
+    }
+    switch (c->to.encoding) {
+    case ENC_UTF16LE:
+    case ENC_UTF16BE:
+        out += EncodeUtf16(text, units, eol, c->to.encoding == ENC_UTF16BE, dst + out);
+        break;
+    case ENC_ANSI: {
+        size_t unmapped = 0;
+        out += TextEncodeCodePage(c->to.codePage, text, units, eol, dst + out, &unmapped);
+        c->unmapped += unmapped;
+        break;
+    }
+    default:
+        out += TextEncodeUtf8(text, units, eol, dst + out);
+        break;
+    }
+    return out;
+}
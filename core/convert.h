@@ -0,0 +1,57 @@
+// Streaming re-encoding for retropad's batch conversion: a file is fed through in
+// blocks of up to TEXT_CONVERT_BLOCK bytes, each decoded, given the requested line
+// endings and encoded with the same routines the editor loads and saves with, so
+// memory use doesn't grow with the file. Unlike textcore.c this module allocates
+// (malloc), once per converter.
+#pragma once
+
+#include "textcore.h"
+#include "codepage.h"
+
+#define TEXT_CONVERT_BLOCK (256u << 10)
+#define TEXT_CONVERT_KEEP_EOL (-1)      // TextConvertTarget.eol: leave line breaks as they are
+
+typedef struct TextConvertTarget {
+    TextEncoding encoding;
+    const TextCodePage *codePage;   // ENC_ANSI only; required
+    bool bom;                       // UTF-8 only; UTF-16 always gets one
+    int eol;                        // TextEol or TEXT_CONVERT_KEEP_EOL
+} TextConvertTarget;
+
+typedef struct TextConverter {
+    TextEncoding from;              // 0 until detected
+    const TextCodePage *fromCodePage;   // ENC_ANSI source; NULL means Latin-1
+    TextConvertTarget to;
+    bool detecting;                 // UTF-8 assumed for want of a BOM, not yet disproved
+    bool started;                   // first block (BOM) handled
+    TextChar held;                  // last unit of the previous block when it was a CR or a
+                                    // high surrogate, kept for what follows; 0 if none
+    uint8_t carry[4];               // start of a character split by the block boundary
+    size_t carryLength;
+    size_t invalid;                 // ill-formed input sequences, decoded as U+FFFD
+    size_t unmapped;                // characters the target code page lacks, written as '?'
+    TextEolCounts eol;              // line breaks in the input by style
+    uint8_t *stage;
+    TextChar *wide;
+    TextChar *lines;
+} TextConverter;
+
+// `from` 0 detects from the first block: a BOM picks UTF-8 or UTF-16, anything
+// else is taken as UTF-8 until an invalid sequence shows up. Returns false when
+// out of memory.
+bool TextConverterInit(TextConverter *converter, TextEncoding from, const TextCodePage *fromCodePage,
+                       const TextConvertTarget *to);
+void TextConverterFree(TextConverter *converter);
+
+// Bytes of output one TextConvertStep call may produce for `size` input bytes
+size_t TextConvertBound(size_t size);
+
+// Converts the next `size` (at most TEXT_CONVERT_BLOCK) input bytes into dst, which
+// holds TextConvertBound(size) bytes; `last` marks the end of the input, which may
+// come with size 0. The first block should hold the BOM whole. Returns the bytes
+// written, or TEXT_ERROR when detection guessed UTF-8 and the input isn't: start
+// again with `from` ENC_ANSI.
+size_t TextConvertStep(TextConverter *converter, const uint8_t *data, size_t size, bool last, uint8_t *dst);
+
+// NUL bytes without a UTF-16 BOM: most likely not a text file at all
+bool TextConvertLooksBinary(const uint8_t *data, size_t size);
@@ -0,0 +1,489 @@
+// Line interning, linear-space Myers diff and unified diff output for retropad.
+// The search follows the classic formulation (Myers 1986, as in GNU diff): forward
+// and backward furthest-reaching x per diagonal, meeting in a middle snake.
+#include "diff.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DIFF_SSE2 1
+#endif
+
+#define DIFF_PREFETCH_LINES 16      // how far ahead interning fetches table slots
+
+typedef struct DiffLine {
+    size_t start;
+    size_t length;      // without the line break
+    uint64_t hash;      // of the text and whether a break ends it
+} DiffLine;
+
+// Table entry: the number of the line's first occurrence, counting the old text's
+// lines first, plus one (0 is empty)
+typedef struct DiffSlot {
+    uint64_t hash;
+    uint32_t id;
+} DiffSlot;
+
+typedef struct DiffSearch {
+    const uint32_t *x;
+    const uint32_t *y;
+    uint8_t *changedX;
+    uint8_t *changedY;
+    ptrdiff_t *fd;      // furthest x forward per diagonal x - y
+    ptrdiff_t *bd;      // furthest (lowest) x backward
+    ptrdiff_t costLimit;
+    bool approximate;
+} DiffSearch;
+
+typedef struct DiffOut {
+    TextChar *text;
+    size_t length;
+    size_t capacity;
+    bool failed;
+} DiffOut;
+
+// Four units per multiply; lines are short, so this beats a block hash's setup
+static uint64_t LineHash(const TextChar *p, size_t n, bool terminated) {
+    uint64_t h = 0x9E3779B97F4A7C15ULL ^ ((uint64_t)n << 1) ^ (uint64_t)terminated;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        uint64_t v;
+        memcpy(&v, p + i, sizeof(v));
+        h = (h ^ v) * 0xFF51AFD7ED558CCDULL;
+        h ^= h >> 32;
+    }
+    for (; i < n; ++i) h = (h ^ p[i]) * 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 29;
+    h *= 0xBF58476D1CE4E5B9ULL;
+    return h ^ (h >> 32);
+}
+
+// Position of the next LF at or after `from`, or `length`
+static size_t NextBreak(const TextChar *text, size_t from, size_t length) {
+    size_t i = from;
+#ifdef DIFF_SSE2
+    const __m128i lf = _mm_set1_epi16('\n');
+    for (; i + 8 <= length; i += 8) {
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(_mm_loadu_si128((const __m128i *)(text + i)), lf));
+        if (mask) {
+            while (!(mask & 1)) mask >>= 2, ++i;
+            return i;
+        }
+    }
+#endif
+    while (i < length && text[i] != '\n') ++i;
+    return i;
+}
+
+// Splits at LF (a CR before it dropped) and hashes each line while it is in cache
+static DiffLine *SplitLines(const TextChar *text, size_t length, size_t *countOut) {
+    size_t count = 0;
+    size_t capacity = length / 32 + 16;
+    DiffLine *lines = (DiffLine *)malloc(capacity * sizeof(DiffLine));
+    for (size_t start = 0; lines && start < length;) {
+        size_t lf = NextBreak(text, start, length);
+        size_t end = lf > start && lf < length && text[lf - 1] == '\r' ? lf - 1 : lf;
+        if (count == capacity) {
+            capacity *= 2;
+            DiffLine *grown = (DiffLine *)realloc(lines, capacity * sizeof(DiffLine));
+            if (!grown) free(lines);
+            lines = grown;
+            if (!lines) break;
+        }
+        lines[count].start = start;
+        lines[count].length = end - start;
+        lines[count].hash = LineHash(text + start, end - start, lf < length);
+        ++count;
+        start = lf + 1;
+    }
+    *countOut = count;
+    return lines;
+}
+
+typedef struct DiffInterner {
+    const TextChar *texts[2];
+    const DiffLine *lines[2];
+    size_t oldCount;
+    DiffSlot *table;
+    size_t mask;
+} DiffInterner;
+
+// Number of the first line equal to line `index` of side 0 (old) or 1 (new)
+static uint32_t InternLine(const DiffInterner *in, int side, size_t index) {
+    const DiffLine *line = &in->lines[side][index];
+    const TextChar *text = in->texts[side] + line->start;
+    size_t slot = (size_t)line->hash & in->mask;
+    for (;; slot = (slot + 1) & in->mask) {
+        DiffSlot *entry = &in->table[slot];
+        if (entry->id == 0) {
+            entry->hash = line->hash;
+            entry->id = (uint32_t)(side ? in->oldCount + index : index) + 1;
+            return entry->id;
+        }
+        if (entry->hash != line->hash) continue;
+        // Equal hashes, so almost surely equal lines; the text rules out a collision
+        size_t first = entry->id - 1;
+        int firstSide = first >= in->oldCount;
+        const DiffLine *other = &in->lines[firstSide][firstSide ? first - in->oldCount : first];
+        if (other->length == line->length &&
+            memcmp(in->texts[firstSide] + other->start, text, line->length * sizeof(TextChar)) == 0) {
+            return entry->id;
+        }
+    }
+}
+
+// Interns both sides in step, so a line that matches the other side finds its twin
+// (and the table slot) still in cache; slots for lines ahead are prefetched
+static void InternLines(DiffInterner *in, size_t n, size_t m, uint32_t *x, uint32_t *y) {
+    size_t most = n > m ? n : m;
+    for (size_t i = 0; i < most; ++i) {
+#ifdef DIFF_SSE2
+        if (i + DIFF_PREFETCH_LINES < n) {
+            _mm_prefetch((const char *)&in->table[(size_t)in->lines[0][i + DIFF_PREFETCH_LINES].hash & in->mask],
+                         _MM_HINT_T0);
+        }
+        if (i + DIFF_PREFETCH_LINES < m) {
+            _mm_prefetch((const char *)&in->table[(size_t)in->lines[1][i + DIFF_PREFETCH_LINES].hash & in->mask],
+                         _MM_HINT_T0);
+        }
+#endif
+        if (i < n) x[i] = InternLine(in, 0, i);
+        if (i < m) y[i] = InternLine(in, 1, i);
+    }
+}
+
+typedef struct DiffSplit {
+    ptrdiff_t xmid;
+    ptrdiff_t ymid;
+} DiffSplit;
+
+// Finds where an optimal path through x[xoff..xlim) and y[yoff..ylim) crosses the
+// middle, or past the cost limit the furthest point either search has reached. Both
+// ranges are non-empty and differ at both ends, so the split always makes progress.
+static void FindSplit(DiffSearch *s, ptrdiff_t xoff, ptrdiff_t xlim, ptrdiff_t yoff, ptrdiff_t ylim,
+                      DiffSplit *split) {
+    ptrdiff_t *fd = s->fd;
+    ptrdiff_t *bd = s->bd;
+    const uint32_t *xv = s->x;
+    const uint32_t *yv = s->y;
+    const ptrdiff_t dmin = xoff - ylim;
+    const ptrdiff_t dmax = xlim - yoff;
+    const ptrdiff_t fmid = xoff - yoff;
+    const ptrdiff_t bmid = xlim - ylim;
+    ptrdiff_t fmin = fmid, fmax = fmid;
+    ptrdiff_t bmin = bmid, bmax = bmid;
+    const bool odd = ((fmid - bmid) & 1) != 0;
+    fd[fmid] = xoff;
+    bd[bmid] = xlim;
+
+    for (ptrdiff_t cost = 1;; ++cost) {
+        if (fmin > dmin) fd[--fmin - 1] = -1;
+        else ++fmin;
+        if (fmax < dmax) fd[++fmax + 1] = -1;
+        else --fmax;
+        for (ptrdiff_t d = fmax; d >= fmin; d -= 2) {
+            ptrdiff_t lo = fd[d - 1], hi = fd[d + 1];
+            ptrdiff_t x = lo >= hi ? lo + 1 : hi;
+            ptrdiff_t y = x - d;
+            while (x < xlim && y < ylim && xv[x] == yv[y]) ++x, ++y;
+            fd[d] = x;
+            if (odd && bmin <= d && d <= bmax && bd[d] <= x) {
+                split->xmid = x;
+                split->ymid = y;
+                return;
+            }
+        }
+
+        if (bmin > dmin) bd[--bmin - 1] = PTRDIFF_MAX;
+        else ++bmin;
+        if (bmax < dmax) bd[++bmax + 1] = PTRDIFF_MAX;
+        else --bmax;
+        for (ptrdiff_t d = bmax; d >= bmin; d -= 2) {
+            ptrdiff_t lo = bd[d - 1], hi = bd[d + 1];
+            ptrdiff_t x = lo < hi ? lo : hi - 1;
+            ptrdiff_t y = x - d;
+            while (xoff < x && yoff < y && xv[x - 1] == yv[y - 1]) --x, --y;
+            bd[d] = x;
+            if (!odd && fmin <= d && d <= fmax && x <= fd[d]) {
+                split->xmid = x;
+                split->ymid = y;
+                return;
+            }
+        }
+
+        if (cost >= s->costLimit) {
+            // Too expensive: take whichever search got further from its corner
+            ptrdiff_t fxyBest = -1, fxBest = 0;
+            for (ptrdiff_t d = fmax; d >= fmin; d -= 2) {
+                ptrdiff_t x = fd[d] < xlim ? fd[d] : xlim;
+                ptrdiff_t y = x - d;
+                if (ylim < y) x = ylim + d, y = ylim;
+                if (fxyBest < x + y) fxyBest = x + y, fxBest = x;
+            }
+            ptrdiff_t bxyBest = PTRDIFF_MAX, bxBest = 0;
+            for (ptrdiff_t d = bmax; d >= bmin; d -= 2) {
+                ptrdiff_t x = bd[d] > xoff ? bd[d] : xoff;
+                ptrdiff_t y = x - d;
+                if (y < yoff) x = yoff + d, y = yoff;
+                if (x + y < bxyBest) bxyBest = x + y, bxBest = x;
+            }
+            if ((xlim + ylim) - bxyBest < fxyBest - (xoff + yoff)) {
+                split->xmid = fxBest;
+                split->ymid = fxyBest - fxBest;
+            } else {
+                split->xmid = bxBest;
+                split->ymid = bxyBest - bxBest;
+            }
+            s->approximate = true;
+            return;
+        }
+    }
+}
+
+static void CompareRange(DiffSearch *s, ptrdiff_t xoff, ptrdiff_t xlim, ptrdiff_t yoff, ptrdiff_t ylim) {
+    for (;;) {
+        while (xoff < xlim && yoff < ylim && s->x[xoff] == s->y[yoff]) ++xoff, ++yoff;
+        while (xoff < xlim && yoff < ylim && s->x[xlim - 1] == s->y[ylim - 1]) --xlim, --ylim;
+        if (xoff == xlim) {
+            memset(s->changedY + yoff, 1, (size_t)(ylim - yoff));
+            return;
+        }
+        if (yoff == ylim) {
+            memset(s->changedX + xoff, 1, (size_t)(xlim - xoff));
+            return;
+        }
+        DiffSplit split;
+        FindSplit(s, xoff, xlim, yoff, ylim, &split);
+        // Recurse into the smaller half and loop on the other, so the stack stays shallow
+        if ((split.xmid - xoff) + (split.ymid - yoff) < (xlim - split.xmid) + (ylim - split.ymid)) {
+            CompareRange(s, xoff, split.xmid, yoff, split.ymid);
+            xoff = split.xmid;
+            yoff = split.ymid;
+        } else {
+            CompareRange(s, split.xmid, xlim, split.ymid, ylim);
+            xlim = split.xmid;
+            ylim = split.ymid;
+        }
+    }
+}
+
+// Pairs unchanged lines in order; each run of changes between pairs is a hunk
+static bool CollectHunks(const uint8_t *changedX, size_t n, const uint8_t *changedY, size_t m, TextDiff *diff) {
+    size_t count = 0, capacity = 0;
+    TextDiffHunk *hunks = NULL;
+    size_t i = 0, j = 0;
+    while (i < n || j < m) {
+        if (i < n && j < m && !changedX[i] && !changedY[j]) {
+            ++i, ++j;
+            continue;
+        }
+        TextDiffHunk h = {i, 0, j, 0};
+        while (i < n && changedX[i]) ++i, ++h.oldCount;
+        while (j < m && changedY[j]) ++j, ++h.newCount;
+        if (count == capacity) {
+            capacity = capacity ? capacity * 2 : 16;
+            TextDiffHunk *grown = (TextDiffHunk *)realloc(hunks, capacity * sizeof(TextDiffHunk));
+            if (!grown) {
+                free(hunks);
+                return false;
+            }
+            hunks = grown;
+        }
+        hunks[count++] = h;
+    }
+    diff->hunks = hunks;
+    diff->count = count;
+    return true;
+}
+
+bool TextDiffLines(const TextChar *oldText, size_t oldLength, const TextChar *newText, size_t newLength,
+                   size_t costLimit, TextDiff *diff) {
+    memset(diff, 0, sizeof(*diff));
+    size_t n = 0, m = 0;
+    DiffLine *oldLines = SplitLines(oldText, oldLength, &n);
+    DiffLine *newLines = SplitLines(newText, newLength, &m);
+    bool ok = oldLines && newLines && n < UINT32_MAX / 4 && m < UINT32_MAX / 4;
+
+    size_t tableSize = 16;
+    while (ok && tableSize < 2 * (n + m)) tableSize *= 2;
+    uint32_t *ids = ok ? (uint32_t *)malloc((n + m + 1) * sizeof(uint32_t)) : NULL;
+    DiffSlot *table = ok ? (DiffSlot *)calloc(tableSize, sizeof(DiffSlot)) : NULL;
+    uint8_t *changed = ok ? (uint8_t *)calloc(n + m + 1, 1) : NULL;
+    ok = ids && table && changed;
+    if (ok) {
+        DiffInterner in = {{oldText, newText}, {oldLines, newLines}, n, table, tableSize - 1};
+        InternLines(&in, n, m, ids, ids + n);
+    }
+    free(table);
+    free(oldLines);
+    free(newLines);
+
+    if (ok) {
+        DiffSearch s;
+        s.x = ids;
+        s.y = ids + n;
+        s.changedX = changed;
+        s.changedY = changed + n;
+        s.costLimit = (ptrdiff_t)(costLimit ? costLimit : TEXT_DIFF_COST_LIMIT);
+        s.approximate = false;
+
+        // The common ends cost nothing; the diagonal arrays only need to span the rest
+        size_t prefix = 0, suffix = 0;
+        while (prefix < n && prefix < m && s.x[prefix] == s.y[prefix]) ++prefix;
+        while (suffix < n - prefix && suffix < m - prefix && s.x[n - 1 - suffix] == s.y[m - 1 - suffix]) ++suffix;
+        size_t span = (n - prefix - suffix) + (m - prefix - suffix) + 3;
+        ptrdiff_t *diagonals = (ptrdiff_t *)malloc(2 * span * sizeof(ptrdiff_t));
+        ok = diagonals != NULL;
+        if (ok) {
+            // Diagonals run from prefix - (m - suffix) - 1 to (n - suffix) - prefix + 1
+            ptrdiff_t dmin = (ptrdiff_t)prefix - (ptrdiff_t)(m - suffix);
+            s.fd = diagonals - dmin + 1;
+            s.bd = diagonals + span - dmin + 1;
+            CompareRange(&s, (ptrdiff_t)prefix, (ptrdiff_t)(n - suffix), (ptrdiff_t)prefix, (ptrdiff_t)(m - suffix));
+            free(diagonals);
+            ok = CollectHunks(s.changedX, n, s.changedY, m, diff);
+            diff->approximate = s.approximate;
+        }
+    }
+    free(ids);
+    free(changed);
+    diff->oldLines = n;
+    diff->newLines = m;
+    if (!ok) TextDiffFree(diff);
+    return ok;
+}
+
+void TextDiffFree(TextDiff *diff) {
+    free(diff->hunks);
+    diff->hunks = NULL;
+    diff->count = 0;
+}
+
+static void Put(DiffOut *out, const TextChar *text, size_t length) {
+    if (out->failed) return;
+    if (out->capacity - out->length < length + 1) {
+        size_t capacity = out->capacity ? out->capacity : 4096;
+        while (capacity - out->length < length + 1) capacity *= 2;
+        TextChar *grown = (TextChar *)realloc(out->text, capacity * sizeof(TextChar));
+        if (!grown) {
+            out->failed = true;
+            return;
+        }
+        out->text = grown;
+        out->capacity = capacity;
+    }
+    memcpy(out->text + out->length, text, length * sizeof(TextChar));
+    out->length += length;
+}
+
+static void PutAscii(DiffOut *out, const char *text) {
+    TextChar units[64];
+    size_t n = 0;
+    while (text[n] && n < 64) {
+        units[n] = (TextChar)(unsigned char)text[n];
+        ++n;
+    }
+    Put(out, units, n);
+}
+
+static void PutNumber(DiffOut *out, size_t value) {
+    char digits[24];
+    size_t n = sizeof(digits) - 1;
+    digits[n] = '\0';
+    do {
+        digits[--n] = (char)('0' + value % 10);
+        value /= 10;
+    } while (value);
+    PutAscii(out, digits + n);
+}
+
+// "-3,2" style range: 1-based start, count left out when it is 1, and an empty range
+// named by the line before it
+static void PutRange(DiffOut *out, char sign, size_t start, size_t count) {
+    char prefix[2] = {sign, '\0'};
+    PutAscii(out, prefix);
+    PutNumber(out, count ? start + 1 : start);
+    if (count != 1) {
+        PutAscii(out, ",");
+        PutNumber(out, count);
+    }
+}
+
+typedef struct DiffSide {
+    const TextChar *text;
+    size_t length;
+    DiffLine *lines;
+    size_t count;
+} DiffSide;
+
+static void PutLine(DiffOut *out, char sign, const DiffSide *side, size_t line) {
+    TextChar mark = (TextChar)sign;
+    Put(out, &mark, 1);
+    Put(out, side->text + side->lines[line].start, side->lines[line].length);
+    PutAscii(out, "\r\n");
+    if (line + 1 == side->count && side->text[side->length - 1] != '\n') {
+        PutAscii(out, "\\ No newline at end of file\r\n");
+    }
+}
+
+TextChar *TextDiffUnified(const TextChar *oldText, size_t oldLength, const TextChar *newText, size_t newLength,
+                          const TextDiff *diff, const TextChar *oldName, const TextChar *newName, size_t context,
+                          size_t *hunkOffsets, size_t *lengthOut) {
+    DiffSide a = {oldText, oldLength, NULL, 0};
+    DiffSide b = {newText, newLength, NULL, 0};
+    a.lines = SplitLines(oldText, oldLength, &a.count);
+    b.lines = SplitLines(newText, newLength, &b.count);
+    DiffOut out = {NULL, 0, 0, a.lines == NULL || b.lines == NULL};
+
+    PutAscii(&out, "--- ");
+    Put(&out, oldName, TextLength(oldName));
+    PutAscii(&out, "\r\n+++ ");
+    Put(&out, newName, TextLength(newName));
+    PutAscii(&out, "\r\n");
+
+    for (size_t first = 0; first < diff->count && !out.failed;) {
+        // Hunks whose contexts would touch share one header
+        size_t last = first;
+        while (last + 1 < diff->count &&
+               diff->hunks[last + 1].oldLine - (diff->hunks[last].oldLine + diff->hunks[last].oldCount) <= 2 * context) {
+            ++last;
+        }
+        const TextDiffHunk *h0 = &diff->hunks[first];
+        const TextDiffHunk *h1 = &diff->hunks[last];
+        size_t lead = h0->oldLine < context ? h0->oldLine : context;
+        size_t oldEnd = h1->oldLine + h1->oldCount;
+        size_t trail = a.count - oldEnd < context ? a.count - oldEnd : context;
+        size_t oldStart = h0->oldLine - lead;
+        size_t newStart = h0->newLine - lead;
+        size_t newEnd = h1->newLine + h1->newCount;
+        PutAscii(&out, "@@ ");
+        PutRange(&out, '-', oldStart, oldEnd + trail - oldStart);
+        PutAscii(&out, " ");
+        PutRange(&out, '+', newStart, newEnd + trail - newStart);
+        PutAscii(&out, " @@\r\n");
+
+        size_t line = oldStart;
+        for (size_t k = first; k <= last; ++k) {
+            const TextDiffHunk *h = &diff->hunks[k];
+            for (; line < h->oldLine; ++line) PutLine(&out, ' ', &a, line);
+            if (hunkOffsets) hunkOffsets[k] = out.length;
+            for (size_t i = 0; i < h->oldCount; ++i) PutLine(&out, '-', &a, h->oldLine + i);
+            for (size_t i = 0; i < h->newCount; ++i) PutLine(&out, '+', &b, h->newLine + i);
+            line = h->oldLine + h->oldCount;
+        }
+        for (; line < oldEnd + trail; ++line) PutLine(&out, ' ', &a, line);
+        first = last + 1;
+    }
+
+    free(a.lines);
+    free(b.lines);
+    TextChar nul = 0;
+    Put(&out, &nul, 1);
+    if (out.failed) {
+        free(out.text);
+        return NULL;
+    }
+    *lengthOut = out.length - 1;
+    return out.text;
+}
@@ -0,0 +1,42 @@
+// Line diff for retropad's Compare with File. Lines are interned to integers through
+// a hash table (equal text, equal number), then compared with Myers' O(ND) algorithm
+// in linear space: each step finds the middle snake of the remaining range by
+// searching from both ends and recurses on the two halves. Past a cost limit the
+// search settles for the furthest point reached, so badly mismatched inputs still
+// finish quickly with a correct, if not minimal, diff. Unlike textcore.c this
+// allocates (malloc).
+#pragma once
+
+#include "textcore.h"
+
+#define TEXT_DIFF_COST_LIMIT 4096   // default edit steps per middle-snake search
+
+typedef struct TextDiffHunk {
+    size_t oldLine;     // 0-based; with no lines removed, where the new ones go
+    size_t oldCount;
+    size_t newLine;
+    size_t newCount;
+} TextDiffHunk;
+
+typedef struct TextDiff {
+    TextDiffHunk *hunks;    // in order, none adjacent to the next
+    size_t count;
+    size_t oldLines;
+    size_t newLines;
+    bool approximate;       // the cost limit cut a search short; still correct, maybe not minimal
+} TextDiff;
+
+// Lines split at LF with a CR before it ignored; a last line without a break differs
+// from the same line with one. costLimit 0 takes TEXT_DIFF_COST_LIMIT. Returns false
+// when out of memory or either text has 4G lines or more.
+bool TextDiffLines(const TextChar *oldText, size_t oldLength, const TextChar *newText, size_t newLength,
+                   size_t costLimit, TextDiff *diff);
+void TextDiffFree(TextDiff *diff);
+
+// The diff as a unified diff (CRLF line breaks, `context` lines around each change,
+// hunks closer than twice that joined) headed by the two names. hunkOffsets, NULL or
+// diff->count entries, gets where each hunk's first changed line starts in the
+// result. Returns a malloc'd, NUL-terminated result of *lengthOut units, or NULL.
+TextChar *TextDiffUnified(const TextChar *oldText, size_t oldLength, const TextChar *newText, size_t newLength,
+                          const TextDiff *diff, const TextChar *oldName, const TextChar *newName, size_t context,
+                          size_t *hunkOffsets, size_t *lengthOut);
@@ -0,0 +1,1465 @@
+// Chunked narrow/wide document store for retropad.
+#include "docstore.h"
+#include "lz.h"
+#include "platform.h"
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define DOCSTORE_SSE2 1
+#endif
+
+#define DOC_CHUNK_MAX (2 * DOC_CHUNK_UNITS)   // in-place inserts may grow a chunk this far
+#define DOC_CHUNK_MAX_BYTES (DOC_CHUNK_MAX * sizeof(TextChar))
+#define DOC_CACHE_SLOTS 8                     // expanded cold chunks kept for reads
+#define DOC_PACK_MIN 1024                     // shorter chunks aren't worth packing
+#define DOC_LOAD_MIN_SEGMENT (4u << 20)       // input bytes per load thread, at least
+#define DOC_SNAPSHOT_SLOTS 2                  // expanded cold chunks per snapshot
+
+// Header of the refcounted blocks that hold chunk text, packed images and chunk
+// arrays, so snapshots can share them. Only the store's thread adds references
+// (taking a snapshot, or copying a shared chunk array), so a count of 1 seen there
+// means no other thread can be reading the block.
+typedef union DocBlock {
+    PlatformRefCount refs;
+    uint64_t align;
+} DocBlock;
+
+typedef struct DocChunk {
+    void *data;             // uint8_t[] when narrow, TextChar[] when wide; NULL while packed (blocks)
+    void *packed;           // LZ image of the text while the chunk is cold (block)
+    size_t start;           // document offset of the first unit
+    size_t lineBase;        // line breaks before this chunk
+    uint64_t lastUse;       // store clock at the last edit, oldest is packed first
+    uint32_t length;
+    uint32_t capacity;      // units; 0 while packed
+    uint32_t breaks;        // LFs inside the chunk
+    uint32_t packedSize;
+    bool wide;
+    bool incompressible;    // packing didn't pay off; retried after the next edit
+    bool counted;           // `stats` matches the text
+    TextStats stats;
+} DocChunk;
+
+typedef struct DocCacheSlot {
+    const void *key;        // packed image the slot was expanded from
+    uint8_t *data;
+    uint64_t lastUse;
+} DocCacheSlot;
+
+// Read-side state. Reads take a const store, so this lives behind a pointer.
+typedef struct DocCache {
+    DocCacheSlot slots[DOC_CACHE_SLOTS];
+    size_t slotCount;       // slots reads may expand into
+    uint8_t *work;          // compressor output
+    uint64_t clock;
+    uint64_t hits;
+    uint64_t decompressions;
+    uint64_t decompressNanos;
+} DocCache;
+
+// Chunk arrays are shared with snapshots: while one is, the store treats it and every
+// chunk buffer it points to as read-only, and copies it before the next change.
+struct DocStore {
+    DocChunk *chunks;       // block, holding a reference to each chunk's buffers
+    size_t count;
+    size_t capacity;
+    size_t length;
+    size_t breaks;
+    size_t budget;          // unpacked text bytes allowed before packing; 0 = never pack
+    size_t rawBytes;        // text buffers of unpacked chunks
+    size_t packedBytes;
+    uint64_t clock;
+    DocCache *cache;
+    TextEolCounts sourceEol;    // line breaks in the loaded input, before the rewrite
+    bool counted;               // `stats` is the sum of the chunks' counts
+    TextStats stats;
+};
+
+// A store frozen at the moment it was taken: its own DocStore over the shared chunk
+// array, with a cache of its own so reading it never touches the live store
+struct DocSnapshot {
+    DocStore view;
+    DocCache cache;
+};
+
+// Scratch for DocStoreFind: the needle in every form the chunk scanners want
+typedef struct FindPlan {
+    const TextChar *needle;
+    size_t length;
+    unsigned flags;         // for chunk searches: TEXT_FIND_MATCH_CASE at most
+    bool matchCase;
+    bool wholeWord;         // checked against the whole store, not per chunk
+    bool narrowPossible;    // some narrow chunk could contain a match
+    uint8_t *narrow;        // needle as bytes (matchCase)
+    TextChar *folded;       // needle folded (!matchCase)
+    TextChar fold[256];     // Latin-1 folded; U+00B5 leaves Latin-1
+    TextChar *window;       // 2 * (length - 1) units for matches that span chunks
+} FindPlan;
+
+static DocBlock *BlockOf(const void *data) {
+    return (DocBlock *)data - 1;
+}
+
+static void *BlockAlloc(size_t bytes) {
+    DocBlock *block = (DocBlock *)malloc(sizeof(DocBlock) + (bytes ? bytes : 1));
+    if (!block) return NULL;
+    block->refs = 1;
+    return block + 1;
+}
+
+// Only for blocks nobody shares
+static void *BlockRealloc(void *data, size_t bytes) {
+    if (!data) return BlockAlloc(bytes);
+    DocBlock *block = (DocBlock *)realloc(BlockOf(data), sizeof(DocBlock) + (bytes ? bytes : 1));
+    return block ? block + 1 : NULL;
+}
+
+static void BlockRetain(void *data) {
+    if (data) PlatformRefIncrement(&BlockOf(data)->refs);
+}
+
+static void BlockRelease(void *data) {
+    if (data && PlatformRefDecrement(&BlockOf(data)->refs) == 0) free(BlockOf(data));
+}
+
+static bool BlockShared(const void *data) {
+    return data && PlatformRefLoad(&BlockOf(data)->refs) > 1;
+}
+
+// Drops a reference to a chunk array; the last one also drops the array's references
+// to its chunks' buffers
+static void ReleaseChunks(DocChunk *chunks, size_t count) {
+    if (!chunks || PlatformRefDecrement(&BlockOf(chunks)->refs) != 0) return;
+    for (size_t i = 0; i < count; ++i) {
+        BlockRelease(chunks[i].data);
+        BlockRelease(chunks[i].packed);
+    }
+    free(BlockOf(chunks));
+}
+
+static bool FitsNarrow(const TextChar *text, size_t length) {
+    TextChar bits = 0;
+    for (size_t i = 0; i < length; ++i) bits |= text[i];
+    return bits <= 0xFF;
+}
+
+static uint32_t CountBreaksWide(const TextChar *text, size_t length) {
+    uint32_t n = 0;
+    for (size_t i = 0; i < length; ++i) n += text[i] == '\n';
+    return n;
+}
+
+static uint32_t CountBreaksNarrow(const uint8_t *text, size_t length) {
+    uint32_t n = 0;
+    const uint8_t *end = text + length;
+    while ((text = memchr(text, '\n', (size_t)(end - text))) != NULL) {
+        ++n;
+        ++text;
+    }
+    return n;
+}
+
+static uint32_t CountUnitBreaks(const void *text, bool wide, size_t from, size_t length) {
+    return wide ? CountBreaksWide((const TextChar *)text + from, length)
+                : CountBreaksNarrow((const uint8_t *)text + from, length);
+}
+
+static void ReadUnits(const void *text, bool wide, size_t from, size_t length, TextChar *dst) {
+    if (wide) {
+        memcpy(dst, (const TextChar *)text + from, length * sizeof(TextChar));
+    } else {
+        const uint8_t *src = (const uint8_t *)text + from;
+        for (size_t i = 0; i < length; ++i) dst[i] = src[i];
+    }
+}
+
+static size_t UnitSize(bool wide) {
+    return wide ? sizeof(TextChar) : 1;
+}
+
+static size_t ChunkRawBytes(const DocChunk *c) {
+    return c->data ? (size_t)c->capacity * UnitSize(c->wide) : 0;
+}
+
+static uint64_t DecompressChunk(const DocChunk *c, uint8_t *dst) {
+    uint64_t start = PlatformNowNanos();
+    LzDecompress((const uint8_t *)c->packed, c->packedSize, dst, (size_t)c->length * UnitSize(c->wide));
+    return PlatformNowNanos() - start;
+}
+
+// The chunk's text for reading. Packed chunks are expanded into the least recently
+// used cache slot; the pointer stays valid until another packed chunk is read.
+static const void *ChunkText(const DocStore *store, const DocChunk *c) {
+    if (c->data) return c->data;
+    DocCache *cache = store->cache;
+    DocCacheSlot *victim = &cache->slots[0];
+    for (size_t i = 0; i < cache->slotCount; ++i) {
+        DocCacheSlot *slot = &cache->slots[i];
+        if (slot->key == c->packed) {
+            cache->hits++;
+            slot->lastUse = ++cache->clock;
+            return slot->data;
+        }
+        if (slot->lastUse < victim->lastUse) victim = slot;
+    }
+    cache->decompressNanos += DecompressChunk(c, victim->data);
+    cache->decompressions++;
+    victim->key = c->packed;
+    victim->lastUse = ++cache->clock;
+    return victim->data;
+}
+
+static void DropPacked(DocStore *store, DocChunk *c) {
+    if (!c->packed) return;
+    for (size_t i = 0; i < DOC_CACHE_SLOTS; ++i) {
+        if (store->cache->slots[i].key == c->packed) store->cache->slots[i].key = NULL;
+    }
+    store->packedBytes -= c->packedSize;
+    BlockRelease(c->packed);
+    c->packed = NULL;
+    c->packedSize = 0;
+}
+
+static void FreeChunk(DocStore *store, DocChunk *c) {
+    store->rawBytes -= ChunkRawBytes(c);
+    BlockRelease(c->data);
+    c->data = NULL;
+    DropPacked(store, c);
+}
+
+// Unpacks a chunk that is about to be edited, or copies its text while a snapshot
+// shares it, and marks it recently used
+static bool OpenChunk(DocStore *store, DocChunk *c) {
+    if (BlockShared(c->data)) {
+        void *data = BlockAlloc(ChunkRawBytes(c));
+        if (!data) return false;
+        memcpy(data, c->data, (size_t)c->length * UnitSize(c->wide));
+        BlockRelease(c->data);
+        c->data = data;
+    } else if (!c->data) {
+        size_t bytes = (size_t)c->length * UnitSize(c->wide);
+        uint8_t *data = (uint8_t *)BlockAlloc(bytes);
+        if (!data) return false;
+        const void *cached = NULL;
+        for (size_t i = 0; i < DOC_CACHE_SLOTS && !cached; ++i) {
+            if (store->cache->slots[i].key == c->packed) cached = store->cache->slots[i].data;
+        }
+        if (cached) {
+            memcpy(data, cached, bytes);
+        } else {
+            store->cache->decompressNanos += DecompressChunk(c, data);
+            store->cache->decompressions++;
+        }
+        DropPacked(store, c);
+        c->data = data;
+        c->capacity = c->length;
+        store->rawBytes += bytes;
+    }
+    c->lastUse = ++store->clock;
+    c->incompressible = false;
+    return true;
+}
+
+static void PackChunk(DocStore *store, DocChunk *c) {
+    size_t bytes = (size_t)c->length * UnitSize(c->wide);
+    size_t size = LzCompress((const uint8_t *)c->data, bytes, store->cache->work, LzCompressBound(DOC_CHUNK_MAX_BYTES));
+    // Worth it only if it saves at least an eighth
+    void *packed = size && size <= bytes - bytes / 8 ? BlockAlloc(size) : NULL;
+    if (!packed) {
+        c->incompressible = true;
+        return;
+    }
+    memcpy(packed, store->cache->work, size);
+    store->rawBytes -= ChunkRawBytes(c);
+    store->packedBytes += size;
+    BlockRelease(c->data);
+    c->data = NULL;
+    c->capacity = 0;
+    c->packed = packed;
+    c->packedSize = (uint32_t)size;
+}
+
+typedef struct ChunkAge {
+    uint64_t lastUse;
+    size_t index;
+} ChunkAge;
+
+static int CompareAge(const void *a, const void *b) {
+    uint64_t x = ((const ChunkAge *)a)->lastUse;
+    uint64_t y = ((const ChunkAge *)b)->lastUse;
+    return x < y ? -1 : x > y;
+}
+
+// Packs least recently edited chunks until the unpacked text fits in `keepBytes`
+static void PackColdest(DocStore *store, size_t keepBytes) {
+    if (store->rawBytes <= keepBytes || !store->cache->work) return;
+    ChunkAge *order = (ChunkAge *)malloc(store->count * sizeof(ChunkAge));
+    if (!order) return;
+    size_t n = 0;
+    for (size_t i = 0; i < store->count; ++i) {
+        const DocChunk *c = &store->chunks[i];
+        if (c->data && !c->incompressible && c->length >= DOC_PACK_MIN) {
+            order[n].lastUse = c->lastUse;
+            order[n].index = i;
+            n++;
+        }
+    }
+    qsort(order, n, sizeof(ChunkAge), CompareAge);
+    for (size_t k = 0; k < n && store->rawBytes > keepBytes; ++k) {
+        PackChunk(store, &store->chunks[order[k].index]);
+    }
+    free(order);
+}
+
+// Run after every edit; packs down to three quarters of the budget so it doesn't
+// trigger again on the next keystroke
+static void EnforceBudget(DocStore *store) {
+    if (store->budget && store->rawBytes > store->budget) {
+        PackColdest(store, store->budget - store->budget / 4);
+    }
+}
+
+static void ChunkTextStats(const DocStore *store, const DocChunk *c, TextStats *stats) {
+    const void *text = ChunkText(store, c);
+    if (c->wide) TextStatsWide((const TextChar *)text, c->length, stats);
+    else TextStatsNarrow((const uint8_t *)text, c->length, stats);
+}
+
+// Takes a chunk's counts again if its text changed since they were last taken
+static void CountChunk(const DocStore *store, DocChunk *c) {
+    if (c->counted) return;
+    ChunkTextStats(store, c, &c->stats);
+    c->counted = true;
+}
+
+// Stores wide text into a chunk at `at`, narrowing when the chunk is narrow
+static void WriteChunk(DocChunk *c, size_t at, const TextChar *text, size_t length) {
+    c->counted = false;
+    if (c->wide) {
+        memcpy((TextChar *)c->data + at, text, length * sizeof(TextChar));
+    } else {
+        uint8_t *dst = (uint8_t *)c->data + at;
+        for (size_t i = 0; i < length; ++i) dst[i] = (uint8_t)text[i];
+    }
+}
+
+static bool InitChunk(DocStore *store, DocChunk *c, bool wide, size_t capacity) {
+    memset(c, 0, sizeof(*c));
+    c->data = BlockAlloc(capacity * UnitSize(wide));
+    if (!c->data) return false;
+    c->wide = wide;
+    c->capacity = (uint32_t)capacity;
+    c->lastUse = ++store->clock;
+    store->rawBytes += capacity * UnitSize(wide);
+    return true;
+}
+
+static bool InitChunkFromText(DocStore *store, DocChunk *c, const TextChar *text, size_t length) {
+    if (!InitChunk(store, c, !FitsNarrow(text, length), length)) return false;
+    WriteChunk(c, 0, text, length);
+    c->length = (uint32_t)length;
+    c->breaks = CountBreaksWide(text, length);
+    return true;
+}
+
+// Moves an open chunk to a new buffer of `capacity` units, widening if asked
+static bool ReshapeChunk(DocStore *store, DocChunk *c, bool wide, size_t capacity) {
+    size_t before = ChunkRawBytes(c);
+    if (wide == c->wide) {
+        void *data = BlockRealloc(c->data, capacity * UnitSize(wide));
+        if (!data) return false;
+        c->data = data;
+    } else {
+        TextChar *data = (TextChar *)BlockAlloc(capacity * sizeof(TextChar));
+        if (!data) return false;
+        ReadUnits(c->data, c->wide, 0, c->length, data);
+        BlockRelease(c->data);
+        c->data = data;
+        c->wide = true;
+    }
+    c->capacity = (uint32_t)capacity;
+    store->rawBytes = store->rawBytes - before + ChunkRawBytes(c);
+    return true;
+}
+
+static bool ReserveChunks(DocStore *store, size_t extra) {
+    if (store->count + extra <= store->capacity) return true;
+    size_t capacity = store->capacity ? store->capacity * 2 : 16;
+    while (capacity < store->count + extra) capacity *= 2;
+    DocChunk *chunks = (DocChunk *)BlockRealloc(store->chunks, capacity * sizeof(DocChunk));
+    if (!chunks) return false;
+    store->chunks = chunks;
+    store->capacity = capacity;
+    return true;
+}
+
+// Gives the store a chunk array of its own before it changes one a snapshot shares.
+// The copy takes its own reference to every buffer, so the text stays shared until
+// an edit opens a chunk.
+static bool OwnChunks(DocStore *store) {
+    if (!BlockShared(store->chunks)) return true;
+    DocChunk *chunks = (DocChunk *)BlockAlloc(store->capacity * sizeof(DocChunk));
+    if (!chunks) return false;
+    memcpy(chunks, store->chunks, store->count * sizeof(DocChunk));
+    for (size_t i = 0; i < store->count; ++i) {
+        BlockRetain(chunks[i].data);
+        BlockRetain(chunks[i].packed);
+    }
+    ReleaseChunks(store->chunks, store->count);
+    store->chunks = chunks;
+    return true;
+}
+
+static void Reindex(DocStore *store, size_t from) {
+    size_t start = 0;
+    size_t lines = 0;
+    if (from > 0 && from <= store->count) {
+        const DocChunk *prev = &store->chunks[from - 1];
+        start = prev->start + prev->length;
+        lines = prev->lineBase + prev->breaks;
+    } else {
+        from = 0;
+    }
+    for (size_t i = from; i < store->count; ++i) {
+        store->chunks[i].start = start;
+        store->chunks[i].lineBase = lines;
+        start += store->chunks[i].length;
+        lines += store->chunks[i].breaks;
+    }
+}
+
+// Chunk holding `pos`; the end of the document maps to the last chunk. Requires count > 0.
+static size_t Locate(const DocStore *store, size_t pos) {
+    size_t lo = 0;
+    size_t hi = store->count - 1;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo + 1) / 2;
+        if (store->chunks[mid].start <= pos) lo = mid;
+        else hi = mid - 1;
+    }
+    return lo;
+}
+
+static void RemoveChunks(DocStore *store, size_t index, size_t n) {
+    for (size_t i = index; i < index + n; ++i) FreeChunk(store, &store->chunks[i]);
+    memmove(&store->chunks[index], &store->chunks[index + n], (store->count - index - n) * sizeof(DocChunk));
+    store->count -= n;
+}
+
+DocStore *DocStoreCreate(void) {
+    DocStore *store = (DocStore *)calloc(1, sizeof(DocStore));
+    if (!store) return NULL;
+    store->cache = (DocCache *)calloc(1, sizeof(DocCache));
+    if (!store->cache) {
+        free(store);
+        return NULL;
+    }
+    store->cache->slotCount = DOC_CACHE_SLOTS;
+    return store;
+}
+
+void DocStoreClear(DocStore *store) {
+    if (!store) return;
+    if (BlockShared(store->chunks)) {
+        // The snapshots keep the chunks; the store starts over without them. Their
+        // packed images may be freed later and the addresses reused, so the cache
+        // forgets them now.
+        ReleaseChunks(store->chunks, store->count);
+        store->chunks = NULL;
+        store->capacity = 0;
+        store->count = 0;
+        store->rawBytes = 0;
+        store->packedBytes = 0;
+        for (size_t i = 0; i < DOC_CACHE_SLOTS; ++i) store->cache->slots[i].key = NULL;
+    } else {
+        RemoveChunks(store, 0, store->count);
+    }
+    store->length = 0;
+    store->breaks = 0;
+    store->counted = false;
+    memset(&store->sourceEol, 0, sizeof(store->sourceEol));
+}
+
+void DocStoreDestroy(DocStore *store) {
+    if (!store) return;
+    DocStoreClear(store);
+    for (size_t i = 0; i < DOC_CACHE_SLOTS; ++i) free(store->cache->slots[i].data);
+    free(store->cache->work);
+    free(store->cache);
+    ReleaseChunks(store->chunks, 0);
+    free(store);
+}
+
+size_t DocStoreLength(const DocStore *store) {
+    return store->length;
+}
+
+void DocStoreGetSourceEol(const DocStore *store, TextEolCounts *counts) {
+    *counts = store->sourceEol;
+}
+
+bool DocStoreSetBudget(DocStore *store, size_t bytes) {
+    DocCache *cache = store->cache;
+    if (bytes && !cache->work) {
+        // Everything packing and reading packed chunks needs, allocated up front so
+        // reads never fail
+        cache->work = (uint8_t *)malloc(LzCompressBound(DOC_CHUNK_MAX_BYTES));
+        for (size_t i = 0; i < DOC_CACHE_SLOTS && cache->work; ++i) {
+            cache->slots[i].data = (uint8_t *)malloc(DOC_CHUNK_MAX_BYTES);
+            if (!cache->slots[i].data) {
+                while (i-- > 0) {
+                    free(cache->slots[i].data);
+                    cache->slots[i].data = NULL;
+                }
+                free(cache->work);
+                cache->work = NULL;
+            }
+        }
+        if (!cache->work) return false;
+    }
+    store->budget = bytes;
+    // Without memory to copy a shared chunk array, the next edit packs instead
+    if (OwnChunks(store)) EnforceBudget(store);
+    return true;
+}
+
+void DocStoreCompact(DocStore *store, size_t keepBytes) {
+    if (OwnChunks(store)) PackColdest(store, keepBytes);
+}
+
+void DocStoreGetTextStats(DocStore *store, TextStats *stats) {
+    if (!store->counted) {
+        // Chunks a snapshot shares are read-only: ones not counted yet are counted
+        // without keeping the result
+        bool shared = BlockShared(store->chunks);
+        memset(&store->stats, 0, sizeof(store->stats));
+        for (size_t i = 0; i < store->count; ++i) {
+            DocChunk *c = &store->chunks[i];
+            if (shared && !c->counted) {
+                TextStats counts;
+                ChunkTextStats(store, c, &counts);
+                TextStatsAppend(&store->stats, &counts);
+                continue;
+            }
+            CountChunk(store, c);
+            TextStatsAppend(&store->stats, &c->stats);
+        }
+        store->counted = true;
+    }
+    *stats = store->stats;
+}
+
+void DocStoreGetStats(const DocStore *store, DocStoreStats *stats) {
+    const DocCache *cache = store->cache;
+    memset(stats, 0, sizeof(*stats));
+    stats->chunks = store->count;
+    stats->length = store->length;
+    stats->rawBytes = store->rawBytes;
+    stats->packedBytes = store->packedBytes;
+    stats->bytes = sizeof(DocStore) + sizeof(DocCache) + store->capacity * sizeof(DocChunk) +
+                   store->rawBytes + store->packedBytes;
+    if (cache->work) stats->bytes += LzCompressBound(DOC_CHUNK_MAX_BYTES) + DOC_CACHE_SLOTS * DOC_CHUNK_MAX_BYTES;
+    for (size_t i = 0; i < store->count; ++i) {
+        const DocChunk *c = &store->chunks[i];
+        stats->wideChunks += c->wide;
+        if (c->packed) {
+            stats->packedChunks++;
+            stats->packedSourceBytes += (size_t)c->length * UnitSize(c->wide);
+        }
+    }
+    stats->cacheHits = cache->hits;
+    stats->decompressions = cache->decompressions;
+    stats->decompressNanos = cache->decompressNanos;
+}
+
+// Tops up the last chunk before starting new ones; `narrow` is set for Latin-1 input
+static bool AppendUnits(DocStore *store, const TextChar *text, const uint8_t *narrow, size_t length) {
+    while (length > 0) {
+        DocChunk *last = store->count ? &store->chunks[store->count - 1] : NULL;
+        size_t room = last && last->length < DOC_CHUNK_UNITS ? DOC_CHUNK_UNITS - last->length : 0;
+        size_t take = length < DOC_CHUNK_UNITS ? length : DOC_CHUNK_UNITS;
+        bool wide = text && !FitsNarrow(text, room && room < take ? room : take);
+        if (room > 0 && !OpenChunk(store, last)) return false;
+
+        // A short narrow tail is widened rather than left behind as a tiny chunk
+        if (room > 0 && wide && !last->wide && last->length < DOC_CHUNK_UNITS / 4 &&
+            !ReshapeChunk(store, last, true, last->capacity)) {
+            return false;
+        }
+
+        if (room > 0 && (last->wide || !wide)) {
+            if (take > room) take = room;
+            if (last->capacity < last->length + take) {
+                size_t capacity = (size_t)last->capacity * 2;
+                if (capacity < last->length + take) capacity = last->length + take;
+                if (capacity > DOC_CHUNK_UNITS) capacity = DOC_CHUNK_UNITS;
+                if (!ReshapeChunk(store, last, last->wide, capacity)) return false;
+            }
+        } else {
+            if (!ReserveChunks(store, 1)) return false;
+            last = &store->chunks[store->count];
+            if (!InitChunk(store, last, wide, take)) return false;
+            last->start = store->length;
+            last->lineBase = store->breaks;
+            store->count++;
+        }
+
+        uint32_t breaks;
+        if (text) {
+            WriteChunk(last, last->length, text, take);
+            breaks = CountBreaksWide(text, take);
+            text += take;
+        } else {
+            if (last->wide) {
+                TextChar *dst = (TextChar *)last->data + last->length;
+                for (size_t i = 0; i < take; ++i) dst[i] = narrow[i];
+            } else {
+                memcpy((uint8_t *)last->data + last->length, narrow, take);
+            }
+            breaks = CountBreaksNarrow(narrow, take);
+            narrow += take;
+        }
+        last->length += (uint32_t)take;
+        last->breaks += breaks;
+        last->counted = false;
+        store->counted = false;
+        store->length += take;
+        store->breaks += breaks;
+        length -= take;
+    }
+    return true;
+}
+
+bool DocStoreAppend(DocStore *store, const TextChar *text, size_t length) {
+    if (!OwnChunks(store)) return false;
+    bool ok = AppendUnits(store, text, NULL, length);
+    EnforceBudget(store);
+    return ok;
+}
+
+bool DocStoreAppendLatin1(DocStore *store, const uint8_t *text, size_t length) {
+    if (!OwnChunks(store)) return false;
+    bool ok = AppendUnits(store, NULL, text, length);
+    EnforceBudget(store);
+    return ok;
+}
+
+static bool InsertInChunk(DocStore *store, DocChunk *c, size_t offset, const TextChar *text, size_t length) {
+    if (!OpenChunk(store, c)) return false;
+    bool wide = c->wide || !FitsNarrow(text, length);
+    size_t needed = (size_t)c->length + length;
+    if (wide != c->wide || needed > c->capacity) {
+        size_t capacity = needed + needed / 2;
+        if (capacity > DOC_CHUNK_MAX) capacity = DOC_CHUNK_MAX;
+        if (!ReshapeChunk(store, c, wide, capacity)) return false;
+    }
+    size_t unit = c->wide ? sizeof(TextChar) : 1;
+    uint8_t *base = (uint8_t *)c->data;
+    memmove(base + (offset + length) * unit, base + offset * unit, (c->length - offset) * unit);
+    WriteChunk(c, offset, text, length);
+    c->length += (uint32_t)length;
+    c->breaks += CountBreaksWide(text, length);
+    return true;
+}
+
+// Inserts too large for the chunk: cut it at `offset` and put the text in new chunks between
+static bool SplitInsert(DocStore *store, size_t index, size_t offset, const TextChar *text, size_t length) {
+    DocChunk *c = &store->chunks[index];
+    if (!OpenChunk(store, c)) return false;
+    size_t tailLength = c->length - offset;
+    size_t pieces = (length + DOC_CHUNK_UNITS - 1) / DOC_CHUNK_UNITS;
+    size_t added = pieces + (tailLength > 0);
+
+    DocChunk *fresh = (DocChunk *)malloc(added * sizeof(DocChunk));
+    if (!fresh || !ReserveChunks(store, added)) {
+        free(fresh);
+        return false;
+    }
+    c = &store->chunks[index];
+
+    size_t built = 0;
+    bool ok = true;
+    for (size_t i = 0; i < pieces && ok; ++i) {
+        size_t from = i * DOC_CHUNK_UNITS;
+        size_t take = length - from < DOC_CHUNK_UNITS ? length - from : DOC_CHUNK_UNITS;
+        ok = InitChunkFromText(store, &fresh[built], text + from, take);
+        built += ok;
+    }
+    if (ok && tailLength > 0) {
+        DocChunk *tail = &fresh[built];
+        ok = InitChunk(store, tail, c->wide, tailLength);
+        if (ok) {
+            size_t unit = UnitSize(c->wide);
+            memcpy(tail->data, (uint8_t *)c->data + offset * unit, tailLength * unit);
+            tail->length = (uint32_t)tailLength;
+            tail->breaks = CountUnitBreaks(c->data, c->wide, offset, tailLength);
+            built++;
+        }
+    }
+    if (!ok) {
+        for (size_t i = 0; i < built; ++i) FreeChunk(store, &fresh[i]);
+        free(fresh);
+        return false;
+    }
+
+    if (tailLength > 0) c->breaks -= fresh[added - 1].breaks;
+    c->length = (uint32_t)offset;
+    c->counted = false;
+    size_t at = index + 1;
+    memmove(&store->chunks[at + added], &store->chunks[at], (store->count - at) * sizeof(DocChunk));
+    memcpy(&store->chunks[at], fresh, added * sizeof(DocChunk));
+    store->count += added;
+    free(fresh);
+    if (offset == 0) RemoveChunks(store, index, 1);
+    return true;
+}
+
+static bool InsertText(DocStore *store, size_t pos, const TextChar *text, size_t length) {
+    if (pos > store->length) return false;
+    if (length == 0) return true;
+    if (pos == store->length && (store->count == 0 || store->chunks[store->count - 1].length < DOC_CHUNK_UNITS)) {
+        return AppendUnits(store, text, NULL, length);
+    }
+
+    size_t index = Locate(store, pos);
+    DocChunk *c = &store->chunks[index];
+    size_t offset = pos - c->start;
+    bool ok = (size_t)c->length + length <= DOC_CHUNK_MAX ? InsertInChunk(store, c, offset, text, length)
+                                                          : SplitInsert(store, index, offset, text, length);
+    if (!ok) return false;
+    store->length += length;
+    store->breaks += CountBreaksWide(text, length);
+    store->counted = false;
+    Reindex(store, index);
+    return true;
+}
+
+bool DocStoreInsert(DocStore *store, size_t pos, const TextChar *text, size_t length) {
+    if (!OwnChunks(store)) return false;
+    bool ok = InsertText(store, pos, text, length);
+    EnforceBudget(store);
+    return ok;
+}
+
+// Folds chunk `index + 1` into `index` when both are small; best effort
+static void MergeWithNext(DocStore *store, size_t index) {
+    if (index + 1 >= store->count) return;
+    DocChunk *a = &store->chunks[index];
+    DocChunk *b = &store->chunks[index + 1];
+    size_t total = (size_t)a->length + b->length;
+    if (total > DOC_CHUNK_UNITS / 2) return;
+
+    bool wide = a->wide || b->wide;
+    if (!OpenChunk(store, a)) return;
+    if ((wide != a->wide || a->capacity < total) && !ReshapeChunk(store, a, wide, total)) return;
+    const void *text = ChunkText(store, b);
+    if (a->wide) ReadUnits(text, b->wide, 0, b->length, (TextChar *)a->data + a->length);
+    else memcpy((uint8_t *)a->data + a->length, text, b->length);
+    a->length = (uint32_t)total;
+    a->breaks += b->breaks;
+    a->counted = false;
+    RemoveChunks(store, index + 1, 1);
+}
+
+// Removes [offset, offset + take) from an open chunk that keeps some of its text
+static void TrimChunk(DocStore *store, DocChunk *c, size_t offset, size_t take) {
+    size_t unit = UnitSize(c->wide);
+    uint8_t *base = (uint8_t *)c->data;
+    uint32_t breaks = CountUnitBreaks(c->data, c->wide, offset, take);
+    c->breaks -= breaks;
+    store->breaks -= breaks;
+    memmove(base + offset * unit, base + (offset + take) * unit, (c->length - offset - take) * unit);
+    c->length -= (uint32_t)take;
+    c->counted = false;
+}
+
+// Opens the chunks a delete only trims, so the delete itself can't fail halfway
+static bool OpenDeleteEnds(DocStore *store, size_t pos, size_t length) {
+    DocChunk *head = &store->chunks[Locate(store, pos)];
+    if ((pos > head->start || length < head->length) && !OpenChunk(store, head)) return false;
+    size_t end = pos + length;
+    DocChunk *tail = &store->chunks[Locate(store, end - 1)];
+    return end == tail->start + tail->length || OpenChunk(store, tail);
+}
+
+static bool DeleteText(DocStore *store, size_t pos, size_t length) {
+    if (pos >= store->length || length == 0) return true;
+    if (length > store->length - pos) length = store->length - pos;
+    if (!OpenDeleteEnds(store, pos, length)) return false;
+
+    size_t first = Locate(store, pos);
+    size_t index = first;
+    size_t offset = pos - store->chunks[index].start;
+    size_t remaining = length;
+
+    DocChunk *c = &store->chunks[index];
+    if (offset > 0 || remaining < c->length) {
+        size_t take = c->length - offset < remaining ? c->length - offset : remaining;
+        TrimChunk(store, c, offset, take);
+        remaining -= take;
+        ++index;
+    }
+    // Whole chunks go in one block move
+    size_t whole = 0;
+    while (remaining > 0 && store->chunks[index + whole].length <= remaining) {
+        store->breaks -= store->chunks[index + whole].breaks;
+        remaining -= store->chunks[index + whole].length;
+        ++whole;
+    }
+    RemoveChunks(store, index, whole);
+    if (remaining > 0) TrimChunk(store, &store->chunks[index], 0, remaining);
+    store->length -= length;
+    store->counted = false;
+
+    if (first > 0) --first;
+    MergeWithNext(store, first);
+    MergeWithNext(store, first + 1 < store->count ? first + 1 : first);
+    Reindex(store, first);
+    return true;
+}
+
+bool DocStoreDelete(DocStore *store, size_t pos, size_t length) {
+    if (!OwnChunks(store)) return false;
+    bool ok = DeleteText(store, pos, length);
+    EnforceBudget(store);
+    return ok;
+}
+
+bool DocStoreReplace(DocStore *store, size_t pos, size_t removeLength, const TextChar *text, size_t length) {
+    if (pos > store->length || removeLength > store->length - pos || !OwnChunks(store)) return false;
+    // Open both ends of the removed range, then insert behind it, so any failure
+    // leaves the store untouched. Nothing is packed until the delete is done.
+    bool ok = (removeLength == 0 || OpenDeleteEnds(store, pos, removeLength)) &&
+              InsertText(store, pos + removeLength, text, length);
+    if (ok) DeleteText(store, pos, removeLength);
+    EnforceBudget(store);
+    return ok;
+}
+
+TextChar DocStoreCharAt(const DocStore *store, size_t pos) {
+    if (pos >= store->length) return 0;
+    const DocChunk *c = &store->chunks[Locate(store, pos)];
+    size_t offset = pos - c->start;
+    const void *text = ChunkText(store, c);
+    return c->wide ? ((const TextChar *)text)[offset] : ((const uint8_t *)text)[offset];
+}
+
+size_t DocStoreCopy(const DocStore *store, size_t pos, size_t length, TextChar *dst) {
+    if (pos >= store->length) return 0;
+    if (length > store->length - pos) length = store->length - pos;
+    size_t index = Locate(store, pos);
+    size_t offset = pos - store->chunks[index].start;
+    size_t copied = 0;
+    while (copied < length) {
+        const DocChunk *c = &store->chunks[index++];
+        size_t take = c->length - offset < length - copied ? c->length - offset : length - copied;
+        ReadUnits(ChunkText(store, c), c->wide, offset, take, dst + copied);
+        copied += take;
+        offset = 0;
+    }
+    return copied;
+}
+
+// Input side of a load: one segment of the file, read front to back exactly once
+typedef struct LoadCursor {
+    const uint8_t *data;
+    size_t size;
+    size_t pos;
+    TextEncoding encoding;
+    const uint16_t *high;   // code page bytes 0x80..0xFF for ENC_ANSI; NULL is Latin-1
+    bool validate;          // detecting UTF-8: stop at the first ill-formed sequence
+    bool invalid;
+    bool ascii;             // no byte above 0x7F so far
+    TextEolCounts eol;      // line breaks as they were in the input
+} LoadCursor;
+
+#define BYTES_ONE 0x0101010101010101ull
+#define BYTES_HIGH 0x8080808080808080ull
+
+// Leading run of ASCII bytes other than CR and LF, 8 bytes at a time
+static size_t PlainAsciiRun(const uint8_t *p, size_t n) {
+    size_t i = 0;
+    for (; i + 8 <= n; i += 8) {
+        uint64_t v;
+        memcpy(&v, p + i, sizeof(v));
+        uint64_t cr = v ^ (BYTES_ONE * '\r');
+        uint64_t lf = v ^ (BYTES_ONE * '\n');
+        if ((v | ((cr - BYTES_ONE) & ~cr) | ((lf - BYTES_ONE) & ~lf)) & BYTES_HIGH) break;
+    }
+    while (i < n && p[i] < 0x80 && p[i] != '\r' && p[i] != '\n') ++i;
+    return i;
+}
+
+static TextChar ReadInputUnit(const uint8_t *p, TextEncoding encoding) {
+    switch (encoding) {
+    case ENC_UTF16LE:
+        return (TextChar)(p[0] | (p[1] << 8));
+    case ENC_UTF16BE:
+        return (TextChar)((p[0] << 8) | p[1]);
+    default:
+        return p[0];
+    }
+}
+
+static void PutUnit(DocChunk *c, TextChar u) {
+    if (c->wide) ((TextChar *)c->data)[c->length++] = u;
+    else ((uint8_t *)c->data)[c->length++] = (uint8_t)u;
+}
+
+// Decodes from the cursor into a chunk being loaded until it is full or the segment
+// ends, rewriting CR, LF and CRLF as CRLF and counting LFs as it goes, so each input
+// byte is read once and each unit written once. The chunk starts narrow and widens at
+// the first character above U+00FF. Stops a unit short of full when a CRLF or a
+// surrogate pair would not fit. Fails only if widening runs out of memory.
+static bool FillChunk(DocStore *store, DocChunk *c, LoadCursor *in) {
+    const uint8_t *data = in->data;
+    bool utf16 = in->encoding == ENC_UTF16LE || in->encoding == ENC_UTF16BE;
+    size_t unit = utf16 ? 2 : 1;
+    while (in->pos < in->size && c->length + 1 < DOC_CHUNK_UNITS) {
+        size_t pos = in->pos;
+        if (!utf16) {
+            size_t room = DOC_CHUNK_UNITS - c->length;
+            size_t run = PlainAsciiRun(data + pos, in->size - pos < room ? in->size - pos : room);
+            if (run) {
+                if (c->wide) {
+                    TextChar *dst = (TextChar *)c->data + c->length;
+                    for (size_t i = 0; i < run; ++i) dst[i] = data[pos + i];
+                } else {
+                    memcpy((uint8_t *)c->data + c->length, data + pos, run);
+                }
+                c->length += (uint32_t)run;
+                in->pos += run;
+                continue;
+            }
+        }
+        if (pos + unit > in->size) {
+            // Odd trailing byte of UTF-16, dropped as TextDecodeRaw does
+            in->pos = in->size;
+            break;
+        }
+
+        uint32_t cp = ReadInputUnit(data + pos, in->encoding);
+        size_t used = unit;
+        if (!utf16 && cp >= 0x80) {
+            in->ascii = false;
+            if (in->encoding == ENC_UTF8) {
+                bool valid;
+                used = TextDecodeUtf8Char(data + pos, in->size - pos, &cp, &valid);
+                if (!valid && in->validate) {
+                    in->invalid = true;
+                    return true;
+                }
+            } else if (in->high) {
+                cp = in->high[cp - 0x80];
+            }
+        }
+
+        if (cp == '\r' || cp == '\n') {
+            if (cp == '\r' && pos + 2 * unit <= in->size && ReadInputUnit(data + pos + unit, in->encoding) == '\n') {
+                used += unit;
+                in->eol.crlf++;
+            } else if (cp == '\r') {
+                in->eol.cr++;
+            } else {
+                in->eol.lf++;
+            }
+            PutUnit(c, '\r');
+            PutUnit(c, '\n');
+            c->breaks++;
+        } else {
+            if (cp > 0xFF && !c->wide && !ReshapeChunk(store, c, true, c->capacity)) return false;
+            if (cp >= 0x10000) {
+                cp -= 0x10000;
+                PutUnit(c, (TextChar)(0xD800 + (cp >> 10)));
+                PutUnit(c, (TextChar)(0xDC00 + (cp & 0x3FF)));
+            } else {
+                PutUnit(c, (TextChar)cp);
+            }
+        }
+        in->pos += used;
+    }
+    return true;
+}
+
+// Decodes a BOM-less segment into an empty store, chunk by chunk. Returns early,
+// successfully, when validation finds the input isn't UTF-8.
+static bool LoadRange(DocStore *store, LoadCursor *in) {
+    while (in->pos < in->size && !in->invalid) {
+        if (!ReserveChunks(store, 1)) return false;
+        DocChunk *c = &store->chunks[store->count];
+        if (!InitChunk(store, c, false, DOC_CHUNK_UNITS)) return false;
+        c->start = store->length;
+        c->lineBase = store->breaks;
+        store->count++;
+        bool ok = FillChunk(store, c, in);
+        store->length += c->length;
+        store->breaks += c->breaks;
+        if (!ok) return false;
+        // Counted while the chunk is still in cache, so the first query only adds up
+        CountChunk(store, c);
+        if (c->length == 0) {
+            RemoveChunks(store, store->count - 1, 1);
+        } else if (c->length < c->capacity) {
+            // Only the last chunk comes up short; give back what it didn't use
+            ReshapeChunk(store, c, c->wide, c->length);
+        }
+        EnforceBudget(store);
+    }
+    return true;
+}
+
+typedef struct LoadSegment {
+    DocStore *store;
+    LoadCursor in;
+    const uint16_t *fallback;   // code page to decode with if the input isn't UTF-8
+    bool recoded;               // decoded again with the fallback
+    PlatformThread *thread;
+    bool ok;
+} LoadSegment;
+
+static void RestartAsCodePage(LoadSegment *segment) {
+    DocStoreClear(segment->store);
+    segment->in.pos = 0;
+    segment->in.encoding = ENC_ANSI;
+    segment->in.high = segment->fallback;
+    segment->in.validate = false;
+    segment->in.invalid = false;
+    memset(&segment->in.eol, 0, sizeof(segment->in.eol));
+    segment->recoded = true;
+    segment->ok = LoadRange(segment->store, &segment->in);
+}
+
+static void LoadSegmentMain(void *param) {
+    LoadSegment *segment = (LoadSegment *)param;
+    segment->ok = LoadRange(segment->store, &segment->in);
+    if (segment->ok && segment->in.invalid && segment->fallback) RestartAsCodePage(segment);
+}
+
+// Segment boundary at or before `at` that splits neither a character nor a CR from
+// the LF after it (each segment normalizes line endings on its own)
+static size_t SegmentSplit(const uint8_t *data, size_t size, size_t at, TextEncoding encoding) {
+    size_t split = TextSplitPoint(data, size, at, encoding);
+    bool utf16 = encoding == ENC_UTF16LE || encoding == ENC_UTF16BE;
+    size_t unit = utf16 ? 2 : 1;
+    if (split < unit || split >= size) return split;
+    return ReadInputUnit(data + split - unit, encoding) == '\r' ? split - unit : split;
+}
+
+// Moves every chunk of `from` to the end of `store`, leaving `from` empty
+static bool AdoptChunks(DocStore *store, DocStore *from) {
+    if (!ReserveChunks(store, from->count)) return false;
+    size_t first = store->count;
+    for (size_t i = 0; i < from->count; ++i) {
+        DocChunk *c = &store->chunks[store->count++];
+        *c = from->chunks[i];
+        c->lastUse = ++store->clock;
+    }
+    store->length += from->length;
+    store->breaks += from->breaks;
+    store->counted = false;
+    store->rawBytes += from->rawBytes;
+    store->packedBytes += from->packedBytes;
+    from->count = 0;
+    from->length = 0;
+    from->breaks = 0;
+    from->rawBytes = 0;
+    from->packedBytes = 0;
+    Reindex(store, first);
+    return true;
+}
+
+// Each segment decodes into a store of its own; splicing their chunk lists in order
+// and reindexing is the prefix sum that places every segment's output. With `validate`,
+// one ill-formed sequence anywhere makes the whole input the fallback code page:
+// segments decode it themselves once they hit one, and segments that finished as
+// UTF-8 are decoded again unless they were pure ASCII. Returns the encoding loaded,
+// ENC_ANSI with the store empty when there is no fallback, or 0 on failure.
+static TextEncoding LoadSegments(DocStore *store, const LoadCursor *whole, const TextCodePage *fallback,
+                                 unsigned threads) {
+    LoadSegment segments[DOC_LOAD_MAX_THREADS];
+    size_t n = 0;
+    bool ok = true;
+    for (size_t pos = 0, i = 0; i < threads && pos < whole->size && ok; ++i) {
+        size_t end = i + 1 == threads ? whole->size
+                                      : SegmentSplit(whole->data, whole->size, whole->size / threads * (i + 1), whole->encoding);
+        if (end <= pos) continue;
+        LoadSegment *segment = &segments[n];
+        memset(segment, 0, sizeof(*segment));
+        segment->store = DocStoreCreate();
+        segment->in = *whole;
+        segment->in.data = whole->data + pos;
+        segment->in.size = end - pos;
+        segment->fallback = fallback ? fallback->high : NULL;
+        ok = segment->store != NULL;
+        // Without compression buffers a segment just stays unpacked until spliced
+        if (ok && store->budget) DocStoreSetBudget(segment->store, store->budget / threads);
+        if (ok) n++;
+        pos = end;
+    }
+
+    // The calling thread takes the first segment, and any a thread couldn't start for
+    for (size_t i = 1; i < n && ok; ++i) segments[i].thread = PlatformThreadStart(LoadSegmentMain, &segments[i]);
+    if (ok && n > 0) LoadSegmentMain(&segments[0]);
+    for (size_t i = 1; i < n; ++i) {
+        if (segments[i].thread) PlatformThreadJoin(segments[i].thread);
+        else if (ok) LoadSegmentMain(&segments[i]);
+    }
+
+    TextEncoding encoding = whole->encoding;
+    for (size_t i = 0; i < n; ++i) {
+        if (segments[i].in.invalid || segments[i].recoded) encoding = ENC_ANSI;
+    }
+    for (size_t i = 0; i < n && ok && fallback && encoding != whole->encoding; ++i) {
+        if (!segments[i].recoded && !segments[i].in.ascii) RestartAsCodePage(&segments[i]);
+    }
+
+    // Without a fallback, input that isn't UTF-8 comes back as an empty store
+    bool keep = encoding == whole->encoding || fallback;
+    for (size_t i = 0; i < n; ++i) {
+        ok = ok && segments[i].ok && (!keep || AdoptChunks(store, segments[i].store));
+        store->sourceEol.crlf += segments[i].in.eol.crlf;
+        store->sourceEol.lf += segments[i].in.eol.lf;
+        store->sourceEol.cr += segments[i].in.eol.cr;
+        DocStoreDestroy(segments[i].store);
+    }
+    if (ok && keep) EnforceBudget(store);
+    else DocStoreClear(store);
+    return ok ? encoding : (TextEncoding)0;
+}
+
+static TextEncoding LoadInput(DocStore *store, const uint8_t *data, size_t size, TextEncoding encoding,
+                              const TextCodePage *codePage, bool detect, unsigned threads) {
+    if (store->length != 0 || !OwnChunks(store)) return (TextEncoding)0;
+    LoadCursor whole;
+    memset(&whole, 0, sizeof(whole));
+    whole.encoding = encoding;
+    whole.high = codePage && encoding == ENC_ANSI ? codePage->high : NULL;
+    whole.ascii = true;
+    if (detect) {
+        // Only a BOM is sniffed up front; UTF-8 is validated during the decode
+        whole.encoding = TextBomLength(data, size, ENC_UTF16LE) ? ENC_UTF16LE
+                       : TextBomLength(data, size, ENC_UTF16BE) ? ENC_UTF16BE : ENC_UTF8;
+        whole.high = NULL;
+        whole.validate = whole.encoding == ENC_UTF8 && !TextBomLength(data, size, ENC_UTF8);
+    }
+    size_t bom = TextBomLength(data, size, whole.encoding);
+    whole.data = data + bom;
+    whole.size = size - bom;
+
+    if (threads == 0) {
+        size_t useful = whole.size / DOC_LOAD_MIN_SEGMENT;
+        threads = PlatformCpuCount();
+        if (threads > useful) threads = useful ? (unsigned)useful : 1;
+    }
+    if (threads > DOC_LOAD_MAX_THREADS) threads = DOC_LOAD_MAX_THREADS;
+    if (whole.size < threads) threads = 1;
+    return LoadSegments(store, &whole, whole.validate ? codePage : NULL, threads);
+}
+
+bool DocStoreLoad(DocStore *store, const uint8_t *data, size_t size, TextEncoding encoding) {
+    return LoadInput(store, data, size, encoding, NULL, false, 1) != 0;
+}
+
+bool DocStoreLoadCodePage(DocStore *store, const uint8_t *data, size_t size, const TextCodePage *codePage) {
+    return LoadInput(store, data, size, ENC_ANSI, codePage, false, 1) != 0;
+}
+
+bool DocStoreLoadParallel(DocStore *store, const uint8_t *data, size_t size, TextEncoding encoding,
+                          const TextCodePage *codePage, unsigned threads) {
+    return LoadInput(store, data, size, encoding, codePage, false, threads) != 0;
+}
+
+TextEncoding DocStoreLoadDetect(DocStore *store, const uint8_t *data, size_t size, const TextCodePage *fallback,
+                                unsigned threads) {
+    return LoadInput(store, data, size, ENC_UTF8, fallback, true, threads);
+}
+
+// First i in [from, last] whose folded byte is `first`, or TEXT_ERROR. SSE2 folds 16
+// ASCII bytes at a time; blocks with bytes above 0x7F go through the table.
+static size_t NarrowNextCandidate(const uint8_t *text, size_t from, size_t last, const FindPlan *plan) {
+    TextChar first = plan->folded[0];
+    size_t i = from;
+#ifdef DOCSTORE_SSE2
+    const __m128i want = _mm_set1_epi8((char)first);
+    const __m128i beforeA = _mm_set1_epi8('A' - 1);
+    const __m128i afterZ = _mm_set1_epi8('Z' + 1);
+    const __m128i caseBit = _mm_set1_epi8(0x20);
+    for (; i + 16 <= last + 1; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(text + i));
+        if (_mm_movemask_epi8(v)) {
+            for (size_t k = i; k < i + 16; ++k) {
+                if (plan->fold[text[k]] == first) return k;
+            }
+            continue;
+        }
+        if (first > 0x7F) continue;
+        __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, beforeA), _mm_cmplt_epi8(v, afterZ));
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_or_si128(v, _mm_and_si128(upper, caseBit)), want));
+        if (mask) {
+            while (!(mask & 1)) mask >>= 1, ++i;
+            return i;
+        }
+    }
+#endif
+    for (; i <= last; ++i) {
+        if (plan->fold[text[i]] == first) return i;
+    }
+    return TEXT_ERROR;
+}
+
+static size_t NarrowFindForward(const uint8_t *text, size_t length, const FindPlan *plan, size_t from) {
+    size_t m = plan->length;
+    if (m > length || from > length - m) return TEXT_ERROR;
+    size_t last = length - m;
+    if (plan->matchCase) {
+        const uint8_t *p = text + from;
+        const uint8_t *stop = text + last + 1;
+        while (p < stop && (p = memchr(p, plan->narrow[0], (size_t)(stop - p))) != NULL) {
+            if (memcmp(p + 1, plan->narrow + 1, m - 1) == 0) return (size_t)(p - text);
+            ++p;
+        }
+        return TEXT_ERROR;
+    }
+    for (size_t i = from; i <= last; ++i) {
+        i = NarrowNextCandidate(text, i, last, plan);
+        if (i == TEXT_ERROR) break;
+        size_t j = 1;
+        while (j < m && plan->fold[text[i + j]] == plan->folded[j]) ++j;
+        if (j == m) return i;
+    }
+    return TEXT_ERROR;
+}
+
+static size_t NarrowFindBackward(const uint8_t *text, size_t length, const FindPlan *plan, size_t limit) {
+    size_t m = plan->length;
+    if (m > length || limit == 0) return TEXT_ERROR;
+    size_t i = length - m;
+    if (i > limit - 1) i = limit - 1;
+    for (;;) {
+        size_t j = 0;
+        if (plan->matchCase) {
+            while (j < m && text[i + j] == plan->narrow[j]) ++j;
+        } else {
+            while (j < m && plan->fold[text[i + j]] == plan->folded[j]) ++j;
+        }
+        if (j == m) return i;
+        if (i == 0) break;
+        --i;
+    }
+    return TEXT_ERROR;
+}
+
+static size_t ChunkFindForward(const DocStore *store, const DocChunk *c, const FindPlan *plan, size_t from) {
+    if (c->wide) {
+        return TextFindForward((const TextChar *)ChunkText(store, c), c->length, plan->needle, plan->length, plan->flags, from);
+    }
+    return plan->narrowPossible ? NarrowFindForward((const uint8_t *)ChunkText(store, c), c->length, plan, from) : TEXT_ERROR;
+}
+
+static size_t ChunkFindBackward(const DocStore *store, const DocChunk *c, const FindPlan *plan, size_t limit) {
+    if (c->wide) {
+        return TextFindBackward((const TextChar *)ChunkText(store, c), c->length, plan->needle, plan->length, plan->flags, limit);
+    }
+    return plan->narrowPossible ? NarrowFindBackward((const uint8_t *)ChunkText(store, c), c->length, plan, limit) : TEXT_ERROR;
+}
+
+// Matches starting in the last needle-1 units of chunk `index` and running into later
+// chunks, restricted to starts in [lo, hi). Forward picks the first, backward the last.
+static size_t FindAcrossBoundary(const DocStore *store, const FindPlan *plan, size_t index, size_t lo, size_t hi, bool forward) {
+    const DocChunk *c = &store->chunks[index];
+    size_t m = plan->length;
+    size_t chunkEnd = c->start + c->length;
+    if (m < 2 || index + 1 >= store->count) return TEXT_ERROR;
+
+    size_t winStart = chunkEnd - (m - 1 < c->length ? m - 1 : c->length);
+    if (winStart < lo) winStart = lo;
+    if (hi > chunkEnd) hi = chunkEnd;
+    if (winStart >= hi) return TEXT_ERROR;
+
+    size_t winLen = DocStoreCopy(store, winStart, hi - winStart + m - 1, plan->window);
+    size_t hit = forward ? TextFindForward(plan->window, winLen, plan->needle, m, plan->flags, 0)
+                         : TextFindBackward(plan->window, winLen, plan->needle, m, plan->flags, hi - winStart);
+    return hit == TEXT_ERROR || winStart + hit >= hi ? TEXT_ERROR : winStart + hit;
+}
+
+static size_t StoreFindForward(const DocStore *store, const FindPlan *plan, size_t from) {
+    if (plan->length > store->length || from > store->length - plan->length) return TEXT_ERROR;
+    for (size_t i = Locate(store, from); i < store->count; ++i) {
+        const DocChunk *c = &store->chunks[i];
+        size_t local = from > c->start ? from - c->start : 0;
+        size_t hit = ChunkFindForward(store, c, plan, local);
+        if (hit != TEXT_ERROR) return c->start + hit;
+        hit = FindAcrossBoundary(store, plan, i, from, store->length, true);
+        if (hit != TEXT_ERROR) return hit;
+    }
+    return TEXT_ERROR;
+}
+
+static size_t StoreFindBackward(const DocStore *store, const FindPlan *plan, size_t limit) {
+    if (plan->length > store->length || limit == 0) return TEXT_ERROR;
+    for (size_t i = Locate(store, limit - 1) + 1; i-- > 0;) {
+        const DocChunk *c = &store->chunks[i];
+        size_t hit = FindAcrossBoundary(store, plan, i, 0, limit, false);
+        if (hit != TEXT_ERROR) return hit;
+        size_t local = limit - c->start < c->length ? limit - c->start : c->length;
+        hit = ChunkFindBackward(store, c, plan, local);
+        if (hit != TEXT_ERROR) return c->start + hit;
+    }
+    return TEXT_ERROR;
+}
+
+// Whole words need a non-word unit (or the end of the document) on both sides, which
+// may sit in the next or previous chunk, so they are checked here and the search goes
+// on past a match that fails
+static bool AtWordBreaks(const DocStore *store, size_t pos, size_t length) {
+    return (pos == 0 || !TextIsWordChar(DocStoreCharAt(store, pos - 1))) &&
+           (pos + length >= store->length || !TextIsWordChar(DocStoreCharAt(store, pos + length)));
+}
+
+static size_t StoreFindWordForward(const DocStore *store, const FindPlan *plan, size_t from) {
+    for (;;) {
+        size_t hit = StoreFindForward(store, plan, from);
+        if (hit == TEXT_ERROR || !plan->wholeWord || AtWordBreaks(store, hit, plan->length)) return hit;
+        from = hit + 1;
+    }
+}
+
+static size_t StoreFindWordBackward(const DocStore *store, const FindPlan *plan, size_t limit) {
+    for (;;) {
+        size_t hit = StoreFindBackward(store, plan, limit);
+        if (hit == TEXT_ERROR || !plan->wholeWord || AtWordBreaks(store, hit, plan->length)) return hit;
+        limit = hit;
+    }
+}
+
+bool DocStoreFind(const DocStore *store, const TextChar *needle, size_t needleLength,
+                  unsigned flags, size_t start, size_t *matchOut) {
+    if (!needle || needleLength == 0 || needleLength > store->length) return false;
+
+    FindPlan plan;
+    plan.needle = needle;
+    plan.length = needleLength;
+    plan.flags = flags & TEXT_FIND_MATCH_CASE;
+    plan.matchCase = (flags & TEXT_FIND_MATCH_CASE) != 0;
+    plan.wholeWord = (flags & TEXT_FIND_WHOLE_WORD) != 0;
+    plan.narrow = (uint8_t *)malloc(needleLength);
+    plan.folded = (TextChar *)malloc(needleLength * sizeof(TextChar));
+    plan.window = (TextChar *)malloc(2 * needleLength * sizeof(TextChar));
+    if (!plan.narrow || !plan.folded || !plan.window) {
+        free(plan.narrow);
+        free(plan.folded);
+        free(plan.window);
+        return false;
+    }
+    // A narrow chunk can only match a needle whose units (folded) are what some
+    // Latin-1 character (folded) is
+    for (unsigned b = 0; b < 256; ++b) plan.fold[b] = TextFoldChar((TextChar)b);
+    plan.narrowPossible = true;
+    for (size_t i = 0; i < needleLength; ++i) {
+        TextChar c = plan.matchCase ? needle[i] : TextFoldChar(needle[i]);
+        bool fits = c <= 0xFF;
+        for (unsigned b = 0x80; !fits && !plan.matchCase && b < 256; ++b) fits = plan.fold[b] == c;
+        if (!fits) plan.narrowPossible = false;
+        plan.narrow[i] = (uint8_t)c;
+        plan.folded[i] = c;
+    }
+
+    if (start > store->length) start = store->length;
+    size_t found;
+    if (flags & TEXT_FIND_DOWN) {
+        found = StoreFindWordForward(store, &plan, start);
+        if (found == TEXT_ERROR && start > 0) found = StoreFindWordForward(store, &plan, 0);
+    } else {
+        found = StoreFindWordBackward(store, &plan, start);
+        if (found == TEXT_ERROR && start < store->length) {
+            found = StoreFindWordBackward(store, &plan, store->length);
+            if (found != TEXT_ERROR && found < start) found = TEXT_ERROR;
+        }
+    }
+
+    free(plan.narrow);
+    free(plan.folded);
+    free(plan.window);
+    if (found == TEXT_ERROR) return false;
+    *matchOut = found;
+    return true;
+}
+
+size_t DocStoreLineCount(const DocStore *store) {
+    return store->breaks + 1;
+}
+
+size_t DocStoreLineFromOffset(const DocStore *store, size_t pos) {
+    if (store->count == 0) return 0;
+    if (pos > store->length) pos = store->length;
+    const DocChunk *c = &store->chunks[Locate(store, pos)];
+    return c->lineBase + CountUnitBreaks(ChunkText(store, c), c->wide, 0, pos - c->start);
+}
+
+size_t DocStoreLineStart(const DocStore *store, size_t line) {
+    if (line == 0) return 0;
+    if (line > store->breaks) return TEXT_ERROR;
+
+    // Last chunk whose lineBase is below `line` holds the line-th LF
+    size_t lo = 0;
+    size_t hi = store->count - 1;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo + 1) / 2;
+        if (store->chunks[mid].lineBase < line) lo = mid;
+        else hi = mid - 1;
+    }
+    const DocChunk *c = &store->chunks[lo];
+    size_t want = line - c->lineBase;
+    const void *data = ChunkText(store, c);
+    if (!c->wide) {
+        const uint8_t *base = (const uint8_t *)data;
+        const uint8_t *p = base;
+        while ((p = memchr(p, '\n', c->length - (size_t)(p - base))) != NULL) {
+            if (--want == 0) return c->start + (size_t)(p - base) + 1;
+            ++p;
+        }
+        return TEXT_ERROR;
+    }
+    const TextChar *text = (const TextChar *)data;
+    for (size_t i = 0; i < c->length; ++i) {
+        if (text[i] == '\n' && --want == 0) return c->start + i + 1;
+    }
+    return TEXT_ERROR;
+}
+
+DocSnapshot *DocStoreSnapshot(DocStore *store) {
+    DocSnapshot *snapshot = (DocSnapshot *)calloc(1, sizeof(DocSnapshot));
+    if (!snapshot) return NULL;
+    // Packed chunks stay packed in the snapshot; they expand into its own slots
+    DocCache *cache = &snapshot->cache;
+    cache->slotCount = DOC_SNAPSHOT_SLOTS;
+    for (size_t i = 0; i < DOC_SNAPSHOT_SLOTS && store->packedBytes; ++i) {
+        cache->slots[i].data = (uint8_t *)malloc(DOC_CHUNK_MAX_BYTES);
+        if (!cache->slots[i].data) {
+            DocSnapshotRelease(snapshot);
+            return NULL;
+        }
+    }
+    BlockRetain(store->chunks);
+    snapshot->view = *store;
+    snapshot->view.budget = 0;
+    snapshot->view.cache = cache;
+    return snapshot;
+}
+
+void DocSnapshotRelease(DocSnapshot *snapshot) {
+    if (!snapshot) return;
+    ReleaseChunks(snapshot->view.chunks, snapshot->view.count);
+    for (size_t i = 0; i < DOC_SNAPSHOT_SLOTS; ++i) free(snapshot->cache.slots[i].data);
+    free(snapshot);
+}
+
+const DocStore *DocSnapshotStore(const DocSnapshot *snapshot) {
+    return &snapshot->view;
+}
+
+void DocSnapshotGetTextStats(DocSnapshot *snapshot, TextStats *stats) {
+    DocStoreGetTextStats(&snapshot->view, stats);
+}
@@ -0,0 +1,109 @@
+// Chunked document storage for retropad. Text is kept as a sequence of chunks that
+// are either narrow (one byte per unit, U+0000..U+00FF) or wide (UTF-16), so mostly
+// ASCII/Latin-1 documents cost about one byte per character. A chunk only widens
+// when a character above U+00FF is inserted into it. With a memory budget set, the
+// least recently edited chunks are LZ-compressed (core/lz.h) once the uncompressed
+// text outgrows it; reads expand them into a small cache, edits unpack them again.
+// Snapshots share the chunks with the store and stay as they were while it changes.
+// Unlike textcore.c this module allocates (malloc). Functions that can fail return
+// false and leave the store unchanged.
+#pragma once
+
+#include "textcore.h"
+#include "codepage.h"
+#include "textstats.h"
+
+#define DOC_CHUNK_UNITS 16384   // chunk length produced by append and load
+#define DOC_LOAD_MAX_THREADS 64
+
+typedef struct DocStore DocStore;
+typedef struct DocSnapshot DocSnapshot;
+
+typedef struct DocStoreStats {
+    size_t chunks;
+    size_t wideChunks;
+    size_t length;          // code units
+    size_t bytes;           // resident bytes: text buffers plus bookkeeping
+    size_t packedChunks;
+    size_t rawBytes;        // uncompressed text buffers
+    size_t packedBytes;     // compressed images of cold chunks
+    size_t packedSourceBytes;   // what the cold chunks would take uncompressed
+    uint64_t cacheHits;         // reads of cold chunks served by the cache
+    uint64_t decompressions;
+    uint64_t decompressNanos;
+} DocStoreStats;
+
+DocStore *DocStoreCreate(void);
+void DocStoreDestroy(DocStore *store);
+
+size_t DocStoreLength(const DocStore *store);
+void DocStoreGetStats(const DocStore *store, DocStoreStats *stats);
+// Words, characters and sizes of the whole text. Every chunk keeps its own counts
+// (taken as it loads), so this rescans only chunks edited since the last call and
+// adds up the rest.
+void DocStoreGetTextStats(DocStore *store, TextStats *stats);
+
+// Uncompressed bytes to keep before cold chunks are packed; 0 (the default) never
+// packs. Fails only if the compression buffers can't be allocated. The budget counts
+// this store's own buffers only: any other copy of the text a caller keeps (such as
+// an EDIT control's) isn't seen by it and comes on top.
+bool DocStoreSetBudget(DocStore *store, size_t bytes);
+// Packs least recently edited chunks until at most `keepBytes` stay uncompressed,
+// regardless of the budget (e.g. when the document goes idle). Needs a budget set once.
+void DocStoreCompact(DocStore *store, size_t keepBytes);
+
+bool DocStoreAppend(DocStore *store, const TextChar *text, size_t length);
+bool DocStoreAppendLatin1(DocStore *store, const uint8_t *text, size_t length);
+bool DocStoreInsert(DocStore *store, size_t pos, const TextChar *text, size_t length);
+// Fails only when a packed chunk at either end of the range can't be unpacked.
+bool DocStoreDelete(DocStore *store, size_t pos, size_t length);
+bool DocStoreReplace(DocStore *store, size_t pos, size_t removeLength, const TextChar *text, size_t length);
+void DocStoreClear(DocStore *store);
+
+// Decode a whole file image into an empty store in a single pass: each byte is read
+// once, and decoding, the CR/LF to CRLF rewrite and the line index all happen as the
+// chunks fill, so no full-size UTF-16 copy is ever made.
+bool DocStoreLoad(DocStore *store, const uint8_t *data, size_t size, TextEncoding encoding);
+// DocStoreLoad for a single-byte code page (ENC_ANSI with DocStoreLoad means Latin-1)
+bool DocStoreLoadCodePage(DocStore *store, const uint8_t *data, size_t size, const TextCodePage *codePage);
+// Either of the above (codePage may be NULL) split across `threads` workers at
+// character and CRLF boundaries; 0 picks one per processor once the input is big
+// enough to pay for it. The text is identical to a single-threaded load.
+bool DocStoreLoadParallel(DocStore *store, const uint8_t *data, size_t size, TextEncoding encoding,
+                          const TextCodePage *codePage, unsigned threads);
+// DocStoreLoadParallel that detects the encoding on the way instead of in a pass of
+// its own: a BOM picks UTF-16 or UTF-8, anything else is decoded as UTF-8 and
+// validated as it goes. Input that isn't UTF-8 is decoded as `fallback`, or left
+// for the caller (store empty) when that is NULL. Returns the encoding, ENC_ANSI
+// for the fallback, or 0 on failure.
+TextEncoding DocStoreLoadDetect(DocStore *store, const uint8_t *data, size_t size, const TextCodePage *fallback,
+                                unsigned threads);
+// Line breaks by style as the last load found them, before they became CRLF
+void DocStoreGetSourceEol(const DocStore *store, TextEolCounts *counts);
+
+TextChar DocStoreCharAt(const DocStore *store, size_t pos);
+// Copies up to `length` units from `pos`; returns the number copied.
+size_t DocStoreCopy(const DocStore *store, size_t pos, size_t length, TextChar *dst);
+
+// TextFind semantics (wrapping, TEXT_FIND_* flags) over the chunks. Narrow chunks are
+// searched as bytes without widening them.
+bool DocStoreFind(const DocStore *store, const TextChar *needle, size_t needleLength,
+                  unsigned flags, size_t start, size_t *matchOut);
+
+// Line index over LF. Lines are 0-based; DocStoreLineStart returns TEXT_ERROR past the end.
+size_t DocStoreLineCount(const DocStore *store);
+size_t DocStoreLineFromOffset(const DocStore *store, size_t pos);
+size_t DocStoreLineStart(const DocStore *store, size_t line);
+
+// Snapshots: the text as it is now, for reading on another thread while the store
+// keeps changing. Taking one shares the store's chunk array (no text is copied); the
+// store's next change copies the array, and an edit copies a chunk's text only while
+// a snapshot still shares it. NULL when out of memory.
+DocSnapshot *DocStoreSnapshot(DocStore *store);
+// Drops the snapshot's share without locking; may run on any thread
+void DocSnapshotRelease(DocSnapshot *snapshot);
+// The snapshot as a store for the read functions above (length, copy, find, lines,
+// stats). One thread at a time may read a snapshot, and snapshots of the same store
+// on different threads don't affect each other or the store.
+const DocStore *DocSnapshotStore(const DocSnapshot *snapshot);
+void DocSnapshotGetTextStats(DocSnapshot *snapshot, TextStats *stats);
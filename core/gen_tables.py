@@ -0,0 +1,185 @@
+#!/usr/bin/env python3
+"""Generate the lookup tables used by the retropad text core.
+
+Run from the core/ directory:  python3 gen_tables.py
+The output files are checked in; rerun only when the tables need to change.
+"""
+import sys
+import unicodedata
+
+
+def lower_map():
+    mapping = {}
+    for cp in range(0x10000):
+        if 0xD800 <= cp <= 0xDFFF:
+            continue
+        lowered = chr(cp).lower()
+        if len(lowered) == 1 and ord(lowered) <= 0xFFFF and ord(lowered) != cp:
+            mapping[cp] = ord(lowered)
+    return mapping
+
+
+def fold_map():
+    """Simple case folding (CaseFolding.txt C+S) for the BMP: casefold() where it gives
+    one character, else the lowercase mapping (the S entries, e.g. U+1E9E -> U+00DF)."""
+    mapping = {}
+    for cp in range(0x10000):
+        if 0xD800 <= cp <= 0xDFFF:
+            continue
+        folded = chr(cp).casefold()
+        if len(folded) != 1:
+            folded = chr(cp).lower()
+        if len(folded) == 1 and ord(folded) <= 0xFFFF and ord(folded) != cp:
+            mapping[cp] = ord(folded)
+    return mapping
+
+
+def is_word_char(cp):
+    """Letters, marks, digits and connector punctuation ('_'); surrogates count, as the
+    characters they pair into are mostly letters."""
+    if 0xD800 <= cp <= 0xDFFF:
+        return True
+    category = unicodedata.category(chr(cp))
+    return category[0] in "LMN" or category == "Pc"
+
+
+def emit_word_bits(out):
+    blocks = []
+    index = []
+    for page in range(256):
+        bits = [0] * 32
+        for lo in range(256):
+            if is_word_char((page << 8) | lo):
+                bits[lo >> 3] |= 1 << (lo & 7)
+        if bits not in blocks:
+            blocks.append(bits)
+        index.append(blocks.index(bits))
+    out.write("// Word characters for whole-word search: each page of the BMP picks a 256-bit block\n")
+    out.write("const uint8_t g_textWordPages[256] = {\n")
+    for row in range(0, 256, 16):
+        out.write("    " + ", ".join("%d" % v for v in index[row:row + 16]) + ",\n")
+    out.write("};\n\n")
+    out.write("const uint8_t g_textWordBits[%d][32] = {\n" % len(blocks))
+    for bits in blocks:
+        out.write("    {" + ", ".join("0x%02X" % v for v in bits) + "},\n")
+    out.write("};\n")
+
+
+def emit_two_level(out, name, mapping, comment):
+    pages = sorted({cp >> 8 for cp in mapping})
+    out.write("// %s\n" % comment)
+    for page in pages:
+        out.write("static const uint16_t k%sPage%02X[256] = {\n" % (name, page))
+        values = [mapping.get((page << 8) | lo, (page << 8) | lo) for lo in range(256)]
+        for row in range(0, 256, 8):
+            out.write("    " + ", ".join("0x%04X" % v for v in values[row:row + 8]) + ",\n")
+        out.write("};\n\n")
+    out.write("const uint16_t *const g_text%sPages[256] = {\n" % name)
+    for row in range(0, 256, 4):
+        cells = []
+        for page in range(row, row + 4):
+            cells.append(("k%sPage%02X" % (name, page)) if page in pages else "NULL")
+        out.write("    " + ", ".join(cells) + ",\n")
+    out.write("};\n")
+
+
+# (Windows code page number, Python codec, display name)
+CODE_PAGES = [
+    (1250, "cp1250", "Central European (Windows-1250)"),
+    (1251, "cp1251", "Cyrillic (Windows-1251)"),
+    (1252, "cp1252", "Western European (Windows-1252)"),
+    (1253, "cp1253", "Greek (Windows-1253)"),
+    (1254, "cp1254", "Turkish (Windows-1254)"),
+    (1255, "cp1255", "Hebrew (Windows-1255)"),
+    (1256, "cp1256", "Arabic (Windows-1256)"),
+    (1257, "cp1257", "Baltic (Windows-1257)"),
+    (1258, "cp1258", "Vietnamese (Windows-1258)"),
+    (437, "cp437", "OEM United States (DOS 437)"),
+    (850, "cp850", "OEM Multilingual Latin 1 (DOS 850)"),
+    (28591, "iso8859_1", "Western European (ISO-8859-1)"),
+    (28592, "iso8859_2", "Central European (ISO-8859-2)"),
+    (28593, "iso8859_3", "Latin 3 (ISO-8859-3)"),
+    (28594, "iso8859_4", "Baltic (ISO-8859-4)"),
+    (28595, "iso8859_5", "Cyrillic (ISO-8859-5)"),
+    (28596, "iso8859_6", "Arabic (ISO-8859-6)"),
+    (28597, "iso8859_7", "Greek (ISO-8859-7)"),
+    (28598, "iso8859_8", "Hebrew (ISO-8859-8)"),
+    (28599, "iso8859_9", "Turkish (ISO-8859-9)"),
+    (28603, "iso8859_13", "Estonian (ISO-8859-13)"),
+    (28605, "iso8859_15", "Latin 9 (ISO-8859-15)"),
+]
+
+
+def code_page_high(codec):
+    """Unicode for bytes 0x80..0xFF. Undefined bytes keep their own value (U+0080..U+00FF)
+    like Windows does for 1252; if that character is already mapped elsewhere they go to
+    the private use area (U+F700 + byte) instead, so every byte still round-trips."""
+    for b in range(0x80):
+        assert bytes([b]).decode(codec) == chr(b), (codec, b)
+    high = []
+    for b in range(0x80, 0x100):
+        try:
+            high.append(ord(bytes([b]).decode(codec)))
+        except UnicodeDecodeError:
+            high.append(None)
+    defined = {u for u in high if u is not None}
+    return [u if u is not None else (0x80 + i if 0x80 + i not in defined else 0xF780 + i)
+            for i, u in enumerate(high)]
+
+
+def emit_code_pages(out):
+    out.write("// Decode: Unicode for bytes 0x80..0xFF. Encode: the character's high byte picks a\n")
+    out.write("// 256-byte block (1-based, 0 = nothing mapped) holding the byte for its low byte.\n\n")
+    entries = []
+    for cp_id, codec, name in CODE_PAGES:
+        high = code_page_high(codec)
+        reverse = {}
+        for i, u in enumerate(high):
+            reverse.setdefault(u, 0x80 + i)
+        pages = sorted({u >> 8 for u in reverse})
+        out.write("static const uint16_t kCp%dHigh[128] = {\n" % cp_id)
+        for row in range(0, 128, 8):
+            out.write("    " + ", ".join("0x%04X" % v for v in high[row:row + 8]) + ",\n")
+        out.write("};\n\n")
+        out.write("static const uint8_t kCp%dPages[256] = {\n" % cp_id)
+        index = [pages.index(p) + 1 if p in pages else 0 for p in range(256)]
+        for row in range(0, 256, 16):
+            out.write("    " + ", ".join("%d" % v for v in index[row:row + 16]) + ",\n")
+        out.write("};\n\n")
+        out.write("static const uint8_t kCp%dBlocks[%d][256] = {\n" % (cp_id, len(pages)))
+        for p in pages:
+            block = [reverse.get((p << 8) | lo, 0) for lo in range(256)]
+            out.write("    {\n")
+            for row in range(0, 256, 16):
+                out.write("        " + ", ".join("0x%02X" % v for v in block[row:row + 16]) + ",\n")
+            out.write("    },\n")
+        out.write("};\n\n")
+        entries.append((cp_id, name))
+    out.write("const TextCodePage g_textCodePages[] = {\n")
+    for cp_id, name in entries:
+        out.write('    {%d, "%s", kCp%dHigh, kCp%dPages, kCp%dBlocks},\n' % (cp_id, name, cp_id, cp_id, cp_id))
+    out.write("};\n\n")
+    out.write("const size_t g_textCodePageCount = sizeof(g_textCodePages) / sizeof(g_textCodePages[0]);\n")
+
+
+def main():
+    header = ("// Generated by gen_tables.py from the Unicode database (Python %s); do not edit.\n"
+              % sys.version.split()[0])
+    with open("textcase.c", "w", newline="\n") as out:
+        out.write(header)
+        out.write('#include "textcore.h"\n\n')
+        emit_two_level(out, "Lower", lower_map(),
+                       "Simple lowercase mapping for the BMP; pages without mappings are NULL")
+        out.write("\n")
+        emit_two_level(out, "Fold", fold_map(),
+                       "Simple case folding for the BMP; pages without mappings are NULL")
+        out.write("\n")
+        emit_word_bits(out)
+    with open("codepages.c", "w", newline="\n") as out:
+        out.write(header)
+        out.write('#include "codepage.h"\n\n')
+        emit_code_pages(out)
+
+
+if __name__ == "__main__":
+    main()
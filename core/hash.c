@@ -0,0 +1,172 @@
+// Stripe hash for retropad: per 64-byte stripe each lane adds its neighbour's data
+// and the 32x32-bit product of its own data mixed with a key, and every 16 stripes
+// the lanes are scrambled. SSE2 takes two lanes per register.
+#include "hash.h"
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HASH_SSE2 1
+#endif
+
+#define HASH_LANES 8
+#define HASH_BLOCK_STRIPES 16
+#define HASH_PRIME32 0x9E3779B1ULL
+#define HASH_PRIME64 0x9E3779B185EBCA87ULL
+
+// Stripe s of a block keys with kKeys[s..s+8); the scramble uses the last eight
+static const uint64_t kKeys[HASH_BLOCK_STRIPES + HASH_LANES] = {
+    0x94594D8B75673FCAULL, 0x8623121DE0BBF37AULL, 0x3ECB55E90827174AULL,
+    0xAA2078E5484D1466ULL, 0xA318D8B3F637F221ULL, 0x34D24C28AA10CAE2ULL,
+    0xC313063D20DD02F4ULL, 0x46F1417059300965ULL, 0xBE44DB9BE1374045ULL,
+    0xD1A1C00970D5CAF6ULL, 0x8709FEC007546DBBULL, 0xBC944C3FE56C297EULL,
+    0x0F2EDED7213F6D69ULL, 0x33B52C97A42A0397ULL, 0xB505D6E19E9CC914ULL,
+    0xD992F7F575EE364FULL, 0x0D9CF6DAF644A8FDULL, 0xCADD3E7F2D328AD5ULL,
+    0x502EB5D19AD08FA3ULL, 0x401E4DA81D152300ULL, 0x5336F85EF7316ABFULL,
+    0xC804587225120C15ULL, 0xAE481F9183575F0DULL, 0x85FCD2F2D526523EULL,
+};
+
+static uint64_t Avalanche(uint64_t h) {
+    h ^= h >> 33;
+    h *= 0xFF51AFD7ED558CCDULL;
+    h ^= h >> 33;
+    h *= 0xC4CEB9FE1A85EC53ULL;
+    h ^= h >> 33;
+    return h;
+}
+
+#ifndef HASH_SSE2
+// Little-endian, as the SSE2 path reads it
+static uint64_t Load64(const uint8_t *p) {
+    uint64_t v = 0;
+    for (int i = 7; i >= 0; --i) v = (v << 8) | p[i];
+    return v;
+}
+#endif
+
+// Takes `count` whole stripes from p into the lanes
+static void HashStripes(HashState *state, const uint8_t *p, size_t count) {
+    unsigned stripe = state->stripe;
+#ifdef HASH_SSE2
+    __m128i acc[HASH_LANES / 2];
+    for (int j = 0; j < HASH_LANES / 2; ++j) acc[j] = _mm_loadu_si128((const __m128i *)(state->acc + 2 * j));
+    const __m128i prime = _mm_set1_epi32((int)HASH_PRIME32);
+    for (size_t n = 0; n < count; ++n, p += HASH_STRIPE) {
+        // The hardware prefetcher alone falls behind this loop on a cold buffer
+        _mm_prefetch((const char *)p + 1024, _MM_HINT_T0);
+        for (int j = 0; j < HASH_LANES / 2; ++j) {
+            __m128i data = _mm_loadu_si128((const __m128i *)(p + 16 * j));
+            __m128i mixed = _mm_xor_si128(data, _mm_loadu_si128((const __m128i *)(kKeys + stripe + 2 * j)));
+            __m128i product = _mm_mul_epu32(mixed, _mm_srli_epi64(mixed, 32));
+            __m128i swapped = _mm_shuffle_epi32(data, _MM_SHUFFLE(1, 0, 3, 2));
+            acc[j] = _mm_add_epi64(acc[j], _mm_add_epi64(product, swapped));
+        }
+        if (++stripe == HASH_BLOCK_STRIPES) {
+            for (int j = 0; j < HASH_LANES / 2; ++j) {
+                __m128i a = _mm_xor_si128(acc[j], _mm_srli_epi64(acc[j], 47));
+                a = _mm_xor_si128(a, _mm_loadu_si128((const __m128i *)(kKeys + HASH_BLOCK_STRIPES + 2 * j)));
+                __m128i low = _mm_mul_epu32(a, prime);
+                __m128i high = _mm_mul_epu32(_mm_srli_epi64(a, 32), prime);
+                acc[j] = _mm_add_epi64(low, _mm_slli_epi64(high, 32));
+            }
+            stripe = 0;
+        }
+    }
+    for (int j = 0; j < HASH_LANES / 2; ++j) _mm_storeu_si128((__m128i *)(state->acc + 2 * j), acc[j]);
+#else
+    uint64_t *acc = state->acc;
+    for (size_t n = 0; n < count; ++n, p += HASH_STRIPE) {
+        for (int i = 0; i < HASH_LANES; ++i) {
+            uint64_t mixed = Load64(p + 8 * i) ^ kKeys[stripe + i];
+            acc[i] += (mixed & 0xFFFFFFFFu) * (mixed >> 32) + Load64(p + 8 * (i ^ 1));
+        }
+        if (++stripe == HASH_BLOCK_STRIPES) {
+            for (int i = 0; i < HASH_LANES; ++i) {
+                uint64_t a = acc[i] ^ (acc[i] >> 47) ^ kKeys[HASH_BLOCK_STRIPES + i];
+                acc[i] = a * HASH_PRIME32;
+            }
+            stripe = 0;
+        }
+    }
+#endif
+    state->stripe = stripe;
+}
+
+void HashBegin(HashState *state) {
+    memset(state, 0, sizeof(*state));
+    for (int i = 0; i < HASH_LANES; ++i) state->acc[i] = kKeys[HASH_LANES + i] ^ (HASH_PRIME64 * (uint64_t)(i + 1));
+}
+
+void HashUpdate(HashState *state, const void *data, size_t size) {
+    const uint8_t *p = (const uint8_t *)data;
+    state->length += size;
+    if (state->buffered > 0) {
+        size_t take = HASH_STRIPE - state->buffered;
+        if (take > size) take = size;
+        memcpy(state->buffer + state->buffered, p, take);
+        state->buffered += (unsigned)take;
+        p += take;
+        size -= take;
+        if (state->buffered < HASH_STRIPE) return;
+        HashStripes(state, state->buffer, 1);
+        state->buffered = 0;
+    }
+    size_t whole = size / HASH_STRIPE;
+    HashStripes(state, p, whole);
+    p += whole * HASH_STRIPE;
+    size -= whole * HASH_STRIPE;
+    memcpy(state->buffer, p, size);
+    state->buffered = (unsigned)size;
+}
+
+uint64_t HashEnd(const HashState *state) {
+    // The tail goes in zero-padded; the length tells it apart from real zeros
+    HashState last = *state;
+    if (last.buffered > 0) {
+        memset(last.buffer + last.buffered, 0, HASH_STRIPE - last.buffered);
+        HashStripes(&last, last.buffer, 1);
+    }
+    uint64_t h = last.length * HASH_PRIME64;
+    for (int i = 0; i < HASH_LANES; ++i) h = (h ^ Avalanche(last.acc[i] ^ kKeys[i])) * HASH_PRIME64;
+    return Avalanche(h);
+}
+
+uint64_t HashBytes(const void *data, size_t size) {
+    HashState state;
+    HashBegin(&state);
+    HashUpdate(&state, data, size);
+    return HashEnd(&state);
+}
+
+void HashSamplePiece(uint64_t size, unsigned index, uint64_t *offsetOut, size_t *lengthOut) {
+    const uint64_t all = (uint64_t)HASH_SAMPLE_PIECES * HASH_SAMPLE_PIECE;
+    if (size <= all) {
+        uint64_t offset = (uint64_t)index * HASH_SAMPLE_PIECE;
+        if (offset > size) offset = size;
+        *offsetOut = offset;
+        *lengthOut = (size_t)(size - offset < HASH_SAMPLE_PIECE ? size - offset : HASH_SAMPLE_PIECE);
+        return;
+    }
+    *offsetOut = (size - HASH_SAMPLE_PIECE) / (HASH_SAMPLE_PIECES - 1) * index;
+    if (index == HASH_SAMPLE_PIECES - 1) *offsetOut = size - HASH_SAMPLE_PIECE;
+    *lengthOut = HASH_SAMPLE_PIECE;
+}
+
+uint64_t HashSampleEnd(HashState *state, uint64_t size) {
+    uint8_t bytes[8];
+    for (int i = 0; i < 8; ++i) bytes[i] = (uint8_t)(size >> (8 * i));
+    HashUpdate(state, bytes, sizeof(bytes));
+    return HashEnd(state);
+}
+
+uint64_t HashSample(const void *data, size_t size) {
+    HashState state;
+    HashBegin(&state);
+    for (unsigned i = 0; i < HASH_SAMPLE_PIECES; ++i) {
+        uint64_t offset;
+        size_t length;
+        HashSamplePiece(size, i, &offset, &length);
+        HashUpdate(&state, (const uint8_t *)data + offset, length);
+    }
+    return HashSampleEnd(&state, size);
+}
@@ -0,0 +1,40 @@
+// Fast 64-bit content hash for retropad, used to tell whether a file on disk still
+// holds what was loaded or saved. Not cryptographic. Data is taken 64 bytes at a time
+// into eight 64-bit lanes (32x32-bit multiplies, SSE2 where it's available, with a
+// scalar path that gives the same result), so a large file hashes at about memory
+// bandwidth. Nothing here allocates.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define HASH_STRIPE 64
+
+// Hash of a stream fed in pieces; any split gives the hash of the whole
+typedef struct HashState {
+    uint64_t acc[8];
+    uint64_t length;
+    uint8_t buffer[HASH_STRIPE];
+    unsigned buffered;
+    unsigned stripe;        // stripes since the lanes were last scrambled
+} HashState;
+
+void HashBegin(HashState *state);
+void HashUpdate(HashState *state, const void *data, size_t size);
+uint64_t HashEnd(const HashState *state);
+
+uint64_t HashBytes(const void *data, size_t size);
+
+// Sampled hash: HASH_SAMPLE_PIECES pieces of HASH_SAMPLE_PIECE bytes spread evenly
+// over the input (the first at the start, the last at the end; small inputs are taken
+// whole), then the size. Cheap evidence that a file whose size and write time haven't
+// changed still holds the bytes it did.
+#define HASH_SAMPLE_PIECES 64
+#define HASH_SAMPLE_PIECE 4096
+
+// Where piece `index` of a `size`-byte input lies, so a file can be sampled without
+// reading it all; the pieces are hashed in index order
+void HashSamplePiece(uint64_t size, unsigned index, uint64_t *offsetOut, size_t *lengthOut);
+// Sample of `size` bytes: HashUpdate of each piece, then HashSampleEnd
+uint64_t HashSample(const void *data, size_t size);
+uint64_t HashSampleEnd(HashState *state, uint64_t size);
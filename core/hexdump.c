@@ -0,0 +1,125 @@
+// Hex dump rows, byte patterns and byte search for retropad's hex view.
+#include "hexdump.h"
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define HEXDUMP_SSE2 1
+#endif
+
+static const char kHexDigits[] = "0123456789ABCDEF";
+
+unsigned HexOffsetDigits(uint64_t size) {
+    return size > 0xFFFFFFFFull ? 16 : 8;
+}
+
+size_t HexByteColumn(unsigned digits, size_t index) {
+    return digits + 2 + 3 * index + (index >= HEX_ROW_BYTES / 2);
+}
+
+size_t HexCharColumn(unsigned digits, size_t index) {
+    return digits + 2 + 3 * HEX_ROW_BYTES + 2 + index;
+}
+
+size_t HexByteAtColumn(unsigned digits, size_t column) {
+    size_t hex = digits + 2;
+    size_t chars = HexCharColumn(digits, 0);
+    if (column >= chars && column < chars + HEX_ROW_BYTES) return column - chars;
+    if (column < hex || column >= chars - 1) return HEX_ROW_BYTES;
+    size_t rel = column - hex;
+    // The space after a byte belongs to it; the extra one between the groups to the left
+    return rel < 3 * HEX_ROW_BYTES / 2 ? rel / 3 : (rel - 1) / 3;
+}
+
+size_t HexFormatRow(uint64_t offset, unsigned digits, const uint8_t *bytes, size_t count, TextChar *out) {
+    size_t length = HEX_ROW_LENGTH(digits);
+    for (size_t i = 0; i < length; ++i) out[i] = ' ';
+    for (unsigned i = 0; i < digits; ++i) {
+        out[digits - 1 - i] = (TextChar)kHexDigits[(offset >> (4 * i)) & 0xF];
+    }
+    for (size_t i = 0; i < count && i < HEX_ROW_BYTES; ++i) {
+        uint8_t b = bytes[i];
+        size_t column = HexByteColumn(digits, i);
+        out[column] = (TextChar)kHexDigits[b >> 4];
+        out[column + 1] = (TextChar)kHexDigits[b & 0xF];
+        out[HexCharColumn(digits, i)] = b >= 0x20 && b < 0x7F ? (TextChar)b : '.';
+    }
+    return length;
+}
+
+static int HexValue(TextChar c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+size_t HexParsePattern(const TextChar *text, size_t length, uint8_t *out, size_t capacity) {
+    size_t count = 0;
+    size_t i = 0;
+    while (i < length) {
+        TextChar c = text[i];
+        if (c == ' ' || c == '\t') {
+            ++i;
+        } else if (c == '"') {
+            size_t close = i + 1;
+            while (close < length && text[close] != '"') ++close;
+            if (close == length || close == i + 1) return 0;
+            size_t bytes = TextEncodeUtf8(text + i + 1, close - i - 1, TEXT_EOL_CRLF, NULL);
+            if (bytes > capacity - count) return 0;
+            TextEncodeUtf8(text + i + 1, close - i - 1, TEXT_EOL_CRLF, out + count);
+            count += bytes;
+            i = close + 1;
+        } else {
+            int high = HexValue(c);
+            int low = i + 1 < length ? HexValue(text[i + 1]) : -1;
+            if (high < 0 || low < 0 || count == capacity) return 0;
+            out[count++] = (uint8_t)(high << 4 | low);
+            i += 2;
+        }
+    }
+    return count;
+}
+
+size_t HexFind(const uint8_t *data, size_t size, const uint8_t *pattern, size_t length) {
+    if (length == 0 || length > size) return HEX_NOT_FOUND;
+    size_t last = size - length;    // last possible start
+    size_t i = 0;
+#ifdef HEXDUMP_SSE2
+    // Sixteen starts at a time: the first and last pattern bytes must both match before
+    // the rest is compared, which rejects nearly every start in random data
+    const __m128i first = _mm_set1_epi8((char)pattern[0]);
+    const __m128i end = _mm_set1_epi8((char)pattern[length - 1]);
+    for (; i + 16 <= last + 1; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(data + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(data + i + length - 1));
+        unsigned mask = (unsigned)_mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, end)));
+        while (mask) {
+            unsigned bit = 0;
+            while (!(mask & (1u << bit))) ++bit;
+            if (memcmp(data + i + bit, pattern, length) == 0) return i + bit;
+            mask &= mask - 1;
+        }
+    }
+#endif
+    while (i <= last) {
+        const uint8_t *hit = (const uint8_t *)memchr(data + i, pattern[0], last - i + 1);
+        if (!hit) break;
+        i = (size_t)(hit - data);
+        if (memcmp(hit, pattern, length) == 0) return i;
+        ++i;
+    }
+    return HEX_NOT_FOUND;
+}
+
+bool HexLooksBinary(const uint8_t *data, size_t size) {
+    if (TextBomLength(data, size, ENC_UTF16LE) || TextBomLength(data, size, ENC_UTF16BE)) return false;
+    size_t suspicious = 0;
+    for (size_t i = 0; i < size; ++i) {
+        uint8_t b = data[i];
+        // Tab, line breaks, form feeds and the escapes of colored logs are text
+        suspicious += (b < 0x20 && b != '\t' && b != '\n' && b != '\v' && b != '\f' && b != '\r' && b != 0x1B) ||
+                      b == 0x7F;
+    }
+    return suspicious * 32 > size;
+}
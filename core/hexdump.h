@@ -0,0 +1,42 @@
+// Raw byte helpers for retropad's hex view: one row of the dump is formatted at a time
+// from whatever bytes the caller has mapped, byte patterns are parsed from what the
+// user types, and searched for with an SSE2 scan where it's available. Nothing here
+// allocates, so the view's memory doesn't depend on the file's size.
+#pragma once
+
+#include "textcore.h"
+
+#define HEX_ROW_BYTES 16
+#define HEX_NOT_FOUND SIZE_MAX
+#define HEX_PATTERN_MAX 256
+
+// A row is the offset in `digits` hex digits, two spaces, the bytes as two groups of
+// eight "xx " with an extra space between the groups, a space and the bytes as
+// characters ('.' for anything outside printable ASCII)
+#define HEX_ROW_LENGTH(digits) ((digits) + 2 + 3 * HEX_ROW_BYTES + 2 + HEX_ROW_BYTES)
+
+// Offset digits for a file of `size` bytes: 8, or 16 past 4 GB
+unsigned HexOffsetDigits(uint64_t size);
+
+// Writes the row for bytes[0..count) (count at most HEX_ROW_BYTES; missing bytes are
+// left blank) starting at file offset `offset` into out, HEX_ROW_LENGTH(digits) units,
+// not terminated. Returns that length.
+size_t HexFormatRow(uint64_t offset, unsigned digits, const uint8_t *bytes, size_t count, TextChar *out);
+
+// Columns of byte `index` (0..HEX_ROW_BYTES) in a row: its first hex digit and its character
+size_t HexByteColumn(unsigned digits, size_t index);
+size_t HexCharColumn(unsigned digits, size_t index);
+// Byte under `column`, or HEX_ROW_BYTES when the column is in neither part
+size_t HexByteAtColumn(unsigned digits, size_t column);
+
+// Parses a search pattern: pairs of hex digits, optionally separated by spaces, and
+// "quoted text" taken as UTF-8, in any mix (e.g. `"PK" 03 04`). Returns the byte count
+// (at most `capacity`), or 0 when the text isn't a pattern.
+size_t HexParsePattern(const TextChar *text, size_t length, uint8_t *out, size_t capacity);
+
+// First offset of pattern[0..length) in data[0..size), or HEX_NOT_FOUND
+size_t HexFind(const uint8_t *data, size_t size, const uint8_t *pattern, size_t length);
+
+// Whether the start of a file is better shown as bytes than as text: more than one byte
+// in 32 is NUL or a control character that text doesn't use. A UTF-16 BOM means text.
+bool HexLooksBinary(const uint8_t *data, size_t size);
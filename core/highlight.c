@@ -0,0 +1,550 @@
+// Incremental syntax highlighting for retropad: line tokenizers for log, INI and
+// JSON text, plus the checkpoint and run caches that keep the work per screen.
+#include "highlight.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define LOG_LEVEL_SCAN 128      // units searched for a level word at the start of a log line
+#define NESTING_BITS 32
+#define READ_BLOCK 256          // units copied at a time while looking for a line's end
+
+typedef struct Checkpoint {
+    size_t line;
+    HighlightState state;       // at the start of `line`
+} Checkpoint;
+
+typedef struct CachedLine {
+    size_t line;                // SIZE_MAX when empty
+    HighlightState exit;        // state at the start of the next line
+    uint32_t runCount;
+    HighlightRun runs[HIGHLIGHT_MAX_RUNS];
+} CachedLine;
+
+struct Highlighter {
+    HighlightLanguage language;
+    Checkpoint *checkpoints;    // sorted by line; the first is always line 0
+    size_t count;
+    size_t capacity;
+    CachedLine *cache;          // HIGHLIGHT_CACHE_LINES, indexed by line
+    uint64_t linesTokenized;
+    const DocStore *readStore;  // where the line after the last one read starts, so walks
+    size_t readLine;            // don't look every line up in the line index
+    size_t readStart;
+    TextChar text[HIGHLIGHT_MAX_LINE];
+};
+
+typedef struct RunList {
+    HighlightRun *runs;
+    size_t max;
+    size_t count;
+} RunList;
+
+typedef struct LevelWord {
+    const char *word;
+    uint8_t token;
+} LevelWord;
+
+static const LevelWord g_levelWords[] = {
+    {"ERROR", HIGHLIGHT_ERROR},     {"ERR", HIGHLIGHT_ERROR},   {"FATAL", HIGHLIGHT_ERROR},
+    {"CRITICAL", HIGHLIGHT_ERROR},  {"CRIT", HIGHLIGHT_ERROR},  {"SEVERE", HIGHLIGHT_ERROR},
+    {"PANIC", HIGHLIGHT_ERROR},     {"WARNING", HIGHLIGHT_WARNING}, {"WARN", HIGHLIGHT_WARNING},
+    {"INFO", HIGHLIGHT_INFO},       {"NOTICE", HIGHLIGHT_INFO}, {"DEBUG", HIGHLIGHT_DEBUG},
+    {"TRACE", HIGHLIGHT_DEBUG},     {"VERBOSE", HIGHLIGHT_DEBUG},
+};
+
+void HighlightInitState(HighlightState *state) {
+    memset(state, 0, sizeof(*state));
+}
+
+static bool StateEqual(const HighlightState *a, const HighlightState *b) {
+    return a->objects == b->objects && a->depth == b->depth && a->flags == b->flags && a->level == b->level;
+}
+
+static void Emit(RunList *list, size_t start, size_t length, HighlightToken token) {
+    if (!list->runs || length == 0 || token == HIGHLIGHT_PLAIN) return;
+    if (list->count > 0) {
+        HighlightRun *last = &list->runs[list->count - 1];
+        if (last->token == token && last->start + last->length == start) {
+            last->length += (uint32_t)length;
+            return;
+        }
+    }
+    if (list->count == list->max) return;
+    HighlightRun *run = &list->runs[list->count++];
+    run->start = (uint32_t)start;
+    run->length = (uint32_t)length;
+    run->token = (uint8_t)token;
+}
+
+static bool IsBlank(TextChar c) {
+    return c == ' ' || c == '\t';
+}
+
+static bool IsDigit(TextChar c) {
+    return c >= '0' && c <= '9';
+}
+
+static bool IsLetter(TextChar c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
+static bool IsWordChar(TextChar c) {
+    return IsLetter(c) || IsDigit(c) || c == '_';
+}
+
+static TextChar UpperAscii(TextChar c) {
+    return c >= 'a' && c <= 'z' ? (TextChar)(c - 'a' + 'A') : c;
+}
+
+// text[0..length) equals `word` (upper case ASCII), ignoring case when `anyCase`
+static bool WordIs(const TextChar *text, size_t length, const char *word, bool anyCase) {
+    size_t i = 0;
+    for (; i < length && word[i]; ++i) {
+        TextChar c = anyCase ? UpperAscii(text[i]) : text[i];
+        if (c != (TextChar)word[i]) return false;
+    }
+    return i == length && !word[i];
+}
+
+// --- Log files ---
+
+// A line that carries on the entry above it: indented (stack frames, wrapped
+// messages) or a chained exception
+static bool IsContinuation(const TextChar *text, size_t length) {
+    if (length == 0) return false;
+    if (IsBlank(text[0])) return true;
+    static const char causedBy[] = "Caused by";
+    return length >= sizeof(causedBy) - 1 && WordIs(text, sizeof(causedBy) - 1, causedBy, false);
+}
+
+// Length of a leading timestamp such as "2024-05-01 12:00:03,114" or "[12:00:03]":
+// digit groups joined by -/:.,T+Z or single spaces, with at least one : or -
+static size_t TimestampLength(const TextChar *text, size_t length) {
+    size_t i = 0;
+    bool bracket = length > 0 && text[0] == '[';
+    if (bracket) ++i;
+    if (i >= length || !IsDigit(text[i])) return 0;
+    size_t end = i;
+    bool separator = false;
+    while (i < length) {
+        TextChar c = text[i];
+        if (IsDigit(c)) {
+            end = ++i;
+        } else if (c == '-' || c == ':' || c == '/' || c == '.' || c == ',' || c == 'T' || c == '+' || c == 'Z' ||
+                   (c == ' ' && i + 1 < length && IsDigit(text[i + 1]))) {
+            separator |= c == '-' || c == ':' || c == '/';
+            ++i;
+            if (c == 'Z') end = i;
+        } else {
+            break;
+        }
+    }
+    if (!separator || end < 5) return 0;
+    if (bracket) return end < length && text[end] == ']' ? end + 1 : 0;
+    return end;
+}
+
+// Token for the first level word near the start of the line: upper case anywhere,
+// any case when bracketed ("[warn]")
+static uint8_t FindLevel(const TextChar *text, size_t length) {
+    size_t limit = length < LOG_LEVEL_SCAN ? length : LOG_LEVEL_SCAN;
+    size_t i = 0;
+    while (i < limit) {
+        if (!IsLetter(text[i])) {
+            ++i;
+            continue;
+        }
+        size_t start = i;
+        while (i < length && IsWordChar(text[i])) ++i;
+        bool bracketed = start > 0 && (text[start - 1] == '[' || text[start - 1] == '<') && i < length &&
+                         (text[i] == ']' || text[i] == '>');
+        for (size_t w = 0; w < sizeof(g_levelWords) / sizeof(g_levelWords[0]); ++w) {
+            if (WordIs(text + start, i - start, g_levelWords[w].word, bracketed)) return g_levelWords[w].token;
+        }
+    }
+    return HIGHLIGHT_PLAIN;
+}
+
+// Lines of an entry take its level's color; the timestamp that starts it has its own
+static void TokenizeLog(HighlightState *state, const TextChar *text, size_t length, RunList *list) {
+    if (IsContinuation(text, length)) {
+        Emit(list, 0, length, (HighlightToken)state->level);
+        return;
+    }
+    size_t time = TimestampLength(text, length);
+    Emit(list, 0, time, HIGHLIGHT_TIME);
+    state->level = FindLevel(text + time, length - time);
+    Emit(list, time, length - time, (HighlightToken)state->level);
+}
+
+// --- INI files ---
+
+static size_t TrimEnd(const TextChar *text, size_t from, size_t to) {
+    while (to > from && IsBlank(text[to - 1])) --to;
+    return to;
+}
+
+static bool IsNumber(const TextChar *text, size_t length) {
+    size_t i = length > 0 && (text[0] == '-' || text[0] == '+') ? 1 : 0;
+    bool digits = false;
+    for (; i < length; ++i) {
+        if (IsDigit(text[i])) {
+            digits = true;
+        } else if (text[i] != '.') {
+            return false;
+        }
+    }
+    return digits;
+}
+
+static void TokenizeIni(const TextChar *text, size_t length, RunList *list) {
+    size_t i = 0;
+    while (i < length && IsBlank(text[i])) ++i;
+    if (i == length) return;
+    if (text[i] == ';' || text[i] == '#') {
+        Emit(list, i, length - i, HIGHLIGHT_COMMENT);
+        return;
+    }
+    if (text[i] == '[') {
+        size_t close = i + 1;
+        while (close < length && text[close] != ']') ++close;
+        size_t end = close < length ? close + 1 : length;
+        Emit(list, i, end - i, HIGHLIGHT_SECTION);
+        while (end < length && IsBlank(text[end])) ++end;
+        if (end < length && (text[end] == ';' || text[end] == '#')) Emit(list, end, length - end, HIGHLIGHT_COMMENT);
+        return;
+    }
+    size_t equals = i;
+    while (equals < length && text[equals] != '=' && text[equals] != ':') ++equals;
+    if (equals == length) return;
+    Emit(list, i, TrimEnd(text, i, equals) - i, HIGHLIGHT_KEY);
+
+    size_t value = equals + 1;
+    while (value < length && IsBlank(text[value])) ++value;
+    size_t end = TrimEnd(text, value, length);
+    if (value == end) return;
+    if (text[value] == '"') {
+        Emit(list, value, end - value, HIGHLIGHT_STRING);
+    } else if (IsNumber(text + value, end - value)) {
+        Emit(list, value, end - value, HIGHLIGHT_NUMBER);
+    } else {
+        static const char *const literals[] = {"TRUE", "FALSE", "YES", "NO", "ON", "OFF"};
+        for (size_t w = 0; w < sizeof(literals) / sizeof(literals[0]); ++w) {
+            if (WordIs(text + value, end - value, literals[w], true)) {
+                Emit(list, value, end - value, HIGHLIGHT_LITERAL);
+                break;
+            }
+        }
+    }
+}
+
+// --- JSON (with // and /* */ comments) ---
+
+static bool InObject(const HighlightState *state) {
+    return state->depth > 0 && state->depth <= NESTING_BITS && (state->objects >> (state->depth - 1)) & 1;
+}
+
+static void Push(HighlightState *state, bool object) {
+    if (state->depth < NESTING_BITS) {
+        uint32_t bit = 1u << state->depth;
+        state->objects = object ? state->objects | bit : state->objects & ~bit;
+    }
+    if (state->depth < 255) state->depth++;
+}
+
+static void Pop(HighlightState *state) {
+    if (state->depth == 0) return;
+    state->depth--;
+    if (state->depth < NESTING_BITS) state->objects &= ~(1u << state->depth);
+}
+
+static void TokenizeJson(HighlightState *state, const TextChar *text, size_t length, RunList *list) {
+    size_t i = 0;
+    while (i < length) {
+        TextChar c = text[i];
+        if (state->flags & HIGHLIGHT_IN_COMMENT) {
+            size_t end = i;
+            while (end + 1 < length && !(text[end] == '*' && text[end + 1] == '/')) ++end;
+            if (end + 1 < length) {
+                end += 2;
+                state->flags &= ~HIGHLIGHT_IN_COMMENT;
+            } else {
+                end = length;
+            }
+            Emit(list, i, end - i, HIGHLIGHT_COMMENT);
+            i = end;
+        } else if (c == '/' && i + 1 < length && text[i + 1] == '/') {
+            Emit(list, i, length - i, HIGHLIGHT_COMMENT);
+            return;
+        } else if (c == '/' && i + 1 < length && text[i + 1] == '*') {
+            state->flags |= HIGHLIGHT_IN_COMMENT;
+            Emit(list, i, 2, HIGHLIGHT_COMMENT);
+            i += 2;
+        } else if (c == '"') {
+            // Strings can't span lines; an unterminated one ends with the line
+            size_t end = i + 1;
+            while (end < length && text[end] != '"') end += text[end] == '\\' ? 2 : 1;
+            end = end < length ? end + 1 : length;
+            Emit(list, i, end - i, (state->flags & HIGHLIGHT_EXPECT_KEY) ? HIGHLIGHT_KEY : HIGHLIGHT_STRING);
+            i = end;
+        } else if (c == '-' || IsDigit(c)) {
+            size_t end = i + 1;
+            while (end < length && (IsDigit(text[end]) || text[end] == '.' || text[end] == 'e' || text[end] == 'E' ||
+                                    text[end] == '+' || text[end] == '-')) {
+                ++end;
+            }
+            Emit(list, i, end - i, HIGHLIGHT_NUMBER);
+            i = end;
+        } else if (IsLetter(c)) {
+            size_t end = i + 1;
+            while (end < length && IsLetter(text[end])) ++end;
+            if (WordIs(text + i, end - i, "true", false) || WordIs(text + i, end - i, "false", false) ||
+                WordIs(text + i, end - i, "null", false)) {
+                Emit(list, i, end - i, HIGHLIGHT_LITERAL);
+            }
+            i = end;
+        } else {
+            if (c == '{') {
+                Push(state, true);
+                state->flags |= HIGHLIGHT_EXPECT_KEY;
+            } else if (c == '[') {
+                Push(state, false);
+                state->flags &= ~HIGHLIGHT_EXPECT_KEY;
+            } else if (c == '}' || c == ']') {
+                Pop(state);
+                state->flags &= ~HIGHLIGHT_EXPECT_KEY;
+            } else if (c == ',') {
+                state->flags = InObject(state) ? state->flags | HIGHLIGHT_EXPECT_KEY : state->flags & ~HIGHLIGHT_EXPECT_KEY;
+            } else if (c == ':') {
+                state->flags &= ~HIGHLIGHT_EXPECT_KEY;
+            }
+            ++i;
+        }
+    }
+}
+
+size_t HighlightTokenize(HighlightLanguage language, HighlightState *state, const TextChar *text, size_t length,
+                         HighlightRun *runs, size_t maxRuns) {
+    RunList list = {runs, runs ? maxRuns : 0, 0};
+    switch (language) {
+    case HIGHLIGHT_LOG:
+        TokenizeLog(state, text, length, &list);
+        break;
+    case HIGHLIGHT_INI:
+        TokenizeIni(text, length, &list);
+        break;
+    case HIGHLIGHT_JSON:
+        TokenizeJson(state, text, length, &list);
+        break;
+    default:
+        break;
+    }
+    return list.count;
+}
+
+// True when a line's tokens and outgoing state don't depend on the state it starts in
+static bool LineResets(HighlightLanguage language, const TextChar *text, size_t length) {
+    if (language == HIGHLIGHT_INI) return true;
+    return language == HIGHLIGHT_LOG && !IsContinuation(text, length);
+}
+
+// --- Highlighter ---
+
+Highlighter *HighlighterCreate(HighlightLanguage language) {
+    Highlighter *h = (Highlighter *)calloc(1, sizeof(Highlighter));
+    if (!h) return NULL;
+    h->language = language;
+    h->capacity = 64;
+    h->checkpoints = (Checkpoint *)malloc(h->capacity * sizeof(Checkpoint));
+    h->cache = (CachedLine *)malloc(HIGHLIGHT_CACHE_LINES * sizeof(CachedLine));
+    if (!h->checkpoints || !h->cache) {
+        HighlighterDestroy(h);
+        return NULL;
+    }
+    h->count = 1;
+    h->checkpoints[0].line = 0;
+    HighlightInitState(&h->checkpoints[0].state);
+    for (size_t i = 0; i < HIGHLIGHT_CACHE_LINES; ++i) h->cache[i].line = SIZE_MAX;
+    h->readLine = SIZE_MAX;
+    return h;
+}
+
+void HighlighterDestroy(Highlighter *h) {
+    if (!h) return;
+    free(h->checkpoints);
+    free(h->cache);
+    free(h);
+}
+
+HighlightLanguage HighlighterLanguage(const Highlighter *h) {
+    return h->language;
+}
+
+// Copies `line` without its line break (cut at HIGHLIGHT_MAX_LINE) into h->text
+static bool ReadLine(Highlighter *h, const DocStore *store, size_t line, size_t *lengthOut) {
+    bool next = store == h->readStore && line == h->readLine;
+    size_t start = next ? h->readStart : DocStoreLineStart(store, line);
+    if (start == TEXT_ERROR) return false;
+
+    size_t length = 0;
+    bool found = false;
+    while (!found && length < HIGHLIGHT_MAX_LINE) {
+        size_t want = HIGHLIGHT_MAX_LINE - length < READ_BLOCK ? HIGHLIGHT_MAX_LINE - length : READ_BLOCK;
+        size_t got = DocStoreCopy(store, start + length, want, h->text + length);
+        size_t end = length + got;
+        while (length < end && h->text[length] != '\n') ++length;
+        found = length < end;
+        if (got < want) break;
+    }
+    h->readStore = store;
+    h->readLine = line + 1;
+    if (found) {
+        h->readStart = start + length + 1;
+    } else {
+        h->readStart = length == HIGHLIGHT_MAX_LINE ? DocStoreLineStart(store, line + 1) : TEXT_ERROR;
+    }
+    if ((found || length < HIGHLIGHT_MAX_LINE) && length > 0 && h->text[length - 1] == '\r') --length;
+    *lengthOut = length;
+    return true;
+}
+
+static size_t TokenizeLine(Highlighter *h, HighlightState *state, size_t length, HighlightRun *runs, size_t maxRuns) {
+    h->linesTokenized++;
+    return HighlightTokenize(h->language, state, h->text, length, runs, maxRuns);
+}
+
+// Index of the last checkpoint at or before `line`
+static size_t FindCheckpoint(const Highlighter *h, size_t line) {
+    size_t lo = 0, hi = h->count;
+    while (hi - lo > 1) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (h->checkpoints[mid].line <= line) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static bool InsertCheckpoint(Highlighter *h, size_t index, size_t line, const HighlightState *state) {
+    if (h->count == h->capacity) {
+        Checkpoint *grown = (Checkpoint *)realloc(h->checkpoints, h->capacity * 2 * sizeof(Checkpoint));
+        if (!grown) return false;
+        h->checkpoints = grown;
+        h->capacity *= 2;
+    }
+    memmove(h->checkpoints + index + 1, h->checkpoints + index, (h->count - index) * sizeof(Checkpoint));
+    h->checkpoints[index].line = line;
+    h->checkpoints[index].state = *state;
+    h->count++;
+    return true;
+}
+
+// Checkpoints `line` if the one before it (index `before`) is a full interval back
+static void NoteState(Highlighter *h, size_t before, size_t line, const HighlightState *state) {
+    if (line - h->checkpoints[before].line >= HIGHLIGHT_CHECKPOINT_LINES) InsertCheckpoint(h, before + 1, line, state);
+}
+
+// State at the start of `line`: from the checkpoint before it, or from a line that
+// doesn't depend on earlier ones when that is nearer, checkpointing on the way
+static HighlightState StateAt(Highlighter *h, const DocStore *store, size_t line) {
+    size_t index = FindCheckpoint(h, line);
+    size_t from = h->checkpoints[index].line;
+    HighlightState state = h->checkpoints[index].state;
+    if (line - from > HIGHLIGHT_CHECKPOINT_LINES && h->language != HIGHLIGHT_JSON) {
+        for (size_t back = line; back > from && line - back < HIGHLIGHT_CHECKPOINT_LINES; --back) {
+            size_t length;
+            if (ReadLine(h, store, back, &length) && LineResets(h->language, h->text, length)) {
+                from = back;
+                HighlightInitState(&state);
+                break;
+            }
+        }
+    }
+    for (size_t at = from; at < line; ++at) {
+        if (at > h->checkpoints[index].line && at - h->checkpoints[index].line >= HIGHLIGHT_CHECKPOINT_LINES &&
+            InsertCheckpoint(h, index + 1, at, &state)) {
+            index++;
+        }
+        size_t length;
+        if (!ReadLine(h, store, at, &length)) break;
+        TokenizeLine(h, &state, length, NULL, 0);
+    }
+    return state;
+}
+
+size_t HighlighterLine(Highlighter *h, const DocStore *store, size_t line, const HighlightRun **runsOut) {
+    *runsOut = NULL;
+    if (line >= DocStoreLineCount(store)) return 0;
+    CachedLine *slot = &h->cache[line % HIGHLIGHT_CACHE_LINES];
+    if (slot->line == line) {
+        *runsOut = slot->runs;
+        return slot->runCount;
+    }
+
+    // Scrolling asks for lines in order, so the line above usually has the state
+    HighlightState state;
+    const CachedLine *above = &h->cache[(line + HIGHLIGHT_CACHE_LINES - 1) % HIGHLIGHT_CACHE_LINES];
+    if (line > 0 && above->line == line - 1) {
+        state = above->exit;
+        NoteState(h, FindCheckpoint(h, line), line, &state);
+    } else {
+        state = StateAt(h, store, line);
+    }
+    size_t length;
+    if (!ReadLine(h, store, line, &length)) return 0;
+    slot->runCount = (uint32_t)TokenizeLine(h, &state, length, slot->runs, HIGHLIGHT_MAX_RUNS);
+    slot->exit = state;
+    slot->line = line;
+    *runsOut = slot->runs;
+    return slot->runCount;
+}
+
+void HighlighterEdit(Highlighter *h, const DocStore *store, size_t firstLine, size_t oldLastLine, size_t newLastLine) {
+    h->readLine = SIZE_MAX;
+    for (size_t i = 0; i < HIGHLIGHT_CACHE_LINES; ++i) {
+        if (h->cache[i].line != SIZE_MAX && h->cache[i].line >= firstLine) h->cache[i].line = SIZE_MAX;
+    }
+
+    // Checkpoints up to firstLine still hold; those inside the old lines go, and the
+    // ones after move with the text but may now be wrong
+    size_t keep = FindCheckpoint(h, firstLine) + 1;
+    size_t drop = keep;
+    while (drop < h->count && h->checkpoints[drop].line <= oldLastLine) ++drop;
+    memmove(h->checkpoints + keep, h->checkpoints + drop, (h->count - drop) * sizeof(Checkpoint));
+    h->count -= drop - keep;
+    if (keep == h->count) return;
+    for (size_t i = keep; i < h->count; ++i) {
+        h->checkpoints[i].line = h->checkpoints[i].line - oldLastLine + newLastLine;
+    }
+
+    // Tokenize from the damage on until a moved checkpoint's state comes out the same:
+    // the text after it is unchanged, so every later checkpoint is right again. Past
+    // the budget the rest are dropped and rebuilt when those lines are next shown.
+    HighlightState state = StateAt(h, store, firstLine);
+    size_t next = FindCheckpoint(h, firstLine) + 1;
+    size_t budget = 4 * HIGHLIGHT_CHECKPOINT_LINES;
+    size_t line = firstLine;
+    while (next < h->count) {
+        size_t target = h->checkpoints[next].line;
+        if (target - line > budget) break;
+        budget -= target - line;
+        for (; line < target; ++line) {
+            size_t length;
+            if (!ReadLine(h, store, line, &length)) break;
+            TokenizeLine(h, &state, length, NULL, 0);
+        }
+        if (line < target) break;
+        if (StateEqual(&state, &h->checkpoints[next].state)) return;
+        h->checkpoints[next++].state = state;
+    }
+    h->count = next;
+}
+
+void HighlighterGetStats(const Highlighter *h, HighlighterStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->linesTokenized = h->linesTokenized;
+    stats->checkpoints = h->count;
+    for (size_t i = 0; i < HIGHLIGHT_CACHE_LINES; ++i) stats->cachedLines += h->cache[i].line != SIZE_MAX;
+}
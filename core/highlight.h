@@ -0,0 +1,89 @@
+// Incremental syntax highlighting for retropad: a small per-line tokenizer for log,
+// INI and JSON text, and a Highlighter that feeds it lines from a DocStore. The
+// tokenizer state at the start of a line is checkpointed every
+// HIGHLIGHT_CHECKPOINT_LINES lines, and runs are cached for the lines last asked
+// for, so highlighting a screen costs at most one checkpoint interval plus the
+// screen, whatever the size of the file. After an edit only the damaged lines are
+// tokenized again, up to the first checkpoint whose state comes out unchanged.
+// Unlike textcore.c this module allocates (malloc).
+#pragma once
+
+#include "textcore.h"
+#include "docstore.h"
+
+#define HIGHLIGHT_CHECKPOINT_LINES 128
+#define HIGHLIGHT_CACHE_LINES 256       // lines whose runs are kept; more than a screen
+#define HIGHLIGHT_MAX_RUNS 64           // runs kept per line; the rest of the line stays plain
+#define HIGHLIGHT_MAX_LINE 4096         // units tokenized per line; the rest is ignored
+
+typedef enum HighlightLanguage {
+    HIGHLIGHT_NONE = 0,
+    HIGHLIGHT_LOG,
+    HIGHLIGHT_INI,
+    HIGHLIGHT_JSON
+} HighlightLanguage;
+
+typedef enum HighlightToken {
+    HIGHLIGHT_PLAIN = 0,
+    HIGHLIGHT_ERROR,        // log entries at ERROR/FATAL and their continuation lines
+    HIGHLIGHT_WARNING,
+    HIGHLIGHT_INFO,
+    HIGHLIGHT_DEBUG,
+    HIGHLIGHT_TIME,         // a log line's leading timestamp
+    HIGHLIGHT_COMMENT,
+    HIGHLIGHT_SECTION,      // [section]
+    HIGHLIGHT_KEY,          // INI key, JSON member name
+    HIGHLIGHT_STRING,
+    HIGHLIGHT_NUMBER,
+    HIGHLIGHT_LITERAL,      // true, false, null
+    HIGHLIGHT_TOKEN_COUNT
+} HighlightToken;
+
+// Tokenizer state carried from one line to the next
+typedef struct HighlightState {
+    uint32_t objects;       // JSON: bit d set when nesting level d is an object
+    uint8_t depth;          // JSON nesting depth, saturating at 255
+    uint8_t flags;          // HIGHLIGHT_IN_*, HIGHLIGHT_EXPECT_KEY
+    uint8_t level;          // log: token of the entry that continues on the next line
+} HighlightState;
+
+#define HIGHLIGHT_IN_COMMENT 0x01   // inside /* */
+#define HIGHLIGHT_EXPECT_KEY 0x02   // the next JSON string names a member
+
+// A colored stretch of a line; plain text between runs is not listed
+typedef struct HighlightRun {
+    uint32_t start;
+    uint32_t length;
+    uint8_t token;          // HighlightToken
+} HighlightRun;
+
+typedef struct HighlighterStats {
+    uint64_t linesTokenized;    // every line run through the tokenizer, cached or walked past
+    size_t checkpoints;
+    size_t cachedLines;
+} HighlighterStats;
+
+void HighlightInitState(HighlightState *state);
+// Tokenizes one line (without its line break), moving *state to the start of the
+// next line. Writes up to maxRuns runs in order and returns how many; runs may be
+// NULL when only the state is wanted.
+size_t HighlightTokenize(HighlightLanguage language, HighlightState *state, const TextChar *text, size_t length,
+                         HighlightRun *runs, size_t maxRuns);
+
+typedef struct Highlighter Highlighter;
+
+Highlighter *HighlighterCreate(HighlightLanguage language);
+void HighlighterDestroy(Highlighter *highlighter);
+HighlightLanguage HighlighterLanguage(const Highlighter *highlighter);
+
+// Runs for `line` of `store`, valid until the next call on this highlighter.
+// Returns the run count (0 when the line is plain or past the end).
+size_t HighlighterLine(Highlighter *highlighter, const DocStore *store, size_t line, const HighlightRun **runsOut);
+
+// Lines firstLine..oldLastLine of the text were replaced by firstLine..newLastLine
+// (both inclusive); `store` already holds the new text. Pass SIZE_MAX for both last
+// lines when anything from firstLine on may have changed.
+void HighlighterEdit(Highlighter *highlighter, const DocStore *store, size_t firstLine, size_t oldLastLine,
+                     size_t newLastLine);
+
+void HighlighterGetStats(const Highlighter *highlighter, HighlighterStats *stats);
@@ -0,0 +1,454 @@
+// Work-stealing job pool for retropad.
+#include "jobs.h"
+#include "platform.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define JOB_DEQUE_INITIAL 64
+
+typedef struct Job {
+    struct Job *next;       // in the shared queues and the completion list
+    JobRun run;
+    JobDone done;
+    void *arg;
+    JobToken *token;
+    uint64_t submittedAt;
+    JobResult result;
+} Job;
+
+struct JobToken {
+    PlatformRefCount refs;
+    PlatformRefCount cancelled;
+};
+
+// Ring buffer: the owner pushes and pops at the back, thieves take from the front
+typedef struct JobDeque {
+    Job **items;
+    size_t capacity;
+    size_t front;
+    size_t count;
+} JobDeque;
+
+typedef struct JobQueue {
+    Job *first;
+    Job *last;
+} JobQueue;
+
+typedef struct JobCounters {
+    uint64_t submitted[JOB_PRIORITY_COUNT];
+    uint64_t completed[JOB_PRIORITY_COUNT];
+    uint64_t skipped[JOB_PRIORITY_COUNT];
+    uint64_t waitNanos[JOB_PRIORITY_COUNT];
+    uint64_t maxWaitNanos[JOB_PRIORITY_COUNT];
+    uint64_t runNanos[JOB_PRIORITY_COUNT];
+    uint64_t steals;
+} JobCounters;
+
+typedef struct JobWorker {
+    JobPool *pool;
+    PlatformThread *thread;
+    PlatformLock *lock;     // deques and counters
+    JobDeque deques[JOB_PRIORITY_COUNT];
+    JobCounters counters;
+    uint32_t seed;          // victim choice; touched by the worker only
+    unsigned index;
+} JobWorker;
+
+struct JobContext {
+    JobWorker *worker;
+    Job *job;
+};
+
+// Lock order: pool->lock, then a worker's or the shared queue's lock. The completion
+// lock is never held together with another.
+struct JobPool {
+    JobWorker workers[JOB_MAX_WORKERS];
+    unsigned workerCount;
+    unsigned started;
+    PlatformLock *queueLock;            // shared queues and their submitted counts
+    JobQueue queues[JOB_PRIORITY_COUNT];
+    uint64_t submitted[JOB_PRIORITY_COUNT];
+    PlatformLock *lock;                 // sleepers; the conditions below wait on it
+    PlatformCondition *wake;
+    PlatformCondition *idle;
+    unsigned sleepers;
+    PlatformRefCount stopping;
+    PlatformRefCount outstanding;       // submitted jobs not finished yet
+    PlatformLock *doneLock;
+    JobQueue done;
+    bool notified;                      // notify fired since the last drain
+    void (*notify)(void *context);
+    void *notifyContext;
+};
+
+JobToken *JobTokenCreate(void) {
+    JobToken *token = (JobToken *)calloc(1, sizeof(JobToken));
+    if (token) token->refs = 1;
+    return token;
+}
+
+void JobTokenCancel(JobToken *token) {
+    if (token) PlatformRefIncrement(&token->cancelled);
+}
+
+bool JobTokenCancelled(JobToken *token) {
+    return token && PlatformRefLoad(&token->cancelled) != 0;
+}
+
+void JobTokenRelease(JobToken *token) {
+    if (token && PlatformRefDecrement(&token->refs) == 0) free(token);
+}
+
+static void FreeJob(Job *job) {
+    JobTokenRelease(job->token);
+    free(job);
+}
+
+static Job *NewJob(JobPriority priority, JobToken *token, JobRun run, JobDone done, void *arg) {
+    Job *job = (Job *)calloc(1, sizeof(Job));
+    if (!job) return NULL;
+    job->run = run;
+    job->done = done;
+    job->arg = arg;
+    job->token = token;
+    if (token) PlatformRefIncrement(&token->refs);
+    job->result.priority = priority;
+    job->submittedAt = PlatformNowNanos();
+    return job;
+}
+
+static bool DequePushBack(JobDeque *deque, Job *job) {
+    if (deque->count == deque->capacity) {
+        size_t capacity = deque->capacity ? deque->capacity * 2 : JOB_DEQUE_INITIAL;
+        Job **items = (Job **)malloc(capacity * sizeof(Job *));
+        if (!items) return false;
+        for (size_t i = 0; i < deque->count; i++) {
+            items[i] = deque->items[(deque->front + i) % deque->capacity];
+        }
+        free(deque->items);
+        deque->items = items;
+        deque->capacity = capacity;
+        deque->front = 0;
+    }
+    deque->items[(deque->front + deque->count) % deque->capacity] = job;
+    deque->count++;
+    return true;
+}
+
+static Job *DequePopBack(JobDeque *deque) {
+    if (!deque->count) return NULL;
+    deque->count--;
+    return deque->items[(deque->front + deque->count) % deque->capacity];
+}
+
+static Job *DequePopFront(JobDeque *deque) {
+    if (!deque->count) return NULL;
+    Job *job = deque->items[deque->front];
+    deque->front = (deque->front + 1) % deque->capacity;
+    deque->count--;
+    return job;
+}
+
+static void QueuePush(JobQueue *queue, Job *job) {
+    job->next = NULL;
+    if (queue->last) queue->last->next = job;
+    else queue->first = job;
+    queue->last = job;
+}
+
+static Job *QueuePop(JobQueue *queue) {
+    Job *job = queue->first;
+    if (job) {
+        queue->first = job->next;
+        if (!queue->first) queue->last = NULL;
+    }
+    return job;
+}
+
+// Wakes one sleeping worker. Called after the job is queued: a worker about to sleep
+// looks at every queue again while holding pool->lock, so it either sees the job or
+// is already waiting when this takes the lock.
+static void WakeWorker(JobPool *pool) {
+    PlatformLockEnter(pool->lock);
+    if (pool->sleepers) PlatformConditionWake(pool->wake);
+    PlatformLockLeave(pool->lock);
+}
+
+static Job *TakeOwn(JobWorker *worker, JobPriority priority) {
+    PlatformLockEnter(worker->lock);
+    Job *job = DequePopBack(&worker->deques[priority]);
+    PlatformLockLeave(worker->lock);
+    return job;
+}
+
+static Job *TakeShared(JobPool *pool, JobPriority priority) {
+    PlatformLockEnter(pool->queueLock);
+    Job *job = QueuePop(&pool->queues[priority]);
+    PlatformLockLeave(pool->queueLock);
+    return job;
+}
+
+static Job *Steal(JobWorker *worker, JobPriority priority) {
+    JobPool *pool = worker->pool;
+    unsigned count = pool->workerCount;
+    if (count < 2) return NULL;
+    worker->seed ^= worker->seed << 13;
+    worker->seed ^= worker->seed >> 17;
+    worker->seed ^= worker->seed << 5;
+    unsigned first = worker->seed % count;
+    for (unsigned i = 0; i < count; i++) {
+        JobWorker *victim = &pool->workers[(first + i) % count];
+        if (victim == worker) continue;
+        PlatformLockEnter(victim->lock);
+        Job *job = DequePopFront(&victim->deques[priority]);
+        PlatformLockLeave(victim->lock);
+        if (job) {
+            PlatformLockEnter(worker->lock);
+            worker->counters.steals++;
+            PlatformLockLeave(worker->lock);
+            return job;
+        }
+    }
+    return NULL;
+}
+
+// Interactive work anywhere comes before bulk work; within a priority the worker's own
+// newest job comes first (its data is likely still in cache), then the shared queue,
+// then the oldest job of another worker
+static Job *FindJob(JobWorker *worker) {
+    for (int priority = 0; priority < JOB_PRIORITY_COUNT; priority++) {
+        Job *job = TakeOwn(worker, (JobPriority)priority);
+        if (!job) job = TakeShared(worker->pool, (JobPriority)priority);
+        if (!job) job = Steal(worker, (JobPriority)priority);
+        if (job) return job;
+    }
+    return NULL;
+}
+
+static void FinishJob(JobPool *pool, Job *job) {
+    if (!job->done) {
+        FreeJob(job);
+        return;
+    }
+    PlatformLockEnter(pool->doneLock);
+    QueuePush(&pool->done, job);
+    bool first = !pool->notified;
+    pool->notified = true;
+    PlatformLockLeave(pool->doneLock);
+    // JobPoolDestroy drains on its own
+    if (first && pool->notify && !PlatformRefLoad(&pool->stopping)) pool->notify(pool->notifyContext);
+}
+
+static void RunJob(JobWorker *worker, Job *job) {
+    JobPool *pool = worker->pool;
+    JobPriority priority = job->result.priority;
+    uint64_t start = PlatformNowNanos();
+    job->result.worker = worker->index;
+    job->result.waitNanos = start - job->submittedAt;
+    if (!PlatformRefLoad(&pool->stopping) && !JobTokenCancelled(job->token)) {
+        JobContext context = { worker, job };
+        job->run(&context, job->arg);
+        job->result.ran = true;
+        job->result.runNanos = PlatformNowNanos() - start;
+    }
+    job->result.cancelled = !job->result.ran || JobTokenCancelled(job->token);
+
+    PlatformLockEnter(worker->lock);
+    JobCounters *counters = &worker->counters;
+    if (job->result.ran) counters->completed[priority]++;
+    else counters->skipped[priority]++;
+    counters->waitNanos[priority] += job->result.waitNanos;
+    counters->runNanos[priority] += job->result.runNanos;
+    if (job->result.waitNanos > counters->maxWaitNanos[priority]) {
+        counters->maxWaitNanos[priority] = job->result.waitNanos;
+    }
+    PlatformLockLeave(worker->lock);
+
+    FinishJob(pool, job);
+    if (PlatformRefDecrement(&pool->outstanding) == 0) {
+        PlatformLockEnter(pool->lock);
+        PlatformConditionWakeAll(pool->idle);
+        PlatformLockLeave(pool->lock);
+    }
+}
+
+static void WorkerMain(void *arg) {
+    JobWorker *worker = (JobWorker *)arg;
+    JobPool *pool = worker->pool;
+    for (;;) {
+        Job *job = FindJob(worker);
+        if (!job) {
+            PlatformLockEnter(pool->lock);
+            while (!(job = FindJob(worker)) && !PlatformRefLoad(&pool->stopping)) {
+                pool->sleepers++;
+                PlatformConditionWait(pool->wake, pool->lock);
+                pool->sleepers--;
+            }
+            PlatformLockLeave(pool->lock);
+            if (!job) return;   // stopping with nothing queued
+        }
+        RunJob(worker, job);
+    }
+}
+
+static void FreePool(JobPool *pool) {
+    for (unsigned i = 0; i < pool->workerCount; i++) {
+        JobWorker *worker = &pool->workers[i];
+        for (int priority = 0; priority < JOB_PRIORITY_COUNT; priority++) free(worker->deques[priority].items);
+        PlatformLockDestroy(worker->lock);
+    }
+    PlatformLockDestroy(pool->queueLock);
+    PlatformLockDestroy(pool->lock);
+    PlatformLockDestroy(pool->doneLock);
+    PlatformConditionDestroy(pool->wake);
+    PlatformConditionDestroy(pool->idle);
+    free(pool);
+}
+
+JobPool *JobPoolCreate(unsigned threads, void (*notify)(void *context), void *context) {
+    if (!threads) threads = PlatformCpuCount();
+    if (threads < 1) threads = 1;
+    if (threads > JOB_MAX_WORKERS) threads = JOB_MAX_WORKERS;
+
+    JobPool *pool = (JobPool *)calloc(1, sizeof(JobPool));
+    if (!pool) return NULL;
+    pool->notify = notify;
+    pool->notifyContext = context;
+    pool->queueLock = PlatformLockCreate();
+    pool->lock = PlatformLockCreate();
+    pool->doneLock = PlatformLockCreate();
+    pool->wake = PlatformConditionCreate();
+    pool->idle = PlatformConditionCreate();
+    bool ok = pool->queueLock && pool->lock && pool->doneLock && pool->wake && pool->idle;
+    // Every worker exists before any thread starts, since thieves scan all of them
+    for (unsigned i = 0; ok && i < threads; i++) {
+        JobWorker *worker = &pool->workers[i];
+        worker->pool = pool;
+        worker->index = i;
+        worker->seed = 2463534242u + i * 2654435761u;
+        worker->lock = PlatformLockCreate();
+        pool->workerCount = i + 1;
+        ok = worker->lock != NULL;
+    }
+    if (!ok) {
+        FreePool(pool);
+        return NULL;
+    }
+    // A worker that fails to start never receives jobs of its own, so the rest carry on
+    for (unsigned i = 0; i < threads; i++) {
+        pool->workers[i].thread = PlatformThreadStart(WorkerMain, &pool->workers[i]);
+        if (pool->workers[i].thread) pool->started++;
+    }
+    if (!pool->started) {
+        FreePool(pool);
+        return NULL;
+    }
+    return pool;
+}
+
+void JobPoolDestroy(JobPool *pool) {
+    if (!pool) return;
+    PlatformLockEnter(pool->lock);
+    PlatformRefIncrement(&pool->stopping);
+    PlatformConditionWakeAll(pool->wake);
+    PlatformLockLeave(pool->lock);
+    // Workers keep taking queued jobs, skipping them, until every queue is empty
+    for (unsigned i = 0; i < pool->workerCount; i++) {
+        if (pool->workers[i].thread) PlatformThreadJoin(pool->workers[i].thread);
+    }
+    JobPoolDrain(pool);
+    FreePool(pool);
+}
+
+bool JobSubmit(JobPool *pool, JobPriority priority, JobToken *token, JobRun run, JobDone done, void *arg) {
+    if (!pool || !run || (unsigned)priority >= JOB_PRIORITY_COUNT) return false;
+    Job *job = NewJob(priority, token, run, done, arg);
+    if (!job) return false;
+    PlatformRefIncrement(&pool->outstanding);
+    PlatformLockEnter(pool->queueLock);
+    QueuePush(&pool->queues[priority], job);
+    pool->submitted[priority]++;
+    PlatformLockLeave(pool->queueLock);
+    WakeWorker(pool);
+    return true;
+}
+
+bool JobSpawn(JobContext *context, JobPriority priority, JobRun run, JobDone done, void *arg) {
+    if (!context || !run || (unsigned)priority >= JOB_PRIORITY_COUNT) return false;
+    JobWorker *worker = context->worker;
+    Job *job = NewJob(priority, context->job->token, run, done, arg);
+    if (!job) return false;
+    // Counted before it's visible, so the parent's own count can't reach zero first
+    PlatformRefIncrement(&worker->pool->outstanding);
+    PlatformLockEnter(worker->lock);
+    bool pushed = DequePushBack(&worker->deques[priority], job);
+    if (pushed) worker->counters.submitted[priority]++;
+    PlatformLockLeave(worker->lock);
+    if (!pushed) {
+        PlatformRefDecrement(&worker->pool->outstanding);
+        FreeJob(job);
+        return false;
+    }
+    WakeWorker(worker->pool);
+    return true;
+}
+
+bool JobCancelled(JobContext *context) {
+    return PlatformRefLoad(&context->worker->pool->stopping) || JobTokenCancelled(context->job->token);
+}
+
+unsigned JobWorkerIndex(const JobContext *context) {
+    return context->worker->index;
+}
+
+size_t JobPoolDrain(JobPool *pool) {
+    if (!pool) return 0;
+    PlatformLockEnter(pool->doneLock);
+    Job *job = pool->done.first;
+    pool->done.first = pool->done.last = NULL;
+    pool->notified = false;
+    PlatformLockLeave(pool->doneLock);
+
+    size_t count = 0;
+    while (job) {
+        Job *next = job->next;
+        job->done(&job->result, job->arg);
+        FreeJob(job);
+        job = next;
+        count++;
+    }
+    return count;
+}
+
+void JobPoolWait(JobPool *pool) {
+    if (!pool) return;
+    PlatformLockEnter(pool->lock);
+    while (PlatformRefLoad(&pool->outstanding) != 0) PlatformConditionWait(pool->idle, pool->lock);
+    PlatformLockLeave(pool->lock);
+}
+
+void JobPoolGetStats(JobPool *pool, JobPoolStats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    if (!pool) return;
+    stats->workers = pool->started;
+    PlatformLockEnter(pool->queueLock);
+    for (int priority = 0; priority < JOB_PRIORITY_COUNT; priority++) stats->submitted[priority] = pool->submitted[priority];
+    PlatformLockLeave(pool->queueLock);
+    for (unsigned i = 0; i < pool->workerCount; i++) {
+        JobWorker *worker = &pool->workers[i];
+        PlatformLockEnter(worker->lock);
+        const JobCounters *counters = &worker->counters;
+        for (int priority = 0; priority < JOB_PRIORITY_COUNT; priority++) {
+            stats->submitted[priority] += counters->submitted[priority];
+            stats->completed[priority] += counters->completed[priority];
+            stats->skipped[priority] += counters->skipped[priority];
+            stats->waitNanos[priority] += counters->waitNanos[priority];
+            stats->runNanos[priority] += counters->runNanos[priority];
+            if (counters->maxWaitNanos[priority] > stats->maxWaitNanos[priority]) {
+                stats->maxWaitNanos[priority] = counters->maxWaitNanos[priority];
+            }
+        }
+        stats->steals += counters->steals;
+        PlatformLockLeave(worker->lock);
+    }
+}
@@ -0,0 +1,82 @@
+// Background jobs for retropad: a pool with one worker per processor, each owning a
+// deque per priority that it runs newest first and that idle workers steal from
+// oldest first. Jobs submitted from outside the pool wait in a shared queue per
+// priority, and every worker takes interactive work before bulk work. Cancellation is
+// cooperative: a running job polls its token, and a job whose token is cancelled
+// before it starts doesn't run at all. Completions are handed back to the thread that
+// owns the pool (the UI thread): `notify` fires when the completion queue stops being
+// empty, and that thread calls JobPoolDrain to run them.
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define JOB_MAX_WORKERS 64
+
+typedef enum JobPriority {
+    JOB_INTERACTIVE,        // someone is waiting on the result
+    JOB_BULK,               // runs when no interactive job is queued anywhere
+    JOB_PRIORITY_COUNT
+} JobPriority;
+
+typedef struct JobPool JobPool;
+typedef struct JobToken JobToken;
+typedef struct JobContext JobContext;
+
+// What a completion learns about its job
+typedef struct JobResult {
+    bool ran;               // false when cancelled before it started
+    bool cancelled;         // token cancelled (or pool destroyed) by the time it finished
+    JobPriority priority;
+    unsigned worker;        // index of the worker that took it
+    uint64_t waitNanos;     // submitted to started
+    uint64_t runNanos;      // 0 when it didn't run
+} JobResult;
+
+typedef void (*JobRun)(JobContext *context, void *arg);
+typedef void (*JobDone)(const JobResult *result, void *arg);
+
+typedef struct JobPoolStats {
+    unsigned workers;
+    uint64_t submitted[JOB_PRIORITY_COUNT];
+    uint64_t completed[JOB_PRIORITY_COUNT];     // ran to the end
+    uint64_t skipped[JOB_PRIORITY_COUNT];       // cancelled before they started
+    uint64_t waitNanos[JOB_PRIORITY_COUNT];     // sums over completed and skipped jobs
+    uint64_t maxWaitNanos[JOB_PRIORITY_COUNT];
+    uint64_t runNanos[JOB_PRIORITY_COUNT];
+    uint64_t steals;
+} JobPoolStats;
+
+// Cancellation token shared by the submitter and any number of jobs. Create returns a
+// token holding one reference; each job submitted with it holds another until its
+// completion has run. Cancel and Cancelled may be called from any thread.
+JobToken *JobTokenCreate(void);
+void JobTokenCancel(JobToken *token);
+bool JobTokenCancelled(JobToken *token);    // false for NULL
+void JobTokenRelease(JobToken *token);
+
+// `threads` 0 means one per processor (at most JOB_MAX_WORKERS). `notify` (optional)
+// runs on a worker thread, so it should only wake the owner, e.g. with PostMessage.
+// Returns NULL when no worker could be started.
+JobPool *JobPoolCreate(unsigned threads, void (*notify)(void *context), void *context);
+// Jobs that haven't started are skipped, running ones are waited for, and every
+// pending completion runs on the calling thread before the pool is freed.
+void JobPoolDestroy(JobPool *pool);
+
+// Queues `run` (required) and `done` (optional, runs on the owner's thread in
+// JobPoolDrain) from any thread. `token` may be NULL. False when out of memory.
+bool JobSubmit(JobPool *pool, JobPriority priority, JobToken *token, JobRun run, JobDone done, void *arg);
+// From inside a running job: queues a child on this worker's own deque, sharing the
+// parent's token, where idle workers can steal it
+bool JobSpawn(JobContext *context, JobPriority priority, JobRun run, JobDone done, void *arg);
+// Whether the running job should stop early
+bool JobCancelled(JobContext *context);
+unsigned JobWorkerIndex(const JobContext *context);
+
+// Runs the completions queued so far on the calling thread; returns how many ran
+size_t JobPoolDrain(JobPool *pool);
+// Blocks until every submitted job (and its children) has finished; completions still
+// need a JobPoolDrain afterwards
+void JobPoolWait(JobPool *pool);
+void JobPoolGetStats(JobPool *pool, JobPoolStats *stats);
@@ -0,0 +1,510 @@
+// Line slicing, parallel merge sort and hash dedupe for retropad.
+#include "lineops.h"
+#include "platform.h"
+#include "textstats.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define LINES_MIN_PER_THREAD 65536  // lines per worker, at least
+#define LINES_INSERTION_RUN 16      // runs insertion-sorted before merging starts
+#define LINES_KEY_UNITS 8
+
+typedef struct LineSlice {
+    // Units [keyFrom, keyFrom + 8) of the line packed so that comparing the integers
+    // orders the units, zero-padded. Most comparisons end here without touching the
+    // text, which is where a sort over a large file spends its time in cache misses.
+    uint64_t key[2];
+    uint32_t start;
+    uint32_t length;    // without the line break
+} LineSlice;
+
+typedef struct LineOrder {
+    const TextChar *text;
+    TextLineOp op;
+    size_t keyFrom;     // prefix every line shares (a log's date, say), so not in the keys
+} LineOrder;
+
+// The number a line starts with, after blanks: sign, integer digits without leading
+// zeros and fraction digits without trailing zeros, compared digit by digit so no
+// length of number overflows
+typedef struct LineNumber {
+    bool present;
+    bool negative;
+    const TextChar *digits;
+    size_t intDigits;
+    const TextChar *fraction;
+    size_t fracDigits;
+} LineNumber;
+
+// Runs fn over `count` jobs of `stride` bytes, the first on the calling thread, and
+// any a thread couldn't be started for too
+static void RunJobs(void (*fn)(void *), void *jobs, size_t stride, size_t count) {
+    PlatformThread *threads[TEXT_LINES_MAX_THREADS];
+    for (size_t i = 1; i < count; ++i) threads[i] = PlatformThreadStart(fn, (uint8_t *)jobs + i * stride);
+    if (count > 0) fn(jobs);
+    for (size_t i = 1; i < count; ++i) {
+        if (threads[i]) PlatformThreadJoin(threads[i]);
+        else fn((uint8_t *)jobs + i * stride);
+    }
+}
+
+static bool IsDigit(TextChar c) {
+    return c >= '0' && c <= '9';
+}
+
+static void ParseNumber(const TextChar *p, size_t n, LineNumber *num) {
+    memset(num, 0, sizeof(*num));
+    size_t i = 0;
+    while (i < n && (p[i] == ' ' || p[i] == '\t')) ++i;
+    if (i < n && (p[i] == '-' || p[i] == '+')) num->negative = p[i++] == '-';
+    size_t first = i;
+    while (i < n && p[i] == '0') ++i;
+    num->digits = p + i;
+    while (i < n && IsDigit(p[i])) ++i;
+    num->intDigits = (size_t)(p + i - num->digits);
+    num->present = i > first;
+    if (i + 1 < n && p[i] == '.' && IsDigit(p[i + 1])) {
+        num->fraction = p + ++i;
+        while (i < n && IsDigit(p[i])) ++i;
+        num->fracDigits = (size_t)(p + i - num->fraction);
+        while (num->fracDigits > 0 && num->fraction[num->fracDigits - 1] == '0') --num->fracDigits;
+        num->present = true;
+    }
+    if (num->intDigits == 0 && num->fracDigits == 0) num->negative = false;   // -0 is 0
+}
+
+static int CompareNumbers(const LineNumber *a, const LineNumber *b) {
+    if (a->present != b->present) return a->present ? 1 : -1;
+    if (a->negative != b->negative) return a->negative ? -1 : 1;
+    int order = 0;
+    if (a->intDigits != b->intDigits) {
+        order = a->intDigits < b->intDigits ? -1 : 1;
+    } else {
+        for (size_t i = 0; i < a->intDigits && !order; ++i) {
+            if (a->digits[i] != b->digits[i]) order = a->digits[i] < b->digits[i] ? -1 : 1;
+        }
+        size_t n = a->fracDigits > b->fracDigits ? a->fracDigits : b->fracDigits;
+        for (size_t i = 0; i < n && !order; ++i) {
+            TextChar x = i < a->fracDigits ? a->fraction[i] : '0';
+            TextChar y = i < b->fracDigits ? b->fraction[i] : '0';
+            if (x != y) order = x < y ? -1 : 1;
+        }
+    }
+    return a->negative ? -order : order;
+}
+
+// Length of the common prefix, 4 units at a time
+static size_t CommonPrefix(const TextChar *a, const TextChar *b, size_t n) {
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        uint64_t x, y;
+        memcpy(&x, a + i, sizeof(x));
+        memcpy(&y, b + i, sizeof(y));
+        if (x != y) break;
+    }
+    while (i < n && a[i] == b[i]) ++i;
+    return i;
+}
+
+static int CompareLines(const LineOrder *order, LineSlice a, LineSlice b) {
+    if (a.key[0] != b.key[0]) return a.key[0] < b.key[0] ? -1 : 1;
+    if (a.key[1] != b.key[1]) return a.key[1] < b.key[1] ? -1 : 1;
+    const TextChar *x = order->text + a.start;
+    const TextChar *y = order->text + b.start;
+    if (order->op == TEXT_LINES_SORT_NUMERIC) {
+        LineNumber nx, ny;
+        ParseNumber(x, a.length, &nx);
+        ParseNumber(y, b.length, &ny);
+        int c = CompareNumbers(&nx, &ny);
+        if (c) return c;
+    }
+    size_t n = a.length < b.length ? a.length : b.length;
+    size_t i = CommonPrefix(x + order->keyFrom, y + order->keyFrom, n - order->keyFrom) + order->keyFrom;
+    if (order->op == TEXT_LINES_SORT_NOCASE) {
+        for (; i < n; ++i) {
+            TextChar p = TextLowerChar(x[i]);
+            TextChar q = TextLowerChar(y[i]);
+            if (p != q) return p < q ? -1 : 1;
+        }
+    } else if (i < n) {
+        return x[i] < y[i] ? -1 : 1;
+    }
+    return a.length < b.length ? -1 : a.length > b.length;
+}
+
+// Stable merge of a[0..na) and b[0..nb) into out; ties take from a
+static void MergeSlices(const LineOrder *order, const LineSlice *a, size_t na, const LineSlice *b, size_t nb,
+                        LineSlice *out) {
+    size_t i = 0, j = 0;
+    while (i < na && j < nb) *out++ = CompareLines(order, b[j], a[i]) < 0 ? b[j++] : a[i++];
+    memcpy(out, a + i, (na - i) * sizeof(LineSlice));
+    memcpy(out + (na - i), b + j, (nb - j) * sizeof(LineSlice));
+}
+
+// Stable sort of s[0..n) with tmp[0..n) as the other half of each merge pass
+static void SortSlices(const LineOrder *order, LineSlice *s, LineSlice *tmp, size_t n) {
+    for (size_t lo = 0; lo < n; lo += LINES_INSERTION_RUN) {
+        size_t hi = n - lo < LINES_INSERTION_RUN ? n : lo + LINES_INSERTION_RUN;
+        for (size_t i = lo + 1; i < hi; ++i) {
+            LineSlice v = s[i];
+            size_t j = i;
+            for (; j > lo && CompareLines(order, v, s[j - 1]) < 0; --j) s[j] = s[j - 1];
+            s[j] = v;
+        }
+    }
+    LineSlice *from = s;
+    LineSlice *to = tmp;
+    for (size_t width = LINES_INSERTION_RUN; width < n; width *= 2) {
+        for (size_t lo = 0; lo < n; lo += 2 * width) {
+            size_t mid = n - lo < width ? n : lo + width;
+            size_t hi = n - lo < 2 * width ? n : lo + 2 * width;
+            MergeSlices(order, from + lo, mid - lo, from + mid, hi - mid, to + lo);
+        }
+        LineSlice *swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from != s) memcpy(s, from, n * sizeof(LineSlice));
+}
+
+// How many of the first k slices of the merge of a and b come from a
+static size_t CoRank(const LineOrder *order, const LineSlice *a, size_t na, const LineSlice *b, size_t nb, size_t k) {
+    size_t lo = k > nb ? k - nb : 0;
+    size_t hi = k < na ? k : na;
+    while (lo < hi) {
+        size_t i = lo + (hi - lo) / 2;
+        // a[i] goes before b[k - i - 1] (ties go to a), so it is among the first k
+        if (CompareLines(order, a[i], b[k - i - 1]) <= 0) lo = i + 1;
+        else hi = i;
+    }
+    return lo;
+}
+
+typedef struct KeyJob {
+    const LineOrder *order;
+    LineSlice *lines;
+    size_t from;
+    size_t to;
+} KeyJob;
+
+static void KeyJobMain(void *param) {
+    KeyJob *job = (KeyJob *)param;
+    const LineOrder *order = job->order;
+    bool fold = order->op == TEXT_LINES_SORT_NOCASE;
+    for (size_t i = job->from; i < job->to; ++i) {
+        LineSlice *line = &job->lines[i];
+        const TextChar *p = order->text + line->start + order->keyFrom;
+        size_t n = line->length - order->keyFrom;
+        uint64_t key[2] = {0, 0};
+        for (size_t k = 0; k < LINES_KEY_UNITS && k < n; ++k) {
+            uint64_t unit = fold ? TextLowerChar(p[k]) : p[k];
+            key[k / 4] |= unit << (48 - 16 * (k % 4));
+        }
+        line->key[0] = key[0];
+        line->key[1] = key[1];
+    }
+}
+
+// Units every line starts with; the keys begin after them
+static size_t SharedPrefix(const TextChar *text, const LineSlice *lines, size_t count) {
+    size_t shared = count ? lines[0].length : 0;
+    for (size_t i = 1; i < count && shared; ++i) {
+        size_t n = lines[i].length < shared ? lines[i].length : shared;
+        shared = CommonPrefix(text + lines[0].start, text + lines[i].start, n);
+    }
+    return shared;
+}
+
+typedef struct SortJob {
+    const LineOrder *order;
+    LineSlice *lines;
+    LineSlice *tmp;
+    size_t count;
+} SortJob;
+
+static void SortJobMain(void *param) {
+    SortJob *job = (SortJob *)param;
+    SortSlices(job->order, job->lines, job->tmp, job->count);
+}
+
+// Output ranks [kFrom, kTo) of one pairwise merge
+typedef struct MergeJob {
+    const LineOrder *order;
+    const LineSlice *a;
+    size_t na;
+    const LineSlice *b;
+    size_t nb;
+    LineSlice *out;
+    size_t kFrom;
+    size_t kTo;
+} MergeJob;
+
+static void MergeJobMain(void *param) {
+    MergeJob *job = (MergeJob *)param;
+    size_t i0 = CoRank(job->order, job->a, job->na, job->b, job->nb, job->kFrom);
+    size_t i1 = CoRank(job->order, job->a, job->na, job->b, job->nb, job->kTo);
+    size_t j0 = job->kFrom - i0;
+    size_t j1 = job->kTo - i1;
+    MergeSlices(job->order, job->a + i0, i1 - i0, job->b + j0, j1 - j0, job->out + job->kFrom);
+}
+
+// Each worker sorts a block, then runs are merged pairwise, every merge split
+// between the workers its pair gets, until one run is left
+static bool ParallelSort(const LineOrder *order, LineSlice *lines, size_t count, unsigned threads) {
+    LineSlice *tmp = (LineSlice *)malloc((count ? count : 1) * sizeof(LineSlice));
+    if (!tmp) return false;
+    size_t bounds[TEXT_LINES_MAX_THREADS + 1];
+    KeyJob keys[TEXT_LINES_MAX_THREADS];
+    SortJob sorts[TEXT_LINES_MAX_THREADS];
+    size_t runs = threads;
+    for (size_t r = 0; r <= runs; ++r) bounds[r] = count / runs * r + (count % runs) * r / runs;
+    if (order->op != TEXT_LINES_SORT_NUMERIC) {
+        for (size_t r = 0; r < runs; ++r) {
+            keys[r].order = order;
+            keys[r].lines = lines;
+            keys[r].from = bounds[r];
+            keys[r].to = bounds[r + 1];
+        }
+        RunJobs(KeyJobMain, keys, sizeof(KeyJob), runs);
+    }
+    for (size_t r = 0; r < runs; ++r) {
+        sorts[r].order = order;
+        sorts[r].lines = lines + bounds[r];
+        sorts[r].tmp = tmp + bounds[r];
+        sorts[r].count = bounds[r + 1] - bounds[r];
+    }
+    RunJobs(SortJobMain, sorts, sizeof(SortJob), runs);
+
+    LineSlice *from = lines;
+    LineSlice *to = tmp;
+    while (runs > 1) {
+        MergeJob merges[TEXT_LINES_MAX_THREADS];
+        size_t jobs = 0;
+        size_t pairs = runs / 2;
+        size_t per = threads / pairs;
+        for (size_t p = 0; p < pairs; ++p) {
+            size_t lo = bounds[2 * p], mid = bounds[2 * p + 1], hi = bounds[2 * p + 2];
+            for (size_t q = 0; q < per; ++q) {
+                MergeJob *job = &merges[jobs++];
+                job->order = order;
+                job->a = from + lo;
+                job->na = mid - lo;
+                job->b = from + mid;
+                job->nb = hi - mid;
+                job->out = to + lo;
+                job->kFrom = (hi - lo) * q / per;
+                job->kTo = (hi - lo) * (q + 1) / per;
+            }
+        }
+        if (runs % 2) memcpy(to + bounds[runs - 1], from + bounds[runs - 1], (count - bounds[runs - 1]) * sizeof(LineSlice));
+        RunJobs(MergeJobMain, merges, sizeof(MergeJob), jobs);
+        for (size_t r = 0; r <= (runs + 1) / 2; ++r) bounds[r] = bounds[2 * r < runs ? 2 * r : runs];
+        runs = (runs + 1) / 2;
+        LineSlice *swap = from;
+        from = to;
+        to = swap;
+    }
+    if (from != lines) memcpy(lines, from, count * sizeof(LineSlice));
+    free(tmp);
+    return true;
+}
+
+static uint32_t HashLine(const TextChar *p, size_t n) {
+    uint64_t h = 0x9E3779B97F4A7C15ull ^ n;
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4) {
+        uint64_t v;
+        memcpy(&v, p + i, sizeof(v));
+        h = (h ^ v) * 0xFF51AFD7ED558CCDull;
+        h ^= h >> 32;
+    }
+    for (; i < n; ++i) h = (h ^ p[i]) * 0xFF51AFD7ED558CCDull;
+    h ^= h >> 29;
+    return (uint32_t)h;
+}
+
+typedef struct HashJob {
+    const TextChar *text;
+    const LineSlice *lines;
+    uint32_t *hashes;
+    size_t from;
+    size_t to;
+} HashJob;
+
+static void HashJobMain(void *param) {
+    HashJob *job = (HashJob *)param;
+    for (size_t i = job->from; i < job->to; ++i) {
+        job->hashes[i] = HashLine(job->text + job->lines[i].start, job->lines[i].length);
+    }
+}
+
+// Keeps the first of each set of equal lines, in order. Lines are hashed in
+// parallel, then kept lines go into an open-addressing table of their indices.
+// Returns the lines kept, or TEXT_ERROR when out of memory.
+static size_t DedupeLines(const TextChar *text, LineSlice *lines, size_t count, unsigned threads) {
+    size_t slots = 16;
+    while (slots < 2 * count) slots *= 2;
+    uint32_t *hashes = (uint32_t *)malloc((count ? count : 1) * sizeof(uint32_t));
+    uint32_t *table = (uint32_t *)calloc(slots, sizeof(uint32_t));   // kept index + 1, 0 = empty
+    if (!hashes || !table) {
+        free(hashes);
+        free(table);
+        return TEXT_ERROR;
+    }
+    HashJob jobs[TEXT_LINES_MAX_THREADS];
+    for (unsigned t = 0; t < threads; ++t) {
+        jobs[t].text = text;
+        jobs[t].lines = lines;
+        jobs[t].hashes = hashes;
+        jobs[t].from = count * t / threads;
+        jobs[t].to = count * (t + 1) / threads;
+    }
+    RunJobs(HashJobMain, jobs, sizeof(HashJob), threads);
+
+    size_t kept = 0;
+    for (size_t i = 0; i < count; ++i) {
+        uint32_t h = hashes[i];
+        LineSlice line = lines[i];
+        size_t slot = h & (slots - 1);
+        bool repeat = false;
+        for (; table[slot] && !repeat; slot = (slot + 1) & (slots - 1)) {
+            size_t k = table[slot] - 1;
+            repeat = hashes[k] == h && lines[k].length == line.length &&
+                     memcmp(text + lines[k].start, text + line.start, line.length * sizeof(TextChar)) == 0;
+        }
+        if (repeat) continue;
+        // Kept lines move down in place; their hashes move with them
+        table[slot] = (uint32_t)(kept + 1);
+        hashes[kept] = h;
+        lines[kept++] = line;
+    }
+    free(hashes);
+    free(table);
+    return kept;
+}
+
+typedef struct WriteJob {
+    const TextChar *text;
+    const LineSlice *lines;
+    size_t from;
+    size_t to;
+    size_t breaks;      // lines followed by CRLF: every one but a last line without a break
+    TextChar *dst;
+} WriteJob;
+
+static void WriteJobMain(void *param) {
+    WriteJob *job = (WriteJob *)param;
+    TextChar *out = job->dst;
+    for (size_t i = job->from; i < job->to; ++i) {
+        memcpy(out, job->text + job->lines[i].start, job->lines[i].length * sizeof(TextChar));
+        out += job->lines[i].length;
+        if (i < job->breaks) {
+            *out++ = '\r';
+            *out++ = '\n';
+        }
+    }
+}
+
+// The only copy of the line text: workers write blocks of lines at offsets summed up front
+static size_t WriteLines(const TextChar *text, const LineSlice *lines, size_t count, bool trailing, unsigned threads,
+                         TextChar *dst) {
+    size_t breaks = trailing ? count : count ? count - 1 : 0;
+    WriteJob jobs[TEXT_LINES_MAX_THREADS];
+    size_t pos = 0;
+    for (unsigned t = 0; t < threads; ++t) {
+        WriteJob *job = &jobs[t];
+        job->text = text;
+        job->lines = lines;
+        job->from = count * t / threads;
+        job->to = count * (t + 1) / threads;
+        job->breaks = breaks;
+        job->dst = dst + pos;
+        for (size_t i = job->from; i < job->to; ++i) pos += lines[i].length + (i < breaks ? 2 : 0);
+    }
+    RunJobs(WriteJobMain, jobs, sizeof(WriteJob), threads);
+    return pos;
+}
+
+// One slice per line; a break at the very end doesn't start another line
+static LineSlice *SplitLines(const TextChar *text, size_t length, size_t *countOut, bool *trailingOut) {
+    size_t breaks = 0;
+    for (size_t i = 0; i < length; ++i) breaks += text[i] == '\n';
+    bool trailing = length > 0 && text[length - 1] == '\n';
+    size_t count = length == 0 ? 0 : trailing ? breaks : breaks + 1;
+    LineSlice *lines = (LineSlice *)malloc((count ? count : 1) * sizeof(LineSlice));
+    if (!lines) return NULL;
+    size_t start = 0;
+    size_t n = 0;
+    for (size_t i = 0; i <= length && n < count; ++i) {
+        if (i < length && text[i] != '\n') continue;
+        size_t end = i > start && text[i - 1] == '\r' && i < length ? i - 1 : i;
+        lines[n].key[0] = 0;
+        lines[n].key[1] = 0;
+        lines[n].start = (uint32_t)start;
+        lines[n].length = (uint32_t)(end - start);
+        n++;
+        start = i + 1;
+    }
+    *countOut = count;
+    *trailingOut = trailing;
+    return lines;
+}
+
+static unsigned PickThreads(size_t lines, unsigned threads) {
+    if (threads == 0) {
+        size_t useful = lines / LINES_MIN_PER_THREAD;
+        threads = PlatformCpuCount();
+        if (threads > useful) threads = useful ? (unsigned)useful : 1;
+    }
+    if (threads > TEXT_LINES_MAX_THREADS) threads = TEXT_LINES_MAX_THREADS;
+    if (threads > lines) threads = lines ? (unsigned)lines : 1;
+    return threads;
+}
+
+TextChar *TextLinesApply(const TextChar *text, size_t length, TextLineOp op, unsigned threads, size_t *lengthOut) {
+    if (length >= UINT32_MAX) return NULL;
+    size_t count = 0;
+    bool trailing = false;
+    LineSlice *lines = SplitLines(text, length, &count, &trailing);
+    if (!lines) return NULL;
+    threads = PickThreads(count, threads);
+
+    LineOrder order = {text, op, 0};
+    bool ok = true;
+    switch (op) {
+    case TEXT_LINES_SORT:
+    case TEXT_LINES_SORT_NOCASE:
+        order.keyFrom = SharedPrefix(text, lines, count);
+        ok = ParallelSort(&order, lines, count, threads);
+        break;
+    case TEXT_LINES_SORT_NUMERIC:
+        ok = ParallelSort(&order, lines, count, threads);
+        break;
+    case TEXT_LINES_DEDUPE:
+        count = DedupeLines(text, lines, count, threads);
+        ok = count != TEXT_ERROR;
+        break;
+    case TEXT_LINES_TRIM:
+        for (size_t i = 0; i < count; ++i) {
+            while (lines[i].length > 0 && TextIsSpace(text[lines[i].start + lines[i].length - 1])) lines[i].length--;
+        }
+        break;
+    case TEXT_LINES_REVERSE:
+        for (size_t i = 0; i < count / 2; ++i) {
+            LineSlice swap = lines[i];
+            lines[i] = lines[count - 1 - i];
+            lines[count - 1 - i] = swap;
+        }
+        break;
+    }
+
+    // Each break becomes CRLF, which is at most one unit more than it was
+    TextChar *result = ok ? (TextChar *)malloc((length + count + 1) * sizeof(TextChar)) : NULL;
+    if (result) {
+        size_t n = WriteLines(text, lines, count, trailing, threads, result);
+        result[n] = 0;
+        *lengthOut = n;
+    }
+    free(lines);
+    return result;
+}
@@ -0,0 +1,26 @@
+// Whole-line operations for retropad: sort, remove duplicates, trim trailing white
+// space and reverse. Lines are handled as (offset, length) slices of the input, so
+// no line text is copied until the result is written. Sorting is a stable merge
+// sort over slices: workers sort blocks of lines, then merge the runs pairwise with
+// each merge split between workers. Unlike textcore.c this allocates (malloc).
+#pragma once
+
+#include "textcore.h"
+
+#define TEXT_LINES_MAX_THREADS 64
+
+typedef enum TextLineOp {
+    TEXT_LINES_SORT = 0,        // by code unit
+    TEXT_LINES_SORT_NOCASE,     // by TextLowerChar
+    TEXT_LINES_SORT_NUMERIC,    // by the number the line starts with; lines without one first
+    TEXT_LINES_DEDUPE,          // drop exact repeats, keeping each line's first occurrence
+    TEXT_LINES_TRIM,            // drop white space at the end of each line
+    TEXT_LINES_REVERSE
+} TextLineOp;
+
+// Applies `op` to the lines of text[0..length) (split at LF, a CR before it dropped)
+// and joins them again with CRLF; a line break at the very end stays at the end.
+// Equal lines keep their order. `threads` 0 picks one per processor once there are
+// enough lines to pay for it. Returns a malloc'd, NUL-terminated result of
+// *lengthOut units, or NULL when out of memory or the text has 4G units or more.
+TextChar *TextLinesApply(const TextChar *text, size_t length, TextLineOp op, unsigned threads, size_t *lengthOut);
@@ -0,0 +1,142 @@
+// LZ77 block codec for retropad. Each sequence is a token byte (literal count in the
+// high nibble, match length - 4 in the low nibble; 15 means more length bytes follow),
+// the literals, then a 2-byte little-endian offset and any extra match length bytes.
+// The last sequence carries literals only.
+#include "lz.h"
+#include <string.h>
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 12
+
+static uint32_t Read32(const uint8_t *p) {
+    uint32_t v;
+    memcpy(&v, p, sizeof(v));
+    return v;
+}
+
+static uint32_t HashSequence(uint32_t v) {
+    return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// Extra length bytes for a nibble that saturated at 15
+static uint8_t *PutLength(uint8_t *op, const uint8_t *oend, size_t n) {
+    for (; n >= 255; n -= 255) {
+        if (op >= oend) return NULL;
+        *op++ = 255;
+    }
+    if (op >= oend) return NULL;
+    *op++ = (uint8_t)n;
+    return op;
+}
+
+// One sequence; matchLength 0 ends the block with literals only
+static uint8_t *PutSequence(uint8_t *op, const uint8_t *oend, const uint8_t *literals, size_t literalLength,
+                            size_t offset, size_t matchLength) {
+    if (op >= oend) return NULL;
+    size_t extra = matchLength ? matchLength - LZ_MIN_MATCH : 0;
+    uint8_t *token = op++;
+    *token = (uint8_t)(((literalLength < 15 ? literalLength : 15) << 4) | (extra < 15 ? extra : 15));
+    if (literalLength >= 15 && !(op = PutLength(op, oend, literalLength - 15))) return NULL;
+    if (literalLength > (size_t)(oend - op)) return NULL;
+    memcpy(op, literals, literalLength);
+    op += literalLength;
+    if (matchLength == 0) return op;
+
+    if (oend - op < 2) return NULL;
+    *op++ = (uint8_t)offset;
+    *op++ = (uint8_t)(offset >> 8);
+    if (extra >= 15 && !(op = PutLength(op, oend, extra - 15))) return NULL;
+    return op;
+}
+
+static int GetLength(const uint8_t **ip, const uint8_t *iend, size_t *n) {
+    uint8_t b;
+    do {
+        if (*ip >= iend) return 0;
+        b = *(*ip)++;
+        *n += b;
+    } while (b == 255);
+    return 1;
+}
+
+size_t LzCompressBound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+size_t LzCompress(const uint8_t *src, size_t size, uint8_t *dst, size_t capacity) {
+    uint32_t table[1 << LZ_HASH_BITS];
+    memset(table, 0, sizeof(table));
+
+    const uint8_t *ip = src;
+    const uint8_t *anchor = src;
+    const uint8_t *end = src + size;
+    const uint8_t *limit = size >= LZ_MIN_MATCH ? end - LZ_MIN_MATCH : src;
+    uint8_t *op = dst;
+    const uint8_t *oend = dst + capacity;
+    size_t misses = 0;
+
+    while (ip < limit) {
+        uint32_t seq = Read32(ip);
+        uint32_t h = HashSequence(seq);
+        const uint8_t *ref = src + table[h];
+        table[h] = (uint32_t)(ip - src);
+        if (ref >= ip || ip - ref > LZ_MAX_OFFSET || Read32(ref) != seq) {
+            // Step faster through data that keeps missing
+            ip += 1 + (misses++ >> 6);
+            continue;
+        }
+        misses = 0;
+
+        const uint8_t *mp = ip + LZ_MIN_MATCH;
+        const uint8_t *rp = ref + LZ_MIN_MATCH;
+        while (mp < end && *mp == *rp) {
+            ++mp;
+            ++rp;
+        }
+        op = PutSequence(op, oend, anchor, (size_t)(ip - anchor), (size_t)(ip - ref), (size_t)(mp - ip));
+        if (!op) return 0;
+        ip = mp;
+        anchor = ip;
+    }
+
+    op = PutSequence(op, oend, anchor, (size_t)(end - anchor), 0, 0);
+    return op ? (size_t)(op - dst) : 0;
+}
+
+size_t LzDecompress(const uint8_t *src, size_t size, uint8_t *dst, size_t capacity) {
+    const uint8_t *ip = src;
+    const uint8_t *iend = src + size;
+    uint8_t *op = dst;
+    uint8_t *oend = dst + capacity;
+
+    while (ip < iend) {
+        unsigned token = *ip++;
+        size_t literals = token >> 4;
+        if (literals == 15 && !GetLength(&ip, iend, &literals)) return LZ_ERROR;
+        if (literals > (size_t)(iend - ip) || literals > (size_t)(oend - op)) return LZ_ERROR;
+        memcpy(op, ip, literals);
+        op += literals;
+        ip += literals;
+        if (ip == iend) break;
+
+        if (iend - ip < 2) return LZ_ERROR;
+        size_t offset = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - dst)) return LZ_ERROR;
+        size_t length = token & 15;
+        if (length == 15 && !GetLength(&ip, iend, &length)) return LZ_ERROR;
+        length += LZ_MIN_MATCH;
+        if (length > (size_t)(oend - op)) return LZ_ERROR;
+
+        const uint8_t *ref = op - offset;
+        if (offset >= length) {
+            memcpy(op, ref, length);
+        } else {
+            // Overlapping match repeats the last `offset` bytes
+            for (size_t i = 0; i < length; ++i) op[i] = ref[i];
+        }
+        op += length;
+    }
+    return (size_t)(op - dst);
+}
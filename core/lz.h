@@ -0,0 +1,18 @@
+// Small LZ77 block codec for retropad (LZ4-style byte format: literal runs and
+// 4+ byte matches within 64KB). Used to keep cold document chunks compressed;
+// speed matters more than ratio. Nothing here allocates.
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define LZ_ERROR ((size_t)-1)
+
+// Worst-case compressed size for `size` input bytes.
+size_t LzCompressBound(size_t size);
+
+// Returns the compressed size, or 0 when the output does not fit in `capacity`.
+size_t LzCompress(const uint8_t *src, size_t size, uint8_t *dst, size_t capacity);
+
+// Returns the decompressed size, or LZ_ERROR for corrupt input or a short `dst`.
+size_t LzDecompress(const uint8_t *src, size_t size, uint8_t *dst, size_t capacity);
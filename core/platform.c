@@ -0,0 +1,259 @@
+// OS layer for the retropad text core: Win32 or POSIX.
+#include "platform.h"
+#include <stdlib.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+
+struct PlatformThread {
+    HANDLE handle;
+    void (*fn)(void *);
+    void *arg;
+};
+
+uint64_t PlatformNowNanos(void) {
+    static LARGE_INTEGER freq = {0};
+    LARGE_INTEGER now;
+    if (freq.QuadPart == 0) QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (uint64_t)((double)now.QuadPart * 1e9 / (double)freq.QuadPart);
+}
+
+uint64_t PlatformAvailableMemory(void) {
+    MEMORYSTATUSEX status;
+    status.dwLength = sizeof(status);
+    return GlobalMemoryStatusEx(&status) ? status.ullAvailPhys : 0;
+}
+
+unsigned PlatformCpuCount(void) {
+    DWORD_PTR process = 0, system = 0;
+    unsigned n = 0;
+    if (GetProcessAffinityMask(GetCurrentProcess(), &process, &system)) {
+        for (; process; process &= process - 1) ++n;
+    }
+    return n ? n : 1;
+}
+
+static DWORD WINAPI ThreadMain(LPVOID param) {
+    PlatformThread *thread = (PlatformThread *)param;
+    thread->fn(thread->arg);
+    return 0;
+}
+
+PlatformThread *PlatformThreadStart(void (*fn)(void *), void *arg) {
+    PlatformThread *thread = (PlatformThread *)malloc(sizeof(PlatformThread));
+    if (!thread) return NULL;
+    thread->fn = fn;
+    thread->arg = arg;
+    thread->handle = CreateThread(NULL, 0, ThreadMain, thread, 0, NULL);
+    if (!thread->handle) {
+        free(thread);
+        return NULL;
+    }
+    return thread;
+}
+
+void PlatformThreadJoin(PlatformThread *thread) {
+    if (!thread) return;
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+    free(thread);
+}
+
+// Interlocked functions are full barriers
+void PlatformRefIncrement(PlatformRefCount *refs) {
+    InterlockedIncrement(refs);
+}
+
+long PlatformRefDecrement(PlatformRefCount *refs) {
+    return InterlockedDecrement(refs);
+}
+
+long PlatformRefLoad(PlatformRefCount *refs) {
+    return InterlockedCompareExchange(refs, 0, 0);
+}
+
+struct PlatformLock {
+    SRWLOCK lock;
+};
+
+struct PlatformCondition {
+    CONDITION_VARIABLE condition;
+};
+
+PlatformLock *PlatformLockCreate(void) {
+    PlatformLock *lock = (PlatformLock *)malloc(sizeof(PlatformLock));
+    if (lock) InitializeSRWLock(&lock->lock);
+    return lock;
+}
+
+void PlatformLockDestroy(PlatformLock *lock) {
+    free(lock);
+}
+
+void PlatformLockEnter(PlatformLock *lock) {
+    AcquireSRWLockExclusive(&lock->lock);
+}
+
+void PlatformLockLeave(PlatformLock *lock) {
+    ReleaseSRWLockExclusive(&lock->lock);
+}
+
+PlatformCondition *PlatformConditionCreate(void) {
+    PlatformCondition *condition = (PlatformCondition *)malloc(sizeof(PlatformCondition));
+    if (condition) InitializeConditionVariable(&condition->condition);
+    return condition;
+}
+
+void PlatformConditionDestroy(PlatformCondition *condition) {
+    free(condition);
+}
+
+void PlatformConditionWait(PlatformCondition *condition, PlatformLock *lock) {
+    SleepConditionVariableSRW(&condition->condition, &lock->lock, INFINITE, 0);
+}
+
+void PlatformConditionWake(PlatformCondition *condition) {
+    WakeConditionVariable(&condition->condition);
+}
+
+void PlatformConditionWakeAll(PlatformCondition *condition) {
+    WakeAllConditionVariable(&condition->condition);
+}
+
+#else
+#include <pthread.h>
+#include <stdio.h>
+#include <time.h>
+#include <unistd.h>
+
+struct PlatformThread {
+    pthread_t id;
+    void (*fn)(void *);
+    void *arg;
+};
+
+uint64_t PlatformNowNanos(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+uint64_t PlatformAvailableMemory(void) {
+    // MemAvailable counts reclaimable page cache, unlike _SC_AVPHYS_PAGES
+    FILE *f = fopen("/proc/meminfo", "r");
+    if (f) {
+        char line[128];
+        unsigned long long kb = 0;
+        while (fgets(line, sizeof(line), f)) {
+            if (sscanf(line, "MemAvailable: %llu kB", &kb) == 1) break;
+        }
+        fclose(f);
+        if (kb) return (uint64_t)kb * 1024;
+    }
+    long pages = sysconf(_SC_AVPHYS_PAGES);
+    long pageSize = sysconf(_SC_PAGESIZE);
+    return (pages > 0 && pageSize > 0) ? (uint64_t)pages * (uint64_t)pageSize : 0;
+}
+
+unsigned PlatformCpuCount(void) {
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return n > 0 ? (unsigned)n : 1;
+}
+
+static void *ThreadMain(void *param) {
+    PlatformThread *thread = (PlatformThread *)param;
+    thread->fn(thread->arg);
+    return NULL;
+}
+
+PlatformThread *PlatformThreadStart(void (*fn)(void *), void *arg) {
+    PlatformThread *thread = (PlatformThread *)malloc(sizeof(PlatformThread));
+    if (!thread) return NULL;
+    thread->fn = fn;
+    thread->arg = arg;
+    if (pthread_create(&thread->id, NULL, ThreadMain, thread) != 0) {
+        free(thread);
+        return NULL;
+    }
+    return thread;
+}
+
+void PlatformThreadJoin(PlatformThread *thread) {
+    if (!thread) return;
+    pthread_join(thread->id, NULL);
+    free(thread);
+}
+
+// Taking a reference needs no ordering: the taker already has one to copy from
+void PlatformRefIncrement(PlatformRefCount *refs) {
+    __atomic_add_fetch(refs, 1, __ATOMIC_RELAXED);
+}
+
+long PlatformRefDecrement(PlatformRefCount *refs) {
+    return __atomic_sub_fetch(refs, 1, __ATOMIC_ACQ_REL);
+}
+
+long PlatformRefLoad(PlatformRefCount *refs) {
+    return __atomic_load_n(refs, __ATOMIC_ACQUIRE);
+}
+
+struct PlatformLock {
+    pthread_mutex_t mutex;
+};
+
+struct PlatformCondition {
+    pthread_cond_t condition;
+};
+
+PlatformLock *PlatformLockCreate(void) {
+    PlatformLock *lock = (PlatformLock *)malloc(sizeof(PlatformLock));
+    if (lock && pthread_mutex_init(&lock->mutex, NULL) != 0) {
+        free(lock);
+        return NULL;
+    }
+    return lock;
+}
+
+void PlatformLockDestroy(PlatformLock *lock) {
+    if (!lock) return;
+    pthread_mutex_destroy(&lock->mutex);
+    free(lock);
+}
+
+void PlatformLockEnter(PlatformLock *lock) {
+    pthread_mutex_lock(&lock->mutex);
+}
+
+void PlatformLockLeave(PlatformLock *lock) {
+    pthread_mutex_unlock(&lock->mutex);
+}
+
+PlatformCondition *PlatformConditionCreate(void) {
+    PlatformCondition *condition = (PlatformCondition *)malloc(sizeof(PlatformCondition));
+    if (condition && pthread_cond_init(&condition->condition, NULL) != 0) {
+        free(condition);
+        return NULL;
+    }
+    return condition;
+}
+
+void PlatformConditionDestroy(PlatformCondition *condition) {
+    if (!condition) return;
+    pthread_cond_destroy(&condition->condition);
+    free(condition);
+}
+
+void PlatformConditionWait(PlatformCondition *condition, PlatformLock *lock) {
+    pthread_cond_wait(&condition->condition, &lock->mutex);
+}
+
+void PlatformConditionWake(PlatformCondition *condition) {
+    pthread_cond_signal(&condition->condition);
+}
+
+void PlatformConditionWakeAll(PlatformCondition *condition) {
+    pthread_cond_broadcast(&condition->condition);
+}
+
+#endif
@@ -0,0 +1,46 @@
+// Thin OS layer for the retropad text core: clocks, memory queries, threads and locks
+#pragma once
+
+#include <stdint.h>
+
+typedef struct PlatformThread PlatformThread;
+typedef struct PlatformLock PlatformLock;
+typedef struct PlatformCondition PlatformCondition;
+
+// Reference count that threads may drop concurrently
+typedef long PlatformRefCount;
+
+// Monotonic clock in nanoseconds
+uint64_t PlatformNowNanos(void);
+
+// Physical memory that can be used without swapping, in bytes (0 if unknown)
+uint64_t PlatformAvailableMemory(void);
+
+// Logical processors this process may run on (at least 1)
+unsigned PlatformCpuCount(void);
+
+// Runs fn(arg) on a new thread; NULL if the thread couldn't be started
+PlatformThread *PlatformThreadStart(void (*fn)(void *), void *arg);
+// Waits for the thread to finish and frees it
+void PlatformThreadJoin(PlatformThread *thread);
+
+// Atomic reference count updates. Decrement returns the count left; 0 means the caller
+// dropped the last reference and everything the others wrote before dropping theirs is
+// visible to it. Load sees every drop made before it.
+void PlatformRefIncrement(PlatformRefCount *refs);
+long PlatformRefDecrement(PlatformRefCount *refs);
+long PlatformRefLoad(PlatformRefCount *refs);
+
+// Mutual exclusion between threads (not reentrant). Create returns NULL when out of memory.
+PlatformLock *PlatformLockCreate(void);
+void PlatformLockDestroy(PlatformLock *lock);
+void PlatformLockEnter(PlatformLock *lock);
+void PlatformLockLeave(PlatformLock *lock);
+
+// Condition variable. Wait releases `lock` (held by the caller) while it sleeps and
+// holds it again on return; wakeups may be spurious, so wait in a loop.
+PlatformCondition *PlatformConditionCreate(void);
+void PlatformConditionDestroy(PlatformCondition *condition);
+void PlatformConditionWait(PlatformCondition *condition, PlatformLock *lock);
+void PlatformConditionWake(PlatformCondition *condition);
+void PlatformConditionWakeAll(PlatformCondition *condition);
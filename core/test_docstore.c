@@ -0,0 +1,790 @@
+// Unit tests for the chunked document store. Run with `make test`.
+#include "docstore.h"
+#include "lz.h"
+#include "highlight.h"
+#include "platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int g_failures = 0;
+static int g_checks = 0;
+
+#define CHECK(cond) \
+    do { \
+        ++g_checks; \
+        if (!(cond)) { \
+            ++g_failures; \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+        } \
+    } while (0)
+
+static unsigned g_seed = 2463534242u;
+
+static unsigned NextRandom(void) {
+    g_seed ^= g_seed << 13;
+    g_seed ^= g_seed >> 17;
+    g_seed ^= g_seed << 5;
+    return g_seed;
+}
+
+static bool StoreEquals(const DocStore *store, const TextChar *expected, size_t length) {
+    if (DocStoreLength(store) != length) return false;
+    TextChar *copy = (TextChar *)malloc((length + 1) * sizeof(TextChar));
+    bool same = copy && DocStoreCopy(store, 0, length, copy) == length &&
+                memcmp(copy, expected, length * sizeof(TextChar)) == 0;
+    free(copy);
+    return same;
+}
+
+static size_t CountLines(const TextChar *text, size_t length) {
+    size_t lines = 1;
+    for (size_t i = 0; i < length; ++i) lines += text[i] == '\n';
+    return lines;
+}
+
+// The store's running counts agree with counting the whole text afresh
+static bool StatsMatch(DocStore *store, const TextChar *ref, size_t length) {
+    TextStats actual, expected;
+    DocStoreGetTextStats(store, &actual);
+    TextStatsWide(ref, length, &expected);
+    return actual.length == expected.length && actual.words == expected.words && actual.chars == expected.chars &&
+           actual.ascii == expected.ascii && actual.utf8Bytes == expected.utf8Bytes &&
+           actual.lineBreaks == expected.lineBreaks;
+}
+
+static void TestNarrowAndWiden(void) {
+    DocStore *store = DocStoreCreate();
+    size_t length = 3 * DOC_CHUNK_UNITS + 17;
+    TextChar *text = (TextChar *)malloc(length * sizeof(TextChar));
+    for (size_t i = 0; i < length; ++i) text[i] = (TextChar)(i % 61 == 60 ? '\n' : 'a' + i % 26);
+
+    CHECK(DocStoreAppend(store, text, length));
+    DocStoreStats stats;
+    DocStoreGetStats(store, &stats);
+    CHECK(stats.chunks == 4 && stats.wideChunks == 0);
+    CHECK(stats.bytes < length * 2);
+
+    // One non-Latin-1 character widens only the chunk it lands in
+    const TextChar euro[] = {0x20AC};
+    CHECK(DocStoreInsert(store, DOC_CHUNK_UNITS + 5, euro, 1));
+    DocStoreGetStats(store, &stats);
+    CHECK(stats.wideChunks == 1);
+    CHECK(DocStoreCharAt(store, DOC_CHUNK_UNITS + 5) == 0x20AC);
+    CHECK(DocStoreCharAt(store, DOC_CHUNK_UNITS + 6) == text[DOC_CHUNK_UNITS + 5]);
+
+    DocStoreDestroy(store);
+    free(text);
+}
+
+// Random edits against a flat reference copy
+static void TestEditsMatchReference(void) {
+    DocStore *store = DocStoreCreate();
+    size_t capacity = 1 << 20;
+    TextChar *ref = (TextChar *)malloc(capacity * sizeof(TextChar));
+    TextChar insert[40000];
+    size_t length = 0;
+    bool ok = true;
+
+    for (int round = 0; round < 400 && ok; ++round) {
+        unsigned op = NextRandom() % 3;
+        size_t pos = length ? NextRandom() % (length + 1) : 0;
+        if (op < 2 || length == 0) {
+            size_t n = (NextRandom() % 8 == 0) ? NextRandom() % 40000 : NextRandom() % 40;
+            if (length + n > capacity) continue;
+            for (size_t i = 0; i < n; ++i) {
+                unsigned r = NextRandom() % 100;
+                insert[i] = (TextChar)(r < 5 ? '\n' : r < 7 ? 0x3A9 : r < 20 ? ' ' : 'a' + r % 26);
+            }
+            ok = DocStoreInsert(store, pos, insert, n);
+            memmove(ref + pos + n, ref + pos, (length - pos) * sizeof(TextChar));
+            memcpy(ref + pos, insert, n * sizeof(TextChar));
+            length += n;
+        } else {
+            size_t n = NextRandom() % (length - pos + 1);
+            if (NextRandom() % 4 == 0) n = n / 64;
+            DocStoreDelete(store, pos, n);
+            memmove(ref + pos, ref + pos + n, (length - pos - n) * sizeof(TextChar));
+            length -= n;
+        }
+        ok = ok && StoreEquals(store, ref, length);
+        ok = ok && DocStoreLineCount(store) == CountLines(ref, length);
+        ok = ok && (round % 8 || StatsMatch(store, ref, length));
+    }
+    CHECK(ok);
+
+    // Line index agrees with a linear scan
+    size_t line = 0;
+    bool linesOk = DocStoreLineStart(store, 0) == 0;
+    for (size_t i = 0; i < length && linesOk; ++i) {
+        linesOk = DocStoreLineFromOffset(store, i) == line;
+        if (ref[i] == '\n') {
+            ++line;
+            linesOk = linesOk && DocStoreLineStart(store, line) == i + 1;
+        }
+    }
+    CHECK(linesOk);
+    CHECK(DocStoreLineStart(store, line + 1) == TEXT_ERROR);
+
+    const TextChar repl[] = {'x', 'y'};
+    CHECK(DocStoreReplace(store, 0, length ? 1 : 0, repl, 2));
+    CHECK(!DocStoreReplace(store, DocStoreLength(store), 1, repl, 2));
+
+    DocStoreDestroy(store);
+    free(ref);
+}
+
+static void TestFindMatchesTextFind(void) {
+    size_t length = 5 * DOC_CHUNK_UNITS;
+    TextChar *text = (TextChar *)malloc(length * sizeof(TextChar));
+
+    // Wide chunks (omega in each), then narrow ones, where the micro sign folds out of Latin-1
+    for (int pass = 0; pass < 2; ++pass) {
+        DocStore *store = DocStoreCreate();
+        for (size_t i = 0; i < length; ++i) {
+            unsigned r = NextRandom() % 64;
+            text[i] = (TextChar)(r == 0 ? (pass ? 0xB5 : 0x3A9) : r == 1 ? 0xC9 : "abAB "[r % 5]);
+        }
+        CHECK(DocStoreAppend(store, text, length));
+
+        bool ok = true;
+        TextChar needle[24];
+        for (int round = 0; round < 300 && ok; ++round) {
+            size_t n = 1 + NextRandom() % (round % 2 ? 4 : 20);
+            size_t from = NextRandom() % (length - n);
+            memcpy(needle, text + from, n * sizeof(TextChar));
+            if (round % 3 == 0) needle[0] = 'a';
+            if (round % 5 == 0) needle[n - 1] = pass ? 0x3BC : 0x3C9; // lowercase mu, omega
+            // Put the needle across a chunk boundary now and then
+            size_t start = (round % 4 == 0) ? (NextRandom() % 4 + 1) * DOC_CHUNK_UNITS - n / 2 : NextRandom() % length;
+            unsigned flags = (NextRandom() % 2 ? TEXT_FIND_MATCH_CASE : 0) | (NextRandom() % 2 ? TEXT_FIND_DOWN : 0) |
+                             (NextRandom() % 2 ? TEXT_FIND_WHOLE_WORD : 0);
+
+            size_t expected = 0, actual = 0;
+            bool e = TextFind(text, length, needle, n, flags, start, &expected);
+            bool a = DocStoreFind(store, needle, n, flags, start, &actual);
+            ok = e == a && (!e || expected == actual);
+            if (!ok) fprintf(stderr, "find mismatch: pass %d round %d len %zu start %zu flags %u\n", pass, round, n, start, flags);
+        }
+        CHECK(ok);
+
+        // A match straddling the first boundary
+        size_t at = DOC_CHUNK_UNITS - 2;
+        size_t pos = 0;
+        CHECK(DocStoreFind(store, text + at, 5, TEXT_FIND_DOWN | TEXT_FIND_MATCH_CASE, at, &pos) && pos == at);
+        DocStoreDestroy(store);
+    }
+
+    // Whole words look at the units on either side even when they are in other chunks
+    DocStore *store = DocStoreCreate();
+    for (size_t i = 0; i < length; ++i) text[i] = 'x';
+    size_t at = DOC_CHUNK_UNITS;
+    memcpy(text + at, u"cat", 3 * sizeof(TextChar));
+    text[2 * DOC_CHUNK_UNITS - 1] = ' ';
+    memcpy(text + 2 * DOC_CHUNK_UNITS, u"Cat", 3 * sizeof(TextChar));
+    text[2 * DOC_CHUNK_UNITS + 3] = '.';
+    CHECK(DocStoreAppend(store, text, length));
+    size_t pos = 0;
+    CHECK(DocStoreFind(store, u"CAT", 3, TEXT_FIND_DOWN | TEXT_FIND_WHOLE_WORD, 0, &pos) && pos == 2 * DOC_CHUNK_UNITS);
+    CHECK(DocStoreFind(store, u"cat", 3, TEXT_FIND_DOWN | TEXT_FIND_MATCH_CASE, 0, &pos) && pos == at);
+    CHECK(!DocStoreFind(store, u"cat", 3, TEXT_FIND_DOWN | TEXT_FIND_MATCH_CASE | TEXT_FIND_WHOLE_WORD, 0, &pos));
+    DocStoreDestroy(store);
+    free(text);
+}
+
+static void TestLoad(void) {
+    // CRLF split across a block boundary, lone CR and LF, and a multi-byte sequence on the boundary
+    size_t size = 3 * DOC_CHUNK_UNITS;
+    uint8_t *data = (uint8_t *)malloc(size);
+    memset(data, 'x', size);
+    data[0] = 0xEF; data[1] = 0xBB; data[2] = 0xBF;
+    data[DOC_CHUNK_UNITS - 1] = '\r';
+    data[DOC_CHUNK_UNITS] = '\n';
+    data[2 * DOC_CHUNK_UNITS - 1] = 0xE2;
+    data[2 * DOC_CHUNK_UNITS] = 0x82;
+    data[2 * DOC_CHUNK_UNITS + 1] = 0xAC;
+    data[size - 3] = '\n';
+    data[size - 1] = '\r';
+
+    DocStore *store = DocStoreCreate();
+    CHECK(DocStoreLoad(store, data, size, ENC_UTF8));
+
+    size_t bound = TextDecodeBound(size, ENC_UTF8);
+    TextChar *decoded = (TextChar *)malloc(bound * sizeof(TextChar));
+    TextChar *expected = (TextChar *)malloc(2 * bound * sizeof(TextChar));
+    size_t n = TextDecode(data, size, ENC_UTF8, decoded);
+    n = TextNormalizeLineEndings(decoded, n, expected);
+    CHECK(StoreEquals(store, expected, n));
+    CHECK(DocStoreLineCount(store) == 4);
+
+    DocStore *latin = DocStoreCreate();
+    const uint8_t ansi[] = {'c', 'a', 'f', 0xE9, '\n'};
+    CHECK(DocStoreLoad(latin, ansi, sizeof(ansi), ENC_ANSI));
+    const TextChar cafe[] = {'c', 'a', 'f', 0xE9, '\r', '\n'};
+    CHECK(StoreEquals(latin, cafe, 6));
+
+    TextEolCounts eol;
+    DocStoreGetSourceEol(latin, &eol);
+    CHECK(eol.lf == 1 && eol.crlf == 0 && eol.cr == 0);
+
+    DocStore *cyrillic = DocStoreCreate();
+    const uint8_t koi[] = {0xCF, 0xF0, 0xE8, '\r', '\n', 'x'};
+    CHECK(DocStoreLoadCodePage(cyrillic, koi, sizeof(koi), TextFindCodePage(1251)));
+    const TextChar privet[] = {0x41F, 0x440, 0x438, '\r', '\n', 'x'};
+    CHECK(StoreEquals(cyrillic, privet, 6));
+
+    DocStoreDestroy(cyrillic);
+    DocStoreDestroy(latin);
+    DocStoreDestroy(store);
+    free(expected);
+    free(decoded);
+    free(data);
+}
+
+static void TestLzRoundTrip(void) {
+    size_t size = 200000;
+    uint8_t *src = (uint8_t *)malloc(size);
+    uint8_t *packed = (uint8_t *)malloc(LzCompressBound(size));
+    uint8_t *out = (uint8_t *)malloc(size);
+    static const char *const words[] = {"alpha ", "beta ", "gamma ", "delta\r\n"};
+
+    bool ok = true;
+    for (int round = 0; round < 4 && ok; ++round) {
+        size_t n = round == 0 ? 0 : round == 1 ? 3 : size;
+        // Rounds 2 and 3: random words, then noise that won't compress
+        for (size_t i = 0; i < n;) {
+            const char *w = round == 3 ? NULL : words[NextRandom() % 4];
+            if (!w) src[i++] = (uint8_t)NextRandom();
+            while (w && *w && i < n) src[i++] = (uint8_t)*w++;
+        }
+        size_t packedSize = LzCompress(src, n, packed, LzCompressBound(n));
+        ok = packedSize > 0 && LzDecompress(packed, packedSize, out, n) == n && memcmp(src, out, n) == 0;
+        if (round == 2) ok = ok && packedSize < n / 2;
+    }
+    CHECK(ok);
+
+    // Truncated or short-buffer input is rejected rather than overrunning
+    size_t packedSize = LzCompress(src, 1000, packed, LzCompressBound(1000));
+    CHECK(LzDecompress(packed, packedSize, out, 999) == LZ_ERROR);
+    CHECK(LzCompress(src, size, packed, 100) == 0);
+
+    free(src);
+    free(packed);
+    free(out);
+}
+
+// Random edits and reads against a reference while a tight budget keeps most chunks packed
+static void TestPackedChunks(void) {
+    size_t length = 40 * DOC_CHUNK_UNITS;
+    size_t capacity = length * 2;
+    TextChar *ref = (TextChar *)malloc(capacity * sizeof(TextChar));
+    for (size_t i = 0; i < length; ++i) {
+        unsigned r = NextRandom() % 97;
+        ref[i] = (TextChar)(r == 0 ? '\n' : r == 1 ? 0x3A9 : "the quick fox "[i % 14]);
+    }
+    DocStore *store = DocStoreCreate();
+    CHECK(DocStoreSetBudget(store, 4 * DOC_CHUNK_UNITS));
+    CHECK(DocStoreAppend(store, ref, length));
+
+    DocStoreStats stats;
+    DocStoreGetStats(store, &stats);
+    CHECK(stats.packedChunks > 30 && stats.rawBytes <= 4 * DOC_CHUNK_UNITS);
+    CHECK(stats.packedBytes < stats.packedSourceBytes / 2);
+
+    bool ok = StoreEquals(store, ref, length) && StatsMatch(store, ref, length);
+    TextChar insert[300];
+    for (int round = 0; round < 300 && ok; ++round) {
+        size_t pos = NextRandom() % (length + 1);
+        size_t n = NextRandom() % 300;
+        if (round % 2 && length + n <= capacity) {
+            for (size_t i = 0; i < n; ++i) insert[i] = (TextChar)(NextRandom() % 20 == 0 ? '\n' : 'a' + i % 26);
+            ok = DocStoreInsert(store, pos, insert, n);
+            memmove(ref + pos + n, ref + pos, (length - pos) * sizeof(TextChar));
+            memcpy(ref + pos, insert, n * sizeof(TextChar));
+            length += n;
+        } else {
+            if (n > length - pos) n = length - pos;
+            ok = DocStoreReplace(store, pos, n, insert, 1);
+            memmove(ref + pos + 1, ref + pos + n, (length - pos - n) * sizeof(TextChar));
+            ref[pos] = insert[0];
+            length = length - n + 1;
+        }
+        size_t probe = NextRandom() % length;
+        ok = ok && DocStoreCharAt(store, probe) == ref[probe];
+        ok = ok && DocStoreLineCount(store) == CountLines(ref, length);
+        ok = ok && (round % 32 || StatsMatch(store, ref, length));
+    }
+    CHECK(ok && StoreEquals(store, ref, length));
+
+    size_t expected = 0, actual = 0;
+    const TextChar needle[] = {'f', 'o', 'x', ' ', 't'};
+    bool e = TextFind(ref, length, needle, 5, TEXT_FIND_DOWN, length / 2, &expected);
+    bool a = DocStoreFind(store, needle, 5, TEXT_FIND_DOWN, length / 2, &actual);
+    CHECK(e == a && expected == actual);
+
+    DocStoreGetStats(store, &stats);
+    CHECK(stats.decompressions > 0 && stats.rawBytes <= 4 * DOC_CHUNK_UNITS);
+    DocStoreCompact(store, 0);
+    DocStoreGetStats(store, &stats);
+    CHECK(stats.packedChunks > 0 && StoreEquals(store, ref, length));
+
+    DocStoreDestroy(store);
+    free(ref);
+}
+
+static bool SameStores(const DocStore *a, const DocStore *b) {
+    size_t length = DocStoreLength(b);
+    TextChar *expected = (TextChar *)malloc((length + 1) * sizeof(TextChar));
+    bool same = expected && DocStoreCopy(b, 0, length, expected) == length && StoreEquals(a, expected, length);
+    free(expected);
+    return same;
+}
+
+// Parallel loads must produce exactly the single-threaded text, with seams landing
+// inside multi-byte sequences, CRLFs and CR CR LF runs
+static bool SameAsSerialLoad(const uint8_t *data, size_t size, TextEncoding encoding,
+                             const TextCodePage *codePage, unsigned threads, size_t budget) {
+    DocStore *serial = DocStoreCreate();
+    DocStore *parallel = DocStoreCreate();
+    bool ok = serial && parallel && DocStoreSetBudget(parallel, budget) &&
+              DocStoreLoadParallel(serial, data, size, encoding, codePage, 1) &&
+              DocStoreLoadParallel(parallel, data, size, encoding, codePage, threads);
+    ok = ok && SameStores(parallel, serial) && DocStoreLineCount(parallel) == DocStoreLineCount(serial);
+    TextEolCounts a, b;
+    if (ok) {
+        DocStoreGetSourceEol(serial, &a);
+        DocStoreGetSourceEol(parallel, &b);
+        ok = a.crlf == b.crlf && a.lf == b.lf && a.cr == b.cr;
+    }
+    // Counts taken per chunk during the load join up across the seams
+    TextStats x, y;
+    if (ok) {
+        DocStoreGetTextStats(serial, &x);
+        DocStoreGetTextStats(parallel, &y);
+        ok = x.words == y.words && x.chars == y.chars && x.utf8Bytes == y.utf8Bytes;
+    }
+    DocStoreDestroy(parallel);
+    DocStoreDestroy(serial);
+    return ok;
+}
+
+static void TestParallelLoad(void) {
+    static const char *const pieces[] = {"a", "word ", "\xC3\xA9", "\xE2\x82\xAC", "\xF0\x9F\x98\x80",
+                                         "\r\n", "\r", "\n", "\r\r\n"};
+    size_t size = 12 * DOC_CHUNK_UNITS;
+    uint8_t *utf8 = (uint8_t *)malloc(size + 8);
+    uint8_t *bytes = (uint8_t *)malloc(size);
+    size_t n = 0;
+    while (n < size) {
+        const char *p = pieces[NextRandom() % 9];
+        size_t len = strlen(p);
+        memcpy(utf8 + n, p, len);
+        n += len;
+    }
+    // Raw bytes read as UTF-16 and cp1251 get CRs and LFs at random too
+    for (size_t i = 0; i < size; ++i) {
+        unsigned r = NextRandom();
+        bytes[i] = (r & 7) == 0 ? '\r' : (r & 7) == 1 ? '\n' : (r & 6) == 2 ? 0 : (uint8_t)(r >> 8);
+    }
+
+    static const unsigned threads[] = {2, 3, 7, DOC_LOAD_MAX_THREADS};
+    for (size_t i = 0; i < sizeof(threads) / sizeof(threads[0]); ++i) {
+        CHECK(SameAsSerialLoad(utf8, n, ENC_UTF8, NULL, threads[i], 0));
+        CHECK(SameAsSerialLoad(bytes, size, ENC_UTF16LE, NULL, threads[i], 0));
+        CHECK(SameAsSerialLoad(bytes, size - 1, ENC_UTF16BE, NULL, threads[i], 0));
+        CHECK(SameAsSerialLoad(bytes, size, ENC_ANSI, TextFindCodePage(1251), threads[i], 0));
+    }
+    CHECK(SameAsSerialLoad(utf8, n, ENC_UTF8, NULL, 4, 4 * DOC_CHUNK_UNITS));
+    CHECK(SameAsSerialLoad(utf8, 5, ENC_UTF8, NULL, 0, 0));
+
+    // Inputs a few bytes long put the first seam inside the first character, where
+    // the split has to back up to offset 0
+    static const char *const small[] = {"\xE2\x82\xAC" "A", "\xF0\x9F\x98\x80" "a", "\xC3\xA9\xC3\xA9",
+                                        "a\xE2\x82\xAC", "\xE2\x82\xAC\xE2\x82\xAC", "\r\n\xC3\xA9"};
+    static const uint8_t smallUtf16[] = {0x3D, 0xD8, 0x00, 0xDE, 'A', 0};
+    for (unsigned t = 2; t <= 4; ++t) {
+        for (size_t i = 0; i < sizeof(small) / sizeof(small[0]); ++i) {
+            CHECK(SameAsSerialLoad((const uint8_t *)small[i], strlen(small[i]), ENC_UTF8, NULL, t, 0));
+        }
+        CHECK(SameAsSerialLoad(smallUtf16, sizeof(smallUtf16), ENC_UTF16LE, NULL, t, 0));
+    }
+
+    free(bytes);
+    free(utf8);
+}
+
+// Detection during the load agrees with TextDetectEncoding; input that isn't UTF-8
+// loads as the fallback code page even where some segments were valid UTF-8
+static void TestLoadDetect(void) {
+    size_t size = 8 * DOC_CHUNK_UNITS;
+    uint8_t *data = (uint8_t *)malloc(size);
+    for (size_t i = 0; i < size; i += 2) {
+        data[i] = (uint8_t)('a' + NextRandom() % 26);
+        data[i + 1] = i % 64 == 0 ? '\n' : ' ';
+    }
+    memcpy(data + 100, "\xC3\xA9", 2);
+    const TextCodePage *cp1252 = TextFindCodePage(1252);
+
+    for (unsigned threads = 1; threads <= 4; threads += 3) {
+        DocStore *store = DocStoreCreate();
+        DocStore *expected = DocStoreCreate();
+        data[size - 10] = 'x';
+        CHECK(DocStoreLoadDetect(store, data, size, cp1252, threads) == ENC_UTF8);
+        CHECK(TextDetectEncoding(data, size) == ENC_UTF8);
+        CHECK(DocStoreLoad(expected, data, size, ENC_UTF8));
+        CHECK(SameAsSerialLoad(data, size, ENC_UTF8, NULL, threads, 0));
+        CHECK(SameStores(store, expected) && DocStoreLength(store) == size + size / 64 - 1);
+
+        // A lone 0xE9 near the end: the whole file is cp1252, "é" early on included
+        DocStoreClear(store);
+        DocStoreClear(expected);
+        data[size - 10] = 0xE9;
+        CHECK(DocStoreLoadDetect(store, data, size, cp1252, threads) == ENC_ANSI);
+        CHECK(TextDetectEncoding(data, size) == ENC_ANSI);
+        CHECK(DocStoreLoadCodePage(expected, data, size, cp1252));
+        CHECK(SameStores(store, expected) && DocStoreLength(store) == size + size / 64);
+
+        DocStoreClear(store);
+        CHECK(DocStoreLoadDetect(store, data, size, NULL, threads) == ENC_ANSI);
+        CHECK(DocStoreLength(store) == 0);
+        DocStoreDestroy(expected);
+        DocStoreDestroy(store);
+    }
+
+    DocStore *store = DocStoreCreate();
+    const uint8_t utf16[] = {0xFF, 0xFE, 'h', 0, '\r', 0};
+    CHECK(DocStoreLoadDetect(store, utf16, sizeof(utf16), cp1252, 0) == ENC_UTF16LE);
+    const TextChar h[] = {'h', '\r', '\n'};
+    CHECK(StoreEquals(store, h, 3));
+    DocStoreDestroy(store);
+    free(data);
+}
+
+static void AppendAscii(DocStore *store, const char *text) {
+    TextChar buffer[256];
+    size_t length = strlen(text);
+    for (size_t i = 0; i < length; ++i) buffer[i] = (TextChar)(unsigned char)text[i];
+    DocStoreAppend(store, buffer, length);
+}
+
+// Runs for `line` found by tokenizing every line from the top
+static size_t ReferenceRuns(const DocStore *store, HighlightLanguage language, size_t line, HighlightRun *runs) {
+    HighlightState state;
+    HighlightInitState(&state);
+    TextChar text[HIGHLIGHT_MAX_LINE];
+    size_t count = 0;
+    for (size_t at = 0; at <= line; ++at) {
+        size_t start = DocStoreLineStart(store, at);
+        size_t end = DocStoreLineStart(store, at + 1);
+        end = end == TEXT_ERROR ? DocStoreLength(store) : end - 2;
+        size_t length = DocStoreCopy(store, start, end - start, text);
+        count = HighlightTokenize(language, &state, text, length, runs, HIGHLIGHT_MAX_RUNS);
+    }
+    return count;
+}
+
+static bool RunsMatch(Highlighter *highlighter, const DocStore *store, size_t line) {
+    HighlightRun expected[HIGHLIGHT_MAX_RUNS];
+    const HighlightRun *runs;
+    size_t count = HighlighterLine(highlighter, store, line, &runs);
+    if (count != ReferenceRuns(store, HighlighterLanguage(highlighter), line, expected)) return false;
+    for (size_t i = 0; i < count; ++i) {
+        if (runs[i].start != expected[i].start || runs[i].length != expected[i].length ||
+            runs[i].token != expected[i].token) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static void TestHighlightTokens(void) {
+    const char *lines[] = {"2024-05-01 12:00:03,114 ERROR boom", "\tat Foo.bar", "[12:00:04] [warn] slow", "plain"};
+    const HighlightToken tokens[] = {HIGHLIGHT_ERROR, HIGHLIGHT_ERROR, HIGHLIGHT_WARNING, HIGHLIGHT_PLAIN};
+    HighlightState state;
+    HighlightInitState(&state);
+    for (size_t i = 0; i < 4; ++i) {
+        TextChar text[64];
+        size_t length = strlen(lines[i]);
+        for (size_t j = 0; j < length; ++j) text[j] = (TextChar)lines[i][j];
+        HighlightRun runs[4];
+        size_t count = HighlightTokenize(HIGHLIGHT_LOG, &state, text, length, runs, 4);
+        CHECK(count > 0 || tokens[i] == HIGHLIGHT_PLAIN);
+        if (count > 0) CHECK(runs[count - 1].token == tokens[i] && runs[count - 1].start + runs[count - 1].length == length);
+        if (i == 0) CHECK(count == 2 && runs[0].token == HIGHLIGHT_TIME && runs[0].length == 23);
+    }
+
+    // A block comment and nesting carry over lines; keys and values differ by position
+    DocStore *store = DocStoreCreate();
+    AppendAscii(store, "{\"a\": [1, true],\r\n/* note\r\nstill */ \"b\": {\"c\": \"d\"}}");
+    Highlighter *highlighter = HighlighterCreate(HIGHLIGHT_JSON);
+    const HighlightRun *runs;
+    CHECK(HighlighterLine(highlighter, store, 0, &runs) == 3);
+    CHECK(runs[0].token == HIGHLIGHT_KEY && runs[0].start == 1 && runs[0].length == 3);
+    CHECK(runs[1].token == HIGHLIGHT_NUMBER && runs[2].token == HIGHLIGHT_LITERAL);
+    CHECK(HighlighterLine(highlighter, store, 1, &runs) == 1 && runs[0].token == HIGHLIGHT_COMMENT);
+    CHECK(HighlighterLine(highlighter, store, 2, &runs) == 4);
+    CHECK(runs[0].token == HIGHLIGHT_COMMENT && runs[0].length == 8);
+    CHECK(runs[1].token == HIGHLIGHT_KEY && runs[2].token == HIGHLIGHT_KEY && runs[3].token == HIGHLIGHT_STRING);
+    CHECK(HighlighterLine(highlighter, store, 3, &runs) == 0);
+    HighlighterDestroy(highlighter);
+    DocStoreDestroy(store);
+}
+
+// Random edits keep the cached runs and checkpoints equal to a full re-tokenize,
+// and showing a screen deep in the file costs about a screen once checkpoints exist
+static void TestHighlighterIncremental(void) {
+    static const char *const pieces[] = {"{", "}", "[", "],", "\"k\": ", "\"v\",", "12,", "/*", "*/",
+                                         "ERROR x", "  at y", "INFO z", "\r\n", "\r\n", "\r\n"};
+    const HighlightLanguage languages[] = {HIGHLIGHT_JSON, HIGHLIGHT_LOG};
+    for (size_t l = 0; l < 2; ++l) {
+        DocStore *store = DocStoreCreate();
+        for (size_t i = 0; i < 6000; ++i) AppendAscii(store, pieces[NextRandom() % 15]);
+        Highlighter *highlighter = HighlighterCreate(languages[l]);
+        size_t lines = DocStoreLineCount(store);
+        CHECK(lines > 1000);
+
+        for (int round = 0; round < 60; ++round) {
+            size_t top = NextRandom() % lines;
+            for (size_t line = top; line < top + 8 && line < lines; ++line) CHECK(RunsMatch(highlighter, store, line));
+
+            size_t pos = NextRandom() % (DocStoreLength(store) + 1);
+            while (pos > 0 && DocStoreCharAt(store, pos - 1) == '\r') --pos;
+            size_t removed = NextRandom() % 8;
+            if (pos + removed > DocStoreLength(store)) removed = DocStoreLength(store) - pos;
+            while (removed > 0 && DocStoreCharAt(store, pos + removed - 1) == '\r') --removed;
+            const char *piece = pieces[NextRandom() % 15];
+            TextChar text[16];
+            size_t length = strlen(piece);
+            for (size_t i = 0; i < length; ++i) text[i] = (TextChar)piece[i];
+            size_t firstLine = DocStoreLineFromOffset(store, pos);
+            size_t oldLastLine = DocStoreLineFromOffset(store, pos + removed);
+            CHECK(DocStoreReplace(store, pos, removed, text, length));
+            HighlighterEdit(highlighter, store, firstLine, oldLastLine, DocStoreLineFromOffset(store, pos + length));
+            lines = DocStoreLineCount(store);
+        }
+
+        HighlighterStats before, after;
+        const HighlightRun *runs;
+        HighlighterLine(highlighter, store, lines - 1, &runs);
+        HighlighterGetStats(highlighter, &before);
+        size_t top = lines / 2;
+        for (size_t line = top; line < top + 40; ++line) CHECK(RunsMatch(highlighter, store, line));
+        HighlighterGetStats(highlighter, &after);
+        CHECK(after.linesTokenized - before.linesTokenized <= HIGHLIGHT_CHECKPOINT_LINES + 40);
+        CHECK(after.checkpoints >= lines / HIGHLIGHT_CHECKPOINT_LINES);
+        HighlighterDestroy(highlighter);
+        DocStoreDestroy(store);
+    }
+}
+
+// Random edit of store and ref together: inserts (some wide, some past a chunk) and deletes
+static bool RandomEdit(DocStore *store, TextChar *ref, size_t *length, size_t capacity, unsigned *seed) {
+    TextChar insert[2 * DOC_CHUNK_UNITS];
+    *seed ^= *seed << 13;
+    *seed ^= *seed >> 17;
+    *seed ^= *seed << 5;
+    unsigned r = *seed;
+    size_t pos = *length ? (r >> 8) % (*length + 1) : 0;
+    if (r % 3 < 2 || *length == 0) {
+        size_t n = r % 16 == 0 ? (r >> 4) % (2 * DOC_CHUNK_UNITS) : (r >> 4) % 40;
+        if (*length + n > capacity) return true;
+        for (size_t i = 0; i < n; ++i) {
+            unsigned u = (unsigned)(i * 7 + r) % 100;
+            insert[i] = (TextChar)(u < 5 ? '\n' : u < 7 ? 0x3A9 : u < 20 ? ' ' : 'a' + u % 26);
+        }
+        if (!DocStoreInsert(store, pos, insert, n)) return false;
+        memmove(ref + pos + n, ref + pos, (*length - pos) * sizeof(TextChar));
+        memcpy(ref + pos, insert, n * sizeof(TextChar));
+        *length += n;
+    } else {
+        size_t n = (r >> 4) % (*length - pos + 1) / 16;
+        if (!DocStoreDelete(store, pos, n)) return false;
+        memmove(ref + pos, ref + pos + n, (*length - pos - n) * sizeof(TextChar));
+        *length -= n;
+    }
+    return true;
+}
+
+static void TestSnapshots(void) {
+    size_t capacity = 24 * DOC_CHUNK_UNITS;
+    size_t length = 6 * DOC_CHUNK_UNITS + 5;
+    TextChar *ref = (TextChar *)malloc(capacity * sizeof(TextChar));
+    TextChar *original = (TextChar *)malloc(length * sizeof(TextChar));
+    TextChar *before = (TextChar *)malloc(capacity * sizeof(TextChar));
+    for (size_t i = 0; i < length; ++i) ref[i] = (TextChar)(i % 53 == 52 ? '\n' : "snapshot "[i % 9]);
+    memcpy(original, ref, length * sizeof(TextChar));
+    size_t originalLength = length;
+    DocStore *store = DocStoreCreate();
+    CHECK(DocStoreAppend(store, ref, length));
+
+    // Edits after the snapshot, including ones that widen and split chunks, don't reach it
+    DocSnapshot *first = DocStoreSnapshot(store);
+    DocSnapshot *same = DocStoreSnapshot(store);
+    CHECK(first && same);
+    unsigned seed = 88172645u;
+    bool ok = true;
+    for (int round = 0; round < 200 && ok; ++round) ok = RandomEdit(store, ref, &length, capacity, &seed);
+    CHECK(ok);
+    CHECK(StoreEquals(store, ref, length));
+    CHECK(StatsMatch(store, ref, length));
+    const DocStore *view = DocSnapshotStore(first);
+    CHECK(StoreEquals(view, original, originalLength));
+    CHECK(StoreEquals(DocSnapshotStore(same), original, originalLength));
+    CHECK(DocStoreLineCount(view) == CountLines(original, originalLength));
+    CHECK(DocStoreLineStart(view, 1) == 53);
+    TextStats counts, expected;
+    DocSnapshotGetTextStats(first, &counts);
+    TextStatsWide(original, originalLength, &expected);
+    CHECK(counts.words == expected.words && counts.chars == expected.chars);
+    size_t match = 0;
+    const TextChar needle[] = {'h', 'o', 't', ' ', 's'};
+    CHECK(DocStoreFind(view, needle, 5, TEXT_FIND_DOWN | TEXT_FIND_MATCH_CASE, 0, &match) && match == 5);
+    DocSnapshotRelease(same);
+
+    // A cleared store, a packed one, and snapshots that outlive the store
+    DocSnapshot *second = DocStoreSnapshot(store);
+    DocStoreClear(store);
+    CHECK(DocStoreLength(store) == 0);
+    CHECK(StoreEquals(DocSnapshotStore(second), ref, length));
+    CHECK(DocStoreAppend(store, ref, length));
+    CHECK(DocStoreSetBudget(store, 2 * DOC_CHUNK_UNITS));
+    DocStoreStats stats;
+    DocStoreGetStats(store, &stats);
+    CHECK(stats.packedChunks > 0);
+    DocSnapshot *packed = DocStoreSnapshot(store);
+    CHECK(packed != NULL);
+    memcpy(before, ref, length * sizeof(TextChar));
+    size_t beforeLength = length;
+    ok = true;
+    for (int round = 0; round < 100 && ok; ++round) ok = RandomEdit(store, ref, &length, capacity, &seed);
+    CHECK(ok);
+    DocStoreCompact(store, 0);
+    CHECK(StoreEquals(store, ref, length));
+    CHECK(StoreEquals(DocSnapshotStore(packed), before, beforeLength));
+    DocStoreDestroy(store);
+    CHECK(StoreEquals(DocSnapshotStore(packed), before, beforeLength));
+    CHECK(StoreEquals(DocSnapshotStore(first), original, originalLength));
+    DocSnapshotRelease(packed);
+    DocSnapshotRelease(second);
+    DocSnapshotRelease(first);
+    free(before);
+    free(original);
+    free(ref);
+}
+
+#define STRESS_READERS 4
+#define STRESS_ROUNDS 24
+
+// A snapshot handed to a reader thread with the text it must hold; the reader checks
+// it over and over while the store is edited, then releases it
+typedef struct SnapshotReader {
+    DocSnapshot *snapshot;
+    TextChar *expected;
+    size_t length;
+    unsigned seed;
+    int failures;
+    PlatformThread *thread;
+} SnapshotReader;
+
+static void ReadSnapshot(void *param) {
+    SnapshotReader *reader = (SnapshotReader *)param;
+    const DocStore *view = DocSnapshotStore(reader->snapshot);
+    TextChar *copy = (TextChar *)malloc((reader->length + 1) * sizeof(TextChar));
+    for (int pass = 0; pass < 6 && copy; ++pass) {
+        reader->failures += DocStoreLength(view) != reader->length;
+        reader->failures += DocStoreCopy(view, 0, reader->length, copy) != reader->length ||
+                            memcmp(copy, reader->expected, reader->length * sizeof(TextChar)) != 0;
+        reader->failures += DocStoreLineCount(view) != CountLines(reader->expected, reader->length);
+        for (int probe = 0; probe < 64 && reader->length; ++probe) {
+            reader->seed = reader->seed * 1103515245u + 12345u;
+            size_t pos = (reader->seed >> 4) % reader->length;
+            reader->failures += DocStoreCharAt(view, pos) != reader->expected[pos];
+            size_t line = DocStoreLineFromOffset(view, pos);
+            size_t start = DocStoreLineStart(view, line);
+            reader->failures += start > pos || (start > 0 && reader->expected[start - 1] != '\n');
+        }
+        if (reader->length >= 8) {
+            size_t at = (reader->seed >> 3) % (reader->length - 8);
+            size_t match = TEXT_ERROR;
+            reader->failures += !DocStoreFind(view, reader->expected + at, 8, TEXT_FIND_DOWN | TEXT_FIND_MATCH_CASE, 0,
+                                              &match) ||
+                                match > at || memcmp(reader->expected + match, reader->expected + at, 8 * sizeof(TextChar));
+        }
+        TextStats counts, expected;
+        DocSnapshotGetTextStats(reader->snapshot, &counts);
+        TextStatsWide(reader->expected, reader->length, &expected);
+        reader->failures += counts.words != expected.words || counts.chars != expected.chars ||
+                            counts.lineBreaks != expected.lineBreaks;
+    }
+    reader->failures += copy == NULL;
+    free(copy);
+    DocSnapshotRelease(reader->snapshot);
+}
+
+// Readers on other threads check snapshots while this thread edits, packs and clears
+// the store, and release them while it is still editing
+static void TestSnapshotStress(void) {
+    size_t capacity = 32 * DOC_CHUNK_UNITS;
+    TextChar *ref = (TextChar *)malloc(capacity * sizeof(TextChar));
+    size_t length = 8 * DOC_CHUNK_UNITS;
+    for (size_t i = 0; i < length; ++i) ref[i] = (TextChar)(i % 71 == 70 ? '\n' : "stress "[i % 7]);
+    DocStore *store = DocStoreCreate();
+    CHECK(DocStoreAppend(store, ref, length));
+    unsigned seed = 521288629u;
+    bool ok = true;
+    int failures = 0;
+    for (int round = 0; round < STRESS_ROUNDS && ok; ++round) {
+        if (round == STRESS_ROUNDS / 2) ok = DocStoreSetBudget(store, 3 * DOC_CHUNK_UNITS);
+        SnapshotReader readers[STRESS_READERS];
+        for (int i = 0; i < STRESS_READERS; ++i) {
+            SnapshotReader *reader = &readers[i];
+            memset(reader, 0, sizeof(*reader));
+            reader->snapshot = DocStoreSnapshot(store);
+            reader->expected = (TextChar *)malloc((length + 1) * sizeof(TextChar));
+            memcpy(reader->expected, ref, length * sizeof(TextChar));
+            reader->length = length;
+            reader->seed = seed + (unsigned)i;
+            reader->thread = PlatformThreadStart(ReadSnapshot, reader);
+            if (!reader->thread) ReadSnapshot(reader);
+            // Each reader's snapshot differs from the next one's
+            for (int k = 0; k < 20 && ok; ++k) ok = RandomEdit(store, ref, &length, capacity, &seed);
+        }
+        for (int k = 0; k < 400 && ok; ++k) {
+            ok = RandomEdit(store, ref, &length, capacity, &seed);
+            if (k % 100 == 99) DocStoreCompact(store, DOC_CHUNK_UNITS);
+        }
+        if (round % 8 == 7) {
+            DocStoreClear(store);
+            ok = ok && DocStoreAppend(store, ref, length);
+        }
+        for (int i = 0; i < STRESS_READERS; ++i) {
+            PlatformThreadJoin(readers[i].thread);
+            failures += readers[i].failures;
+            free(readers[i].expected);
+        }
+        ok = ok && StoreEquals(store, ref, length);
+    }
+    CHECK(ok);
+    CHECK(failures == 0);
+    CHECK(StatsMatch(store, ref, length));
+    DocStoreDestroy(store);
+    free(ref);
+}
+
+int main(void) {
+    TestNarrowAndWiden();
+    TestEditsMatchReference();
+    TestFindMatchesTextFind();
+    TestLoad();
+    TestLzRoundTrip();
+    TestPackedChunks();
+    TestParallelLoad();
+    TestLoadDetect();
+    TestHighlightTokens();
+    TestHighlighterIncremental();
+    TestSnapshots();
+    TestSnapshotStress();
+
+    printf("%d checks, %d failures\n", g_checks, g_failures);
+    return g_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,971 @@
+// Unit tests for the retropad text core. Run with `make test`.
+#include "textcore.h"
+#include "codepage.h"
+#include "textstats.h"
+#include "lineops.h"
+#include "hash.h"
+#include "diff.h"
+#include "convert.h"
+#include "hexdump.h"
+#include "jobs.h"
+#include "platform.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int g_failures = 0;
+static int g_checks = 0;
+
+#define CHECK(cond) \
+    do { \
+        ++g_checks; \
+        if (!(cond)) { \
+            ++g_failures; \
+            fprintf(stderr, "%s:%d: CHECK failed: %s\n", __FILE__, __LINE__, #cond); \
+        } \
+    } while (0)
+
+static size_t U16Len(const TextChar *s) {
+    return TextLength(s);
+}
+
+static bool U16Equal(const TextChar *a, size_t aLen, const TextChar *b) {
+    return aLen == U16Len(b) && memcmp(a, b, aLen * sizeof(TextChar)) == 0;
+}
+
+static void TestDetectEncoding(void) {
+    const uint8_t utf16le[] = {0xFF, 0xFE, 'a', 0};
+    const uint8_t utf16be[] = {0xFE, 0xFF, 0, 'a'};
+    const uint8_t utf8bom[] = {0xEF, 0xBB, 0xBF, 'a'};
+    const uint8_t utf8[] = {'a', 0xC3, 0xA9, 0xE2, 0x82, 0xAC, 0xF0, 0x9F, 0x98, 0x80};
+    const uint8_t latin1[] = {'c', 'a', 'f', 0xE9};
+    const uint8_t surrogate[] = {0xED, 0xA0, 0x80};
+    const uint8_t overlong[] = {0xC0, 0xAF};
+
+    CHECK(TextDetectEncoding(utf16le, sizeof(utf16le)) == ENC_UTF16LE);
+    CHECK(TextDetectEncoding(utf16be, sizeof(utf16be)) == ENC_UTF16BE);
+    CHECK(TextDetectEncoding(utf8bom, sizeof(utf8bom)) == ENC_UTF8);
+    CHECK(TextDetectEncoding(utf8, sizeof(utf8)) == ENC_UTF8);
+    CHECK(TextDetectEncoding(latin1, sizeof(latin1)) == ENC_ANSI);
+    CHECK(TextDetectEncoding(surrogate, sizeof(surrogate)) == ENC_ANSI);
+    CHECK(TextDetectEncoding(overlong, sizeof(overlong)) == ENC_ANSI);
+    CHECK(!TextIsValidUtf8(utf8, sizeof(utf8) - 1));
+}
+
+static void TestDecode(void) {
+    const uint8_t utf8[] = {0xEF, 0xBB, 0xBF, 'a', 0xC3, 0xA9, 0xE2, 0x82, 0xAC, 0xF0, 0x9F, 0x98, 0x80};
+    TextChar out[16];
+    size_t n = TextDecode(utf8, sizeof(utf8), ENC_UTF8, out);
+    CHECK(n == TextDecode(utf8, sizeof(utf8), ENC_UTF8, NULL));
+    CHECK(n <= TextDecodeBound(sizeof(utf8), ENC_UTF8));
+    out[n] = 0;
+    CHECK(U16Equal(out, n, u"aé€\U0001F600"));
+
+    // Maximal subparts: truncated 3-byte sequence, stray continuation, invalid lead
+    const uint8_t bad[] = {0xE2, 0x82, 'x', 0x80, 0xFF, 'y'};
+    n = TextDecode(bad, sizeof(bad), ENC_UTF8, out);
+    out[n] = 0;
+    CHECK(U16Equal(out, n, u"�x��y"));
+
+    const uint8_t le[] = {0xFF, 0xFE, 'h', 0, 'i', 0, 0x7A};
+    n = TextDecode(le, sizeof(le), ENC_UTF16LE, out);
+    out[n] = 0;
+    CHECK(U16Equal(out, n, u"hi"));
+
+    const uint8_t be[] = {0xFE, 0xFF, 0, 'h', 0x20, 0xAC};
+    n = TextDecode(be, sizeof(be), ENC_UTF16BE, out);
+    out[n] = 0;
+    CHECK(U16Equal(out, n, u"h€"));
+
+    const uint8_t ansi[] = {'c', 0xE9};
+    n = TextDecode(ansi, sizeof(ansi), ENC_ANSI, out);
+    out[n] = 0;
+    CHECK(U16Equal(out, n, u"cé"));
+}
+
+static void TestEncodeUtf8(void) {
+    const TextChar text[] = u"aé€\U0001F600";
+    uint8_t out[32];
+    size_t n = TextEncodeUtf8(text, U16Len(text), TEXT_EOL_CRLF, out);
+    const uint8_t expected[] = {'a', 0xC3, 0xA9, 0xE2, 0x82, 0xAC, 0xF0, 0x9F, 0x98, 0x80};
+    CHECK(n == sizeof(expected) && memcmp(out, expected, n) == 0);
+    CHECK(TextEncodeUtf8(text, U16Len(text), TEXT_EOL_CRLF, NULL) == n);
+
+    const TextChar lone[] = {0xD800, 'x'};
+    n = TextEncodeUtf8(lone, 2, TEXT_EOL_CRLF, out);
+    CHECK(n == 4 && out[0] == 0xEF && out[1] == 0xBF && out[2] == 0xBD && out[3] == 'x');
+}
+
+static void TestNormalize(void) {
+    const TextChar *src = u"a\nb\r\nc\rd\r\n\n";
+    TextChar out[32];
+    size_t len = U16Len(src);
+    size_t n = TextNormalizeLineEndings(src, len, NULL);
+    CHECK(TextNormalizeLineEndings(src, len, out) == n);
+    out[n] = 0;
+    CHECK(U16Equal(out, n, u"a\r\nb\r\nc\r\nd\r\n\r\n"));
+    CHECK(TextIsCrlfOnly(out, n));
+    CHECK(!TextIsCrlfOnly(src, len));
+    CHECK(!TextIsCrlfOnly(u"a\r", 2));
+}
+
+static void TestFind(void) {
+    const TextChar *text = u"One two ONE two one";
+    size_t len = U16Len(text);
+    size_t pos = 0;
+
+    CHECK(TextFind(text, len, u"one", 3, TEXT_FIND_DOWN, 0, &pos) && pos == 0);
+    CHECK(TextFind(text, len, u"one", 3, TEXT_FIND_DOWN, 1, &pos) && pos == 8);
+    CHECK(TextFind(text, len, u"one", 3, TEXT_FIND_DOWN | TEXT_FIND_MATCH_CASE, 0, &pos) && pos == 16);
+    // Wraps to the top when nothing follows the start
+    CHECK(TextFind(text, len, u"One", 3, TEXT_FIND_DOWN | TEXT_FIND_MATCH_CASE, 5, &pos) && pos == 0);
+    // Searching up finds the last match before start, then wraps to the bottom
+    CHECK(TextFind(text, len, u"two", 3, 0, 12, &pos) && pos == 4);
+    CHECK(TextFind(text, len, u"two", 3, 0, 2, &pos) && pos == 12);
+    CHECK(!TextFind(text, len, u"three", 5, TEXT_FIND_DOWN, 0, &pos));
+    CHECK(TextFind(u"ÉTÉ", 3, u"été", 3, TEXT_FIND_DOWN, 0, &pos) && pos == 0);
+
+    // Case folding: micro sign and capital mu, long s, Kelvin sign
+    CHECK(TextFind(u"x µm", 4, u"ΜM", 2, TEXT_FIND_DOWN, 0, &pos) && pos == 2);
+    CHECK(TextFind(u"ſt", 2, u"ST", 2, TEXT_FIND_DOWN, 0, &pos) && pos == 0);
+    CHECK(TextFind(u"5 \u212A", 3, u"k", 1, TEXT_FIND_DOWN, 0, &pos) && pos == 2);
+    // The 8-unit ASCII blocks fold only A-Z, and blocks with other characters still match
+    const TextChar *blocks = u"xxxxxxxx@[xxxxxxxxxxxxxxxxxxxxÉxxxxxNeedle";
+    size_t blocksLen = U16Len(blocks);
+    CHECK(!TextFind(blocks, blocksLen, u"`{", 2, TEXT_FIND_DOWN, 0, &pos));
+    CHECK(TextFind(blocks, blocksLen, u"nEEDLE", 6, TEXT_FIND_DOWN, 0, &pos) && pos == 36);
+    CHECK(TextFind(blocks, blocksLen, u"éX", 2, TEXT_FIND_DOWN, 0, &pos) && pos == 30);
+
+    // Whole words: letters, digits and '_' continue a word, punctuation ends it
+    const TextChar *words = u"cat concat cat_ cat. écat";
+    size_t wordsLen = U16Len(words);
+    CHECK(TextFind(words, wordsLen, u"cat", 3, TEXT_FIND_DOWN | TEXT_FIND_WHOLE_WORD, 1, &pos) && pos == 16);
+    CHECK(TextFind(words, wordsLen, u"CAT", 3, TEXT_FIND_WHOLE_WORD, 16, &pos) && pos == 0);
+    CHECK(!TextFind(words, wordsLen, u"con", 3, TEXT_FIND_DOWN | TEXT_FIND_WHOLE_WORD, 0, &pos));
+    size_t count = 0;
+    TextReplaceAll(words, wordsLen, u"cat", 3, u"dog", 3, TEXT_FIND_WHOLE_WORD, NULL, &count);
+    CHECK(count == 2);
+    // A slice starting inside "concat" and ending inside "cat_": its ends aren't breaks
+    const TextChar *slice = words + 7;
+    size_t sliceLen = 9;
+    unsigned inWords = TEXT_FIND_WHOLE_WORD | TEXT_FIND_WORD_BEFORE | TEXT_FIND_WORD_AFTER;
+    CHECK(TextFind(slice, sliceLen, u"cat", 3, TEXT_FIND_DOWN | TEXT_FIND_WHOLE_WORD, 0, &pos) && pos == 0);
+    CHECK(!TextFind(slice, sliceLen, u"cat", 3, TEXT_FIND_DOWN | inWords, 0, &pos));
+    CHECK(!TextFind(slice, sliceLen, u"cat", 3, inWords, sliceLen, &pos));
+    CHECK(TextFind(slice, sliceLen - 2, u"cat", 3, TEXT_FIND_DOWN | TEXT_FIND_WHOLE_WORD | TEXT_FIND_WORD_BEFORE, 0, &pos) &&
+          pos == 4);
+    CHECK(!TextFind(slice, sliceLen - 2, u"cat", 3, TEXT_FIND_DOWN | inWords, 0, &pos));
+    TextReplaceAll(slice, sliceLen, u"cat", 3, u"dog", 3, inWords, NULL, &count);
+    CHECK(count == 0);
+}
+
+static void TestReplaceAll(void) {
+    const TextChar *text = u"cat Cat cat";
+    size_t len = U16Len(text);
+    size_t count = 0;
+    TextChar out[64];
+
+    size_t n = TextReplaceAll(text, len, u"cat", 3, u"dog!", 4, TEXT_FIND_MATCH_CASE, NULL, &count);
+    CHECK(count == 2);
+    CHECK(TextReplaceAll(text, len, u"cat", 3, u"dog!", 4, TEXT_FIND_MATCH_CASE, out, NULL) == n);
+    out[n] = 0;
+    CHECK(U16Equal(out, n, u"dog! Cat dog!"));
+
+    n = TextReplaceAll(text, len, u"CAT", 3, NULL, 0, 0, out, &count);
+    out[n] = 0;
+    CHECK(count == 3 && U16Equal(out, n, u"  "));
+
+    n = TextReplaceAll(u"aaaa", 4, u"aa", 2, u"b", 1, TEXT_FIND_MATCH_CASE, out, &count);
+    out[n] = 0;
+    CHECK(count == 2 && U16Equal(out, n, u"bb"));
+}
+
+static void TestCodePages(void) {
+    uint8_t bytes[256];
+    TextChar wide[256];
+    uint8_t back[256];
+    for (int i = 0; i < 256; ++i) bytes[i] = (uint8_t)i;
+
+    // Every byte of every built-in code page survives decode + encode
+    bool roundTrip = TextCodePageCount() >= 20;
+    for (size_t i = 0; i < TextCodePageCount(); ++i) {
+        const TextCodePage *cp = TextCodePageAt(i);
+        size_t unmapped = 1;
+        TextDecodeCodePage(cp, bytes, 256, wide);
+        TextEncodeCodePage(cp, wide, 256, TEXT_EOL_CRLF, back, &unmapped);
+        if (memcmp(bytes, back, 256) != 0 || unmapped != 0) {
+            fprintf(stderr, "code page %u does not round-trip\n", cp->id);
+            roundTrip = false;
+        }
+    }
+    CHECK(roundTrip);
+    CHECK(TextFindCodePage(932) == NULL);
+
+    const uint8_t sample[] = {0x80, 0xC0, 0xB0, 0x81};
+    TextDecodeCodePage(TextFindCodePage(1252), sample, 4, wide);
+    CHECK(wide[0] == 0x20AC && wide[1] == 0xC0 && wide[3] == 0x81);
+    TextDecodeCodePage(TextFindCodePage(1251), sample, 4, wide);
+    CHECK(wide[1] == 0x0410);
+    TextDecodeCodePage(TextFindCodePage(437), sample, 4, wide);
+    CHECK(wide[2] == 0x2591);
+
+    size_t unmapped = 0;
+    const TextChar mixed[] = {'a', 0x3A9, 0x20AC, 0xE9};
+    TextEncodeCodePage(TextFindCodePage(1252), mixed, 4, TEXT_EOL_CRLF, back, &unmapped);
+    CHECK(unmapped == 1 && back[1] == '?' && back[2] == 0x80 && back[3] == 0xE9);
+
+    // The vector ASCII path hands over to the tables at any offset
+    uint8_t text[100];
+    TextChar expected[100];
+    bool fastOk = true;
+    const TextCodePage *greek = TextFindCodePage(1253);
+    for (size_t at = 0; at < sizeof(text) && fastOk; ++at) {
+        for (size_t i = 0; i < sizeof(text); ++i) {
+            text[i] = (uint8_t)(i == at ? 0xC1 : 'a' + i % 26);
+            expected[i] = i == at ? 0x391 : text[i];
+        }
+        TextDecodeCodePage(greek, text, sizeof(text), wide);
+        fastOk = memcmp(wide, expected, sizeof(expected)) == 0;
+        TextEncodeCodePage(greek, wide, sizeof(text), TEXT_EOL_CRLF, back, NULL);
+        fastOk = fastOk && memcmp(back, text, sizeof(text)) == 0;
+    }
+    CHECK(fastOk);
+}
+
+static void TestEol(void) {
+    const TextChar *src = u"a\r\nb\nc\rd\r\n";
+    TextEolCounts counts = {0, 0, 0};
+    TextCountEol(src, U16Len(src), &counts);
+    CHECK(counts.crlf == 2 && counts.lf == 1 && counts.cr == 1);
+    CHECK(TextDominantEol(&counts) == TEXT_EOL_CRLF && TextEolMixed(&counts));
+    TextEolCounts lfOnly = {1, 3, 0};
+    TextEolCounts none = {0, 0, 0};
+    CHECK(TextDominantEol(&lfOnly) == TEXT_EOL_LF && TextDominantEol(&none) == TEXT_EOL_CRLF && !TextEolMixed(&none));
+
+    TextChar out[64];
+    size_t n = TextConvertEol(src, U16Len(src), TEXT_EOL_LF, out);
+    CHECK(U16Equal(out, n, u"a\nb\nc\rd\n"));
+    n = TextConvertEol(src, U16Len(src), TEXT_EOL_CR, NULL);
+    CHECK(TextConvertEol(src, U16Len(src), TEXT_EOL_CR, out) == n && U16Equal(out, n, u"a\rb\nc\rd\r"));
+
+    uint8_t bytes[64];
+    n = TextEncodeUtf8(u"\u00e9\r\nx\r\n", 6, TEXT_EOL_LF, bytes);
+    CHECK(n == 5 && memcmp(bytes, "\xC3\xA9\nx\n", 5) == 0);
+
+    // Long enough for the vector path, with CRLFs inside its blocks
+    const TextChar *lines = u"0123456789abcdef\r\n0123456789\r\nabcdef0123456789abcdef\r\n";
+    const char *expected = "0123456789abcdef\r0123456789\rabcdef0123456789abcdef\r";
+    n = TextEncodeCodePage(TextFindCodePage(1252), lines, U16Len(lines), TEXT_EOL_CR, bytes, NULL);
+    CHECK(n == strlen(expected) && memcmp(bytes, expected, n) == 0);
+    n = TextEncodeCodePage(TextFindCodePage(1252), lines, U16Len(lines), TEXT_EOL_CRLF, bytes, NULL);
+    CHECK(n == U16Len(lines));
+}
+
+static bool SameStats(const TextStats *a, const TextStats *b) {
+    return a->length == b->length && a->words == b->words && a->chars == b->chars && a->units == b->units &&
+           a->ascii == b->ascii && a->utf8Bytes == b->utf8Bytes && a->lineBreaks == b->lineBreaks;
+}
+
+static void TestStats(void) {
+    const TextChar *text = u"  Hello,\tw\u00f6rld\r\n \u4e16\u754c \U0001F600x\u3000end";
+    TextStats stats;
+    TextStatsWide(text, U16Len(text), &stats);
+    CHECK(stats.words == 5 && stats.lineBreaks == 1 && stats.chars == 24 && stats.units == 25);
+    CHECK(stats.ascii == 19 && stats.utf8Bytes == 19 + 2 + 2 * 3 + 3 + 4);
+    CHECK(!stats.startsInWord && stats.endsInWord);
+
+    // Random text with every kind of space and unpaired surrogates: the vector
+    // paths, a scalar count and any split joined back up agree
+    static const TextChar pool[] = {'a', 'Z', ' ', '\t', '\r', '\n', 0x85, 0xA0, 0xE9, 0x3A9, 0x2003, 0x3000,
+                                    0x4E16, 0xD83D, 0xDE00, 0x0B};
+    TextChar wide[3000];
+    uint8_t narrow[3000];
+    uint8_t utf8[3000 * 3];
+    unsigned seed = 12345;
+    bool ok = true;
+    for (int round = 0; round < 200 && ok; ++round) {
+        size_t length = 0;
+        seed = seed * 1103515245u + 12345u;
+        size_t n = (seed >> 8) % 3000;
+        bool latin = round % 2 == 0;
+        for (; length < n; ++length) {
+            seed = seed * 1103515245u + 12345u;
+            TextChar c = pool[(seed >> 16) % (latin ? 9 : 16)];
+            // Mostly letters, so words run past block edges
+            if ((seed >> 8) % 4) c = (TextChar)('a' + (seed >> 12) % 26);
+            wide[length] = c;
+            narrow[length] = (uint8_t)c;
+        }
+        size_t words = 0, breaks = 0, crs = 0;
+        for (size_t i = 0; i < length; ++i) {
+            words += !TextIsSpace(wide[i]) && (i == 0 || TextIsSpace(wide[i - 1]));
+            breaks += wide[i] == '\n';
+            crs += wide[i] == '\r';
+        }
+        TextStatsWide(wide, length, &stats);
+        ok = stats.words == words && stats.lineBreaks == breaks && stats.units == length - breaks - crs &&
+             stats.utf8Bytes == TextEncodeUtf8(wide, length, TEXT_EOL_CRLF, utf8) - breaks - crs;
+        if (latin) {
+            TextStats fromNarrow;
+            TextStatsNarrow(narrow, length, &fromNarrow);
+            ok = ok && SameStats(&stats, &fromNarrow);
+        }
+        TextStats joined = {0};
+        for (size_t at = 0; at < length;) {
+            seed = seed * 1103515245u + 12345u;
+            size_t take = 1 + (seed >> 8) % 100;
+            if (take > length - at) take = length - at;
+            TextStats piece;
+            TextStatsWide(wide + at, take, &piece);
+            TextStatsAppend(&joined, &piece);
+            at += take;
+        }
+        ok = ok && SameStats(&stats, &joined);
+    }
+    CHECK(ok);
+}
+
+static bool LinesGive(const TextChar *text, TextLineOp op, const TextChar *expected) {
+    size_t n = 0;
+    TextChar *out = TextLinesApply(text, U16Len(text), op, 1, &n);
+    bool same = out && U16Equal(out, n, expected) && out[n] == 0;
+    free(out);
+    return same;
+}
+
+static void TestLineOps(void) {
+    CHECK(LinesGive(u"b\r\na\r\nc", TEXT_LINES_SORT, u"a\r\nb\r\nc"));
+    CHECK(LinesGive(u"b\r\na\r\n\r\n", TEXT_LINES_SORT, u"\r\na\r\nb\r\n"));
+    CHECK(LinesGive(u"b\r\nA\r\na\r\nB", TEXT_LINES_SORT_NOCASE, u"A\r\na\r\nb\r\nB"));
+    CHECK(LinesGive(u"10\r\n9\r\n-2.5\r\nx\r\n 3\r\n0010.50\r\n-0", TEXT_LINES_SORT_NUMERIC,
+                    u"x\r\n-2.5\r\n-0\r\n 3\r\n9\r\n10\r\n0010.50"));
+    CHECK(LinesGive(u"a\r\nb\r\na\r\nb\r\nc\n", TEXT_LINES_DEDUPE, u"a\r\nb\r\nc\r\n"));
+    CHECK(LinesGive(u"a  \r\nb\t\r\n  c ", TEXT_LINES_TRIM, u"a\r\nb\r\n  c"));
+    CHECK(LinesGive(u"1\r\n2\r\n3", TEXT_LINES_REVERSE, u"3\r\n2\r\n1"));
+    CHECK(LinesGive(u"", TEXT_LINES_SORT, u""));
+
+    // Many short lines with lots of repeats: every thread count gives the
+    // single-threaded result, and sorted output is in order
+    size_t lines = 200000;
+    TextChar *text = (TextChar *)malloc(lines * 8 * sizeof(TextChar));
+    size_t length = 0;
+    unsigned seed = 99;
+    for (size_t i = 0; i < lines; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        size_t n = (seed >> 16) % 5;
+        for (size_t j = 0; j < n; ++j) text[length++] = (TextChar)("aAbB1 "[(seed >> (2 * j + 3)) % 6]);
+        text[length++] = '\r';
+        text[length++] = '\n';
+    }
+    static const TextLineOp ops[] = {TEXT_LINES_SORT, TEXT_LINES_SORT_NOCASE, TEXT_LINES_SORT_NUMERIC, TEXT_LINES_DEDUPE};
+    static const unsigned threads[] = {3, 8};
+    bool ok = true;
+    for (size_t o = 0; o < sizeof(ops) / sizeof(ops[0]) && ok; ++o) {
+        size_t n = 0;
+        TextChar *serial = TextLinesApply(text, length, ops[o], 1, &n);
+        ok = serial != NULL;
+        for (size_t t = 0; t < 2 && ok; ++t) {
+            size_t m = 0;
+            TextChar *parallel = TextLinesApply(text, length, ops[o], threads[t], &m);
+            ok = parallel && m == n && memcmp(parallel, serial, n * sizeof(TextChar)) == 0;
+            free(parallel);
+        }
+        if (ok && ops[o] == TEXT_LINES_SORT) {
+            // Adjacent lines in order
+            size_t prev = 0, prevLen = 0, start = 0;
+            for (size_t i = 0; i + 1 < n && ok; ++i) {
+                if (serial[i] != '\r') continue;
+                size_t len = i - start;
+                size_t common = len < prevLen ? len : prevLen;
+                int c = 0;
+                for (size_t k = 0; k < common && !c; ++k) c = serial[prev + k] - serial[start + k];
+                ok = c < 0 || (c == 0 && prevLen <= len);
+                prev = start;
+                prevLen = len;
+                start = i + 2;
+            }
+        }
+        if (ok && ops[o] == TEXT_LINES_DEDUPE) {
+            // Nothing left to remove
+            size_t m = 0;
+            TextChar *again = TextLinesApply(serial, n, TEXT_LINES_DEDUPE, 1, &m);
+            ok = again && m == n && n < length / 100;
+            free(again);
+        }
+        free(serial);
+    }
+    CHECK(ok);
+    free(text);
+}
+
+static void TestHash(void) {
+    // Fixed values, so the SSE2 and scalar paths (and builds) agree with each other
+    CHECK(HashBytes("", 0) == 0x3c02d634db3d887eULL);
+    CHECK(HashBytes("retropad", 8) == 0x77f8ab0e45bcf8f4ULL);
+
+    size_t size = 5000;
+    uint8_t *data = (uint8_t *)malloc(size);
+    for (size_t i = 0; i < size; ++i) data[i] = (uint8_t)(i * 131 + (i >> 9));
+    uint64_t whole = HashBytes(data, size);
+
+    // Any split of the stream gives the hash of the whole
+    bool splitsMatch = true;
+    for (size_t cut = 0; cut <= size; cut += 37) {
+        HashState state;
+        HashBegin(&state);
+        HashUpdate(&state, data, cut / 3);
+        HashUpdate(&state, data + cut / 3, cut - cut / 3);
+        HashUpdate(&state, data + cut, size - cut);
+        splitsMatch = splitsMatch && HashEnd(&state) == whole;
+    }
+    CHECK(splitsMatch);
+
+    // One flipped bit or a trailing zero byte anywhere changes it
+    bool allDiffer = HashBytes(data, size - 1) != whole && HashBytes(data, size - 1) != HashBytes(data, size - 2);
+    for (size_t i = 0; i < size; i += 61) {
+        data[i] ^= 0x10;
+        allDiffer = allDiffer && HashBytes(data, size) != whole;
+        data[i] ^= 0x10;
+    }
+    CHECK(allDiffer);
+    memset(data, 0, size);
+    CHECK(HashBytes(data, 64) != HashBytes(data, 65));
+    free(data);
+
+    // Samples: small inputs are taken whole; big ones only where the pieces lie
+    size = 1u << 20;
+    data = (uint8_t *)calloc(size, 1);
+    CHECK(HashSample(data, 5000) != HashSample(data, 5001));
+    data[4999] = 1;
+    CHECK(HashSample(data, 5000) != HashSample(data + 1, 5000));
+    uint64_t sample = HashSample(data, size);
+    uint64_t offset = 0;
+    size_t length = 0;
+    HashSamplePiece(size, HASH_SAMPLE_PIECES - 1, &offset, &length);
+    CHECK(offset + length == size);
+    HashSamplePiece(size, 1, &offset, &length);
+    data[offset + length] ^= 1;    // between pieces
+    CHECK(HashSample(data, size) == sample);
+    data[offset] ^= 1;
+    CHECK(HashSample(data, size) != sample);
+    free(data);
+}
+
+// Text of lines "L<n>" for each value, CRLF-terminated
+static TextChar *DiffText(const unsigned *values, size_t count, size_t *lengthOut) {
+    TextChar *text = (TextChar *)malloc((count * 8 + 1) * sizeof(TextChar));
+    size_t length = 0;
+    for (size_t i = 0; i < count; ++i) {
+        text[length++] = 'L';
+        text[length++] = (TextChar)('0' + values[i]);
+        text[length++] = '\r';
+        text[length++] = '\n';
+    }
+    *lengthOut = length;
+    return text;
+}
+
+// Lines outside the hunks pair up in order and are equal
+static bool DiffConsistent(const TextDiff *diff, const unsigned *a, size_t n, const unsigned *b, size_t m) {
+    size_t i = 0, j = 0;
+    for (size_t k = 0; k <= diff->count; ++k) {
+        size_t oldTo = k < diff->count ? diff->hunks[k].oldLine : n;
+        size_t newTo = k < diff->count ? diff->hunks[k].newLine : m;
+        if (oldTo - i != newTo - j) return false;
+        for (; i < oldTo; ++i, ++j) {
+            if (a[i] != b[j]) return false;
+        }
+        if (k < diff->count) {
+            i += diff->hunks[k].oldCount;
+            j += diff->hunks[k].newCount;
+        }
+    }
+    return i == n && j == m;
+}
+
+static size_t LcsLength(const unsigned *a, size_t n, const unsigned *b, size_t m) {
+    size_t *row = (size_t *)calloc(m + 1, sizeof(size_t));
+    for (size_t i = 0; i < n; ++i) {
+        size_t diag = 0;
+        for (size_t j = 0; j < m; ++j) {
+            size_t up = row[j + 1];
+            row[j + 1] = a[i] == b[j] ? diag + 1 : (row[j] > up ? row[j] : up);
+            diag = up;
+        }
+    }
+    size_t result = row[m];
+    free(row);
+    return result;
+}
+
+static void TestDiff(void) {
+    const TextChar *oldText = u"a\r\nb\r\nc\r\nd\r\n";
+    const TextChar *newText = u"a\r\nB\r\nc\r\nd\r\ne";
+    TextDiff diff;
+    CHECK(TextDiffLines(oldText, U16Len(oldText), newText, U16Len(newText), 0, &diff));
+    CHECK(diff.count == 2 && diff.oldLines == 4 && diff.newLines == 5 && !diff.approximate);
+    size_t offsets[2] = {0, 0};
+    size_t length = 0;
+    TextChar *unified = TextDiffUnified(oldText, U16Len(oldText), newText, U16Len(newText), &diff, u"old", u"new", 1,
+                                        offsets, &length);
+    CHECK(unified && U16Equal(unified, length,
+                              u"--- old\r\n+++ new\r\n@@ -1,4 +1,5 @@\r\n a\r\n-b\r\n+B\r\n c\r\n d\r\n+e\r\n"
+                              u"\\ No newline at end of file\r\n"));
+    CHECK(unified && unified[offsets[0]] == '-' && unified[offsets[1]] == '+' && unified[offsets[1] + 1] == 'e');
+    free(unified);
+    TextDiffFree(&diff);
+
+    // A missing final line break is a change; a CR before LF isn't
+    CHECK(TextDiffLines(u"x\r\ny\n", 6, u"x\ny", 3, 0, &diff) && diff.count == 1 && diff.hunks[0].oldLine == 1);
+    TextDiffFree(&diff);
+    CHECK(TextDiffLines(u"", 0, u"", 0, 0, &diff) && diff.count == 0);
+    TextDiffFree(&diff);
+
+    // Random edits over a small alphabet: minimal without a cost limit, and still a
+    // correct pairing when a tiny limit forces the heuristic
+    unsigned seed = 7;
+    bool minimal = true, consistent = true, approximated = false;
+    for (int round = 0; round < 200; ++round) {
+        unsigned a[300], b[300];
+        size_t n = 0, m = 0;
+        seed = seed * 1103515245u + 12345u;
+        size_t count = 50 + (seed >> 16) % 200;
+        for (size_t i = 0; i < count; ++i) {
+            seed = seed * 1103515245u + 12345u;
+            unsigned v = (seed >> 16) % 4;
+            unsigned edit = (seed >> 20) % 10;
+            if (edit != 0) a[n++] = v;                              // dropped from a
+            if (edit != 1) b[m++] = edit == 2 ? (v + 1) % 4 : v;    // dropped from or changed in b
+        }
+        size_t aLen = 0, bLen = 0;
+        TextChar *aText = DiffText(a, n, &aLen);
+        TextChar *bText = DiffText(b, m, &bLen);
+        for (size_t limit = 0; limit <= 2; limit += 2) {
+            if (!TextDiffLines(aText, aLen, bText, bLen, limit, &diff)) {
+                consistent = false;
+                continue;
+            }
+            consistent = consistent && DiffConsistent(&diff, a, n, b, m);
+            if (limit == 0) {
+                size_t changed = 0;
+                for (size_t k = 0; k < diff.count; ++k) changed += diff.hunks[k].oldCount + diff.hunks[k].newCount;
+                minimal = minimal && !diff.approximate && changed == n + m - 2 * LcsLength(a, n, b, m);
+            }
+            approximated = approximated || diff.approximate;
+            TextDiffFree(&diff);
+        }
+        free(aText);
+        free(bText);
+    }
+    CHECK(minimal);
+    CHECK(consistent);
+    CHECK(approximated);
+}
+
+// Runs `data` through a converter in random blocks of up to `maxBlock` bytes; false
+// when detection had to give up on UTF-8
+static bool ConvertInBlocks(const uint8_t *data, size_t size, TextEncoding from, const TextConvertTarget *to,
+                            size_t maxBlock, uint8_t **outputOut, size_t *lengthOut, TextConverter *converter) {
+    TextConverterInit(converter, from, NULL, to);
+    uint8_t *output = (uint8_t *)malloc(TextConvertBound(size) + size * 6 + 16);
+    size_t length = 0;
+    size_t pos = 0;
+    bool ok = true;
+    for (bool last = false; !last;) {
+        size_t block = pos == 0 ? 4 + rand() % maxBlock : 1 + rand() % maxBlock;
+        if (block > size - pos) block = size - pos;
+        last = pos + block == size;
+        size_t written = TextConvertStep(converter, data + pos, block, last, output + length);
+        if (written == TEXT_ERROR) {
+            ok = false;
+            break;
+        }
+        length += written;
+        pos += block;
+    }
+    TextConverterFree(converter);
+    *outputOut = output;
+    *lengthOut = length;
+    return ok;
+}
+
+static void TestConvert(void) {
+    // Mixed line breaks, two- and three-byte characters and a surrogate pair, so
+    // blocks split characters, CRLFs and pairs
+    static const char piece[] = "caf\xC3\xA9\r\nline\nold mac\r\xE2\x82\xAC \xF0\x9F\x98\x80 end\r\n";
+    size_t size = 0;
+    uint8_t *utf8 = (uint8_t *)malloc(40 * sizeof(piece));
+    for (int i = 0; i < 40; ++i) {
+        memcpy(utf8 + size, piece, sizeof(piece) - 1);
+        size += sizeof(piece) - 1;
+    }
+    size_t wideLength = TextDecode(utf8, size, ENC_UTF8, NULL);
+    TextChar *wide = (TextChar *)malloc(wideLength * sizeof(TextChar));
+    TextDecode(utf8, size, ENC_UTF8, wide);
+    TextChar *normalized = (TextChar *)malloc(2 * wideLength * sizeof(TextChar));
+    size_t normalizedLength = TextNormalizeLineEndings(wide, wideLength, normalized);
+
+    // To UTF-8 with LF, and UTF-16BE with CR, match converting the whole text at once
+    TextConvertTarget toUtf8 = {ENC_UTF8, NULL, false, TEXT_EOL_LF};
+    size_t expectedLength = TextEncodeUtf8(normalized, normalizedLength, TEXT_EOL_LF, NULL);
+    uint8_t *expected = (uint8_t *)malloc(expectedLength);
+    TextEncodeUtf8(normalized, normalizedLength, TEXT_EOL_LF, expected);
+    TextConvertTarget toUtf16 = {ENC_UTF16BE, NULL, false, TEXT_EOL_CR};
+    TextChar *crText = (TextChar *)malloc(normalizedLength * sizeof(TextChar));
+    size_t crLength = TextConvertEol(normalized, normalizedLength, TEXT_EOL_CR, crText);
+    bool utf8Match = true, utf16Match = true, kept = true;
+    for (int round = 0; round < 50; ++round) {
+        TextConverter converter;
+        uint8_t *output;
+        size_t length;
+        bool ok = ConvertInBlocks(utf8, size, 0, &toUtf8, 1 + round * 7, &output, &length, &converter);
+        utf8Match = utf8Match && ok && length == expectedLength && memcmp(output, expected, length) == 0 &&
+                    converter.eol.crlf == 80 && converter.eol.lf == 40 && converter.eol.cr == 40;
+        free(output);
+
+        ok = ConvertInBlocks(utf8, size, ENC_UTF8, &toUtf16, 1 + round * 7, &output, &length, &converter);
+        bool same = ok && length == 2 + crLength * 2 && output[0] == 0xFE && output[1] == 0xFF;
+        for (size_t i = 0; same && i < crLength; ++i) {
+            same = output[2 + 2 * i] == (uint8_t)(crText[i] >> 8) && output[3 + 2 * i] == (uint8_t)crText[i];
+        }
+        utf16Match = utf16Match && same;
+
+        // ...and back from UTF-16 keeping the line breaks gives the CR-only UTF-8 text
+        uint8_t *back;
+        size_t backLength;
+        TextConvertTarget keep = {ENC_UTF8, NULL, false, TEXT_CONVERT_KEEP_EOL};
+        ok = ConvertInBlocks(output, length, 0, &keep, 1 + round * 3, &back, &backLength, &converter);
+        size_t crUtf8Length = TextEncodeUtf8(crText, crLength, TEXT_EOL_CRLF, NULL);
+        uint8_t *crUtf8 = (uint8_t *)malloc(crUtf8Length);
+        TextEncodeUtf8(crText, crLength, TEXT_EOL_CRLF, crUtf8);
+        kept = kept && ok && converter.from == ENC_UTF16BE && converter.invalid == 0 && backLength == crUtf8Length &&
+               memcmp(back, crUtf8, backLength) == 0;
+        free(crUtf8);
+        free(back);
+        free(output);
+    }
+    CHECK(utf8Match);
+    CHECK(utf16Match);
+    CHECK(kept);
+
+    // Not UTF-8: detection gives up and the caller starts again as ANSI
+    static const uint8_t latin1[] = {'n', 'a', 0xEF, 'v', 'e', '\n'};
+    TextConverter converter;
+    uint8_t *output;
+    size_t length;
+    CHECK(!ConvertInBlocks(latin1, sizeof(latin1), 0, &toUtf8, 8, &output, &length, &converter));
+    free(output);
+    CHECK(ConvertInBlocks(latin1, sizeof(latin1), ENC_ANSI, &toUtf8, 8, &output, &length, &converter));
+    CHECK(length == 7 && output[2] == 0xC3 && output[3] == 0xAF);
+    free(output);
+    // ...while a forced UTF-8 source counts the bad sequence
+    CHECK(ConvertInBlocks(latin1, sizeof(latin1), ENC_UTF8, &toUtf8, 8, &output, &length, &converter));
+    CHECK(converter.invalid == 1);
+    free(output);
+
+    // Characters a code page lacks are counted
+    TextConvertTarget to1252 = {ENC_ANSI, TextFindCodePage(1252), false, TEXT_EOL_CRLF};
+    CHECK(ConvertInBlocks(utf8, size, 0, &to1252, 64, &output, &length, &converter));
+    CHECK(converter.unmapped == 80 && length == normalizedLength);   // both halves of the pair
+    free(output);
+    CHECK(TextConvertLooksBinary((const uint8_t *)"MZ\0\0", 4));
+    CHECK(!TextConvertLooksBinary((const uint8_t *)"\xFF\xFEh\0", 4));
+
+    free(crText);
+    free(expected);
+    free(normalized);
+    free(wide);
+    free(utf8);
+}
+
+static void TestHexDump(void) {
+    // Rows: offset, two groups of eight, characters; a short row is padded
+    TextChar row[HEX_ROW_LENGTH(16)];
+    const uint8_t bytes[] = {'H', 'i', 0, 0x7F, 0xFF, '~', ' ', 'x', 0x10};
+    size_t length = HexFormatRow(0x1234A, 8, bytes, sizeof(bytes), row);
+    CHECK(length == HEX_ROW_LENGTH(8));
+    static const char expected[] = "0001234A  48 69 00 7F FF 7E 20 78  10                       Hi...~ x.       ";
+    bool same = length == sizeof(expected) - 1;
+    for (size_t i = 0; same && i < length; ++i) same = row[i] == (TextChar)expected[i];
+    CHECK(same);
+    CHECK(HexOffsetDigits(0xFFFFFFFFull) == 8 && HexOffsetDigits(0x100000000ull) == 16);
+    CHECK(HexFormatRow(0x100000000ull, 16, bytes, 1, row) == HEX_ROW_LENGTH(16) && row[7] == '1' && row[8] == '0');
+    for (size_t i = 0; i < HEX_ROW_BYTES; ++i) {
+        CHECK(HexByteAtColumn(8, HexByteColumn(8, i)) == i && HexByteAtColumn(8, HexByteColumn(8, i) + 1) == i);
+        CHECK(HexByteAtColumn(8, HexCharColumn(8, i)) == i);
+    }
+    CHECK(HexByteAtColumn(8, 3) == HEX_ROW_BYTES && HexByteAtColumn(8, HexCharColumn(8, 0) - 1) == HEX_ROW_BYTES);
+
+    // Patterns
+    uint8_t pattern[HEX_PATTERN_MAX];
+    CHECK(HexParsePattern(u"DEad be EF", 10, pattern, sizeof(pattern)) == 4 && pattern[0] == 0xDE && pattern[3] == 0xEF);
+    CHECK(HexParsePattern(u"\"PK\" 0304", 9, pattern, sizeof(pattern)) == 4 && pattern[1] == 'K' && pattern[3] == 4);
+    CHECK(HexParsePattern(u"\"é\"", 3, pattern, sizeof(pattern)) == 2 && pattern[0] == 0xC3);
+    CHECK(HexParsePattern(u"ABC", 3, pattern, sizeof(pattern)) == 0);
+    CHECK(HexParsePattern(u"zz", 2, pattern, sizeof(pattern)) == 0);
+    CHECK(HexParsePattern(u"\"open", 5, pattern, sizeof(pattern)) == 0);
+    CHECK(HexParsePattern(u"0102", 4, pattern, 1) == 0);
+
+    // Search agrees with a plain scan for every pattern length and position, including
+    // matches in the last bytes the SSE2 loop can't reach
+    uint32_t seed = 12345;
+    size_t size = 1000;
+    uint8_t *data = (uint8_t *)malloc(size);
+    for (size_t i = 0; i < size; ++i) {
+        seed = seed * 1103515245u + 12345u;
+        data[i] = (uint8_t)("abAB\0"[(seed >> 16) % 5]);
+    }
+    bool agree = true;
+    for (size_t len = 1; len <= 7; ++len) {
+        for (size_t start = 0; start + len <= size; start += 37) {
+            size_t naive = HEX_NOT_FOUND;
+            for (size_t i = 0; i + len <= size && naive == HEX_NOT_FOUND; ++i) {
+                if (memcmp(data + i, data + start, len) == 0) naive = i;
+            }
+            agree = agree && HexFind(data, size, data + start, len) == naive;
+            agree = agree && HexFind(data + start, size - start, data + start, len) == 0;
+        }
+    }
+    CHECK(agree);
+    const uint8_t missing[] = {'z'};
+    CHECK(HexFind(data, size, missing, 1) == HEX_NOT_FOUND);
+    data[size - 1] = 'z';
+    CHECK(HexFind(data, size, missing, 1) == size - 1);
+    CHECK(HexFind(data, 3, data, 4) == HEX_NOT_FOUND);
+    free(data);
+
+    // Binary sniffing
+    CHECK(HexLooksBinary((const uint8_t *)"MZ\x90\0\3\0\0\0", 8));
+    CHECK(!HexLooksBinary((const uint8_t *)"\xFF\xFEh\0i\0", 6));
+    static const char colored[] = "\x1B[31merror\x1B[0m\tdone\r\n";
+    CHECK(!HexLooksBinary((const uint8_t *)colored, sizeof(colored) - 1));
+    static const char oneNul[] = "a long line of ordinary text with one stray NUL \0 in it\n";
+    CHECK(!HexLooksBinary((const uint8_t *)oneNul, sizeof(oneNul) - 1));
+}
+
+typedef struct TestJob {
+    size_t index;
+    uint64_t value;
+    unsigned order;
+    JobResult result;
+    bool done;
+} TestJob;
+
+static PlatformRefCount g_jobNotifies;
+static PlatformRefCount g_jobGate;
+static PlatformRefCount g_jobOrder;
+static PlatformRefCount g_jobChildren;
+
+static void CountNotify(void *context) {
+    (void)context;
+    PlatformRefIncrement(&g_jobNotifies);
+}
+
+static void TinyJob(JobContext *context, void *arg) {
+    (void)context;
+    TestJob *job = (TestJob *)arg;
+    job->value = job->index * 2 + 1;
+}
+
+// Sums a long series; `index` is the length
+static void HugeJob(JobContext *context, void *arg) {
+    TestJob *job = (TestJob *)arg;
+    uint64_t sum = 0;
+    for (size_t i = 1; i <= job->index; i++) {
+        sum += i;
+        if ((i & 0xFFFF) == 0 && JobCancelled(context)) break;
+    }
+    job->value = sum;
+}
+
+static void RecordOrder(JobContext *context, void *arg) {
+    (void)context;
+    ((TestJob *)arg)->order = (unsigned)PlatformRefLoad(&g_jobOrder);
+    PlatformRefIncrement(&g_jobOrder);
+}
+
+// Holds its worker until the gate opens or the job is cancelled
+static void GateJob(JobContext *context, void *arg) {
+    (void)arg;
+    while (!PlatformRefLoad(&g_jobGate) && !JobCancelled(context)) {
+    }
+}
+
+static void SpinUntilCancelled(JobContext *context, void *arg) {
+    (void)arg;
+    PlatformRefIncrement(&g_jobGate);
+    while (!JobCancelled(context)) {
+    }
+}
+
+static void ChildJob(JobContext *context, void *arg) {
+    TinyJob(context, arg);
+    PlatformRefIncrement(&g_jobChildren);
+}
+
+// Spawns its children and stays busy until they're done, so each one has to be stolen
+static void ParentJob(JobContext *context, void *arg) {
+    TestJob *children = (TestJob *)arg;
+    for (size_t i = 0; i < 1000; i++) {
+        if (!JobSpawn(context, JOB_BULK, ChildJob, NULL, &children[i])) return;
+    }
+    while (PlatformRefLoad(&g_jobChildren) != 1000) {
+    }
+}
+
+static void StoreResult(const JobResult *result, void *arg) {
+    TestJob *job = (TestJob *)arg;
+    job->result = *result;
+    job->done = true;
+}
+
+static void TestJobs(void) {
+    enum { TINY = 5000, HUGE = 4, QUEUED = 100 };
+    TestJob *jobs = (TestJob *)calloc(TINY + 1000, sizeof(TestJob));
+    TestJob huge[HUGE];
+    memset(huge, 0, sizeof(huge));
+    JobPool *pool = JobPoolCreate(4, CountNotify, NULL);
+    CHECK(pool != NULL);
+    if (!jobs || !pool) {
+        free(jobs);
+        JobPoolDestroy(pool);
+        return;
+    }
+
+    // Thousands of tiny interactive jobs next to a few huge bulk ones
+    bool submitted = true;
+    for (size_t i = 0; i < HUGE; i++) {
+        huge[i].index = 20000000 + i;
+        submitted = submitted && JobSubmit(pool, JOB_BULK, NULL, HugeJob, StoreResult, &huge[i]);
+    }
+    for (size_t i = 0; i < TINY; i++) {
+        jobs[i].index = i;
+        submitted = submitted && JobSubmit(pool, JOB_INTERACTIVE, NULL, TinyJob, i % 2 ? StoreResult : NULL, &jobs[i]);
+    }
+    CHECK(submitted);
+    JobPoolWait(pool);
+    CHECK(PlatformRefLoad(&g_jobNotifies) == 1);
+    CHECK(JobPoolDrain(pool) == HUGE + TINY / 2);
+    CHECK(JobPoolDrain(pool) == 0);
+    bool tinyOk = true;
+    for (size_t i = 0; i < TINY; i++) {
+        tinyOk = tinyOk && jobs[i].value == i * 2 + 1 && jobs[i].done == (i % 2 == 1);
+        if (jobs[i].done) tinyOk = tinyOk && jobs[i].result.ran && !jobs[i].result.cancelled && jobs[i].result.worker < 4;
+    }
+    CHECK(tinyOk);
+    for (size_t i = 0; i < HUGE; i++) {
+        uint64_t n = huge[i].index;
+        CHECK(huge[i].done && huge[i].result.ran && huge[i].result.priority == JOB_BULK);
+        CHECK(huge[i].value == n * (n + 1) / 2);
+        CHECK(huge[i].result.runNanos > 0);
+    }
+    JobPoolStats stats;
+    JobPoolGetStats(pool, &stats);
+    CHECK(stats.workers == 4);
+    CHECK(stats.submitted[JOB_INTERACTIVE] == TINY && stats.completed[JOB_INTERACTIVE] == TINY);
+    CHECK(stats.submitted[JOB_BULK] == HUGE && stats.completed[JOB_BULK] == HUGE);
+    CHECK(stats.skipped[JOB_INTERACTIVE] == 0 && stats.skipped[JOB_BULK] == 0);
+    CHECK(stats.runNanos[JOB_BULK] > 0 && stats.maxWaitNanos[JOB_INTERACTIVE] * TINY >= stats.waitNanos[JOB_INTERACTIVE]);
+
+    // Children spawned by a busy job are stolen by the other workers
+    for (size_t i = 0; i < 1000; i++) {
+        jobs[TINY + i].index = i;
+        jobs[TINY + i].value = 0;
+    }
+    CHECK(JobSubmit(pool, JOB_BULK, NULL, ParentJob, NULL, &jobs[TINY]));
+    JobPoolWait(pool);
+    bool childrenOk = true;
+    for (size_t i = 0; i < 1000; i++) childrenOk = childrenOk && jobs[TINY + i].value == i * 2 + 1;
+    CHECK(childrenOk);
+    JobPoolGetStats(pool, &stats);
+    CHECK(stats.steals == 1000);
+    CHECK(stats.submitted[JOB_BULK] == HUGE + 1 + 1000 && stats.completed[JOB_BULK] == HUGE + 1 + 1000);
+    JobPoolDestroy(pool);
+
+    // One worker: jobs queued behind a busy one are skipped once their token is
+    // cancelled, and interactive jobs go ahead of bulk jobs submitted before them
+    pool = JobPoolCreate(1, NULL, NULL);
+    JobToken *token = JobTokenCreate();
+    CHECK(pool != NULL && token != NULL);
+    if (!pool || !token) {
+        JobTokenRelease(token);
+        JobPoolDestroy(pool);
+        free(jobs);
+        return;
+    }
+    memset(jobs, 0, (TINY + 1000) * sizeof(TestJob));
+    CHECK(JobSubmit(pool, JOB_INTERACTIVE, NULL, GateJob, NULL, NULL));
+    for (size_t i = 0; i < QUEUED; i++) {
+        jobs[i].index = i;
+        CHECK(JobSubmit(pool, JOB_BULK, token, TinyJob, StoreResult, &jobs[i]));
+    }
+    for (size_t i = 0; i < 20; i++) {
+        CHECK(JobSubmit(pool, i < 10 ? JOB_BULK : JOB_INTERACTIVE, NULL, RecordOrder, StoreResult, &jobs[QUEUED + i]));
+    }
+    JobTokenCancel(token);
+    CHECK(JobTokenCancelled(token) && !JobTokenCancelled(NULL));
+    JobTokenRelease(token);
+    PlatformRefIncrement(&g_jobGate);
+    JobPoolWait(pool);
+    CHECK(JobPoolDrain(pool) == QUEUED + 20);
+    bool skipped = true;
+    for (size_t i = 0; i < QUEUED; i++) {
+        skipped = skipped && jobs[i].done && !jobs[i].result.ran && jobs[i].result.cancelled && jobs[i].value == 0;
+    }
+    CHECK(skipped);
+    bool ordered = true;
+    for (size_t i = 0; i < 10; i++) {
+        ordered = ordered && jobs[QUEUED + i].order == 10 + i && jobs[QUEUED + 10 + i].order == i;
+    }
+    CHECK(ordered);
+    JobPoolGetStats(pool, &stats);
+    CHECK(stats.skipped[JOB_BULK] == QUEUED && stats.completed[JOB_BULK] == 10);
+    CHECK(stats.completed[JOB_INTERACTIVE] == 11);
+
+    // A running job stops when its token is cancelled
+    g_jobGate = 0;
+    token = JobTokenCreate();
+    TestJob spinner;
+    memset(&spinner, 0, sizeof(spinner));
+    CHECK(JobSubmit(pool, JOB_INTERACTIVE, token, SpinUntilCancelled, StoreResult, &spinner));
+    while (!PlatformRefLoad(&g_jobGate)) {
+    }
+    JobTokenCancel(token);
+    JobPoolWait(pool);
+    CHECK(JobPoolDrain(pool) == 1);
+    CHECK(spinner.done && spinner.result.ran && spinner.result.cancelled);
+    JobTokenRelease(token);
+
+    // Destroying the pool stops the running job, skips queued ones and still
+    // delivers their completions
+    g_jobGate = 0;
+    memset(jobs, 0, QUEUED * sizeof(TestJob));
+    CHECK(JobSubmit(pool, JOB_INTERACTIVE, NULL, GateJob, StoreResult, &spinner));
+    for (size_t i = 0; i < QUEUED; i++) CHECK(JobSubmit(pool, JOB_BULK, NULL, TinyJob, StoreResult, &jobs[i]));
+    JobPoolDestroy(pool);
+    bool delivered = true;
+    for (size_t i = 0; i < QUEUED; i++) delivered = delivered && jobs[i].done && !jobs[i].result.ran && jobs[i].value == 0;
+    CHECK(delivered);
+    free(jobs);
+}
+
+int main(void) {
+    TestDetectEncoding();
+    TestDecode();
+    TestEncodeUtf8();
+    TestNormalize();
+    TestFind();
+    TestReplaceAll();
+    TestCodePages();
+    TestEol();
+    TestStats();
+    TestLineOps();
+    TestHash();
+    TestDiff();
+    TestConvert();
+    TestHexDump();
+    TestJobs();
+
+    printf("%d checks, %d failures\n", g_checks, g_failures);
+    return g_failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
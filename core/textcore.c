@@ -0,0 +1,497 @@
+// Text core for retropad: portable encoding, normalization and search helpers.
+#include "textcore.h"
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define TEXTCORE_SSE2 1
+#endif
+
+#define REPLACEMENT_CHAR 0xFFFD
+
+static bool IsAsciiWord(const uint8_t *p) {
+    uint64_t word;
+    memcpy(&word, p, sizeof(word));
+    return (word & 0x8080808080808080ull) == 0;
+}
+
+size_t TextBomLength(const uint8_t *data, size_t size, TextEncoding encoding) {
+    switch (encoding) {
+    case ENC_UTF8:
+        return (size >= 3 && data[0] == 0xEF && data[1] == 0xBB && data[2] == 0xBF) ? 3 : 0;
+    case ENC_UTF16LE:
+        return (size >= 2 && data[0] == 0xFF && data[1] == 0xFE) ? 2 : 0;
+    case ENC_UTF16BE:
+        return (size >= 2 && data[0] == 0xFE && data[1] == 0xFF) ? 2 : 0;
+    case ENC_ANSI:
+    default:
+        return 0;
+    }
+}
+
+// Length of the well-formed sequence starting with lead byte `b`, with the
+// allowed range for the second byte (rules out overlongs and surrogates).
+static size_t Utf8SequenceInfo(uint8_t b, uint8_t *lo, uint8_t *hi, uint32_t *bits) {
+    *lo = 0x80;
+    *hi = 0xBF;
+    if (b >= 0xC2 && b <= 0xDF) {
+        *bits = b & 0x1F;
+        return 2;
+    }
+    if (b >= 0xE0 && b <= 0xEF) {
+        if (b == 0xE0) *lo = 0xA0;
+        if (b == 0xED) *hi = 0x9F;
+        *bits = b & 0x0F;
+        return 3;
+    }
+    if (b >= 0xF0 && b <= 0xF4) {
+        if (b == 0xF0) *lo = 0x90;
+        if (b == 0xF4) *hi = 0x8F;
+        *bits = b & 0x07;
+        return 4;
+    }
+    return 0;
+}
+
+bool TextIsValidUtf8(const uint8_t *data, size_t size) {
+    size_t i = 0;
+    while (i < size) {
+        if (data[i] < 0x80) {
+            while (i + 8 <= size && IsAsciiWord(data + i)) i += 8;
+            while (i < size && data[i] < 0x80) ++i;
+            continue;
+        }
+        uint8_t lo, hi;
+        uint32_t bits;
+        size_t seqLen = Utf8SequenceInfo(data[i], &lo, &hi, &bits);
+        if (seqLen == 0 || i + seqLen > size) return false;
+        if (data[i + 1] < lo || data[i + 1] > hi) return false;
+        for (size_t j = 2; j < seqLen; ++j) {
+            if ((data[i + j] & 0xC0) != 0x80) return false;
+        }
+        i += seqLen;
+    }
+    return true;
+}
+
+TextEncoding TextDetectEncoding(const uint8_t *data, size_t size) {
+    if (size >= 2 && data[0] == 0xFF && data[1] == 0xFE) {
+        return ENC_UTF16LE;
+    }
+    if (size >= 2 && data[0] == 0xFE && data[1] == 0xFF) {
+        return ENC_UTF16BE;
+    }
+    if (size >= 3 && data[0] == 0xEF && data[1] == 0xBB && data[2] == 0xBF) {
+        return ENC_UTF8;
+    }
+    return TextIsValidUtf8(data, size) ? ENC_UTF8 : ENC_ANSI;
+}
+
+size_t TextDecodeBound(size_t size, TextEncoding encoding) {
+    switch (encoding) {
+    case ENC_UTF16LE:
+    case ENC_UTF16BE:
+        return size / 2;
+    case ENC_UTF8:
+    case ENC_ANSI:
+    default:
+        // Every UTF-8 byte yields at most one UTF-16 unit
+        return size;
+    }
+}
+
+// Decode one non-ASCII sequence at data[i]; returns bytes consumed and stores the
+// code point (U+FFFD for an ill-formed maximal subpart).
+static size_t DecodeUtf8Sequence(const uint8_t *data, size_t size, size_t i, uint32_t *cpOut) {
+    uint8_t lo, hi;
+    uint32_t cp;
+    size_t seqLen = Utf8SequenceInfo(data[i], &lo, &hi, &cp);
+    if (seqLen == 0) {
+        *cpOut = REPLACEMENT_CHAR;
+        return 1;
+    }
+    size_t j = 1;
+    for (; j < seqLen; ++j) {
+        if (i + j >= size) break;
+        uint8_t c = data[i + j];
+        if (c < lo || c > hi) break;
+        lo = 0x80;
+        hi = 0xBF;
+        cp = (cp << 6) | (c & 0x3F);
+    }
+    if (j < seqLen) {
+        *cpOut = REPLACEMENT_CHAR;
+        return j;
+    }
+    *cpOut = cp;
+    return seqLen;
+}
+
+size_t TextDecodeUtf8Char(const uint8_t *data, size_t size, uint32_t *cpOut, bool *validOut) {
+    if (data[0] < 0x80) {
+        *cpOut = data[0];
+        *validOut = true;
+        return 1;
+    }
+    uint8_t lo, hi;
+    uint32_t bits;
+    size_t seqLen = Utf8SequenceInfo(data[0], &lo, &hi, &bits);
+    size_t used = DecodeUtf8Sequence(data, size, 0, cpOut);
+    *validOut = seqLen != 0 && used == seqLen;
+    return used;
+}
+
+static size_t DecodeUtf8(const uint8_t *data, size_t size, TextChar *dst) {
+    size_t i = 0;
+    size_t out = 0;
+    while (i < size) {
+        if (data[i] < 0x80) {
+            while (i + 8 <= size && IsAsciiWord(data + i)) {
+                if (dst) {
+                    for (size_t k = 0; k < 8; ++k) dst[out + k] = data[i + k];
+                }
+                i += 8;
+                out += 8;
+            }
+            while (i < size && data[i] < 0x80) {
+                if (dst) dst[out] = data[i];
+                ++out;
+                ++i;
+            }
+            continue;
+        }
+
+        uint32_t cp;
+        i += DecodeUtf8Sequence(data, size, i, &cp);
+        if (cp >= 0x10000) {
+            if (dst) {
+                cp -= 0x10000;
+                dst[out] = (TextChar)(0xD800 + (cp >> 10));
+                dst[out + 1] = (TextChar)(0xDC00 + (cp & 0x3FF));
+            }
+            out += 2;
+        } else {
+            if (dst) dst[out] = (TextChar)cp;
+            ++out;
+        }
+    }
+    return out;
+}
+
+size_t TextDecode(const uint8_t *data, size_t size, TextEncoding encoding, TextChar *dst) {
+    size_t offset = TextBomLength(data, size, encoding);
+    return TextDecodeRaw(data + offset, size - offset, encoding, dst);
+}
+
+size_t TextSplitPoint(const uint8_t *data, size_t size, size_t at, TextEncoding encoding) {
+    if (at >= size) return size;
+    switch (encoding) {
+    case ENC_UTF16LE:
+    case ENC_UTF16BE:
+        return at & ~(size_t)1;
+    case ENC_UTF8:
+        // Back up to the lead byte; a valid sequence has at most three continuations
+        for (size_t back = 0; back < 4 && back <= at; ++back) {
+            if ((data[at - back] & 0xC0) != 0x80) return at - back;
+        }
+        return at;
+    case ENC_ANSI:
+    default:
+        return at;
+    }
+}
+
+size_t TextDecodeRaw(const uint8_t *data, size_t size, TextEncoding encoding, TextChar *dst) {
+    switch (encoding) {
+    case ENC_UTF16LE: {
+        size_t count = size / 2;
+        if (dst) {
+            for (size_t i = 0; i < count; ++i) {
+                dst[i] = (TextChar)(data[i * 2] | (data[i * 2 + 1] << 8));
+            }
+        }
+        return count;
+    }
+    case ENC_UTF16BE: {
+        size_t count = size / 2;
+        if (dst) {
+            for (size_t i = 0; i < count; ++i) {
+                dst[i] = (TextChar)((data[i * 2] << 8) | data[i * 2 + 1]);
+            }
+        }
+        return count;
+    }
+    case ENC_UTF8:
+        return DecodeUtf8(data, size, dst);
+    case ENC_ANSI:
+        if (dst) {
+            for (size_t i = 0; i < size; ++i) dst[i] = data[i];
+        }
+        return size;
+    default:
+        return TEXT_ERROR;
+    }
+}
+
+size_t TextEncodeUtf8(const TextChar *text, size_t length, TextEol eol, uint8_t *dst) {
+    size_t out = 0;
+    for (size_t i = 0; i < length; ++i) {
+        uint32_t c = text[i];
+        if (c == '\r' && eol != TEXT_EOL_CRLF && i + 1 < length && text[i + 1] == '\n') {
+            if (dst) dst[out] = eol == TEXT_EOL_LF ? '\n' : '\r';
+            out += 1;
+            ++i;
+        } else if (c < 0x80) {
+            if (dst) dst[out] = (uint8_t)c;
+            out += 1;
+        } else if (c < 0x800) {
+            if (dst) {
+                dst[out] = (uint8_t)(0xC0 | (c >> 6));
+                dst[out + 1] = (uint8_t)(0x80 | (c & 0x3F));
+            }
+            out += 2;
+        } else if (c >= 0xD800 && c <= 0xDBFF && i + 1 < length && text[i + 1] >= 0xDC00 && text[i + 1] <= 0xDFFF) {
+            uint32_t cp = 0x10000 + ((c - 0xD800) << 10) + (text[i + 1] - 0xDC00);
+            if (dst) {
+                dst[out] = (uint8_t)(0xF0 | (cp >> 18));
+                dst[out + 1] = (uint8_t)(0x80 | ((cp >> 12) & 0x3F));
+                dst[out + 2] = (uint8_t)(0x80 | ((cp >> 6) & 0x3F));
+                dst[out + 3] = (uint8_t)(0x80 | (cp & 0x3F));
+            }
+            out += 4;
+            ++i;
+        } else {
+            if (c >= 0xD800 && c <= 0xDFFF) c = REPLACEMENT_CHAR;
+            if (dst) {
+                dst[out] = (uint8_t)(0xE0 | (c >> 12));
+                dst[out + 1] = (uint8_t)(0x80 | ((c >> 6) & 0x3F));
+                dst[out + 2] = (uint8_t)(0x80 | (c & 0x3F));
+            }
+            out += 3;
+        }
+    }
+    return out;
+}
+
+size_t TextNormalizeLineEndings(const TextChar *text, size_t length, TextChar *dst) {
+    size_t out = 0;
+    for (size_t i = 0; i < length; ++i) {
+        TextChar c = text[i];
+        if (c == '\r' || c == '\n') {
+            // CRLF stays as-is; lone CR or LF becomes CRLF
+            if (c == '\r' && i + 1 < length && text[i + 1] == '\n') ++i;
+            if (dst) {
+                dst[out] = '\r';
+                dst[out + 1] = '\n';
+            }
+            out += 2;
+        } else {
+            if (dst) dst[out] = c;
+            ++out;
+        }
+    }
+    return out;
+}
+
+size_t TextConvertEol(const TextChar *text, size_t length, TextEol eol, TextChar *dst) {
+    if (eol == TEXT_EOL_CRLF) {
+        if (dst) memcpy(dst, text, length * sizeof(TextChar));
+        return length;
+    }
+    size_t out = 0;
+    for (size_t i = 0; i < length; ++i) {
+        TextChar c = text[i];
+        if (c == '\r' && i + 1 < length && text[i + 1] == '\n') {
+            c = eol == TEXT_EOL_LF ? '\n' : '\r';
+            ++i;
+        }
+        if (dst) dst[out] = c;
+        ++out;
+    }
+    return out;
+}
+
+void TextCountEol(const TextChar *text, size_t length, TextEolCounts *counts) {
+    for (size_t i = 0; i < length; ++i) {
+        if (text[i] == '\n') {
+            counts->lf++;
+        } else if (text[i] == '\r') {
+            if (i + 1 < length && text[i + 1] == '\n') {
+                counts->crlf++;
+                ++i;
+            } else {
+                counts->cr++;
+            }
+        }
+    }
+}
+
+TextEol TextDominantEol(const TextEolCounts *counts) {
+    if (counts->crlf >= counts->lf && counts->crlf >= counts->cr) return TEXT_EOL_CRLF;
+    return counts->lf >= counts->cr ? TEXT_EOL_LF : TEXT_EOL_CR;
+}
+
+bool TextEolMixed(const TextEolCounts *counts) {
+    return (counts->crlf != 0) + (counts->lf != 0) + (counts->cr != 0) > 1;
+}
+
+bool TextIsCrlfOnly(const TextChar *text, size_t length) {
+    for (size_t i = 0; i < length; ++i) {
+        TextChar c = text[i];
+        if (c > '\r') continue;
+        if (c == '\n') return false;
+        if (c == '\r') {
+            if (i + 1 >= length || text[i + 1] != '\n') return false;
+            ++i;
+        }
+    }
+    return true;
+}
+
+size_t TextLength(const TextChar *text) {
+    const TextChar *p = text;
+    while (*p) ++p;
+    return (size_t)(p - text);
+}
+
+static bool MatchAt(const TextChar *text, const TextChar *needle, size_t needleLength, bool matchCase) {
+    if (matchCase) {
+        return memcmp(text, needle, needleLength * sizeof(TextChar)) == 0;
+    }
+    for (size_t i = 0; i < needleLength; ++i) {
+        if (TextFoldChar(text[i]) != TextFoldChar(needle[i])) return false;
+    }
+    return true;
+}
+
+static bool AtWordBreaks(const TextChar *text, size_t length, size_t pos, size_t needleLength, unsigned flags) {
+    bool before = pos == 0 ? !(flags & TEXT_FIND_WORD_BEFORE) : !TextIsWordChar(text[pos - 1]);
+    bool after = pos + needleLength >= length ? !(flags & TEXT_FIND_WORD_AFTER)
+                                              : !TextIsWordChar(text[pos + needleLength]);
+    return before && after;
+}
+
+// First i in [from, last] where text[i] (folded unless matchCase) is `first`, or
+// TEXT_ERROR. SSE2 looks at 8 units at a time; ASCII folds there by setting 0x20 on
+// A-Z, and only blocks holding other characters go through the table.
+static size_t NextCandidate(const TextChar *text, size_t from, size_t last, TextChar first, bool matchCase) {
+    size_t i = from;
+#ifdef TEXTCORE_SSE2
+    const __m128i want = _mm_set1_epi16((short)first);
+    const __m128i nonAscii = _mm_set1_epi16((short)0xFF80);
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i beforeA = _mm_set1_epi16('A' - 1);
+    const __m128i afterZ = _mm_set1_epi16('Z' + 1);
+    const __m128i caseBit = _mm_set1_epi16(0x20);
+    for (; i + 8 <= last + 1; i += 8) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(text + i));
+        if (!matchCase) {
+            if (_mm_movemask_epi8(_mm_cmpeq_epi16(_mm_and_si128(v, nonAscii), zero)) != 0xFFFF) {
+                for (size_t k = i; k < i + 8; ++k) {
+                    if (TextFoldChar(text[k]) == first) return k;
+                }
+                continue;
+            }
+            __m128i upper = _mm_and_si128(_mm_cmpgt_epi16(v, beforeA), _mm_cmplt_epi16(v, afterZ));
+            v = _mm_or_si128(v, _mm_and_si128(upper, caseBit));
+        }
+        int mask = _mm_movemask_epi8(_mm_cmpeq_epi16(v, want));
+        if (mask) {
+            while (!(mask & 1)) mask >>= 2, ++i;
+            return i;
+        }
+    }
+#endif
+    for (; i <= last; ++i) {
+        if ((matchCase ? text[i] : TextFoldChar(text[i])) == first) return i;
+    }
+    return TEXT_ERROR;
+}
+
+size_t TextFindForward(const TextChar *text, size_t length, const TextChar *needle, size_t needleLength,
+                       unsigned flags, size_t from) {
+    if (needleLength == 0 || needleLength > length) return TEXT_ERROR;
+    bool matchCase = (flags & TEXT_FIND_MATCH_CASE) != 0;
+    bool wholeWord = (flags & TEXT_FIND_WHOLE_WORD) != 0;
+    size_t last = length - needleLength;
+    TextChar first = matchCase ? needle[0] : TextFoldChar(needle[0]);
+    for (size_t i = from; i <= last; ++i) {
+        i = NextCandidate(text, i, last, first, matchCase);
+        if (i == TEXT_ERROR) break;
+        if (MatchAt(text + i + 1, needle + 1, needleLength - 1, matchCase) &&
+            (!wholeWord || AtWordBreaks(text, length, i, needleLength, flags))) {
+            return i;
+        }
+    }
+    return TEXT_ERROR;
+}
+
+size_t TextFindBackward(const TextChar *text, size_t length, const TextChar *needle, size_t needleLength,
+                        unsigned flags, size_t limit) {
+    if (needleLength == 0 || needleLength > length || limit == 0) return TEXT_ERROR;
+    bool matchCase = (flags & TEXT_FIND_MATCH_CASE) != 0;
+    bool wholeWord = (flags & TEXT_FIND_WHOLE_WORD) != 0;
+    size_t i = length - needleLength;
+    if (i > limit - 1) i = limit - 1;
+    for (;;) {
+        if (MatchAt(text + i, needle, needleLength, matchCase) &&
+            (!wholeWord || AtWordBreaks(text, length, i, needleLength, flags))) {
+            return i;
+        }
+        if (i == 0) break;
+        --i;
+    }
+    return TEXT_ERROR;
+}
+
+bool TextFind(const TextChar *text, size_t length, const TextChar *needle, size_t needleLength,
+              unsigned flags, size_t start, size_t *matchOut) {
+    if (!needle || needleLength == 0) return false;
+    if (start > length) start = length;
+
+    size_t found;
+    if (flags & TEXT_FIND_DOWN) {
+        found = TextFindForward(text, length, needle, needleLength, flags, start);
+        if (found == TEXT_ERROR && start > 0) {
+            found = TextFindForward(text, length, needle, needleLength, flags, 0);
+        }
+    } else {
+        found = TextFindBackward(text, length, needle, needleLength, flags, start);
+        if (found == TEXT_ERROR && start < length) {
+            found = TextFindBackward(text, length, needle, needleLength, flags, length);
+            if (found != TEXT_ERROR && found < start) found = TEXT_ERROR;
+        }
+    }
+
+    if (found == TEXT_ERROR) return false;
+    *matchOut = found;
+    return true;
+}
+
+size_t TextReplaceAll(const TextChar *text, size_t length, const TextChar *needle, size_t needleLength,
+                      const TextChar *replacement, size_t replacementLength, unsigned flags,
+                      TextChar *dst, size_t *countOut) {
+    size_t count = 0;
+    size_t out = 0;
+    size_t copyFrom = 0;
+
+    if (needle && needleLength > 0) {
+        size_t pos;
+        while ((pos = TextFindForward(text, length, needle, needleLength, flags, copyFrom)) != TEXT_ERROR) {
+            size_t run = pos - copyFrom;
+            if (dst) {
+                memcpy(dst + out, text + copyFrom, run * sizeof(TextChar));
+                if (replacementLength) memcpy(dst + out + run, replacement, replacementLength * sizeof(TextChar));
+            }
+            out += run + replacementLength;
+            copyFrom = pos + needleLength;
+            ++count;
+        }
+    }
+
+    size_t tail = length - copyFrom;
+    if (dst) memcpy(dst + out, text + copyFrom, tail * sizeof(TextChar));
+    out += tail;
+    if (countOut) *countOut = count;
+    return out;
+}
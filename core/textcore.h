@@ -0,0 +1,135 @@
+// Platform-neutral text core for retropad: encoding detection, decode/encode,
+// line-ending normalization and search/replace over UTF-16 buffers.
+// Nothing here allocates; callers size buffers with the measure calls (dst == NULL).
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef uint16_t TextChar;   // one UTF-16 code unit (WCHAR on Windows)
+
+typedef enum TextEncoding {
+    ENC_UTF8 = 1,
+    ENC_UTF16LE = 2,
+    ENC_UTF16BE = 3,
+    ENC_ANSI = 4
+} TextEncoding;
+
+#define TEXT_ERROR ((size_t)-1)
+
+// How line breaks are written to a file. Text in memory always uses CRLF.
+typedef enum TextEol {
+    TEXT_EOL_CRLF = 0,
+    TEXT_EOL_LF = 1,
+    TEXT_EOL_CR = 2
+} TextEol;
+
+typedef struct TextEolCounts {
+    size_t crlf;
+    size_t lf;      // LF without a CR before it
+    size_t cr;      // CR without an LF after it
+} TextEolCounts;
+
+enum {
+    TEXT_FIND_MATCH_CASE = 0x1,
+    TEXT_FIND_DOWN = 0x2,
+    TEXT_FIND_WHOLE_WORD = 0x4,     // no word character (TextIsWordChar) right before or after
+    // With TEXT_FIND_WHOLE_WORD on a slice of a longer text: the character just before
+    // (after) the slice is a word character, so that end of the slice isn't a break
+    TEXT_FIND_WORD_BEFORE = 0x8,
+    TEXT_FIND_WORD_AFTER = 0x10
+};
+
+// BOM sniffing, then strict UTF-8 validation; anything else is ANSI.
+TextEncoding TextDetectEncoding(const uint8_t *data, size_t size);
+bool TextIsValidUtf8(const uint8_t *data, size_t size);
+size_t TextBomLength(const uint8_t *data, size_t size, TextEncoding encoding);
+
+// Upper bound on TextDecode output so callers can decode in a single pass.
+size_t TextDecodeBound(size_t size, TextEncoding encoding);
+
+// Decode to UTF-16, skipping any BOM. Invalid UTF-8 becomes U+FFFD per maximal
+// subpart. ENC_ANSI is treated as ISO-8859-1 here; callers with a real code page
+// map it themselves. Returns units written (or needed when dst is NULL).
+size_t TextDecode(const uint8_t *data, size_t size, TextEncoding encoding, TextChar *dst);
+
+// TextDecode without BOM handling, for decoding a file block by block.
+size_t TextDecodeRaw(const uint8_t *data, size_t size, TextEncoding encoding, TextChar *dst);
+
+// One UTF-8 sequence at data[0] (size > 0). Returns the bytes consumed and the code
+// point in *cpOut; an ill-formed maximal subpart gives U+FFFD with *validOut false.
+size_t TextDecodeUtf8Char(const uint8_t *data, size_t size, uint32_t *cpOut, bool *validOut);
+
+// Largest split point <= `at` that does not cut a UTF-16 unit or a UTF-8 sequence,
+// so both halves decode exactly as the whole would.
+size_t TextSplitPoint(const uint8_t *data, size_t size, size_t at, TextEncoding encoding);
+
+// UTF-16 to UTF-8 (unpaired surrogates become U+FFFD), writing each CRLF as `eol`.
+// Returns bytes written/needed.
+size_t TextEncodeUtf8(const TextChar *text, size_t length, TextEol eol, uint8_t *dst);
+
+// Rewrite LF, CR and CRLF as CRLF. Returns units written/needed.
+size_t TextNormalizeLineEndings(const TextChar *text, size_t length, TextChar *dst);
+
+// Copy with each CRLF written as `eol`; lone CRs and LFs are kept. Returns units
+// written/needed.
+size_t TextConvertEol(const TextChar *text, size_t length, TextEol eol, TextChar *dst);
+
+// Adds up the line breaks in `text` by style.
+void TextCountEol(const TextChar *text, size_t length, TextEolCounts *counts);
+// The most common style; ties and text without line breaks go to CRLF, then LF.
+TextEol TextDominantEol(const TextEolCounts *counts);
+bool TextEolMixed(const TextEolCounts *counts);
+
+// True when every CR is followed by LF and every LF preceded by CR, i.e.
+// TextNormalizeLineEndings would return the text unchanged. Stops at the first offender.
+bool TextIsCrlfOnly(const TextChar *text, size_t length);
+
+size_t TextLength(const TextChar *text);
+
+// Notepad search semantics: searching down starts at `start` and wraps to the top;
+// searching up finds the last match before `start` and wraps to the bottom. Without
+// TEXT_FIND_MATCH_CASE both sides are compared through TextFoldChar as they're read.
+bool TextFind(const TextChar *text, size_t length, const TextChar *needle, size_t needleLength,
+              unsigned flags, size_t start, size_t *matchOut);
+
+// Building blocks for TextFind without wrapping: the first match at or after `from`,
+// or the last match starting before `limit`; TEXT_ERROR when there is none. `flags`
+// other than TEXT_FIND_DOWN apply; for whole words the ends of `text` count as breaks
+// unless TEXT_FIND_WORD_BEFORE/TEXT_FIND_WORD_AFTER say otherwise.
+size_t TextFindForward(const TextChar *text, size_t length, const TextChar *needle, size_t needleLength,
+                       unsigned flags, size_t from);
+size_t TextFindBackward(const TextChar *text, size_t length, const TextChar *needle, size_t needleLength,
+                        unsigned flags, size_t limit);
+
+// Replace every non-overlapping match. Returns the output length (written when dst
+// is non-NULL) and the number of replacements in *countOut.
+size_t TextReplaceAll(const TextChar *text, size_t length, const TextChar *needle, size_t needleLength,
+                      const TextChar *replacement, size_t replacementLength, unsigned flags,
+                      TextChar *dst, size_t *countOut);
+
+// Simple Unicode lowercase mapping (BMP), table generated by gen_tables.py.
+extern const uint16_t *const g_textLowerPages[256];
+
+static inline TextChar TextLowerChar(TextChar c) {
+    const uint16_t *page = g_textLowerPages[c >> 8];
+    return page ? page[c & 0xFF] : c;
+}
+
+// Simple Unicode case folding (BMP), what case-insensitive search compares. Unlike
+// lowercasing it also joins e.g. U+00B5 with U+03BC and U+017F with 's'.
+extern const uint16_t *const g_textFoldPages[256];
+
+static inline TextChar TextFoldChar(TextChar c) {
+    const uint16_t *page = g_textFoldPages[c >> 8];
+    return page ? page[c & 0xFF] : c;
+}
+
+// Letters, marks, digits, connector punctuation and surrogates (gen_tables.py)
+extern const uint8_t g_textWordPages[256];
+extern const uint8_t g_textWordBits[][32];
+
+static inline bool TextIsWordChar(TextChar c) {
+    return (g_textWordBits[g_textWordPages[c >> 8]][(c & 0xFF) >> 3] >> (c & 7)) & 1;
+}
@@ -0,0 +1,192 @@
+// Word, character and size counts for retropad: a 16-unit SSE2 classifier with a
+// scalar path for the rest.
+#include "textstats.h"
+#include <string.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define STATS_SSE2 1
+#endif
+
+// Running counts over one piece of text
+typedef struct StatsScan {
+    size_t words;
+    size_t crs;
+    size_t lfs;
+    size_t high;            // units at or above U+0080
+    size_t utf8Extra;       // UTF-8 bytes beyond one per unit
+    size_t pairedLows;      // low surrogates that complete a pair
+    unsigned prevSpace;     // 1 when the unit before the next is white space, or there is none
+    bool prevHighSurrogate;
+#ifdef STATS_SSE2
+    __m128i crLanes;        // per-byte counts, folded into the totals before they wrap
+    __m128i lfLanes;
+    __m128i highLanes;
+    unsigned pending;
+#endif
+} StatsScan;
+
+bool TextIsSpace(TextChar c) {
+    if (c <= 0xFF) return (c >= 0x09 && c <= 0x0D) || c == 0x20 || c == 0x85 || c == 0xA0;
+    return c == 0x1680 || (c >= 0x2000 && c <= 0x200A) || c == 0x2028 || c == 0x2029 || c == 0x202F ||
+           c == 0x205F || c == 0x3000;
+}
+
+static bool IsHighSurrogate(TextChar c) {
+    return c >= 0xD800 && c < 0xDC00;
+}
+
+static bool IsLowSurrogate(TextChar c) {
+    return c >= 0xDC00 && c < 0xE000;
+}
+
+static void BeginScan(StatsScan *scan) {
+    memset(scan, 0, sizeof(*scan));
+    scan->prevSpace = 1;
+}
+
+static void ScanUnit(StatsScan *scan, TextChar c) {
+    unsigned space = TextIsSpace(c);
+    scan->words += (space ^ 1) & scan->prevSpace;
+    scan->prevSpace = space;
+    scan->crs += c == '\r';
+    scan->lfs += c == '\n';
+    bool highSurrogate = false;
+    if (c >= 0x80) {
+        scan->high++;
+        if (c < 0x800) {
+            scan->utf8Extra += 1;
+        } else if (IsLowSurrogate(c) && scan->prevHighSurrogate) {
+            // The high surrogate already counted 3 bytes; the pair is 4
+            scan->pairedLows++;
+        } else {
+            scan->utf8Extra += 2;
+            highSurrogate = IsHighSurrogate(c);
+        }
+    }
+    scan->prevHighSurrogate = highSurrogate;
+}
+
+#ifdef STATS_SSE2
+static unsigned Popcount16(unsigned v) {
+    v = v - ((v >> 1) & 0x5555);
+    v = (v & 0x3333) + ((v >> 2) & 0x3333);
+    v = (v + (v >> 4)) & 0x0F0F;
+    return (v + (v >> 8)) & 0x1F;
+}
+
+static size_t LaneSum(__m128i lanes) {
+    __m128i sum = _mm_sad_epu8(lanes, _mm_setzero_si128());
+    return (size_t)_mm_cvtsi128_si32(sum) + (size_t)_mm_extract_epi16(sum, 4);
+}
+
+static void FlushLanes(StatsScan *scan) {
+    size_t high = LaneSum(scan->highLanes);
+    scan->crs += LaneSum(scan->crLanes);
+    scan->lfs += LaneSum(scan->lfLanes);
+    scan->high += high;
+    scan->utf8Extra += high;    // U+0080..U+00FF take two bytes
+    scan->crLanes = _mm_setzero_si128();
+    scan->lfLanes = _mm_setzero_si128();
+    scan->highLanes = _mm_setzero_si128();
+    scan->pending = 0;
+}
+
+// 16 units at or below U+00FF, one per byte
+static void ScanBlock(StatsScan *scan, __m128i v) {
+    // 0x09..0x0D is (v - 9) <= 4 unsigned; then space, NEL and NBSP
+    __m128i t = _mm_sub_epi8(v, _mm_set1_epi8(9));
+    __m128i space = _mm_cmpeq_epi8(_mm_min_epu8(t, _mm_set1_epi8(4)), t);
+    space = _mm_or_si128(space, _mm_cmpeq_epi8(v, _mm_set1_epi8(' ')));
+    space = _mm_or_si128(space, _mm_cmpeq_epi8(v, _mm_set1_epi8((char)0x85)));
+    space = _mm_or_si128(space, _mm_cmpeq_epi8(v, _mm_set1_epi8((char)0xA0)));
+    unsigned mask = (unsigned)_mm_movemask_epi8(space);
+    // A word starts at each non-space unit whose predecessor is a space
+    scan->words += Popcount16(~mask & ((mask << 1) | scan->prevSpace) & 0xFFFF);
+    scan->prevSpace = mask >> 15;
+    scan->prevHighSurrogate = false;
+
+    scan->crLanes = _mm_sub_epi8(scan->crLanes, _mm_cmpeq_epi8(v, _mm_set1_epi8('\r')));
+    scan->lfLanes = _mm_sub_epi8(scan->lfLanes, _mm_cmpeq_epi8(v, _mm_set1_epi8('\n')));
+    scan->highLanes = _mm_sub_epi8(scan->highLanes, _mm_cmplt_epi8(v, _mm_setzero_si128()));
+    if (++scan->pending == 255) FlushLanes(scan);
+}
+#endif
+
+static void FinishScan(StatsScan *scan, size_t length, TextStats *stats) {
+#ifdef STATS_SSE2
+    FlushLanes(scan);
+#endif
+    memset(stats, 0, sizeof(*stats));
+    stats->length = length;
+    stats->words = scan->words;
+    stats->units = length - scan->crs - scan->lfs;
+    stats->chars = stats->units - scan->pairedLows;
+    stats->ascii = stats->units - scan->high;
+    stats->utf8Bytes = stats->units + scan->utf8Extra;
+    stats->lineBreaks = scan->lfs;
+}
+
+void TextStatsNarrow(const uint8_t *text, size_t length, TextStats *stats) {
+    StatsScan scan;
+    BeginScan(&scan);
+    size_t i = 0;
+#ifdef STATS_SSE2
+    for (; i + 16 <= length; i += 16) ScanBlock(&scan, _mm_loadu_si128((const __m128i *)(text + i)));
+#endif
+    for (; i < length; ++i) ScanUnit(&scan, text[i]);
+    FinishScan(&scan, length, stats);
+    if (length > 0) {
+        stats->startsInWord = !TextIsSpace(text[0]);
+        stats->endsInWord = !TextIsSpace(text[length - 1]);
+    }
+}
+
+void TextStatsWide(const TextChar *text, size_t length, TextStats *stats) {
+    StatsScan scan;
+    BeginScan(&scan);
+    size_t i = 0;
+#ifdef STATS_SSE2
+    const __m128i above = _mm_set1_epi16((short)0xFF00);
+    for (; i + 16 <= length; i += 16) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(text + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(text + i + 8));
+        __m128i any = _mm_and_si128(_mm_or_si128(a, b), above);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi16(any, _mm_setzero_si128())) == 0xFFFF) {
+            ScanBlock(&scan, _mm_packus_epi16(a, b));
+        } else {
+            for (size_t j = 0; j < 16; ++j) ScanUnit(&scan, text[i + j]);
+        }
+    }
+#endif
+    for (; i < length; ++i) ScanUnit(&scan, text[i]);
+    FinishScan(&scan, length, stats);
+    if (length > 0) {
+        stats->startsInWord = !TextIsSpace(text[0]);
+        stats->endsInWord = !TextIsSpace(text[length - 1]);
+        stats->startsLowSurrogate = IsLowSurrogate(text[0]);
+        stats->endsHighSurrogate = IsHighSurrogate(text[length - 1]);
+    }
+}
+
+void TextStatsAppend(TextStats *total, const TextStats *next) {
+    if (next->length == 0) return;
+    if (total->length == 0) {
+        *total = *next;
+        return;
+    }
+    total->words += next->words - (total->endsInWord && next->startsInWord);
+    total->chars += next->chars;
+    total->utf8Bytes += next->utf8Bytes;
+    if (total->endsHighSurrogate && next->startsLowSurrogate) {
+        // Both halves counted as unpaired: two characters of 3 bytes, not one of 4
+        total->chars -= 1;
+        total->utf8Bytes -= 2;
+    }
+    total->length += next->length;
+    total->units += next->units;
+    total->ascii += next->ascii;
+    total->lineBreaks += next->lineBreaks;
+    total->endsInWord = next->endsInWord;
+    total->endsHighSurrogate = next->endsHighSurrogate;
+}
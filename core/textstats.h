@@ -0,0 +1,33 @@
+// Word, character and size counts for retropad's document statistics. A word is a
+// maximal run of characters that aren't Unicode white space. Counts for adjacent
+// pieces of text combine exactly with TextStatsAppend, so a document can keep one
+// TextStats per chunk and recount only the chunks an edit touched. Nothing here
+// allocates.
+#pragma once
+
+#include "textcore.h"
+
+typedef struct TextStats {
+    size_t length;          // code units, line breaks included
+    size_t words;
+    size_t chars;           // characters other than CR and LF; a surrogate pair is one
+    size_t units;           // code units other than CR and LF
+    size_t ascii;           // of those, the units below U+0080
+    size_t utf8Bytes;       // their UTF-8 size (an unpaired surrogate takes 3, as U+FFFD)
+    size_t lineBreaks;      // LFs
+    bool startsInWord;
+    bool endsInWord;
+    bool startsLowSurrogate;
+    bool endsHighSurrogate;
+} TextStats;
+
+bool TextIsSpace(TextChar c);
+
+// Counts for Latin-1 units (a narrow document chunk) or UTF-16 text. Blocks of
+// 16 units at or below U+00FF are classified with SSE2 where it's available.
+void TextStatsNarrow(const uint8_t *text, size_t length, TextStats *stats);
+void TextStatsWide(const TextChar *text, size_t length, TextStats *stats);
+
+// Adds the counts for text that directly follows what `total` covers (zeroed for
+// none). A word or surrogate pair split across the seam counts once.
+void TextStatsAppend(TextStats *total, const TextStats *next);
@@ -0,0 +1,327 @@
+// Document model for retropad: keeps a compact DocStore in step with the EDIT control,
+// or holds it on its own for a document the control doesn't show.
+#include "document.h"
+#include "scratch.h"
+#include "trace.h"
+
+#define COMPARE_BLOCK 4096   // units compared per DocStoreCopy while diffing
+#define IDLE_KEEP_BYTES (4u << 20)  // uncompressed text left after an idle compaction
+#define EDIT_MAX_LENGTH 0x7FFFFFFD  // longest text handed to the control
+
+typedef struct DocumentState {
+    DocStore *store;
+    BOOL valid;             // store matches the control (or is the document, when detached)
+    BOOL detached;          // DocumentAdopt: the control is empty and its changes are ignored
+    int depth;              // nesting of bracketed edit messages
+    BOOL anywhere;          // the current message may change text anywhere (undo, settext)
+    DWORD selStart;
+    DWORD selEnd;
+    size_t lengthBefore;
+    size_t budget;          // DocStoreSetBudget for every new store
+    BOOL damaged;           // lines changed since DocumentTakeDamage
+    DocumentDamage damage;
+} DocumentState;
+
+static DocumentState g_doc = {0};
+
+BOOL GetEditText(HWND hwndEdit, WCHAR **bufferOut, int *lengthOut) {
+    int length = GetWindowTextLengthW(hwndEdit);
+    WCHAR *buffer = (WCHAR *)ScratchAlloc((length + 1) * sizeof(WCHAR));
+    if (!buffer) return FALSE;
+    GetWindowTextW(hwndEdit, buffer, length + 1);
+    if (lengthOut) *lengthOut = length;
+    *bufferOut = buffer;
+    return TRUE;
+}
+
+BOOL BeginDocView(HWND hwndEdit, DocView *view) {
+    view->handle = NULL;
+    view->length = GetWindowTextLengthW(hwndEdit);
+
+    HLOCAL handle = (HLOCAL)SendMessageW(hwndEdit, EM_GETHANDLE, 0, 0);
+    const WCHAR *text = handle ? (const WCHAR *)LocalLock(handle) : NULL;
+    if (text) {
+        view->handle = handle;
+        view->text = text;
+        return TRUE;
+    }
+
+    TRACE_BEGIN(span, "DocViewCopy");
+    WCHAR *copy = NULL;
+    BOOL ok = GetEditText(hwndEdit, &copy, &view->length);
+    view->text = copy;
+    TRACE_END_BYTES(span, (size_t)view->length * sizeof(WCHAR));
+    return ok;
+}
+
+void EndDocView(DocView *view) {
+    if (view->handle) {
+        LocalUnlock(view->handle);
+        view->handle = NULL;
+    }
+    view->text = NULL;
+}
+
+void DocumentSetBudget(size_t bytes) {
+    g_doc.budget = bytes;
+    if (g_doc.store) DocStoreSetBudget(g_doc.store, bytes);
+}
+
+DocStore *DocumentNewStore(void) {
+    DocStore *store = DocStoreCreate();
+    // Without the compression buffers the store just stays uncompressed
+    if (store && g_doc.budget) DocStoreSetBudget(store, g_doc.budget);
+    return store;
+}
+
+static void TraceStoreStats(void) {
+    if (!g_traceEnabled || !g_doc.store) return;
+    DocStoreStats stats;
+    DocStoreGetStats(g_doc.store, &stats);
+    TraceCounter("doc bytes", (LONGLONG)stats.bytes);
+    TraceCounter("doc raw bytes", (LONGLONG)stats.rawBytes);
+    TraceCounter("doc packed bytes", (LONGLONG)stats.packedBytes);
+    TraceCounter("doc packed source bytes", (LONGLONG)stats.packedSourceBytes);
+    TraceCounter("doc decompress us", (LONGLONG)(stats.decompressNanos / 1000));
+    // The control's copy isn't in the budget; traces show it so the total is visible
+    TraceCounter("doc control bytes", g_doc.detached ? 0 : (LONGLONG)(stats.length * sizeof(WCHAR)));
+}
+
+void DocumentCompactIdle(void) {
+    if (!g_doc.store || !g_doc.budget) return;
+    TRACE_BEGIN(span, "DocumentCompact");
+    DocStoreCompact(g_doc.store, IDLE_KEEP_BYTES < g_doc.budget ? IDLE_KEEP_BYTES : g_doc.budget);
+    TRACE_END(span);
+    TraceStoreStats();
+}
+
+const DocStore *DocumentStore(void) {
+    return g_doc.valid ? g_doc.store : NULL;
+}
+
+DocSnapshot *DocumentSnapshot(void) {
+    return g_doc.valid ? DocStoreSnapshot(g_doc.store) : NULL;
+}
+
+void DocumentGetTextStats(HWND hwndEdit, TextStats *stats) {
+    if (g_doc.valid) {
+        DocStoreGetTextStats(g_doc.store, stats);
+        return;
+    }
+    ZeroMemory(stats, sizeof(*stats));
+    DocView view;
+    if (!BeginDocView(hwndEdit, &view)) return;
+    TextStatsWide((const TextChar *)view.text, (size_t)view.length, stats);
+    EndDocView(&view);
+}
+
+// Records that lines firstLine..oldLastLine became firstLine..newLastLine; a second
+// change before the first is taken widens it to everything from the earlier line on
+static void NoteDamage(size_t firstLine, size_t oldLastLine, size_t newLastLine) {
+    if (g_doc.damaged) {
+        firstLine = min(firstLine, g_doc.damage.firstLine);
+        oldLastLine = newLastLine = SIZE_MAX;
+    }
+    g_doc.damaged = TRUE;
+    g_doc.damage.firstLine = firstLine;
+    g_doc.damage.oldLastLine = oldLastLine;
+    g_doc.damage.newLastLine = newLastLine;
+}
+
+static void SetStore(DocStore *store) {
+    NoteDamage(0, SIZE_MAX, SIZE_MAX);
+    if (g_doc.store != store) {
+        DocStoreDestroy(g_doc.store);
+        g_doc.store = store;
+    }
+    g_doc.valid = store != NULL;
+}
+
+// Hands the control a buffer filled straight from the store (EM_SETHANDLE), or an empty
+// one for NULL. No staging copy is made, but the buffer is the control's own UTF-16
+// copy of the text and stays next to the store for as long as the control shows it.
+static BOOL FillEdit(HWND hwndEdit, const DocStore *store) {
+    size_t length = store ? DocStoreLength(store) : 0;
+    if (length > EDIT_MAX_LENGTH) return FALSE;
+
+    TRACE_BEGIN(span, "FillEdit");
+    HLOCAL mem = LocalAlloc(LMEM_MOVEABLE, (length + 1) * sizeof(WCHAR));
+    WCHAR *text = mem ? (WCHAR *)LocalLock(mem) : NULL;
+    if (!text) {
+        if (mem) LocalFree(mem);
+        TRACE_END(span);
+        return FALSE;
+    }
+    if (length) DocStoreCopy(store, 0, length, (TextChar *)text);
+    text[length] = L'\0';
+    LocalUnlock(mem);
+
+    // The new buffer already matches the store, so any EN_CHANGE it raises is ignored
+    HLOCAL old = (HLOCAL)SendMessageW(hwndEdit, EM_GETHANDLE, 0, 0);
+    g_doc.depth++;
+    SendMessageW(hwndEdit, EM_SETHANDLE, (WPARAM)mem, 0);
+    g_doc.depth--;
+    if (old && old != mem) LocalFree(old);
+    TRACE_END_BYTES(span, length * sizeof(WCHAR));
+    return TRUE;
+}
+
+BOOL DocumentFitsEdit(const DocStore *store, size_t maxBytes) {
+    size_t length = DocStoreLength(store);
+    return length <= EDIT_MAX_LENGTH && (!maxBytes || length <= maxBytes / sizeof(WCHAR));
+}
+
+BOOL DocumentReplace(HWND hwndEdit, DocStore *store) {
+    if (!store || !FillEdit(hwndEdit, store)) {
+        DocStoreDestroy(store);
+        return FALSE;
+    }
+    SetStore(store);
+    g_doc.detached = FALSE;
+    TraceStoreStats();
+    return TRUE;
+}
+
+BOOL DocumentAdopt(HWND hwndEdit, DocStore *store) {
+    // The control's old buffer goes first, so the two documents are never both in memory
+    if (!store || !FillEdit(hwndEdit, NULL)) {
+        DocStoreDestroy(store);
+        return FALSE;
+    }
+    SetStore(store);
+    g_doc.detached = TRUE;
+    TraceStoreStats();
+    return TRUE;
+}
+
+BOOL DocumentShow(HWND hwndEdit) {
+    return g_doc.valid && !g_doc.detached && FillEdit(hwndEdit, g_doc.store);
+}
+
+// Rebuilds the store from the control; the fallback when an edit can't be localized
+static void Resync(HWND hwndEdit) {
+    TRACE_BEGIN(span, "DocumentResync");
+    DocView view;
+    DocStore *store = NULL;
+    if (BeginDocView(hwndEdit, &view)) {
+        store = DocumentNewStore();
+        if (store && !DocStoreAppend(store, (const TextChar *)view.text, (size_t)view.length)) {
+            DocStoreDestroy(store);
+            store = NULL;
+        }
+        EndDocView(&view);
+    }
+    if (store) {
+        SetStore(store);
+    } else {
+        g_doc.valid = FALSE;
+    }
+    TRACE_END_BYTES(span, store ? DocStoreLength(store) * sizeof(WCHAR) : 0);
+}
+
+// Length of the common run of store[from..] and text[from..], at most maxLength
+static size_t CommonPrefix(const DocStore *store, const WCHAR *text, size_t from, size_t maxLength) {
+    TextChar block[COMPARE_BLOCK];
+    size_t same = 0;
+    while (same < maxLength) {
+        size_t n = maxLength - same < COMPARE_BLOCK ? maxLength - same : COMPARE_BLOCK;
+        DocStoreCopy(store, from + same, n, block);
+        for (size_t i = 0; i < n; ++i) {
+            if (block[i] != text[from + same + i]) return same + i;
+        }
+        same += n;
+    }
+    return same;
+}
+
+// Common run ending just before store[oldEnd] and text[newEnd], at most maxLength
+static size_t CommonSuffix(const DocStore *store, size_t oldEnd, const WCHAR *text, size_t newEnd, size_t maxLength) {
+    TextChar block[COMPARE_BLOCK];
+    size_t same = 0;
+    while (same < maxLength) {
+        size_t n = maxLength - same < COMPARE_BLOCK ? maxLength - same : COMPARE_BLOCK;
+        DocStoreCopy(store, oldEnd - same - n, n, block);
+        for (size_t i = n; i-- > 0;) {
+            if (block[i] != text[newEnd - same - (n - i)]) return same + (n - 1 - i);
+        }
+        same += n;
+    }
+    return same;
+}
+
+void DocumentBeforeEdit(HWND hwndEdit, UINT msg) {
+    if (g_doc.depth++ > 0) return;
+    SendMessageW(hwndEdit, EM_GETSEL, (WPARAM)&g_doc.selStart, (LPARAM)&g_doc.selEnd);
+    g_doc.lengthBefore = g_doc.store ? DocStoreLength(g_doc.store) : 0;
+    g_doc.anywhere = msg == WM_UNDO || msg == EM_UNDO || msg == WM_SETTEXT;
+}
+
+void DocumentAfterEdit(HWND hwndEdit) {
+    if (--g_doc.depth > 0 || g_doc.detached) return;
+    if (!g_doc.valid) {
+        Resync(hwndEdit);
+        return;
+    }
+
+    DocView view;
+    if (!BeginDocView(hwndEdit, &view)) {
+        g_doc.valid = FALSE;
+        return;
+    }
+    size_t oldLength = g_doc.lengthBefore;
+    size_t newLength = (size_t)view.length;
+
+    // Typing, paste, clear and backspace only touch the old selection and the caret
+    // neighbourhood (two units either side covers a CRLF); undo and settext can touch
+    // anything, so they diff the whole text. Prefix/suffix trimming finds the exact edit.
+    size_t lo = 0;
+    size_t oldHi = oldLength;
+    size_t newHi = newLength;
+    if (!g_doc.anywhere) {
+        DWORD caret = 0;
+        SendMessageW(hwndEdit, EM_GETSEL, (WPARAM)&caret, 0);
+        size_t near = min(g_doc.selStart, caret);
+        size_t hi = min(oldLength, (size_t)max(g_doc.selEnd, g_doc.selStart) + 2);
+        lo = near > 2 ? near - 2 : 0;
+        if (hi >= lo && hi + newLength >= lo + oldLength) {
+            oldHi = hi;
+            newHi = hi + newLength - oldLength;
+        } else {
+            lo = 0;
+        }
+    }
+
+    size_t oldSpan = oldHi - lo;
+    size_t newSpan = newHi - lo;
+    size_t prefix = CommonPrefix(g_doc.store, view.text, lo, min(oldSpan, newSpan));
+    size_t suffix = CommonSuffix(g_doc.store, oldHi, view.text, newHi, min(oldSpan, newSpan) - prefix);
+    size_t pos = lo + prefix;
+    size_t removed = oldSpan - prefix - suffix;
+    size_t inserted = newSpan - prefix - suffix;
+    size_t firstLine = DocStoreLineFromOffset(g_doc.store, pos);
+    size_t oldLastLine = DocStoreLineFromOffset(g_doc.store, pos + removed);
+    BOOL ok = DocStoreReplace(g_doc.store, pos, removed, (const TextChar *)view.text + pos, inserted);
+    EndDocView(&view);
+    if (!ok) {
+        Resync(hwndEdit);
+    } else if (removed > 0 || inserted > 0) {
+        NoteDamage(firstLine, oldLastLine, DocStoreLineFromOffset(g_doc.store, pos + inserted));
+    }
+}
+
+void DocumentNoteChange(HWND hwndEdit) {
+    // Changes inside a bracketed message are applied by DocumentAfterEdit
+    if (g_doc.depth == 0 && !g_doc.detached) Resync(hwndEdit);
+}
+
+BOOL DocumentTakeDamage(DocumentDamage *damage) {
+    if (!g_doc.damaged) return FALSE;
+    *damage = g_doc.damage;
+    g_doc.damaged = FALSE;
+    return TRUE;
+}
+
+void DocumentFree(void) {
+    SetStore(NULL);
+    g_doc.detached = FALSE;
+}
@@ -0,0 +1,79 @@
+// The open document for retropad. The text lives in a DocStore (core/docstore.h);
+// the EDIT control is the view. Edits made through the control are mirrored into
+// the store from the edit subclass, and loads build the store first and then hand
+// the control a buffer filled from it. That buffer is the control's own UTF-16 copy,
+// so a document costs its store plus two bytes per character. A document the control
+// can't hold (or bigger than the caller allows) is adopted without it instead and
+// shown read-only by a store view (storeview.h).
+#pragma once
+
+#include <windows.h>
+#include "core/docstore.h"
+
+// Read-only view of the control's text. For the EDIT control this is the control's
+// own buffer, locked via EM_GETHANDLE; controls that won't hand it out get a scratch
+// copy. Neither the text nor the control may change until EndDocView runs.
+typedef struct DocView {
+    const WCHAR *text;
+    int length;
+    HLOCAL handle;      // locked edit buffer, NULL when text is a copy
+} DocView;
+
+BOOL BeginDocView(HWND hwndEdit, DocView *view);
+void EndDocView(DocView *view);
+
+// Copies the edit text into scratch memory that lives until the current command ends
+BOOL GetEditText(HWND hwndEdit, WCHAR **bufferOut, int *lengthOut);
+
+// Memory budget for the uncompressed part of the document (DocStoreSetBudget);
+// 0 keeps everything uncompressed. Applies to the current and all later stores. It
+// bounds the store only: a document in the control also has the control's UTF-16
+// copy, which no budget packs, while an adopted document has nothing else.
+void DocumentSetBudget(size_t bytes);
+// An empty store with the budget applied, for building a new document
+DocStore *DocumentNewStore(void);
+// Packs all but the most recently edited chunks; call when the user goes idle.
+void DocumentCompactIdle(void);
+
+// The store, or NULL if it could not be kept in step (out of memory); callers then
+// read the control through a DocView instead.
+const DocStore *DocumentStore(void);
+
+// The document as it is now, for a background reader (DocStoreSnapshot); NULL without
+// a store or memory. Release it with DocSnapshotRelease from any thread.
+DocSnapshot *DocumentSnapshot(void);
+
+// Words, characters and sizes of the document. The store recounts only the chunks
+// edited since the last call; without one the control's text is counted in full.
+void DocumentGetTextStats(HWND hwndEdit, TextStats *stats);
+
+// Whether the control should show `store`: it can hold the text, and unless `maxBytes`
+// is 0, its copy of it (two bytes per character) is no bigger than that
+BOOL DocumentFitsEdit(const DocStore *store, size_t maxBytes);
+// Makes `store` the document and shows it in the control. Always takes ownership;
+// on failure (NULL store, no memory for the control's buffer) the store is freed.
+BOOL DocumentReplace(HWND hwndEdit, DocStore *store);
+// Makes `store` the document without showing it: the control is emptied, and changes
+// to it are ignored until the next DocumentReplace. Ownership as for DocumentReplace.
+BOOL DocumentAdopt(HWND hwndEdit, DocStore *store);
+// Refills a freshly created control from the current store; FALSE while it's adopted.
+BOOL DocumentShow(HWND hwndEdit);
+
+// Bracket every message that can change the control's text (see the edit subclass).
+void DocumentBeforeEdit(HWND hwndEdit, UINT msg);
+void DocumentAfterEdit(HWND hwndEdit);
+// EN_CHANGE from the control; resynchronizes if the change came from elsewhere.
+void DocumentNoteChange(HWND hwndEdit);
+
+// Lines changed since the last call, for views that cache per-line results: lines
+// firstLine..oldLastLine (inclusive) are now firstLine..newLastLine, and both last
+// lines are SIZE_MAX when anything from firstLine on may differ. FALSE if none.
+typedef struct DocumentDamage {
+    size_t firstLine;
+    size_t oldLastLine;
+    size_t newLastLine;
+} DocumentDamage;
+
+BOOL DocumentTakeDamage(DocumentDamage *damage);
+
+void DocumentFree(void);
@@ -1,86 +1,91 @@
 // Text file load/save helpers with simple BOM detection for retropad.
 #include "file_io.h"
+#include "filecache.h"
+#include "resource.h"
+#include "trace.h"
+#include "scratch.h"
+#include "core/hexdump.h"
 #include <commdlg.h>
 #include <strsafe.h>
 #include <stdlib.h>
 
-static TextEncoding DetectEncoding(const BYTE *data, DWORD size) {
-    if (size >= 2 && data[0] == 0xFF && data[1] == 0xFE) {
-        return ENC_UTF16LE;
-    }
-    if (size >= 2 && data[0] == 0xFE && data[1] == 0xFF) {
-        return ENC_UTF16BE;
-    }
-    if (size >= 3 && data[0] == 0xEF && data[1] == 0xBB && data[2] == 0xBF) {
-        return ENC_UTF8;
+#define HASH_READ_BYTES (4u << 20)     // piece size for HashFileContents
+#define PROBE_BYTES (64u << 10)        // start of a file ProbeFile looks at
+#define SAVE_BLOCK_UNITS (256u << 10)  // store text encoded at a time by SaveStoreFile
+
+static UINT ResolveCodePage(UINT codePage) {
+    return codePage ? codePage : GetACP();
+}
+
+// Built-in single-byte tables decode block by block into the store; other code pages
+// (the DBCS ones) go through MultiByteToWideChar
+static BOOL DecodeAnsiToStore(const BYTE *data, DWORD size, UINT codePage, DocStore *store, TextEolCounts *eol) {
+    const TextCodePage *table = TextFindCodePage(codePage);
+    if (table) {
+        BOOL ok = DocStoreLoadParallel(store, data, size, ENC_ANSI, table, 0);
+        DocStoreGetSourceEol(store, eol);
+        return ok;
     }
-    // Assume UTF-8 if it converts cleanly, else ANSI
-    int wlen = MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, (LPCSTR)data, size, NULL, 0);
-    return (wlen > 0) ? ENC_UTF8 : ENC_ANSI;
+
+    int ansiChars = MultiByteToWideChar(codePage, 0, (LPCSTR)data, size, NULL, 0);
+    if (ansiChars <= 0) return FALSE;
+    WCHAR *wide = (WCHAR *)ScratchAlloc(((size_t)ansiChars + 1) * sizeof(WCHAR));
+    if (!wide) return FALSE;
+    MultiByteToWideChar(codePage, 0, (LPCSTR)data, size, wide, ansiChars);
+    wide[ansiChars] = L'\0';
+    TextCountEol((const TextChar *)wide, (size_t)ansiChars, eol);
+
+    size_t normLen = 0;
+    WCHAR *normalized = NormalizeLineEndings(wide, &normLen);
+    return normalized && DocStoreAppend(store, (const TextChar *)normalized, normLen);
 }
 
-static BOOL DecodeToWide(const BYTE *data, DWORD size, TextEncoding encoding, WCHAR **outText, size_t *outLength) {
-    int chars = 0;
-    WCHAR *buffer = NULL;
+static ULONGLONG FileTimeValue(const FILETIME *time) {
+    return ((ULONGLONG)time->dwHighDateTime << 32) | time->dwLowDateTime;
+}
 
-    switch (encoding) {
-    case ENC_UTF16LE: {
-        if (size < 2) return FALSE;
-        DWORD byteOffset = (data[0] == 0xFF && data[1] == 0xFE) ? 2 : 0;
-        DWORD wcharCount = (size - byteOffset) / 2;
-        buffer = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, (wcharCount + 1) * sizeof(WCHAR));
-        if (!buffer) return FALSE;
-        CopyMemory(buffer, data + byteOffset, wcharCount * sizeof(WCHAR));
-        buffer[wcharCount] = L'\0';
-        chars = (int)wcharCount;
-        break;
-    }
-    case ENC_UTF16BE: {
-        if (size < 2) return FALSE;
-        DWORD byteOffset = (data[0] == 0xFE && data[1] == 0xFF) ? 2 : 0;
-        DWORD wcharCount = (size - byteOffset) / 2;
-        buffer = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, (wcharCount + 1) * sizeof(WCHAR));
-        if (!buffer) return FALSE;
-        for (DWORD i = 0; i < wcharCount; ++i) {
-            buffer[i] = (WCHAR)((data[byteOffset + i * 2] << 8) | data[byteOffset + i * 2 + 1]);
-        }
-        buffer[wcharCount] = L'\0';
-        chars = (int)wcharCount;
-        break;
-    }
-    case ENC_UTF8: {
-        DWORD byteOffset = (size >= 3 && data[0] == 0xEF && data[1] == 0xBB && data[2] == 0xBF) ? 3 : 0;
-        chars = MultiByteToWideChar(CP_UTF8, 0, (LPCSTR)(data + byteOffset), size - byteOffset, NULL, 0);
-        if (chars <= 0) return FALSE;
-        buffer = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, (chars + 1) * sizeof(WCHAR));
-        if (!buffer) return FALSE;
-        MultiByteToWideChar(CP_UTF8, 0, (LPCSTR)(data + byteOffset), size - byteOffset, buffer, chars);
-        buffer[chars] = L'\0';
-        break;
-    }
-    case ENC_ANSI:
-    default: {
-        chars = MultiByteToWideChar(CP_ACP, 0, (LPCSTR)data, size, NULL, 0);
-        if (chars <= 0) return FALSE;
-        buffer = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, (chars + 1) * sizeof(WCHAR));
-        if (!buffer) return FALSE;
-        MultiByteToWideChar(CP_ACP, 0, (LPCSTR)data, size, buffer, chars);
-        buffer[chars] = L'\0';
-        break;
-    }
-    }
+// Puts the file at the top of the cache as loaded or saved
+static void RememberFile(LPCWSTR path, FileCacheEntry *entry, const FileStamp *stamp, const FileEncoding *encoding) {
+    entry->size = stamp->size;
+    entry->writeTime = stamp->writeTime;
+    entry->hash = stamp->hash;
+    entry->encoding = encoding->encoding;
+    entry->codePage = encoding->codePage;
+    entry->eol = encoding->eol;
+    entry->eolMixed = encoding->eolMixed;
+    FileCacheRecord(path, entry);
+}
 
-    *outText = buffer;
-    if (outLength) {
-        *outLength = (size_t)chars;
+// HashSample of a file on disk, reading only the sampled pieces
+static BOOL SampleFile(LPCWSTR path, ULONGLONG size, UINT64 *sampleOut) {
+    HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return FALSE;
+    BYTE piece[HASH_SAMPLE_PIECE];
+    HashState hash;
+    HashBegin(&hash);
+    BOOL ok = TRUE;
+    for (unsigned i = 0; i < HASH_SAMPLE_PIECES && ok; ++i) {
+        uint64_t offset = 0;
+        size_t length = 0;
+        HashSamplePiece(size, i, &offset, &length);
+        if (length == 0) continue;
+        LARGE_INTEGER to;
+        to.QuadPart = (LONGLONG)offset;
+        DWORD read = 0;
+        ok = SetFilePointerEx(file, to, NULL, FILE_BEGIN) && ReadFile(file, piece, (DWORD)length, &read, NULL) &&
+             read == length;
+        if (ok) HashUpdate(&hash, piece, length);
     }
-    return TRUE;
+    CloseHandle(file);
+    if (ok) *sampleOut = HashSampleEnd(&hash, size);
+    return ok;
 }
 
-BOOL LoadTextFile(HWND owner, LPCWSTR path, WCHAR **textOut, size_t *lengthOut, TextEncoding *encodingOut) {
-    *textOut = NULL;
-    if (lengthOut) *lengthOut = 0;
-    if (encodingOut) *encodingOut = ENC_UTF8;
+static BOOL ReadAndDecodeFile(HWND owner, LPCWSTR path, DocStore *store, const FileEncoding *forced,
+                              FileEncoding *encodingOut, DWORD *bytesOut, FileStamp *stampOut) {
+    FileEncoding chosen = {ENC_UTF8, 0, TEXT_EOL_CRLF, FALSE};
+    if (forced && forced->encoding) chosen = *forced;
+    if (encodingOut) *encodingOut = chosen;
 
     HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
     if (file == INVALID_HANDLE_VALUE) {
@@ -96,86 +101,203 @@ BOOL LoadTextFile(HWND owner, LPCWSTR path, WCHAR **textOut, size_t *lengthOut,
     }
 
     DWORD bytes = (DWORD)size.QuadPart;
-    BYTE *buffer = (BYTE *)HeapAlloc(GetProcessHeap(), 0, bytes + 3);
+    BYTE *buffer = (BYTE *)ScratchAlloc((size_t)bytes + 3);
     if (!buffer) {
         CloseHandle(file);
         MessageBoxW(owner, L"Out of memory.", L"retropad", MB_ICONERROR);
         return FALSE;
     }
 
+    // Taken before reading, so a write that lands during the read shows up as a change
+    FILETIME written = {0, 0};
+    GetFileTime(file, NULL, NULL, &written);
+
     DWORD read = 0;
     BOOL ok = ReadFile(file, buffer, bytes, &read, NULL);
     CloseHandle(file);
+    *bytesOut = read;
     if (!ok) {
-        HeapFree(GetProcessHeap(), 0, buffer);
         MessageBoxW(owner, L"Failed reading file.", L"retropad", MB_ICONERROR);
         return FALSE;
     }
+    // A file opened before, unchanged since, needs neither the whole-file hash nor
+    // detection: the cache has both. Only loads that keep a stamp (the open document)
+    // use and feed the cache.
+    BOOL detect = !forced || !forced->encoding;
+    FileCacheEntry known = {0};
+    BOOL cached = FALSE;
+    if (stampOut) {
+        FileCacheEntry key = {0};
+        key.size = read;
+        key.writeTime = FileTimeValue(&written);
+        key.sample = HashSample(buffer, read);
+        cached = FileCacheLookup(path, &key, &known);
+        stampOut->size = read;
+        stampOut->writeTime = key.writeTime;
+        stampOut->hash = known.hash;
+        if (!cached) {
+            TRACE_BEGIN(hashSpan, "HashFile");
+            stampOut->hash = HashBytes(buffer, read);
+            TRACE_END_BYTES(hashSpan, read);
+            known = key;
+        }
+        if (cached && detect && known.encoding) {
+            chosen.encoding = known.encoding;
+            chosen.codePage = known.codePage;
+            detect = FALSE;
+        }
+    }
 
+    // An empty file leaves the store empty
     if (read == 0) {
-        WCHAR *empty = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, sizeof(WCHAR));
-        if (!empty) {
-            HeapFree(GetProcessHeap(), 0, buffer);
-            return FALSE;
-        }
-        empty[0] = L'\0';
-        *textOut = empty;
-        if (lengthOut) *lengthOut = 0;
-        if (encodingOut) *encodingOut = ENC_UTF8;
-        HeapFree(GetProcessHeap(), 0, buffer);
+        if (stampOut) RememberFile(path, &known, stampOut, &chosen);
         return TRUE;
     }
 
-    TextEncoding enc = DetectEncoding(buffer, read);
-    WCHAR *text = NULL;
-    size_t len = 0;
-    if (!DecodeToWide(buffer, read, enc, &text, &len)) {
-        HeapFree(GetProcessHeap(), 0, buffer);
+    TextEolCounts eol = {0, 0, 0};
+    BOOL decoded = FALSE;
+    if (detect) {
+        // Detection rides along with the decode: one pass over the bytes, falling back
+        // to the ANSI code page at the first sequence that isn't UTF-8
+        UINT codePage = ResolveCodePage(chosen.codePage);
+        TRACE_BEGIN(loadSpan, "DetectAndDecode");
+        chosen.encoding = DocStoreLoadDetect(store, buffer, read, TextFindCodePage(codePage), 0);
+        TRACE_END_BYTES(loadSpan, read);
+        decoded = chosen.encoding != 0;
+        DocStoreGetSourceEol(store, &eol);
+        if (chosen.encoding == ENC_ANSI && DocStoreLength(store) == 0) {
+            // A code page without a built-in table (DBCS)
+            TRACE_BEGIN(decodeSpan, "DecodeAnsi");
+            decoded = DecodeAnsiToStore(buffer, read, codePage, store, &eol);
+            TRACE_END_BYTES(decodeSpan, read);
+        }
+    } else if (chosen.encoding == ENC_ANSI) {
+        TRACE_BEGIN(decodeSpan, "DecodeAnsi");
+        decoded = DecodeAnsiToStore(buffer, read, ResolveCodePage(chosen.codePage), store, &eol);
+        TRACE_END_BYTES(decodeSpan, read);
+    } else if ((chosen.encoding == ENC_UTF16LE || chosen.encoding == ENC_UTF16BE) && read < 2) {
+        decoded = FALSE;
+    } else {
+        // One pass of decode, CRLF normalization and line indexing into the chunks, split
+        // across the processors for big files
+        TRACE_BEGIN(decodeSpan, "DecodeToStore");
+        decoded = DocStoreLoadParallel(store, buffer, read, chosen.encoding, NULL, 0);
+        DocStoreGetSourceEol(store, &eol);
+        TRACE_END_BYTES(decodeSpan, read);
+    }
+    if (!decoded) {
         MessageBoxW(owner, L"Unable to decode file.", L"retropad", MB_ICONERROR);
         return FALSE;
     }
 
-    HeapFree(GetProcessHeap(), 0, buffer);
-    *textOut = text;
-    if (lengthOut) *lengthOut = len;
-    if (encodingOut) *encodingOut = enc;
+    chosen.eol = TextDominantEol(&eol);
+    chosen.eolMixed = TextEolMixed(&eol);
+    if (encodingOut) *encodingOut = chosen;
+    if (stampOut) RememberFile(path, &known, stampOut, &chosen);
     return TRUE;
 }
 
-static BOOL WriteUTF8WithBOM(HANDLE file, const WCHAR *text, size_t length) {
-    static const BYTE bom[] = {0xEF, 0xBB, 0xBF};
-    DWORD written = 0;
-    if (!WriteFile(file, bom, sizeof(bom), &written, NULL)) {
-        return FALSE;
-    }
-    int bytes = WideCharToMultiByte(CP_UTF8, 0, text, (int)length, NULL, 0, NULL, NULL);
-    if (bytes <= 0) return FALSE;
-    BYTE *buffer = (BYTE *)HeapAlloc(GetProcessHeap(), 0, bytes);
-    if (!buffer) return FALSE;
-    WideCharToMultiByte(CP_UTF8, 0, text, (int)length, (LPSTR)buffer, bytes, NULL, NULL);
-    BOOL ok = WriteFile(file, buffer, bytes, &written, NULL);
-    HeapFree(GetProcessHeap(), 0, buffer);
+BOOL LoadTextFile(HWND owner, LPCWSTR path, DocStore *store, const FileEncoding *forced, FileEncoding *encodingOut,
+                  FileStamp *stampOut) {
+    DWORD bytes = 0;
+    TRACE_BEGIN(span, "LoadTextFile");
+    BOOL ok = ReadAndDecodeFile(owner, path, store, forced, encodingOut, &bytes, stampOut);
+    TRACE_END_BYTES(span, bytes);
     return ok;
 }
 
-static BOOL WriteUTF16LE(HANDLE file, const WCHAR *text, size_t length) {
-    static const BYTE bom[] = {0xFF, 0xFE};
+// WriteFile that also feeds the bytes to the file's hash
+static BOOL WriteHashed(HANDLE file, const void *data, size_t size, HashState *hash) {
     DWORD written = 0;
-    if (!WriteFile(file, bom, sizeof(bom), &written, NULL)) {
-        return FALSE;
-    }
-    return WriteFile(file, text, (DWORD)(length * sizeof(WCHAR)), &written, NULL);
+    HashUpdate(hash, data, size);
+    return WriteFile(file, data, (DWORD)size, &written, NULL);
 }
 
-static BOOL WriteANSI(HANDLE file, const WCHAR *text, size_t length) {
-    int bytes = WideCharToMultiByte(CP_ACP, 0, text, (int)length, NULL, 0, NULL, NULL);
-    if (bytes <= 0) return FALSE;
-    BYTE *buffer = (BYTE *)HeapAlloc(GetProcessHeap(), 0, bytes);
+static BOOL EncodeUTF8WithBOM(const WCHAR *text, size_t length, TextEol eol, EncodedFile *out) {
+    static const BYTE bom[] = {0xEF, 0xBB, 0xBF};
+    size_t bytes = TextEncodeUtf8((const TextChar *)text, length, eol, NULL);
+    BYTE *buffer = (BYTE *)ScratchAlloc(sizeof(bom) + bytes);
     if (!buffer) return FALSE;
-    WideCharToMultiByte(CP_ACP, 0, text, (int)length, (LPSTR)buffer, bytes, NULL, NULL);
-    DWORD written = 0;
-    BOOL ok = WriteFile(file, buffer, bytes, &written, NULL);
-    HeapFree(GetProcessHeap(), 0, buffer);
+    CopyMemory(buffer, bom, sizeof(bom));
+    TextEncodeUtf8((const TextChar *)text, length, eol, buffer + sizeof(bom));
+    out->bytes = buffer;
+    out->size = sizeof(bom) + bytes;
+    return TRUE;
+}
+
+// Text with each CRLF written as `eol`, in scratch memory; CRLF returns `text` itself
+static const WCHAR *ConvertEol(const WCHAR *text, size_t *length, TextEol eol) {
+    if (eol == TEXT_EOL_CRLF) return text;
+    WCHAR *converted = (WCHAR *)ScratchAlloc((*length ? *length : 1) * sizeof(WCHAR));
+    if (!converted) return NULL;
+    *length = TextConvertEol((const TextChar *)text, *length, eol, (TextChar *)converted);
+    return converted;
+}
+
+static BOOL EncodeUTF16LE(const WCHAR *text, size_t length, TextEol eol, EncodedFile *out) {
+    WCHAR *buffer = (WCHAR *)ScratchAlloc((length + 1) * sizeof(WCHAR));
+    if (!buffer) return FALSE;
+    buffer[0] = 0xFEFF;     // written little-endian, FF FE
+    if (eol == TEXT_EOL_CRLF) {
+        CopyMemory(buffer + 1, text, length * sizeof(WCHAR));
+    } else {
+        length = TextConvertEol((const TextChar *)text, length, eol, (TextChar *)(buffer + 1));
+    }
+    out->bytes = (const BYTE *)buffer;
+    out->size = (length + 1) * sizeof(WCHAR);
+    return TRUE;
+}
+
+static BOOL EncodeAnsi(const WCHAR *text, size_t length, UINT codePage, TextEol eol, EncodedFile *out) {
+    const TextCodePage *table = TextFindCodePage(codePage);
+    BYTE *buffer = NULL;
+    size_t size = 0;
+    if (table) {
+        buffer = (BYTE *)ScratchAlloc(length ? length : 1);
+        if (!buffer) return FALSE;
+        size_t unmapped = 0;
+        size = TextEncodeCodePage(table, (const TextChar *)text, length, eol, buffer, &unmapped);
+        out->lossy = unmapped > 0;
+    } else if (length > 0) {
+        // WideCharToMultiByte has no line ending option, so DBCS pages convert first
+        text = ConvertEol(text, &length, eol);
+        if (!text) return FALSE;
+        int bytes = WideCharToMultiByte(codePage, 0, text, (int)length, NULL, 0, NULL, NULL);
+        if (bytes <= 0) return FALSE;
+        buffer = (BYTE *)ScratchAlloc((size_t)bytes);
+        if (!buffer) return FALSE;
+        BOOL usedDefault = FALSE;
+        // CP_UTF7/CP_UTF8 reject the lpUsedDefaultChar argument, but they aren't offered here
+        WideCharToMultiByte(codePage, 0, text, (int)length, (LPSTR)buffer, bytes, NULL, &usedDefault);
+        size = (size_t)bytes;
+        out->lossy = usedDefault;
+    }
+    out->bytes = buffer;
+    out->size = size;
+    return TRUE;
+}
+
+BOOL EncodeTextFile(LPCWSTR text, size_t length, const FileEncoding *encoding, EncodedFile *out) {
+    TRACE_BEGIN(span, "EncodeTextFile");
+    out->bytes = NULL;
+    out->size = 0;
+    out->lossy = FALSE;
+    BOOL ok;
+    switch (encoding->encoding) {
+    case ENC_UTF16LE:
+        ok = EncodeUTF16LE(text, length, encoding->eol, out);
+        break;
+    case ENC_ANSI:
+        ok = EncodeAnsi(text, length, ResolveCodePage(encoding->codePage), encoding->eol, out);
+        break;
+    case ENC_UTF16BE:
+        // Saving as UTF-16BE is uncommon; fall back to UTF-8 with BOM to preserve readability
+    case ENC_UTF8:
+    default:
+        ok = EncodeUTF8WithBOM(text, length, encoding->eol, out);
+        break;
+    }
+    TRACE_END_BYTES(span, length * sizeof(WCHAR));
     return ok;
 }
 
@@ -184,106 +306,355 @@ static BOOL WriteANSI(HANDLE file, const WCHAR *text, size_t length) {
 WCHAR* NormalizeLineEndings(const WCHAR *text, size_t *outLength) {
     if (!text) return NULL;
 
-    size_t len = wcslen(text);
-    if (len == 0) {
-        // Return empty string
-        WCHAR *empty = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, sizeof(WCHAR));
-        if (!empty) return NULL;
-        empty[0] = L'\0';
-        if (outLength) *outLength = 0;
-        return empty;
-    }
-
-    // First pass: count how many CRLF pairs we need
-    size_t newLen = 0;
-    for (size_t i = 0; i < len; ++i) {
-        if (text[i] == L'\r') {
-            if (i + 1 < len && text[i + 1] == L'\n') {
-                // Already CRLF, keep it
-                newLen += 2;
-                ++i;  // Skip the \n
-            } else {
-                // Just \r, convert to CRLF
-                newLen += 2;
-            }
-        } else if (text[i] == L'\n') {
-            // Standalone \n, convert to CRLF
-            newLen += 2;
-        } else {
-            // Regular character
-            ++newLen;
-        }
-    }
-
-    // Allocate new buffer
-    WCHAR *result = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, (newLen + 1) * sizeof(WCHAR));
-    if (!result) return NULL;
-
-    // Second pass: build the normalized string
-    size_t dst = 0;
-    for (size_t i = 0; i < len; ++i) {
-        if (text[i] == L'\r') {
-            if (i + 1 < len && text[i + 1] == L'\n') {
-                // Already CRLF, copy as-is
-                result[dst++] = L'\r';
-                result[dst++] = L'\n';
-                ++i;  // Skip the \n
-            } else {
-                // Just \r, convert to CRLF
-                result[dst++] = L'\r';
-                result[dst++] = L'\n';
-            }
-        } else if (text[i] == L'\n') {
-            // Standalone \n, convert to CRLF
-            result[dst++] = L'\r';
-            result[dst++] = L'\n';
-        } else {
-            // Regular character
-            result[dst++] = text[i];
-        }
+    TRACE_BEGIN(span, "NormalizeLineEndings");
+    size_t len = TextLength((const TextChar *)text);
+    size_t newLen = TextNormalizeLineEndings((const TextChar *)text, len, NULL);
+    WCHAR *result = (WCHAR *)ScratchAlloc((newLen + 1) * sizeof(WCHAR));
+    if (!result) {
+        TRACE_END(span);
+        return NULL;
     }
-    result[dst] = L'\0';
+    TextNormalizeLineEndings((const TextChar *)text, len, (TextChar *)result);
+    result[newLen] = L'\0';
 
-    if (outLength) *outLength = dst;
+    if (outLength) *outLength = newLen;
+    TRACE_END_BYTES(span, len * sizeof(WCHAR));
     return result;
 }
 
+// Asked before a save that would turn some characters into question marks
+static BOOL ConfirmLossySave(HWND owner) {
+    return MessageBoxW(owner,
+            L"This file contains characters that can't be saved in the selected encoding. "
+            L"They will be replaced with question marks.\n\nSave anyway?",
+            L"retropad", MB_ICONWARNING | MB_OKCANCEL) == IDOK;
+}
+
+// After a successful save: *stampOut (may be NULL) gets the written file's stamp, and the
+// file goes to the top of the cache as saved
+static void RecordSave(LPCWSTR path, HashState *hash, const FileEncoding *encoding, FileStamp *stampOut) {
+    if (!stampOut) return;
+    // The write time is final once the handle is closed
+    if (!QueryFileStamp(path, stampOut)) {
+        stampOut->size = hash->length;
+        stampOut->writeTime = 0;
+    }
+    stampOut->hash = HashEnd(hash);
+    // Reopening what was just saved then skips detection and hashing
+    FileCacheEntry entry = {0};
+    FileEncoding saved = *encoding;
+    if (saved.encoding == ENC_UTF16BE) saved.encoding = ENC_UTF8;     // what was written
+    if (stampOut->writeTime && SampleFile(path, stampOut->size, &entry.sample)) {
+        RememberFile(path, &entry, stampOut, &saved);
+    }
+}
+
+BOOL SaveEncodedFile(HWND owner, LPCWSTR path, const EncodedFile *encoded, const FileEncoding *encoding,
+                     FileStamp *stampOut) {
+    if (encoded->lossy && !ConfirmLossySave(owner)) return FALSE;
 
-BOOL SaveTextFile(HWND owner, LPCWSTR path, LPCWSTR text, size_t length, TextEncoding encoding) {
+    TRACE_BEGIN(span, "SaveEncodedFile");
     HANDLE file = CreateFileW(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
     if (file == INVALID_HANDLE_VALUE) {
+        TRACE_END(span);
         MessageBoxW(owner, L"Unable to create file.", L"retropad", MB_ICONERROR);
         return FALSE;
     }
 
-    BOOL ok = FALSE;
+    HashState hash;
+    HashBegin(&hash);
+    BOOL ok = WriteHashed(file, encoded->bytes, encoded->size, &hash);
+    CloseHandle(file);
+    TRACE_END_BYTES(span, encoded->size);
+    if (!ok) {
+        MessageBoxW(owner, L"Failed writing file.", L"retropad", MB_ICONERROR);
+    } else {
+        RecordSave(path, &hash, encoding, stampOut);
+    }
+    return ok;
+}
+
+// Encodes the store's text from *pos, at most SAVE_BLOCK_UNITS units of it, and
+// advances *pos. `units` and `lines` hold SAVE_BLOCK_UNITS units and `bytes` 4 bytes per
+// unit. A block never ends between a CR and its LF or inside a surrogate pair, so the
+// blocks encode exactly as the whole text would. Returns the bytes, or NULL on failure.
+static const BYTE *EncodeStoreBlock(const DocStore *store, size_t *pos, TextEncoding encoding, UINT codePage,
+                                    const TextCodePage *table, TextEol eol, TextChar *units, TextChar *lines,
+                                    BYTE *bytes, size_t *sizeOut, BOOL *lossyOut) {
+    size_t total = DocStoreLength(store);
+    size_t length = DocStoreCopy(store, *pos, min(total - *pos, (size_t)SAVE_BLOCK_UNITS), units);
+    if (length == 0) return NULL;
+    if (*pos + length < total && length > 1) {
+        TextChar last = units[length - 1];
+        if (last == '\r' || (last >= 0xD800 && last <= 0xDBFF)) length--;
+    }
+    *pos += length;
+
     switch (encoding) {
     case ENC_UTF16LE:
-        ok = WriteUTF16LE(file, text, length);
+        if (eol == TEXT_EOL_CRLF) {
+            *sizeOut = length * sizeof(TextChar);
+            return (const BYTE *)units;
+        }
+        *sizeOut = TextConvertEol(units, length, eol, lines) * sizeof(TextChar);
+        return (const BYTE *)lines;
+    case ENC_ANSI: {
+        if (table) {
+            size_t unmapped = 0;
+            *sizeOut = TextEncodeCodePage(table, units, length, eol, bytes, &unmapped);
+            if (unmapped) *lossyOut = TRUE;
+            return bytes;
+        }
+        // WideCharToMultiByte has no line ending option, so DBCS pages convert first
+        length = TextConvertEol(units, length, eol, lines);
+        BOOL usedDefault = FALSE;
+        int size = WideCharToMultiByte(codePage, 0, (LPCWSTR)lines, (int)length, (LPSTR)bytes, (int)(length * 4),
+                                       NULL, &usedDefault);
+        if (size <= 0) return NULL;
+        if (usedDefault) *lossyOut = TRUE;
+        *sizeOut = (size_t)size;
+        return bytes;
+    }
+    case ENC_UTF8:
+    default:
+        *sizeOut = TextEncodeUtf8(units, length, eol, bytes);
+        return bytes;
+    }
+}
+
+BOOL SaveStoreFile(HWND owner, LPCWSTR path, const DocStore *store, const FileEncoding *encoding,
+                   FileStamp *stampOut) {
+    TextEncoding target = encoding->encoding == ENC_UTF16BE ? ENC_UTF8 : encoding->encoding;
+    UINT codePage = ResolveCodePage(encoding->codePage);
+    const TextCodePage *table = target == ENC_ANSI ? TextFindCodePage(codePage) : NULL;
+    TextChar *units = (TextChar *)ScratchAlloc(SAVE_BLOCK_UNITS * sizeof(TextChar));
+    TextChar *lines = (TextChar *)ScratchAlloc(SAVE_BLOCK_UNITS * sizeof(TextChar));
+    BYTE *bytes = (BYTE *)ScratchAlloc(SAVE_BLOCK_UNITS * 4);
+    if (!units || !lines || !bytes) {
+        MessageBoxW(owner, L"Not enough memory to save the file.", L"retropad", MB_ICONERROR);
+        return FALSE;
+    }
+    size_t length = DocStoreLength(store);
+    size_t size = 0;
+
+    // Only a code page can lose characters; a first pass finds out before the file is touched
+    if (target == ENC_ANSI) {
+        BOOL lossy = FALSE;
+        for (size_t pos = 0; pos < length && !lossy;) {
+            if (!EncodeStoreBlock(store, &pos, target, codePage, table, encoding->eol, units, lines, bytes, &size,
+                                  &lossy)) {
+                MessageBoxW(owner, L"Unable to encode the file.", L"retropad", MB_ICONERROR);
+                return FALSE;
+            }
+        }
+        if (lossy && !ConfirmLossySave(owner)) return FALSE;
+    }
+
+    TRACE_BEGIN(span, "SaveStoreFile");
+    HANDLE file = CreateFileW(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        TRACE_END(span);
+        MessageBoxW(owner, L"Unable to create file.", L"retropad", MB_ICONERROR);
+        return FALSE;
+    }
+
+    static const BYTE utf8Bom[] = {0xEF, 0xBB, 0xBF};
+    static const BYTE utf16Bom[] = {0xFF, 0xFE};
+    HashState hash;
+    HashBegin(&hash);
+    BOOL ok = TRUE;
+    if (target == ENC_UTF16LE) {
+        ok = WriteHashed(file, utf16Bom, sizeof(utf16Bom), &hash);
+    } else if (target != ENC_ANSI) {
+        ok = WriteHashed(file, utf8Bom, sizeof(utf8Bom), &hash);
+    }
+    for (size_t pos = 0; ok && pos < length;) {
+        BOOL lossy = FALSE;
+        const BYTE *block = EncodeStoreBlock(store, &pos, target, codePage, table, encoding->eol, units, lines,
+                                             bytes, &size, &lossy);
+        ok = block && WriteHashed(file, block, size, &hash);
+    }
+    CloseHandle(file);
+    TRACE_END_BYTES(span, length * sizeof(WCHAR));
+    if (!ok) {
+        MessageBoxW(owner, L"Failed writing file.", L"retropad", MB_ICONERROR);
+    } else {
+        RecordSave(path, &hash, encoding, stampOut);
+    }
+    return ok;
+}
+
+BOOL QueryFileStamp(LPCWSTR path, FileStamp *stamp) {
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if (!GetFileAttributesExW(path, GetFileExInfoStandard, &data)) return FALSE;
+    stamp->size = ((ULONGLONG)data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    stamp->writeTime = FileTimeValue(&data.ftLastWriteTime);
+    stamp->hash = 0;
+    return TRUE;
+}
+
+BOOL ProbeFile(LPCWSTR path, ULONGLONG *sizeOut, BOOL *binaryOut) {
+    HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return FALSE;
+    LARGE_INTEGER size = {0};
+    BYTE *buffer = (BYTE *)ScratchAlloc(PROBE_BYTES);
+    DWORD read = 0;
+    BOOL ok = buffer && GetFileSizeEx(file, &size) && ReadFile(file, buffer, PROBE_BYTES, &read, NULL);
+    CloseHandle(file);
+    if (!ok) return FALSE;
+    *sizeOut = (ULONGLONG)size.QuadPart;
+    *binaryOut = HexLooksBinary(buffer, read);
+    return TRUE;
+}
+
+// Reads rather than maps the file: a mapping would stop the program that is writing
+// it from truncating it while the hash runs
+BOOL HashFileContents(LPCWSTR path, UINT64 *hashOut) {
+    HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                              OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return FALSE;
+    BYTE *buffer = (BYTE *)ScratchAlloc(HASH_READ_BYTES);
+    if (!buffer) {
+        CloseHandle(file);
+        return FALSE;
+    }
+
+    TRACE_BEGIN(span, "HashFileContents");
+    HashState hash;
+    HashBegin(&hash);
+    DWORD read = 0;
+    BOOL ok;
+    while ((ok = ReadFile(file, buffer, HASH_READ_BYTES, &read, NULL)) && read > 0) {
+        HashUpdate(&hash, buffer, read);
+    }
+    CloseHandle(file);
+    TRACE_END_BYTES(span, hash.length);
+    if (ok) *hashOut = HashEnd(&hash);
+    return ok;
+}
+
+static void CodePageLabel(const TextCodePage *codePage, WCHAR *out, size_t outLen) {
+    size_t n = 0;
+    for (; codePage->name[n] && n + 1 < outLen; ++n) out[n] = (WCHAR)codePage->name[n];
+    out[n] = L'\0';
+}
+
+void EncodingDisplayName(const FileEncoding *encoding, WCHAR *out, size_t outLen) {
+    const TextCodePage *table = NULL;
+    switch (encoding->encoding) {
+    case ENC_UTF16LE:
+        StringCchCopyW(out, outLen, L"UTF-16 LE");
+        break;
+    case ENC_UTF16BE:
+        StringCchCopyW(out, outLen, L"UTF-16 BE (saved as UTF-8)");
         break;
     case ENC_ANSI:
-        ok = WriteANSI(file, text, length);
+        table = TextFindCodePage(ResolveCodePage(encoding->codePage));
+        if (table) CodePageLabel(table, out, outLen);
+        else StringCchPrintfW(out, outLen, L"ANSI (code page %u)", ResolveCodePage(encoding->codePage));
         break;
-    case ENC_UTF16BE:
-        // Saving as UTF-16BE is uncommon; fall back to UTF-8 with BOM to preserve readability
-        ok = WriteUTF8WithBOM(file, text, length);
-        encoding = ENC_UTF8;
+    case ENC_UTF8:
+    default:
+        StringCchCopyW(out, outLen, L"UTF-8");
+        break;
+    }
+}
+
+BOOL EncodedTextSize(const TextStats *stats, const FileEncoding *encoding, ULONGLONG *sizeOut) {
+    // With CRLF every CR and LF is written as is; otherwise each CRLF becomes one unit
+    ULONGLONG breakUnits = encoding->eol == TEXT_EOL_CRLF ? stats->length - stats->units : stats->lineBreaks;
+    BOOL exact = TRUE;
+    switch (encoding->encoding) {
+    case ENC_UTF16LE:
+        *sizeOut = 2 + 2 * ((ULONGLONG)stats->units + breakUnits);
         break;
+    case ENC_ANSI:
+        // Single-byte tables write one byte per unit ('?' for what they can't map);
+        // DBCS pages are taken as two bytes per non-ASCII character
+        if (TextFindCodePage(ResolveCodePage(encoding->codePage))) {
+            *sizeOut = (ULONGLONG)stats->units + breakUnits;
+        } else {
+            *sizeOut = (ULONGLONG)stats->ascii + 2 * (ULONGLONG)(stats->chars - stats->ascii) + breakUnits;
+            exact = FALSE;
+        }
+        break;
+    case ENC_UTF16BE:
     case ENC_UTF8:
     default:
-        ok = WriteUTF8WithBOM(file, text, length);
+        *sizeOut = 3 + (ULONGLONG)stats->utf8Bytes + breakUnits;
         break;
     }
+    return exact;
+}
 
-    CloseHandle(file);
-    if (!ok) {
-        MessageBoxW(owner, L"Failed writing file.", L"retropad", MB_ICONERROR);
+typedef struct EncodingPicker {
+    FileEncoding *encoding;
+    BOOL forOpen;           // offers auto-detect and UTF-16 BE
+} EncodingPicker;
+
+static void AddEncodingItem(HWND combo, LPCWSTR label, TextEncoding encoding, UINT codePage, const FileEncoding *current) {
+    LRESULT item = SendMessageW(combo, CB_ADDSTRING, 0, (LPARAM)label);
+    if (item < 0) return;
+    SendMessageW(combo, CB_SETITEMDATA, (WPARAM)item, MAKELPARAM(codePage, encoding));
+    if (current->encoding == encoding && current->codePage == codePage) {
+        SendMessageW(combo, CB_SETCURSEL, (WPARAM)item, 0);
     }
-    return ok;
 }
 
-BOOL OpenFileDialog(HWND owner, WCHAR *pathOut, DWORD pathLen) {
+static void FillEncodingCombo(HWND combo, const EncodingPicker *picker) {
+    const FileEncoding *current = picker->encoding;
+    if (picker->forOpen) AddEncodingItem(combo, L"Auto-detect", (TextEncoding)0, 0, current);
+    AddEncodingItem(combo, L"UTF-8", ENC_UTF8, 0, current);
+    AddEncodingItem(combo, L"UTF-16 LE", ENC_UTF16LE, 0, current);
+    if (picker->forOpen) AddEncodingItem(combo, L"UTF-16 BE", ENC_UTF16BE, 0, current);
+    AddEncodingItem(combo, L"ANSI (system code page)", ENC_ANSI, 0, current);
+    for (size_t i = 0; i < TextCodePageCount(); ++i) {
+        const TextCodePage *cp = TextCodePageAt(i);
+        WCHAR label[64];
+        CodePageLabel(cp, label, ARRAYSIZE(label));
+        AddEncodingItem(combo, label, ENC_ANSI, cp->id, current);
+    }
+    if (SendMessageW(combo, CB_GETCURSEL, 0, 0) == CB_ERR) SendMessageW(combo, CB_SETCURSEL, 0, 0);
+}
+
+// Hook for the encoding row appended to the common file dialogs (IDD_FILE_ENCODING)
+static UINT_PTR CALLBACK EncodingHookProc(HWND dlg, UINT msg, WPARAM wParam, LPARAM lParam) {
+    (void)wParam;
+    if (msg == WM_INITDIALOG) {
+        EncodingPicker *picker = (EncodingPicker *)((OPENFILENAMEW *)lParam)->lCustData;
+        SetWindowLongPtrW(dlg, GWLP_USERDATA, (LONG_PTR)picker);
+        FillEncodingCombo(GetDlgItem(dlg, IDC_ENCODING_COMBO), picker);
+        return TRUE;
+    }
+    if (msg == WM_NOTIFY && ((OFNOTIFYW *)lParam)->hdr.code == CDN_FILEOK) {
+        EncodingPicker *picker = (EncodingPicker *)GetWindowLongPtrW(dlg, GWLP_USERDATA);
+        HWND combo = GetDlgItem(dlg, IDC_ENCODING_COMBO);
+        LRESULT item = SendMessageW(combo, CB_GETCURSEL, 0, 0);
+        if (picker && item != CB_ERR) {
+            LRESULT data = SendMessageW(combo, CB_GETITEMDATA, (WPARAM)item, 0);
+            picker->encoding->encoding = (TextEncoding)HIWORD(data);
+            picker->encoding->codePage = LOWORD(data);
+        }
+    }
+    return 0;
+}
+
+static void AttachEncodingPicker(OPENFILENAMEW *ofn, EncodingPicker *picker) {
+    ofn->Flags |= OFN_EXPLORER | OFN_ENABLEHOOK | OFN_ENABLETEMPLATE | OFN_ENABLESIZING;
+    ofn->hInstance = GetModuleHandleW(NULL);
+    ofn->lpTemplateName = MAKEINTRESOURCEW(IDD_FILE_ENCODING);
+    ofn->lpfnHook = EncodingHookProc;
+    ofn->lCustData = (LPARAM)picker;
+}
+
+BOOL OpenFileDialog(HWND owner, WCHAR *pathOut, DWORD pathLen, FileEncoding *encodingOut) {
     pathOut[0] = L'\0';
+    encodingOut->encoding = (TextEncoding)0;
+    encodingOut->codePage = 0;
+    encodingOut->eol = TEXT_EOL_CRLF;
+    encodingOut->eolMixed = FALSE;
+    EncodingPicker picker = {encodingOut, TRUE};
     OPENFILENAMEW ofn = {0};
     WCHAR filter[] = L"Text Files (*.txt)\0*.txt\0All Files (*.*)\0*.*\0\0";
     ofn.lStructSize = sizeof(ofn);
@@ -293,10 +664,14 @@ BOOL OpenFileDialog(HWND owner, WCHAR *pathOut, DWORD pathLen) {
     ofn.nMaxFile = pathLen;
     ofn.Flags = OFN_FILEMUSTEXIST | OFN_HIDEREADONLY | OFN_PATHMUSTEXIST;
     ofn.lpstrDefExt = L"txt";
+    AttachEncodingPicker(&ofn, &picker);
     return GetOpenFileNameW(&ofn);
 }
 
-BOOL SaveFileDialog(HWND owner, WCHAR *pathOut, DWORD pathLen) {
+BOOL SaveFileDialog(HWND owner, WCHAR *pathOut, DWORD pathLen, FileEncoding *encoding) {
+    // UTF-16 BE isn't written (see EncodeTextFile), so it starts out as UTF-8
+    if (encoding->encoding == ENC_UTF16BE) encoding->encoding = ENC_UTF8;
+    EncodingPicker picker = {encoding, FALSE};
     OPENFILENAMEW ofn = {0};
     WCHAR filter[] = L"Text Files (*.txt)\0*.txt\0All Files (*.*)\0*.*\0\0";
     ofn.lStructSize = sizeof(ofn);
@@ -309,5 +684,6 @@ BOOL SaveFileDialog(HWND owner, WCHAR *pathOut, DWORD pathLen) {
     if (pathOut[0] == L'\0') {
         StringCchCopyW(pathOut, pathLen, L"*.txt");
     }
+    AttachEncodingPicker(&ofn, &picker);
     return GetSaveFileNameW(&ofn);
 }
@@ -2,26 +2,83 @@
 #pragma once
 
 #include <windows.h>
+#include "core/textcore.h"
+#include "core/docstore.h"
+#include "core/codepage.h"
+#include "core/textstats.h"
+#include "core/hash.h"
 
-typedef enum TextEncoding {
-    ENC_UTF8 = 1,
-    ENC_UTF16LE = 2,
-    ENC_UTF16BE = 3,
-    ENC_ANSI = 4
-} TextEncoding;
+// Encoding of a file on disk. codePage only applies to ENC_ANSI, where 0 means the
+// system code page; an encoding of 0 asks the loader to detect it. eol is how line
+// breaks are written (the document itself always holds CRLF); eolMixed records that
+// the file was loaded with more than one style.
+typedef struct FileEncoding {
+    TextEncoding encoding;
+    UINT codePage;
+    TextEol eol;
+    BOOL eolMixed;
+} FileEncoding;
+
+// What a file held when it was last loaded or saved, to tell a real change by another
+// program from a touch or an identical rewrite
+typedef struct FileStamp {
+    ULONGLONG size;
+    ULONGLONG writeTime;    // FILETIME as one number
+    UINT64 hash;            // HashBytes of the file's bytes
+} FileStamp;
 
 typedef struct FileResult {
     WCHAR path[MAX_PATH];
     TextEncoding encoding;
 } FileResult;
 
-BOOL OpenFileDialog(HWND owner, WCHAR *pathOut, DWORD pathLen);
-BOOL SaveFileDialog(HWND owner, WCHAR *pathOut, DWORD pathLen);
+// Both dialogs carry an Encoding drop-down. Open returns the user's pick (encoding 0
+// for auto-detect); Save starts from *encoding and updates it.
+BOOL OpenFileDialog(HWND owner, WCHAR *pathOut, DWORD pathLen, FileEncoding *encodingOut);
+BOOL SaveFileDialog(HWND owner, WCHAR *pathOut, DWORD pathLen, FileEncoding *encoding);
+
+// Reads and decodes `path` into an empty store with line endings normalized to CRLF.
+// `forced` (NULL or encoding 0 to detect) overrides detection; the result, with the
+// file's most common line ending style, is reported in *encodingOut. *stampOut (may
+// be NULL) gets the bytes' hash, size and write time.
+BOOL LoadTextFile(HWND owner, LPCWSTR path, DocStore *store, const FileEncoding *forced, FileEncoding *encodingOut,
+                  FileStamp *stampOut);
+// A file's bytes as saving writes them, BOM included, in scratch memory
+typedef struct EncodedFile {
+    const BYTE *bytes;
+    size_t size;
+    BOOL lossy;             // some characters became '?'
+} EncodedFile;
+
+// Encodes text as `encoding`, writing each CRLF as encoding->eol. Shows no UI, so the
+// caller can encode from a locked buffer and unlock it before SaveEncodedFile.
+BOOL EncodeTextFile(LPCWSTR text, size_t length, const FileEncoding *encoding, EncodedFile *out);
+// Writes what EncodeTextFile produced. If characters were lost the user is asked first,
+// and declining returns FALSE with the file untouched. The bytes are hashed as written.
+BOOL SaveEncodedFile(HWND owner, LPCWSTR path, const EncodedFile *encoded, const FileEncoding *encoding,
+                     FileStamp *stampOut);
+// Encodes and writes the store's text block by block, for a document too big to encode
+// in one piece. Asks about lost characters before the file is touched, like
+// SaveEncodedFile; the store must not change until it returns.
+BOOL SaveStoreFile(HWND owner, LPCWSTR path, const DocStore *store, const FileEncoding *encoding,
+                   FileStamp *stampOut);
+
+// Size and write time of `path` as it is now (hash left 0); FALSE if it can't be read
+BOOL QueryFileStamp(LPCWSTR path, FileStamp *stamp);
+// Size of `path` and whether its first 64 KB look binary (HexLooksBinary), to offer
+// the hex view before loading it as text
+BOOL ProbeFile(LPCWSTR path, ULONGLONG *sizeOut, BOOL *binaryOut);
+// HashBytes of the whole file, read in large sequential pieces
+BOOL HashFileContents(LPCWSTR path, UINT64 *hashOut);
 
-BOOL LoadTextFile(HWND owner, LPCWSTR path, WCHAR **textOut, size_t *lengthOut, TextEncoding *encodingOut);
-BOOL SaveTextFile(HWND owner, LPCWSTR path, LPCWSTR text, size_t length, TextEncoding encoding);
+// Name of an encoding for display, e.g. "UTF-8" or "Windows-1252"
+void EncodingDisplayName(const FileEncoding *encoding, WCHAR *out, size_t outLen);
+// Bytes EncodeTextFile would produce for text with these counts, without encoding it.
+// Exact except for DBCS code pages, where each non-ASCII character is taken as two
+// bytes and FALSE is returned.
+BOOL EncodedTextSize(const TextStats *stats, const FileEncoding *encoding, ULONGLONG *sizeOut);
 
 // Normalize line endings to Windows style (CRLF)
 // Converts any mix of LF and CRLF to consistently use CRLF
-// Returns a newly allocated string; caller must free with HeapFree
+// Returns scratch memory (scratch.h) valid until the current command finishes
 WCHAR* NormalizeLineEndings(const WCHAR *text, size_t *outLength);
@@ -0,0 +1,221 @@
+// File cache for retropad: a small binary file read and rewritten whole on each change.
+// It is reloaded before every use, so several open windows merge their entries.
+#include "filecache.h"
+#include <strsafe.h>
+
+#define FILE_CACHE_MAGIC 0x43465052u   // "RPFC"
+#define FILE_CACHE_VERSION 1u
+#define FILE_CACHE_MAX_BYTES (1u << 20)
+
+typedef struct CacheRecord {
+    FileCacheEntry entry;
+    WCHAR path[MAX_PATH];
+} CacheRecord;
+
+// On disk, after a header of magic, version and count (UINT32 each)
+typedef struct CacheRecordHeader {
+    UINT64 size;
+    UINT64 writeTime;
+    UINT64 sample;
+    UINT64 hash;
+    UINT32 encoding;
+    UINT32 codePage;
+    UINT32 eol;             // TextEol, bit 8 set when mixed
+    UINT32 pathLength;      // WCHARs that follow, no terminator
+} CacheRecordHeader;
+
+static CacheRecord g_records[FILE_CACHE_MAX_ENTRIES];
+static size_t g_recordCount = 0;
+
+static BOOL BuildCachePath(WCHAR *path, size_t pathLen, BOOL create) {
+    DWORD length = GetEnvironmentVariableW(L"LOCALAPPDATA", path, (DWORD)pathLen);
+    if (length == 0 || length >= pathLen) return FALSE;
+    if (FAILED(StringCchCatW(path, pathLen, L"\\retropad"))) return FALSE;
+    if (create) CreateDirectoryW(path, NULL);
+    return SUCCEEDED(StringCchCatW(path, pathLen, L"\\filecache.dat"));
+}
+
+// Entries are keyed by the full path, compared without case like the file system does
+static BOOL CanonicalPath(LPCWSTR path, WCHAR *out) {
+    DWORD length = GetFullPathNameW(path, MAX_PATH, out, NULL);
+    return length > 0 && length < MAX_PATH;
+}
+
+// The fields loading acts on: an encoding and line ending style it knows, and a code page
+// that is the system's (0) or one Windows converts with. UTF-7 and UTF-8 are encodings
+// of their own, never a cached code page.
+static BOOL RecordFieldsValid(const CacheRecordHeader *record) {
+    if (record->encoding < ENC_UTF8 || record->encoding > ENC_ANSI) return FALSE;
+    if ((record->eol & ~0x1FFu) != 0 || (record->eol & 0xFF) > TEXT_EOL_CR) return FALSE;
+    return record->codePage == 0 ||
+           (record->codePage != CP_UTF7 && record->codePage != CP_UTF8 && IsValidCodePage(record->codePage));
+}
+
+static void LoadRecords(void) {
+    g_recordCount = 0;
+    WCHAR path[MAX_PATH];
+    if (!BuildCachePath(path, ARRAYSIZE(path), FALSE)) return;
+    HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return;
+
+    LARGE_INTEGER size = {0};
+    if (!GetFileSizeEx(file, &size) || size.QuadPart < 12 || size.QuadPart > FILE_CACHE_MAX_BYTES) {
+        CloseHandle(file);
+        return;
+    }
+    DWORD bytes = (DWORD)size.QuadPart;
+    BYTE *data = (BYTE *)HeapAlloc(GetProcessHeap(), 0, bytes);
+    if (!data) {
+        CloseHandle(file);
+        return;
+    }
+    DWORD read = 0;
+    BOOL ok = ReadFile(file, data, bytes, &read, NULL);
+    CloseHandle(file);
+
+    UINT32 header[3] = {0, 0, 0};
+    if (ok && read >= sizeof(header)) CopyMemory(header, data, sizeof(header));
+    // A damaged or foreign file is ignored and replaced by the next write
+    if (header[0] == FILE_CACHE_MAGIC && header[1] == FILE_CACHE_VERSION) {
+        DWORD pos = sizeof(header);
+        for (UINT32 i = 0; i < header[2] && g_recordCount < FILE_CACHE_MAX_ENTRIES; ++i) {
+            CacheRecordHeader record;
+            if (read - pos < sizeof(record)) break;
+            CopyMemory(&record, data + pos, sizeof(record));
+            pos += sizeof(record);
+            if (record.pathLength == 0 || record.pathLength >= MAX_PATH ||
+                (read - pos) / sizeof(WCHAR) < (size_t)record.pathLength) {
+                break;
+            }
+            // The path is still framed, so only this record is lost
+            if (!RecordFieldsValid(&record)) {
+                pos += record.pathLength * sizeof(WCHAR);
+                continue;
+            }
+            CacheRecord *out = &g_records[g_recordCount++];
+            out->entry.size = record.size;
+            out->entry.writeTime = record.writeTime;
+            out->entry.sample = record.sample;
+            out->entry.hash = record.hash;
+            out->entry.encoding = (TextEncoding)record.encoding;
+            out->entry.codePage = record.codePage;
+            out->entry.eol = (TextEol)(record.eol & 0xFF);
+            out->entry.eolMixed = (record.eol & 0x100) != 0;
+            CopyMemory(out->path, data + pos, record.pathLength * sizeof(WCHAR));
+            out->path[record.pathLength] = L'\0';
+            pos += record.pathLength * sizeof(WCHAR);
+        }
+    }
+    HeapFree(GetProcessHeap(), 0, data);
+}
+
+// Written to a sibling temp file and swapped in, like retropad.ini
+static void SaveRecords(void) {
+    WCHAR path[MAX_PATH];
+    WCHAR tempPath[MAX_PATH + 8];
+    if (!BuildCachePath(path, ARRAYSIZE(path), TRUE)) return;
+    StringCchPrintfW(tempPath, ARRAYSIZE(tempPath), L"%s.tmp", path);
+
+    size_t bytes = 3 * sizeof(UINT32);
+    for (size_t i = 0; i < g_recordCount; ++i) {
+        bytes += sizeof(CacheRecordHeader) + wcslen(g_records[i].path) * sizeof(WCHAR);
+    }
+    BYTE *data = (BYTE *)HeapAlloc(GetProcessHeap(), 0, bytes);
+    if (!data) return;
+
+    UINT32 header[3] = {FILE_CACHE_MAGIC, FILE_CACHE_VERSION, (UINT32)g_recordCount};
+    CopyMemory(data, header, sizeof(header));
+    size_t pos = sizeof(header);
+    for (size_t i = 0; i < g_recordCount; ++i) {
+        const CacheRecord *in = &g_records[i];
+        CacheRecordHeader record;
+        record.size = in->entry.size;
+        record.writeTime = in->entry.writeTime;
+        record.sample = in->entry.sample;
+        record.hash = in->entry.hash;
+        record.encoding = (UINT32)in->entry.encoding;
+        record.codePage = in->entry.codePage;
+        record.eol = (UINT32)in->entry.eol | (in->entry.eolMixed ? 0x100u : 0u);
+        record.pathLength = (UINT32)wcslen(in->path);
+        CopyMemory(data + pos, &record, sizeof(record));
+        pos += sizeof(record);
+        CopyMemory(data + pos, in->path, record.pathLength * sizeof(WCHAR));
+        pos += record.pathLength * sizeof(WCHAR);
+    }
+
+    HANDLE file = CreateFileW(tempPath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        HeapFree(GetProcessHeap(), 0, data);
+        return;
+    }
+    DWORD written = 0;
+    BOOL ok = WriteFile(file, data, (DWORD)bytes, &written, NULL);
+    CloseHandle(file);
+    HeapFree(GetProcessHeap(), 0, data);
+    if (!ok || !MoveFileExW(tempPath, path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        DeleteFileW(tempPath);
+    }
+}
+
+static size_t FindRecord(LPCWSTR fullPath) {
+    for (size_t i = 0; i < g_recordCount; ++i) {
+        if (lstrcmpiW(g_records[i].path, fullPath) == 0) return i;
+    }
+    return g_recordCount;
+}
+
+// Removes record `index`, keeping the rest in order
+static void RemoveRecord(size_t index) {
+    MoveMemory(&g_records[index], &g_records[index + 1], (g_recordCount - index - 1) * sizeof(CacheRecord));
+    g_recordCount--;
+}
+
+BOOL FileCacheLookup(LPCWSTR path, const FileCacheEntry *key, FileCacheEntry *out) {
+    WCHAR fullPath[MAX_PATH];
+    if (!CanonicalPath(path, fullPath)) return FALSE;
+    LoadRecords();
+    size_t index = FindRecord(fullPath);
+    if (index == g_recordCount) return FALSE;
+    const FileCacheEntry *entry = &g_records[index].entry;
+    if (entry->size != key->size || entry->writeTime != key->writeTime || entry->sample != key->sample) {
+        return FALSE;
+    }
+    *out = *entry;
+    return TRUE;
+}
+
+void FileCacheRecord(LPCWSTR path, const FileCacheEntry *entry) {
+    WCHAR fullPath[MAX_PATH];
+    if (!CanonicalPath(path, fullPath)) return;
+    LoadRecords();
+    size_t index = FindRecord(fullPath);
+    if (index < g_recordCount) {
+        RemoveRecord(index);
+    } else if (g_recordCount == FILE_CACHE_MAX_ENTRIES) {
+        g_recordCount--;    // the least recently used
+    }
+    MoveMemory(&g_records[1], &g_records[0], g_recordCount * sizeof(CacheRecord));
+    g_records[0].entry = *entry;
+    StringCchCopyW(g_records[0].path, ARRAYSIZE(g_records[0].path), fullPath);
+    g_recordCount++;
+    SaveRecords();
+}
+
+void FileCacheForget(LPCWSTR path) {
+    WCHAR fullPath[MAX_PATH];
+    if (!CanonicalPath(path, fullPath)) return;
+    LoadRecords();
+    size_t index = FindRecord(fullPath);
+    if (index == g_recordCount) return;
+    RemoveRecord(index);
+    SaveRecords();
+}
+
+size_t FileCacheRecent(WCHAR (*paths)[MAX_PATH], size_t maxCount) {
+    LoadRecords();
+    size_t count = g_recordCount < maxCount ? g_recordCount : maxCount;
+    for (size_t i = 0; i < count; ++i) {
+        StringCchCopyW(paths[i], MAX_PATH, g_records[i].path);
+    }
+    return count;
+}
@@ -0,0 +1,31 @@
+// Per-user cache of what retropad learned about the files it opened, kept in
+// %LOCALAPPDATA%\retropad\filecache.dat, most recently used first
+#pragma once
+
+#include <windows.h>
+#include "core/textcore.h"
+
+#define FILE_CACHE_MAX_ENTRIES 200     // least recently used entries are dropped past this
+
+// One file as it was when last loaded or saved. size, writeTime and sample (HashSample of
+// the bytes) identify that version; the rest is what loading it found.
+typedef struct FileCacheEntry {
+    ULONGLONG size;
+    ULONGLONG writeTime;
+    UINT64 sample;
+    UINT64 hash;            // HashBytes of the whole file
+    TextEncoding encoding;
+    UINT codePage;
+    TextEol eol;
+    BOOL eolMixed;
+} FileCacheEntry;
+
+// TRUE when `path` is cached with the same size, write time and sample as *key; *out gets
+// the cached entry
+BOOL FileCacheLookup(LPCWSTR path, const FileCacheEntry *key, FileCacheEntry *out);
+// Stores *entry for `path` as the most recent file and writes the cache back
+void FileCacheRecord(LPCWSTR path, const FileCacheEntry *entry);
+// Drops `path`, e.g. once it no longer exists
+void FileCacheForget(LPCWSTR path);
+// Copies up to maxCount recent paths, newest first, into paths; returns how many
+size_t FileCacheRecent(WCHAR (*paths)[MAX_PATH], size_t maxCount);
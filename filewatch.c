@@ -0,0 +1,70 @@
+// Folder change watcher for retropad: one thread blocked on the folder's change
+// notification and a stop event, so nothing is polled.
+#include "filewatch.h"
+#include <strsafe.h>
+
+#define WATCH_PATH_CHARS 1024
+
+typedef struct FileWatch {
+    HANDLE thread;
+    HANDLE stop;
+    HANDLE change;
+    HWND notify;
+    UINT msg;
+} FileWatch;
+
+static FileWatch g_watch = {0};
+
+static DWORD WINAPI WatchThread(LPVOID param) {
+    FileWatch *watch = (FileWatch *)param;
+    HANDLE handles[2] = {watch->stop, watch->change};
+    while (WaitForMultipleObjects(2, handles, FALSE, INFINITE) == WAIT_OBJECT_0 + 1) {
+        PostMessageW(watch->notify, watch->msg, 0, 0);
+        if (!FindNextChangeNotification(watch->change)) break;
+    }
+    return 0;
+}
+
+BOOL FileWatchStart(HWND notify, UINT msg, LPCWSTR path) {
+    FileWatchStop();
+
+    WCHAR folder[WATCH_PATH_CHARS];
+    if (FAILED(StringCchCopyW(folder, ARRAYSIZE(folder), path))) return FALSE;
+    WCHAR *slash = wcsrchr(folder, L'\\');
+    if (!slash) {
+        // A bare file name from the command line lives in the current directory
+        StringCchCopyW(folder, ARRAYSIZE(folder), L".");
+    } else {
+        // Keep the slash for a drive root ("C:\")
+        slash[slash > folder && slash[-1] == L':' ? 1 : 0] = L'\0';
+    }
+
+    g_watch.notify = notify;
+    g_watch.msg = msg;
+    g_watch.change = FindFirstChangeNotificationW(folder, FALSE,
+        FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_SIZE | FILE_NOTIFY_CHANGE_LAST_WRITE);
+    if (g_watch.change == INVALID_HANDLE_VALUE) {
+        g_watch.change = NULL;
+        return FALSE;
+    }
+    g_watch.stop = CreateEventW(NULL, TRUE, FALSE, NULL);
+    if (g_watch.stop) g_watch.thread = CreateThread(NULL, 0, WatchThread, &g_watch, 0, NULL);
+    if (!g_watch.thread) {
+        FileWatchStop();
+        return FALSE;
+    }
+    return TRUE;
+}
+
+void FileWatchStop(void) {
+    if (g_watch.thread) {
+        SetEvent(g_watch.stop);
+        WaitForSingleObject(g_watch.thread, INFINITE);
+        CloseHandle(g_watch.thread);
+    }
+    if (g_watch.stop) CloseHandle(g_watch.stop);
+    if (g_watch.change) FindCloseChangeNotification(g_watch.change);
+    g_watch.thread = NULL;
+    g_watch.stop = NULL;
+    g_watch.change = NULL;
+}
@@ -0,0 +1,11 @@
+// Watches the open file's folder for retropad. A background thread waits on a change
+// notification and posts a message to the main window; the window decides whether
+// the open file itself really changed (see FileStamp in file_io.h).
+#pragma once
+
+#include <windows.h>
+
+// Starts watching the folder that holds `path`, replacing any earlier watch. `msg` is
+// posted to `notify` for every burst of changes in that folder.
+BOOL FileWatchStart(HWND notify, UINT msg, LPCWSTR path);
+void FileWatchStop(void);
@@ -0,0 +1,463 @@
+// Hex view for retropad: rows are formatted and painted straight from a mapped view of
+// the file that covers the screen; nothing else of the file is read or kept.
+#include "hexview.h"
+#include "trace.h"
+#include "core/hexdump.h"
+
+#define HEX_CLASS_NAME L"RetropadHexView"
+#define HEX_MAP_BYTES (1u << 20)        // mapped around the rows on screen
+#define HEX_SEARCH_BYTES (16u << 20)    // mapped at a time while searching
+#define HEX_SCROLL_MAX 0x3FFFFFFF       // scroll bar positions are ints; beyond this rows are scaled
+#define HEX_WHEEL_ROWS 3
+
+typedef struct HexView {
+    HWND hwnd;
+    HWND parent;
+    UINT msg;
+    HANDLE file;
+    HANDLE mapping;             // NULL for an empty file (or none)
+    ULONGLONG size;
+    unsigned digits;            // of the offsets shown
+    DWORD granularity;          // views start at multiples of this
+    const BYTE *view;           // [viewStart, viewStart + viewLength) of the file; NULL if unmapped
+    ULONGLONG viewStart;
+    size_t viewLength;
+    ULONGLONG topRow;
+    int leftColumn;             // first character column shown
+    ULONGLONG selStart;         // selected bytes; none until one is clicked, gone to or found
+    ULONGLONG selLength;
+    unsigned scrollShift;       // rows >> scrollShift fit the scroll bar
+    HFONT font;
+    BOOL ownFont;
+    int charWidth;
+    int lineHeight;
+} HexView;
+
+static HexView *GetView(HWND hwnd) {
+    return (HexView *)GetWindowLongPtrW(hwnd, GWLP_USERDATA);
+}
+
+static ULONGLONG TotalRows(const HexView *v) {
+    return (v->size + HEX_ROW_BYTES - 1) / HEX_ROW_BYTES;
+}
+
+// Whole rows that fit in the window, at least one
+static ULONGLONG PageRows(const HexView *v) {
+    RECT rc;
+    GetClientRect(v->hwnd, &rc);
+    int rows = rc.bottom / v->lineHeight;
+    return rows > 0 ? (ULONGLONG)rows : 1;
+}
+
+static ULONGLONG MaxTopRow(const HexView *v) {
+    ULONGLONG rows = TotalRows(v), page = PageRows(v);
+    return rows > page ? rows - page : 0;
+}
+
+static void Unmap(HexView *v) {
+    if (v->view) UnmapViewOfFile(v->view);
+    v->view = NULL;
+    v->viewLength = 0;
+}
+
+// Pointer to file bytes [start, start + length), remapping when the current view doesn't
+// hold them; NULL if mapping fails
+static const BYTE *MapRange(HexView *v, ULONGLONG start, size_t length) {
+    if (v->view && start >= v->viewStart && start + length <= v->viewStart + v->viewLength) {
+        return v->view + (start - v->viewStart);
+    }
+    Unmap(v);
+    ULONGLONG base = start - start % v->granularity;
+    ULONGLONG span = start + length - base;
+    if (span < HEX_MAP_BYTES) span = HEX_MAP_BYTES;
+    if (span > v->size - base) span = v->size - base;
+    v->view = (const BYTE *)MapViewOfFile(v->mapping, FILE_MAP_READ, (DWORD)(base >> 32), (DWORD)base, (SIZE_T)span);
+    if (!v->view) return NULL;
+    v->viewStart = base;
+    v->viewLength = (size_t)span;
+    return v->view + (start - base);
+}
+
+static void UpdateScrollBars(HexView *v) {
+    RECT rc;
+    GetClientRect(v->hwnd, &rc);
+    ULONGLONG rows = TotalRows(v);
+    v->scrollShift = 0;
+    while ((rows >> v->scrollShift) > HEX_SCROLL_MAX) v->scrollShift++;
+
+    SCROLLINFO si = {0};
+    si.cbSize = sizeof(si);
+    si.fMask = SIF_RANGE | SIF_PAGE | SIF_POS;
+    si.nMax = rows ? (int)((rows - 1) >> v->scrollShift) : 0;
+    si.nPage = (UINT)(PageRows(v) >> v->scrollShift);
+    if (si.nPage == 0) si.nPage = 1;
+    si.nPos = (int)(v->topRow >> v->scrollShift);
+    SetScrollInfo(v->hwnd, SB_VERT, &si, TRUE);
+
+    si.nMax = (int)HEX_ROW_LENGTH(v->digits) - 1;
+    si.nPage = (UINT)(rc.right / v->charWidth);
+    si.nPos = v->leftColumn;
+    SetScrollInfo(v->hwnd, SB_HORZ, &si, TRUE);
+}
+
+static void ScrollToRow(HexView *v, ULONGLONG row) {
+    ULONGLONG maxTop = MaxTopRow(v);
+    if (row > maxTop) row = maxTop;
+    if (row == v->topRow) return;
+    v->topRow = row;
+    UpdateScrollBars(v);
+    InvalidateRect(v->hwnd, NULL, FALSE);
+}
+
+static void ScrollToColumn(HexView *v, int column) {
+    RECT rc;
+    GetClientRect(v->hwnd, &rc);
+    int maxLeft = (int)HEX_ROW_LENGTH(v->digits) - rc.right / v->charWidth;
+    if (column > maxLeft) column = maxLeft;
+    if (column < 0) column = 0;
+    if (column == v->leftColumn) return;
+    v->leftColumn = column;
+    UpdateScrollBars(v);
+    InvalidateRect(v->hwnd, NULL, FALSE);
+}
+
+static void Select(HexView *v, ULONGLONG start, ULONGLONG length) {
+    v->selStart = start;
+    v->selLength = length;
+    ULONGLONG row = start / HEX_ROW_BYTES, page = PageRows(v);
+    if (row < v->topRow) {
+        ScrollToRow(v, row);
+    } else if (row >= v->topRow + page) {
+        ScrollToRow(v, row - page + 1);
+    }
+    InvalidateRect(v->hwnd, NULL, FALSE);
+    SendMessageW(v->parent, v->msg, 0, 0);
+}
+
+static void Paint(HexView *v, HDC dc, const RECT *clip) {
+    RECT rc;
+    GetClientRect(v->hwnd, &rc);
+    HGDIOBJ oldFont = SelectObject(dc, v->font);
+    COLORREF window = GetSysColor(COLOR_WINDOW), text = GetSysColor(COLOR_WINDOWTEXT);
+    COLORREF highlight = GetSysColor(COLOR_HIGHLIGHT), highlightText = GetSysColor(COLOR_HIGHLIGHTTEXT);
+
+    // Only the rows on screen are mapped
+    int rows = (rc.bottom + v->lineHeight - 1) / v->lineHeight;
+    ULONGLONG first = v->topRow * HEX_ROW_BYTES;
+    const BYTE *bytes = NULL;
+    if (v->mapping && first < v->size) {
+        ULONGLONG shown = (ULONGLONG)rows * HEX_ROW_BYTES;
+        bytes = MapRange(v, first, (size_t)(shown < v->size - first ? shown : v->size - first));
+    }
+
+    WCHAR line[HEX_ROW_LENGTH(16)];
+    int x = -v->leftColumn * v->charWidth;
+    ULONGLONG selEnd = v->selStart + v->selLength;
+    for (int r = 0; r < rows; ++r) {
+        RECT rowRect = {0, r * v->lineHeight, rc.right, (r + 1) * v->lineHeight};
+        if (rowRect.bottom <= clip->top || rowRect.top >= clip->bottom) continue;
+        ULONGLONG offset = first + (ULONGLONG)r * HEX_ROW_BYTES;
+        SetBkColor(dc, window);
+        SetTextColor(dc, text);
+        if (!bytes || offset >= v->size) {
+            ExtTextOutW(dc, 0, 0, ETO_OPAQUE, &rowRect, NULL, 0, NULL);
+            continue;
+        }
+        size_t count = v->size - offset < HEX_ROW_BYTES ? (size_t)(v->size - offset) : HEX_ROW_BYTES;
+        size_t length = HexFormatRow(offset, v->digits, bytes + (offset - first), count, (TextChar *)line);
+        ExtTextOutW(dc, x, rowRect.top, ETO_OPAQUE, &rowRect, line, (UINT)length, NULL);
+
+        // Selected bytes are drawn again over the row, in both columns
+        if (selEnd <= offset || v->selStart >= offset + count) continue;
+        size_t from = v->selStart > offset ? (size_t)(v->selStart - offset) : 0;
+        size_t to = selEnd < offset + count ? (size_t)(selEnd - offset) : count;
+        SetBkColor(dc, highlight);
+        SetTextColor(dc, highlightText);
+        for (size_t i = from; i < to; ++i) {
+            size_t column = HexByteColumn(v->digits, i);
+            ExtTextOutW(dc, x + (int)column * v->charWidth, rowRect.top, 0, NULL, line + column, 2, NULL);
+            column = HexCharColumn(v->digits, i);
+            ExtTextOutW(dc, x + (int)column * v->charWidth, rowRect.top, 0, NULL, line + column, 1, NULL);
+        }
+    }
+    SelectObject(dc, oldFont);
+}
+
+static void CreateViewFont(HexView *v) {
+    HDC dc = GetDC(v->hwnd);
+    int height = -MulDiv(10, GetDeviceCaps(dc, LOGPIXELSY), 72);
+    v->font = CreateFontW(height, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE, DEFAULT_CHARSET, OUT_DEFAULT_PRECIS,
+                          CLIP_DEFAULT_PRECIS, DEFAULT_QUALITY, FIXED_PITCH | FF_MODERN, L"Consolas");
+    v->ownFont = v->font != NULL;
+    if (!v->font) v->font = (HFONT)GetStockObject(ANSI_FIXED_FONT);
+    HGDIOBJ old = SelectObject(dc, v->font);
+    TEXTMETRICW tm;
+    GetTextMetricsW(dc, &tm);
+    SelectObject(dc, old);
+    ReleaseDC(v->hwnd, dc);
+    v->charWidth = tm.tmAveCharWidth > 0 ? tm.tmAveCharWidth : 8;
+    v->lineHeight = tm.tmHeight > 0 ? tm.tmHeight : 16;
+}
+
+// Row scrolled to by a scroll bar action; thumb positions come from SIF_TRACKPOS, which
+// unlike the message's own is 32 bits
+static ULONGLONG ScrollRowFor(HexView *v, WORD action) {
+    ULONGLONG page = PageRows(v);
+    switch (action) {
+    case SB_LINEUP:
+        return v->topRow ? v->topRow - 1 : 0;
+    case SB_LINEDOWN:
+        return v->topRow + 1;
+    case SB_PAGEUP:
+        return v->topRow > page ? v->topRow - page : 0;
+    case SB_PAGEDOWN:
+        return v->topRow + page;
+    case SB_TOP:
+        return 0;
+    case SB_BOTTOM:
+        return MaxTopRow(v);
+    case SB_THUMBTRACK:
+    case SB_THUMBPOSITION: {
+        SCROLLINFO si = {0};
+        si.cbSize = sizeof(si);
+        si.fMask = SIF_TRACKPOS;
+        GetScrollInfo(v->hwnd, SB_VERT, &si);
+        return (ULONGLONG)si.nTrackPos << v->scrollShift;
+    }
+    default:
+        return v->topRow;
+    }
+}
+
+// Arrows, pages and Home/End move a one-byte selection; Ctrl+Home/End go to the ends
+static void HandleKey(HexView *v, WPARAM key) {
+    if (v->size == 0) return;
+    ULONGLONG at = v->selStart;
+    ULONGLONG page = PageRows(v) * HEX_ROW_BYTES;
+    BOOL control = (GetKeyState(VK_CONTROL) & 0x8000) != 0;
+    switch (key) {
+    case VK_LEFT:
+        at = at ? at - 1 : 0;
+        break;
+    case VK_RIGHT:
+        at++;
+        break;
+    case VK_UP:
+        at = at >= HEX_ROW_BYTES ? at - HEX_ROW_BYTES : at;
+        break;
+    case VK_DOWN:
+        at += HEX_ROW_BYTES;
+        break;
+    case VK_PRIOR:
+        at = at >= page ? at - page : at % HEX_ROW_BYTES;
+        break;
+    case VK_NEXT:
+        at += page;
+        break;
+    case VK_HOME:
+        at = control ? 0 : at - at % HEX_ROW_BYTES;
+        break;
+    case VK_END:
+        at = control ? v->size - 1 : at - at % HEX_ROW_BYTES + HEX_ROW_BYTES - 1;
+        break;
+    default:
+        return;
+    }
+    if (at >= v->size) at = key == VK_DOWN || key == VK_NEXT ? v->selStart : v->size - 1;
+    Select(v, at, 1);
+}
+
+static LRESULT CALLBACK HexViewProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+    HexView *v = GetView(hwnd);
+    if (!v && msg != WM_CREATE) return DefWindowProcW(hwnd, msg, wParam, lParam);
+    switch (msg) {
+    case WM_CREATE: {
+        v = (HexView *)((CREATESTRUCTW *)lParam)->lpCreateParams;
+        v->hwnd = hwnd;
+        SetWindowLongPtrW(hwnd, GWLP_USERDATA, (LONG_PTR)v);
+        SYSTEM_INFO info;
+        GetSystemInfo(&info);
+        v->granularity = info.dwAllocationGranularity;
+        v->digits = HexOffsetDigits(0);
+        CreateViewFont(v);
+        return 0;
+    }
+    case WM_DESTROY:
+        HexViewClose(hwnd);
+        if (v->ownFont) DeleteObject(v->font);
+        SetWindowLongPtrW(hwnd, GWLP_USERDATA, 0);
+        HeapFree(GetProcessHeap(), 0, v);
+        return 0;
+    case WM_SIZE:
+        UpdateScrollBars(v);
+        ScrollToRow(v, v->topRow);
+        ScrollToColumn(v, v->leftColumn);
+        InvalidateRect(hwnd, NULL, FALSE);
+        return 0;
+    case WM_ERASEBKGND:
+        return 1;   // every pixel is painted by the rows
+    case WM_PAINT: {
+        PAINTSTRUCT ps;
+        HDC dc = BeginPaint(hwnd, &ps);
+        Paint(v, dc, &ps.rcPaint);
+        EndPaint(hwnd, &ps);
+        return 0;
+    }
+    case WM_VSCROLL:
+        ScrollToRow(v, ScrollRowFor(v, LOWORD(wParam)));
+        return 0;
+    case WM_HSCROLL: {
+        RECT rc;
+        GetClientRect(hwnd, &rc);
+        int page = rc.right / v->charWidth;
+        int column = v->leftColumn;
+        switch (LOWORD(wParam)) {
+        case SB_LINEUP: column -= 1; break;
+        case SB_LINEDOWN: column += 1; break;
+        case SB_PAGEUP: column -= page; break;
+        case SB_PAGEDOWN: column += page; break;
+        case SB_THUMBTRACK:
+        case SB_THUMBPOSITION: column = HIWORD(wParam); break;
+        }
+        ScrollToColumn(v, column);
+        return 0;
+    }
+    case WM_MOUSEWHEEL: {
+        int notches = GET_WHEEL_DELTA_WPARAM(wParam) / WHEEL_DELTA;
+        ULONGLONG rows = (ULONGLONG)(notches < 0 ? -notches : notches) * HEX_WHEEL_ROWS;
+        ScrollToRow(v, notches > 0 ? (v->topRow > rows ? v->topRow - rows : 0) : v->topRow + rows);
+        return 0;
+    }
+    case WM_KEYDOWN:
+        HandleKey(v, wParam);
+        return 0;
+    case WM_LBUTTONDOWN: {
+        SetFocus(hwnd);
+        int x = (short)LOWORD(lParam), y = (short)HIWORD(lParam);
+        size_t index = HexByteAtColumn(v->digits, (size_t)(x / v->charWidth + v->leftColumn));
+        ULONGLONG offset = (v->topRow + (ULONGLONG)(y / v->lineHeight)) * HEX_ROW_BYTES + index;
+        if (index < HEX_ROW_BYTES && offset < v->size) Select(v, offset, 1);
+        return 0;
+    }
+    case WM_GETDLGCODE:
+        return DLGC_WANTARROWS;
+    }
+    return DefWindowProcW(hwnd, msg, wParam, lParam);
+}
+
+BOOL HexViewRegister(HINSTANCE instance) {
+    WNDCLASSEXW wc = {0};
+    wc.cbSize = sizeof(wc);
+    wc.lpfnWndProc = HexViewProc;
+    wc.hInstance = instance;
+    wc.hCursor = LoadCursorW(NULL, IDC_ARROW);
+    wc.lpszClassName = HEX_CLASS_NAME;
+    return RegisterClassExW(&wc) != 0;
+}
+
+HWND HexViewCreate(HWND parent, HINSTANCE instance, UINT msg) {
+    HexView *v = (HexView *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(HexView));
+    if (!v) return NULL;
+    v->parent = parent;
+    v->msg = msg;
+    v->file = INVALID_HANDLE_VALUE;
+    HWND hwnd = CreateWindowExW(WS_EX_CLIENTEDGE, HEX_CLASS_NAME, NULL, WS_CHILD | WS_VSCROLL | WS_HSCROLL | WS_TABSTOP,
+                                0, 0, 0, 0, parent, NULL, instance, v);
+    if (!hwnd) HeapFree(GetProcessHeap(), 0, v);
+    return hwnd;
+}
+
+BOOL HexViewOpen(HWND hwnd, LPCWSTR path) {
+    HexView *v = GetView(hwnd);
+    if (!v) return FALSE;
+    HexViewClose(hwnd);
+    // Others may keep writing, but a mapped file can't be truncated under the view
+    HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE, NULL,
+                              OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) return FALSE;
+    LARGE_INTEGER size = {0};
+    HANDLE mapping = NULL;
+    if (!GetFileSizeEx(file, &size) ||
+        (size.QuadPart > 0 && !(mapping = CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL)))) {
+        CloseHandle(file);
+        return FALSE;
+    }
+    v->file = file;
+    v->mapping = mapping;
+    v->size = (ULONGLONG)size.QuadPart;
+    v->digits = HexOffsetDigits(v->size);
+    v->topRow = 0;
+    v->leftColumn = 0;
+    v->selStart = 0;
+    v->selLength = 0;
+    UpdateScrollBars(v);
+    InvalidateRect(hwnd, NULL, FALSE);
+    SendMessageW(v->parent, v->msg, 0, 0);
+    return TRUE;
+}
+
+void HexViewClose(HWND hwnd) {
+    HexView *v = GetView(hwnd);
+    if (!v) return;
+    Unmap(v);
+    if (v->mapping) CloseHandle(v->mapping);
+    if (v->file != INVALID_HANDLE_VALUE) CloseHandle(v->file);
+    v->mapping = NULL;
+    v->file = INVALID_HANDLE_VALUE;
+    v->size = 0;
+    v->topRow = 0;
+    v->selStart = 0;
+    v->selLength = 0;
+}
+
+ULONGLONG HexViewSize(HWND hwnd) {
+    HexView *v = GetView(hwnd);
+    return v ? v->size : 0;
+}
+
+ULONGLONG HexViewSelection(HWND hwnd, ULONGLONG *lengthOut) {
+    HexView *v = GetView(hwnd);
+    *lengthOut = v ? v->selLength : 0;
+    return v ? v->selStart : 0;
+}
+
+void HexViewGoTo(HWND hwnd, ULONGLONG offset) {
+    HexView *v = GetView(hwnd);
+    if (!v || v->size == 0) return;
+    Select(v, offset < v->size ? offset : v->size - 1, 1);
+}
+
+BOOL HexViewFind(HWND hwnd, const BYTE *pattern, size_t length) {
+    HexView *v = GetView(hwnd);
+    if (!v || !v->mapping || length == 0) return FALSE;
+    // From the start of the file until something is selected
+    ULONGLONG from = v->selLength ? v->selStart + 1 : v->selStart;
+    ULONGLONG found = v->size;
+    ULONGLONG scanned = 0;
+    HCURSOR oldCursor = SetCursor(LoadCursorW(NULL, IDC_WAIT));
+    TRACE_BEGIN(span, "HexFind");
+    // One window at a time; consecutive windows overlap by length - 1 bytes so a match
+    // that straddles them is still seen whole
+    while (from + length <= v->size) {
+        ULONGLONG base = from - from % v->granularity;
+        ULONGLONG window = v->size - base < HEX_SEARCH_BYTES ? v->size - base : HEX_SEARCH_BYTES;
+        const BYTE *data = (const BYTE *)MapViewOfFile(v->mapping, FILE_MAP_READ, (DWORD)(base >> 32), (DWORD)base,
+                                                       (SIZE_T)window);
+        if (!data) break;
+        size_t skip = (size_t)(from - base);
+        size_t hit = HexFind(data + skip, (size_t)window - skip, pattern, length);
+        UnmapViewOfFile(data);
+        scanned += window - skip;
+        if (hit != HEX_NOT_FOUND) {
+            found = from + hit;
+            break;
+        }
+        if (base + window == v->size) break;
+        from = base + window - (length - 1);
+    }
+    TRACE_END_BYTES(span, scanned);
+    SetCursor(oldCursor);
+    if (found == v->size) return FALSE;
+    Select(v, found, length);
+    return TRUE;
+}
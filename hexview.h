@@ -0,0 +1,26 @@
+// Read-only hex view for retropad. A child window shows a file as rows of 16 bytes,
+// mapping only the part of the file on screen (and, while searching, one window of it
+// at a time), so memory use doesn't depend on the file's size.
+#pragma once
+
+#include <windows.h>
+
+// Registers the window class; call once before HexViewCreate
+BOOL HexViewRegister(HINSTANCE instance);
+// Creates the (hidden) view. `msg` is sent to `parent` whenever the selection changes.
+HWND HexViewCreate(HWND parent, HINSTANCE instance, UINT msg);
+
+// Shows `path`, replacing whatever the view showed; FALSE (view left empty) if the file
+// can't be opened or mapped. The file can still be written by others but not truncated.
+BOOL HexViewOpen(HWND view, LPCWSTR path);
+void HexViewClose(HWND view);
+
+// File size, and the selection: its first byte and length (at least 1 when size > 0)
+ULONGLONG HexViewSize(HWND view);
+ULONGLONG HexViewSelection(HWND view, ULONGLONG *lengthOut);
+
+// Selects the byte at `offset` (clamped to the file) and scrolls it into view
+void HexViewGoTo(HWND view, ULONGLONG offset);
+// Searches for pattern[0..length) from the byte after the selection's start to the end
+// of the file; FALSE when it isn't found. A match is selected and scrolled into view.
+BOOL HexViewFind(HWND view, const BYTE *pattern, size_t length);
@@ -13,6 +13,8 @@
 #define IDM_FILE_PAGE_SETUP     40005
 #define IDM_FILE_PRINT          40006
 #define IDM_FILE_EXIT           40007
+#define IDM_FILE_PROPERTIES     40008
+#define IDM_FILE_COMPARE        40009
 
 #define IDM_EDIT_UNDO           40010
 #define IDM_EDIT_CUT            40011
@@ -25,17 +27,57 @@
 #define IDM_EDIT_GOTO           40018
 #define IDM_EDIT_SELECT_ALL     40019
 #define IDM_EDIT_TIME_DATE      40020
+#define IDM_EDIT_LINES_SORT     40021   // in TextLineOp order
+#define IDM_EDIT_LINES_SORT_NOCASE  40022
+#define IDM_EDIT_LINES_SORT_NUMERIC 40023
+#define IDM_EDIT_LINES_DEDUPE   40024
+#define IDM_EDIT_LINES_TRIM     40025
+#define IDM_EDIT_LINES_REVERSE  40026
 
 #define IDM_FORMAT_WORD_WRAP    40030
 #define IDM_FORMAT_FONT         40031
+#define IDM_FORMAT_EOL_CRLF     40032   // in TextEol order
+#define IDM_FORMAT_EOL_LF       40033
+#define IDM_FORMAT_EOL_CR       40034
 
 #define IDM_VIEW_STATUS_BAR     40040
+#define IDM_VIEW_HIGHLIGHT_NONE 40041   // in HighlightLanguage order
+#define IDM_VIEW_HIGHLIGHT_LOG  40042
+#define IDM_VIEW_HIGHLIGHT_INI  40043
+#define IDM_VIEW_HIGHLIGHT_JSON 40044
+#define IDM_VIEW_HEX            40045
 
 #define IDM_HELP_VIEW_HELP      40050
 #define IDM_HELP_ABOUT          40051
 
+#define IDM_FILE_RECENT_NONE    40070   // placeholder while the list is empty
+#define IDM_FILE_RECENT_FIRST   40071   // IDM_FILE_RECENT_FIRST + index, up to RECENT_FILES_MAX
+
+// Hidden commands (accelerator only)
+#define IDM_DEBUG_TRACE         40060
+
 // Dialogs and controls
 #define IDD_GOTO                50001
 #define IDD_ABOUT               50002
+#define IDD_FILE_ENCODING       50003
+#define IDD_PROPERTIES          50004
+#define IDD_COMPARE             50005
+#define IDD_HEX_INPUT           50006
 #define IDC_GOTO_EDIT           50010
+#define IDC_ENCODING_LABEL      50011
+#define IDC_ENCODING_COMBO      50012
+#define IDC_PROP_PATH           50013
+#define IDC_PROP_ENCODING       50014
+#define IDC_PROP_EOL            50015
+#define IDC_PROP_LINES          50016
+#define IDC_PROP_WORDS          50017
+#define IDC_PROP_CHARS          50018
+#define IDC_PROP_SIZE           50019
+#define IDC_COMPARE_SUMMARY     50020
+#define IDC_COMPARE_TEXT        50021
+#define IDC_COMPARE_PREV        50022
+#define IDC_COMPARE_NEXT        50023
+#define IDC_FIND_IN_SELECTION   50024
+#define IDC_HEX_LABEL           50025
+#define IDC_HEX_EDIT            50026
 
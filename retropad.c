@@ -4,16 +4,84 @@
 #include <windows.h>
 #include <commdlg.h>
 #include <commctrl.h>
+#include <dlgs.h>
 #include <shellapi.h>
 #include <strsafe.h>
+#include <stdlib.h>
 #include "resource.h"
 #include "file_io.h"
+#include "filecache.h"
+#include "settings.h"
+#include "trace.h"
+#include "scratch.h"
+#include "document.h"
+#include "filewatch.h"
+#include "batch.h"
+#include "hexview.h"
+#include "storeview.h"
+#include "core/lineops.h"
+#include "core/diff.h"
+#include "core/highlight.h"
+#include "core/hexdump.h"
+#include "core/jobs.h"
 
 #define APP_TITLE      L"retropad"
 #define UNTITLED_NAME  L"Untitled"
 #define MAX_PATH_BUFFER 1024
 #define DEFAULT_WIDTH  640
 #define DEFAULT_HEIGHT 480
+#define PASTE_CHUNK_CHARS (1u << 20)                    // characters per EM_REPLACESEL
+#define PASTE_PROGRESS_MIN_CHARS (8 * PASTE_CHUNK_CHARS) // show progress above this size
+#define IDT_DOC_IDLE 1
+#define DOC_IDLE_MS 30000                               // quiet time before cold chunks are packed
+#define DEFAULT_BUDGET_MB 64
+#define IDT_FILE_CHANGED 2
+#define FILE_SETTLE_MS 250                              // lets a burst of writes finish before checking
+#define WM_APP_FILE_CHANGED (WM_APP + 1)
+#define WM_APP_OPEN_REQUEST (WM_APP + 2)
+#define IDT_OPEN_REQUEST 3
+#define OPEN_RETRY_MS 250                               // a modal dialog is up; try the request again
+#define COPYDATA_OPEN_REQUEST 0x4E504F52                // WM_COPYDATA dwData for an OpenRequest ("ROPN")
+#define MAIN_CLASS_NAME L"RETROPAD_WINDOW"
+#define INSTANCE_MUTEX_NAME L"Local\\retropad.instance"
+#define INSTANCE_WAIT_MS 2000                           // for a starting instance to create its window
+#define RECENT_FILES_MAX 9                              // File > Recent Files, numbered &1..&9
+#define WM_APP_HEX_SELECTION (WM_APP + 3)               // sent by the hex view when its selection moves
+#define WM_APP_JOBS_DONE (WM_APP + 4)                   // posted by the job pool when completions are queued
+#define WM_APP_STORE_SELECTION (WM_APP + 5)             // sent by the store view when its selection moves
+
+// A file named on the command line, opened here or handed to the running instance
+// (WM_COPYDATA, so the layout is fixed)
+typedef struct OpenRequest {
+    LONGLONG startedAt;         // TraceNow() when the requesting process started
+    UINT line;                  // 1-based line to put the caret on; 0 for none
+    WCHAR path[MAX_PATH_BUFFER];    // full path
+} OpenRequest;
+
+// Hash of the open file taken on the job pool, so a large same-size rewrite doesn't
+// stall the window while it's read
+typedef struct HashCheck {
+    HWND hwnd;
+    WCHAR path[MAX_PATH_BUFFER];
+    FileStamp stamp;            // as queried before hashing; the job fills in the hash
+    BOOL record;                // the user kept their text: store the stamp without comparing
+    BOOL ok;
+} HashCheck;
+
+// Caption, label and text of the hex view's one-line prompt (IDD_HEX_INPUT)
+typedef struct HexPrompt {
+    LPCWSTR title;
+    LPCWSTR label;
+    WCHAR text[128];
+} HexPrompt;
+
+// What the Compare dialog shows: the unified diff and where each change starts in it
+typedef struct CompareView {
+    const WCHAR *text;
+    TextDiff diff;
+    const size_t *offsets;
+    size_t current;             // change shown; diff.count before the first
+} CompareView;
 
 typedef struct AppState {
     HWND hwndMain;
@@ -25,18 +93,58 @@ typedef struct AppState {
     BOOL statusVisible;
     BOOL statusBeforeWrap;
     BOOL modified;
-    TextEncoding encoding;
+    FileEncoding encoding;
     FINDREPLACEW find;
     HWND hFindDlg;
     HWND hReplaceDlg;
     UINT findFlags;
     WCHAR findText[128];
     WCHAR replaceText[128];
+    BOOL findInSelection;       // "In selection" is checked in Find/Replace
+    DWORD scopeStart;           // range searched while it is; follows replacements made in it
+    DWORD scopeEnd;
+    DWORD foundStart;           // selection the last scoped find or replace left behind
+    DWORD foundEnd;
+    BOOL copyPending;           // clipboard holds a delayed-render copy of [copyStart, copyEnd)
+    BOOL copyFromStore;         // the copy was made in the store view and renders from the store
+    size_t copyStart;
+    size_t copyEnd;
+    int budgetMB;               // uncompressed document text kept in memory; 0 = never compress
+    int readOnlyAboveMB;        // documents whose copy in the EDIT control would be bigger open
+                                // in the store view; 0 = only those the control can't hold
+    BOOL diskStampValid;        // diskStamp describes currentPath as last loaded, saved or accepted
+    FileStamp diskStamp;
+    BOOL checkingDisk;          // the reload prompt is up
+    Highlighter *highlighter;   // NULL when highlighting is off
+    DWORD paintedSelStart;      // selection when highlights were last drawn
+    DWORD paintedSelEnd;
+    WCHAR recentPaths[RECENT_FILES_MAX][MAX_PATH];  // as listed when Recent Files last opened
+    size_t recentCount;
+    BOOL openPending;           // openRequest came from another process and waits to be opened
+    OpenRequest openRequest;
+    HWND hwndHex;               // created the first time a file is shown as bytes
+    BOOL hexMode;               // hwndHex shows hexPath in place of the (empty) document
+    WCHAR hexPath[MAX_PATH_BUFFER];
+    WCHAR hexFindText[128];     // as typed in Find Bytes
+    BYTE hexPattern[HEX_PATTERN_MAX];
+    size_t hexPatternLength;
+    HWND hwndStoreView;         // created the first time a document opens without the EDIT control
+    BOOL storeViewMode;         // hwndStoreView shows the adopted document; the control is empty
+    JobPool *jobs;              // NULL if it couldn't start; work then runs on this thread
+    HashCheck *hashCheck;       // queued or running; its completion frees it
+    JobToken *hashToken;
 } AppState;
 
 static AppState g_app = {0};
 static HINSTANCE g_hInst = NULL;
 static UINT g_findMsg = 0;
+static WCHAR g_tracePath[MAX_PATH_BUFFER] = L"";
+static BOOL g_traceDumpOnExit = FALSE;
+static const WCHAR *const g_eolNames[] = {L"Windows (CRLF)", L"Unix (LF)", L"Macintosh (CR)"};   // by TextEol
+static const COLORREF g_tokenColors[HIGHLIGHT_TOKEN_COUNT] = {   // by HighlightToken
+    RGB(0, 0, 0),       RGB(192, 0, 0),   RGB(176, 112, 0), RGB(0, 96, 160),  RGB(128, 128, 128), RGB(0, 128, 128),
+    RGB(0, 128, 0),     RGB(128, 0, 128), RGB(0, 0, 160),   RGB(163, 21, 21), RGB(9, 134, 88),    RGB(0, 0, 255),
+};
 
 static void UpdateTitle(HWND hwnd);
 static void CreateEditControl(HWND hwnd);
@@ -45,6 +153,7 @@ static BOOL PromptSaveChanges(HWND hwnd);
 static BOOL DoFileOpen(HWND hwnd);
 static BOOL DoFileSave(HWND hwnd, BOOL saveAs);
 static void DoFileNew(HWND hwnd);
+static void HideStoreView(void);
 static void SetWordWrap(HWND hwnd, BOOL enabled);
 static void ToggleStatusBar(HWND hwnd, BOOL visible);
 static void UpdateStatusBar(HWND hwnd);
@@ -52,180 +161,251 @@ static void ShowFindDialog(HWND hwnd);
 static void ShowReplaceDialog(HWND hwnd);
 static BOOL DoFindNext(BOOL reverse);
 static void DoSelectFont(HWND hwnd);
-static BOOL LoadFontFromIni(void);
-static void SaveFontToIni(const LOGFONTW *lf);
+static BOOL LoadFontFromSettings(void);
+static void SaveFontToSettings(const LOGFONTW *lf);
+static BOOL RestoreWindowPlacement(HWND hwnd, int nCmdShow);
+static void SaveViewSettings(HWND hwnd);
 static void InsertTimeDate(HWND hwnd);
+static void DoCompareWithFile(HWND hwnd);
+static void ApplyLineOperation(HWND hwnd, TextLineOp op);
 static void HandleFindReplace(LPFINDREPLACE lpfr);
-static BOOL LoadDocumentFromPath(HWND hwnd, LPCWSTR path);
+static BOOL LoadDocumentFromPath(HWND hwnd, LPCWSTR path, const FileEncoding *forced);
 static INT_PTR CALLBACK GoToDlgProc(HWND dlg, UINT msg, WPARAM wParam, LPARAM lParam);
 static INT_PTR CALLBACK AboutDlgProc(HWND dlg, UINT msg, WPARAM wParam, LPARAM lParam);
+static INT_PTR CALLBACK PropertiesDlgProc(HWND dlg, UINT msg, WPARAM wParam, LPARAM lParam);
+static INT_PTR CALLBACK CompareDlgProc(HWND dlg, UINT msg, WPARAM wParam, LPARAM lParam);
+static INT_PTR CALLBACK HexInputDlgProc(HWND dlg, UINT msg, WPARAM wParam, LPARAM lParam);
 static void DoPasteWithNormalizedLineEndings(HWND hwnd);
+static void ApplyHighlightDamage(HWND hwndEdit, BOOL repaint);
+static void RepaintChangedSelection(HWND hwndEdit);
+static void PaintHighlights(HWND hwndEdit, const RECT *update);
+static void CopySelectionDeferred(HWND hwndEdit);
+static void FlushPendingCopy(void);
+
+static void SetEditText(HWND hwndEdit, LPCWSTR text) {
+    TRACE_BEGIN(span, "SetWindowTextW");
+    SetWindowTextW(hwndEdit, text);
+    TRACE_END(span);
+}
 
-static BOOL GetEditText(HWND hwndEdit, WCHAR **bufferOut, int *lengthOut) {
-    int length = GetWindowTextLengthW(hwndEdit);
-    WCHAR *buffer = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, (length + 1) * sizeof(WCHAR));
-    if (!buffer) return FALSE;
-    GetWindowTextW(hwndEdit, buffer, length + 1);
-    if (lengthOut) *lengthOut = length;
-    *bufferOut = buffer;
-    return TRUE;
+// TEXT_FIND_* for the Find/Replace dialog's Match case and Match whole word
+static unsigned FindOptions(UINT frFlags) {
+    return ((frFlags & FR_MATCHCASE) ? TEXT_FIND_MATCH_CASE : 0) | ((frFlags & FR_WHOLEWORD) ? TEXT_FIND_WHOLE_WORD : 0);
 }
 
-static BOOL FindInEdit(HWND hwndEdit, const WCHAR *needle, BOOL matchCase, BOOL searchDown, DWORD startPos, DWORD *outStart, DWORD *outEnd) {
+static BOOL FindInEdit(HWND hwndEdit, const WCHAR *needle, unsigned options, BOOL searchDown, DWORD startPos, DWORD *outStart, DWORD *outEnd) {
     if (!needle || needle[0] == L'\0') return FALSE;
 
-    WCHAR *text = NULL;
-    int len = 0;
-    if (!GetEditText(hwndEdit, &text, &len)) return FALSE;
-
+    TRACE_BEGIN(span, "FindInEdit");
     size_t needleLen = wcslen(needle);
-    WCHAR *haystack = text;
-    WCHAR *needleBuf = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, (needleLen + 1) * sizeof(WCHAR));
-    if (!needleBuf) {
-        HeapFree(GetProcessHeap(), 0, text);
-        return FALSE;
-    }
-    StringCchCopyW(needleBuf, needleLen + 1, needle);
-
-    if (!matchCase) {
-        CharLowerBuffW(haystack, len);
-        CharLowerBuffW(needleBuf, (DWORD)needleLen);
-    }
-
-    if (startPos > (DWORD)len) startPos = (DWORD)len;
-
-    WCHAR *found = NULL;
-    if (searchDown) {
-        found = wcsstr(haystack + startPos, needleBuf);
-        if (!found && startPos > 0) {
-            found = wcsstr(haystack, needleBuf);
-        }
+    unsigned flags = options | (searchDown ? TEXT_FIND_DOWN : 0);
+    size_t pos = 0;
+    size_t scanned = 0;
+    BOOL found = FALSE;
+
+    // The store searches narrow chunks as bytes; the control's buffer is the fallback
+    const DocStore *store = DocumentStore();
+    if (store) {
+        found = DocStoreFind(store, (const TextChar *)needle, needleLen, flags, startPos, &pos);
+        scanned = DocStoreLength(store);
     } else {
-        WCHAR *p = haystack;
-        while ((p = wcsstr(p, needleBuf)) != NULL) {
-            DWORD idx = (DWORD)(p - haystack);
-            if (idx < startPos) {
-                found = p;
-                p++;
-            } else {
-                break;
-            }
-        }
-        if (!found && startPos < (DWORD)len) {
-            p = haystack + startPos;
-            while ((p = wcsstr(p, needleBuf)) != NULL) {
-                found = p;
-                p++;
-            }
+        DocView view;
+        if (!BeginDocView(hwndEdit, &view)) {
+            TRACE_END(span);
+            return FALSE;
         }
+        found = TextFind((const TextChar *)view.text, (size_t)view.length, (const TextChar *)needle, needleLen, flags, startPos, &pos);
+        scanned = (size_t)view.length;
+        EndDocView(&view);
     }
 
     BOOL result = FALSE;
     if (found) {
-        DWORD pos = (DWORD)(found - haystack);
-        *outStart = pos;
-        *outEnd = pos + (DWORD)needleLen;
+        *outStart = (DWORD)pos;
+        *outEnd = (DWORD)(pos + needleLen);
         result = TRUE;
     }
-
-    HeapFree(GetProcessHeap(), 0, text);
-    HeapFree(GetProcessHeap(), 0, needleBuf);
+    TRACE_END_BYTES(span, scanned * sizeof(WCHAR));
     return result;
 }
 
-static int ReplaceAllOccurrences(HWND hwndEdit, const WCHAR *needle, const WCHAR *replacement, BOOL matchCase) {
-    if (!needle || needle[0] == L'\0') return 0;
-
-    WCHAR *text = NULL;
-    int len = 0;
-    if (!GetEditText(hwndEdit, &text, &len)) return 0;
+static int ReplaceAllInText(HWND hwndEdit, const WCHAR *needle, const WCHAR *replacement, unsigned options) {
+    DocView view;
+    if (!BeginDocView(hwndEdit, &view)) return 0;
 
     size_t needleLen = wcslen(needle);
     size_t replLen = replacement ? wcslen(replacement) : 0;
 
-    WCHAR *searchBuf = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, (len + 1) * sizeof(WCHAR));
-    WCHAR *needleBuf = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, (needleLen + 1) * sizeof(WCHAR));
-    if (!searchBuf || !needleBuf) {
-        HeapFree(GetProcessHeap(), 0, text);
-        if (searchBuf) HeapFree(GetProcessHeap(), 0, searchBuf);
-        if (needleBuf) HeapFree(GetProcessHeap(), 0, needleBuf);
-        return 0;
+    size_t count = 0;
+    size_t newLen = TextReplaceAll((const TextChar *)view.text, (size_t)view.length, (const TextChar *)needle, needleLen,
+                                   (const TextChar *)replacement, replLen, options, NULL, &count);
+    WCHAR *result = count ? (WCHAR *)ScratchAlloc((newLen + 1) * sizeof(WCHAR)) : NULL;
+    if (result) {
+        TextReplaceAll((const TextChar *)view.text, (size_t)view.length, (const TextChar *)needle, needleLen,
+                       (const TextChar *)replacement, replLen, options, (TextChar *)result, NULL);
+        result[newLen] = L'\0';
     }
-    StringCchCopyW(searchBuf, len + 1, text);
-    StringCchCopyW(needleBuf, needleLen + 1, needle);
+    EndDocView(&view);
+    if (!result) return 0;
 
-    if (!matchCase) {
-        CharLowerBuffW(searchBuf, len);
-        CharLowerBuffW(needleBuf, (DWORD)needleLen);
-    }
+    SetEditText(hwndEdit, result);
+    SendMessageW(hwndEdit, EM_SETMODIFY, TRUE, 0);
+    g_app.modified = TRUE;
+    UpdateTitle(g_app.hwndMain);
+    return (int)count;
+}
 
-    int count = 0;
-    WCHAR *p = searchBuf;
-    while ((p = wcsstr(p, needleBuf)) != NULL) {
-        count++;
-        p += needleLen;
-    }
-    if (count == 0) {
-        HeapFree(GetProcessHeap(), 0, text);
-        HeapFree(GetProcessHeap(), 0, searchBuf);
-        HeapFree(GetProcessHeap(), 0, needleBuf);
-        return 0;
-    }
+static int ReplaceAllOccurrences(HWND hwndEdit, const WCHAR *needle, const WCHAR *replacement, unsigned options) {
+    if (!needle || needle[0] == L'\0') return 0;
 
-    size_t newLen = (size_t)len - (size_t)count * needleLen + (size_t)count * replLen;
-    WCHAR *result = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, (newLen + 1) * sizeof(WCHAR));
-    if (!result) {
-        HeapFree(GetProcessHeap(), 0, text);
-        HeapFree(GetProcessHeap(), 0, searchBuf);
-        HeapFree(GetProcessHeap(), 0, needleBuf);
-        return 0;
+    TRACE_BEGIN(span, "ReplaceAllOccurrences");
+    int count = ReplaceAllInText(hwndEdit, needle, replacement, options);
+    TRACE_END(span);
+    return count;
+}
+
+// The range "In selection" searches: the selection, unless it is the one the last
+// scoped find or replace left, in which case the range that search ran in
+static BOOL GetFindScope(HWND hwndEdit, DWORD *scopeStart, DWORD *scopeEnd) {
+    DWORD selStart = 0, selEnd = 0;
+    SendMessageW(hwndEdit, EM_GETSEL, (WPARAM)&selStart, (LPARAM)&selEnd);
+    if (selStart != g_app.foundStart || selEnd != g_app.foundEnd) {
+        g_app.scopeStart = selStart;
+        g_app.scopeEnd = selEnd;
     }
+    *scopeStart = g_app.scopeStart;
+    *scopeEnd = g_app.scopeEnd;
+    return g_app.scopeEnd > g_app.scopeStart;
+}
 
-    WCHAR *dst = result;
-    WCHAR *searchCur = searchBuf;
-    WCHAR *origCur = text;
-    while ((p = wcsstr(searchCur, needleBuf)) != NULL) {
-        size_t delta = (size_t)(p - searchCur);
-        CopyMemory(dst, origCur, delta * sizeof(WCHAR));
-        dst += delta;
-        origCur += delta;
-        searchCur += delta;
+// Flags for searching text[scopeStart, scopeEnd) as a slice: for whole words, a scope
+// edge in the middle of a word isn't a break
+static unsigned ScopeFindFlags(const WCHAR *text, size_t length, DWORD scopeStart, DWORD scopeEnd, unsigned options) {
+    if (!(options & TEXT_FIND_WHOLE_WORD)) return options;
+    if (scopeStart > 0 && TextIsWordChar((TextChar)text[scopeStart - 1])) options |= TEXT_FIND_WORD_BEFORE;
+    if (scopeEnd < length && TextIsWordChar((TextChar)text[scopeEnd])) options |= TEXT_FIND_WORD_AFTER;
+    return options;
+}
 
-        if (replLen) {
-            CopyMemory(dst, replacement, replLen * sizeof(WCHAR));
-            dst += replLen;
-        }
-        origCur += needleLen;
-        searchCur += needleLen;
-    }
-    size_t tail = wcslen(origCur);
-    CopyMemory(dst, origCur, tail * sizeof(WCHAR));
-    dst += tail;
-    *dst = L'\0';
-
-    SetWindowTextW(hwndEdit, result);
-    HeapFree(GetProcessHeap(), 0, text);
-    HeapFree(GetProcessHeap(), 0, searchBuf);
-    HeapFree(GetProcessHeap(), 0, needleBuf);
-    HeapFree(GetProcessHeap(), 0, result);
-    SendMessageW(hwndEdit, EM_SETMODIFY, TRUE, 0);
+// FindInEdit limited to [scopeStart, scopeEnd), wrapping within it; reads only that range
+static BOOL FindInScope(HWND hwndEdit, const WCHAR *needle, unsigned options, BOOL searchDown, DWORD startPos,
+                        DWORD scopeStart, DWORD scopeEnd, DWORD *outStart, DWORD *outEnd) {
+    if (!needle || needle[0] == L'\0') return FALSE;
+    DocView view;
+    if (!BeginDocView(hwndEdit, &view)) return FALSE;
+
+    TRACE_BEGIN(span, "FindInScope");
+    if (scopeEnd > (DWORD)view.length) scopeEnd = (DWORD)view.length;
+    if (scopeStart > scopeEnd) scopeStart = scopeEnd;
+    if (startPos < scopeStart) startPos = scopeStart;
+    if (startPos > scopeEnd) startPos = scopeEnd;
+    size_t needleLen = wcslen(needle);
+    unsigned flags = ScopeFindFlags(view.text, (size_t)view.length, scopeStart, scopeEnd, options) |
+                     (searchDown ? TEXT_FIND_DOWN : 0);
+    size_t pos = 0;
+    BOOL found = TextFind((const TextChar *)view.text + scopeStart, scopeEnd - scopeStart, (const TextChar *)needle,
+                          needleLen, flags, startPos - scopeStart, &pos);
+    EndDocView(&view);
+    if (found) {
+        *outStart = scopeStart + (DWORD)pos;
+        *outEnd = *outStart + (DWORD)needleLen;
+    }
+    TRACE_END_BYTES(span, (scopeEnd - scopeStart) * sizeof(WCHAR));
+    return found;
+}
+
+// Replace All within the find scope as one undoable edit of just that range, which
+// stays selected and becomes the new scope
+static int ReplaceAllInScope(HWND hwndEdit, const WCHAR *needle, const WCHAR *replacement, unsigned options) {
+    DWORD scopeStart = 0, scopeEnd = 0;
+    if (!needle || needle[0] == L'\0' || !GetFindScope(hwndEdit, &scopeStart, &scopeEnd)) return 0;
+    DocView view;
+    if (!BeginDocView(hwndEdit, &view)) return 0;
+
+    TRACE_BEGIN(span, "ReplaceAllInScope");
+    if (scopeEnd > (DWORD)view.length) scopeEnd = (DWORD)view.length;
+    if (scopeStart > scopeEnd) scopeStart = scopeEnd;
+    const TextChar *text = (const TextChar *)view.text + scopeStart;
+    size_t length = scopeEnd - scopeStart;
+    size_t needleLen = wcslen(needle);
+    size_t replLen = replacement ? wcslen(replacement) : 0;
+    options = ScopeFindFlags(view.text, (size_t)view.length, scopeStart, scopeEnd, options);
+
+    size_t count = 0;
+    size_t newLen = TextReplaceAll(text, length, (const TextChar *)needle, needleLen, (const TextChar *)replacement,
+                                   replLen, options, NULL, &count);
+    WCHAR *result = count ? (WCHAR *)ScratchAlloc((newLen + 1) * sizeof(WCHAR)) : NULL;
+    if (result) {
+        TextReplaceAll(text, length, (const TextChar *)needle, needleLen, (const TextChar *)replacement, replLen, options,
+                       (TextChar *)result, NULL);
+        result[newLen] = L'\0';
+    }
+    EndDocView(&view);
+    TRACE_END_BYTES(span, length * sizeof(WCHAR));
+    if (!result) return 0;
+
+    SendMessageW(hwndEdit, EM_SETSEL, scopeStart, scopeEnd);
+    SendMessageW(hwndEdit, EM_REPLACESEL, TRUE, (LPARAM)result);
+    g_app.scopeStart = g_app.foundStart = scopeStart;
+    g_app.scopeEnd = g_app.foundEnd = scopeStart + (DWORD)newLen;
+    SendMessageW(hwndEdit, EM_SETSEL, g_app.scopeStart, g_app.scopeEnd);
+    SendMessageW(hwndEdit, EM_SCROLLCARET, 0, 0);
     g_app.modified = TRUE;
     UpdateTitle(g_app.hwndMain);
-    return count;
+    return (int)count;
+}
+
+// Find Next for a document in the store view: the whole store, from the selection
+static BOOL FindInStoreView(unsigned options, BOOL down) {
+    const DocStore *store = DocumentStore();
+    if (!store || g_app.findText[0] == L'\0') return FALSE;
+    size_t end = 0;
+    size_t start = StoreViewSelection(g_app.hwndStoreView, &end);
+    size_t needleLen = wcslen(g_app.findText);
+    size_t pos = 0;
+    TRACE_BEGIN(span, "FindInStoreView");
+    BOOL found = DocStoreFind(store, (const TextChar *)g_app.findText, needleLen, options | (down ? TEXT_FIND_DOWN : 0),
+                              down ? end : start, &pos);
+    TRACE_END_BYTES(span, DocStoreLength(store) * sizeof(WCHAR));
+    if (found) StoreViewSelect(g_app.hwndStoreView, pos, pos + needleLen);
+    return found;
+}
+
+// Searches the whole document, or the find scope when "In selection" is on, and
+// selects the match
+static BOOL FindAndSelect(unsigned options, BOOL down, DWORD startPos) {
+    DWORD outStart = 0, outEnd = 0;
+    BOOL found;
+    if (g_app.findInSelection) {
+        DWORD scopeStart = 0, scopeEnd = 0;
+        found = GetFindScope(g_app.hwndEdit, &scopeStart, &scopeEnd) &&
+                FindInScope(g_app.hwndEdit, g_app.findText, options, down, startPos, scopeStart, scopeEnd, &outStart,
+                            &outEnd);
+    } else {
+        found = FindInEdit(g_app.hwndEdit, g_app.findText, options, down, startPos, &outStart, &outEnd);
+    }
+    if (!found) return FALSE;
+    SendMessageW(g_app.hwndEdit, EM_SETSEL, outStart, outEnd);
+    SendMessageW(g_app.hwndEdit, EM_SCROLLCARET, 0, 0);
+    g_app.foundStart = outStart;
+    g_app.foundEnd = outEnd;
+    return TRUE;
 }
 
 static void UpdateTitle(HWND hwnd) {
     WCHAR name[MAX_PATH_BUFFER];
-    if (g_app.currentPath[0]) {
-        WCHAR *fileName = wcsrchr(g_app.currentPath, L'\\');
-        fileName = fileName ? fileName + 1 : g_app.currentPath;
+    const WCHAR *path = g_app.hexMode ? g_app.hexPath : g_app.currentPath;
+    if (path[0]) {
+        const WCHAR *fileName = wcsrchr(path, L'\\');
+        fileName = fileName ? fileName + 1 : path;
         StringCchCopyW(name, MAX_PATH_BUFFER, fileName);
     } else {
         StringCchCopyW(name, MAX_PATH_BUFFER, UNTITLED_NAME);
     }
 
     WCHAR title[MAX_PATH_BUFFER + 32];
-    StringCchPrintfW(title, ARRAYSIZE(title), L"%s%s - %s", (g_app.modified ? L"*" : L""), name, APP_TITLE);
+    StringCchPrintfW(title, ARRAYSIZE(title), L"%s%s%s - %s", (g_app.modified ? L"*" : L""), name,
+                     (g_app.hexMode ? L" [Hex]" : g_app.storeViewMode ? L" [Read-only]" : L""), APP_TITLE);
     SetWindowTextW(hwnd, title);
 }
 
@@ -246,22 +426,23 @@ static void HandleDeleteKey(HWND hwndEdit) {
     }
 
     // Get the text
-    WCHAR *text = NULL;
-    int len = 0;
-    if (!GetEditText(hwndEdit, &text, &len)) {
+    DocView view;
+    if (!BeginDocView(hwndEdit, &view)) {
         return;
     }
+    const WCHAR *text = view.text;
+    int len = view.length;
 
     // If cursor is at the end of text, nothing to delete
     if (selStart >= (DWORD)len) {
-        HeapFree(GetProcessHeap(), 0, text);
+        EndDocView(&view);
         return;
     }
 
     // Delete the character at the cursor position
-    WCHAR *newText = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, (len) * sizeof(WCHAR));
+    WCHAR *newText = (WCHAR *)ScratchAlloc((len) * sizeof(WCHAR));
     if (!newText) {
-        HeapFree(GetProcessHeap(), 0, text);
+        EndDocView(&view);
         return;
     }
 
@@ -276,9 +457,10 @@ static void HandleDeleteKey(HWND hwndEdit) {
     }
 
     newText[len - 1] = L'\0';
+    EndDocView(&view);
 
     // Set the new text and restore cursor position
-    SetWindowTextW(hwndEdit, newText);
+    SetEditText(hwndEdit, newText);
     SendMessageW(hwndEdit, EM_SETSEL, selStart, selStart);
     SendMessageW(hwndEdit, EM_SETMODIFY, TRUE, 0);
 
@@ -286,9 +468,27 @@ static void HandleDeleteKey(HWND hwndEdit) {
     g_app.modified = TRUE;
     UpdateTitle(g_app.hwndMain);
     UpdateStatusBar(g_app.hwndMain);
+}
 
-    HeapFree(GetProcessHeap(), 0, text);
-    HeapFree(GetProcessHeap(), 0, newText);
+// Passes a text-changing message to the control with the document model bracketed around it
+static LRESULT ForwardEditMessage(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+    // A deferred copy refers to the current text, so materialize it before any edit.
+    // Cut replaces the clipboard anyway.
+    if (msg != WM_CUT) FlushPendingCopy();
+    DocumentBeforeEdit(hwnd, msg);
+    LRESULT result = DefSubclassProc(hwnd, msg, wParam, lParam);
+    DocumentAfterEdit(hwnd);
+    ApplyHighlightDamage(hwnd, TRUE);
+    RepaintChangedSelection(hwnd);
+    return result;
+}
+
+// Passes a message that may move the selection; the control redraws the selection
+// change itself, without highlights, so those lines are painted again
+static LRESULT ForwardSelectionMessage(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+    LRESULT result = DefSubclassProc(hwnd, msg, wParam, lParam);
+    RepaintChangedSelection(hwnd);
+    return result;
 }
 
 // Subclass procedure for the edit control to intercept WM_PASTE
@@ -300,9 +500,41 @@ static LRESULT CALLBACK EditControlSubclassProc(HWND hwnd, UINT msg, WPARAM wPar
     switch (msg) {
     case WM_PASTE:
         // Intercept paste and use our normalization function instead
+        FlushPendingCopy();
         DoPasteWithNormalizedLineEndings(g_app.hwndMain);
         return 0;
+    case WM_COPY:
+        CopySelectionDeferred(hwnd);
+        return 0;
+    case WM_KEYDOWN:
+        if (wParam != VK_DELETE) return ForwardSelectionMessage(hwnd, msg, wParam, lParam);
+        return ForwardEditMessage(hwnd, msg, wParam, lParam);
+    case WM_LBUTTONDOWN:
+    case WM_LBUTTONUP:
+    case WM_LBUTTONDBLCLK:
+    case WM_MOUSEMOVE:
+    case EM_SETSEL:
+        return ForwardSelectionMessage(hwnd, msg, wParam, lParam);
+    case WM_PAINT: {
+        // The control paints plain text; highlights are drawn over the part it repainted
+        RECT update;
+        if (!g_app.highlighter || !GetUpdateRect(hwnd, &update, FALSE)) break;
+        LRESULT result = DefSubclassProc(hwnd, msg, wParam, lParam);
+        PaintHighlights(hwnd, &update);
+        return result;
+    }
+    case WM_CHAR:
+    case WM_CLEAR:
+    case WM_CUT:
+    case WM_UNDO:
+    case EM_UNDO:
+    case EM_REPLACESEL:
+    case WM_SETTEXT:
+    case WM_IME_CHAR:
+    case WM_IME_COMPOSITION:
+        return ForwardEditMessage(hwnd, msg, wParam, lParam);
     case WM_DESTROY:
+        FlushPendingCopy();
         // Clean up the subclass when edit control is destroyed
         RemoveWindowSubclass(hwnd, EditControlSubclassProc, uIdSubclass);
         break;
@@ -311,6 +543,103 @@ static LRESULT CALLBACK EditControlSubclassProc(HWND hwnd, UINT msg, WPARAM wPar
     return DefSubclassProc(hwnd, msg, wParam, lParam);
 }
 
+// A store view copy is read from the store, which doesn't change while the view shows it
+static HANDLE RenderStoreCopy(void) {
+    const DocStore *store = DocumentStore();
+    if (!store) return NULL;
+
+    TRACE_BEGIN(span, "RenderCopy");
+    size_t length = DocStoreLength(store);
+    size_t start = min(g_app.copyStart, length);
+    size_t end = min(g_app.copyEnd, length);
+    SIZE_T chars = end > start ? end - start : 0;
+    HANDLE data = GlobalAlloc(GMEM_MOVEABLE, (chars + 1) * sizeof(WCHAR));
+    WCHAR *dst = data ? (WCHAR *)GlobalLock(data) : NULL;
+    if (dst) {
+        DocStoreCopy(store, start, chars, (TextChar *)dst);
+        dst[chars] = L'\0';
+        GlobalUnlock(data);
+    }
+    TRACE_END_BYTES(span, chars * sizeof(WCHAR));
+    return data;
+}
+
+static HANDLE RenderPendingCopy(void) {
+    if (g_app.copyFromStore) return RenderStoreCopy();
+    DocView view;
+    if (!BeginDocView(g_app.hwndEdit, &view)) return NULL;
+
+    TRACE_BEGIN(span, "RenderCopy");
+    size_t start = min(g_app.copyStart, (size_t)view.length);
+    size_t end = min(g_app.copyEnd, (size_t)view.length);
+    SIZE_T chars = end > start ? end - start : 0;
+    HANDLE data = GlobalAlloc(GMEM_MOVEABLE, (chars + 1) * sizeof(WCHAR));
+    WCHAR *dst = data ? (WCHAR *)GlobalLock(data) : NULL;
+    if (dst) {
+        CopyMemory(dst, view.text + start, chars * sizeof(WCHAR));
+        dst[chars] = L'\0';
+        GlobalUnlock(data);
+    }
+    EndDocView(&view);
+    TRACE_END_BYTES(span, chars * sizeof(WCHAR));
+    return data;
+}
+
+// Copy only announces CF_UNICODETEXT; the text is produced in WM_RENDERFORMAT
+// when something actually pastes it. In the store view the selection is the view's.
+static void CopySelectionDeferred(HWND hwndEdit) {
+    size_t selStart = 0, selEnd = 0;
+    if (g_app.storeViewMode) {
+        selStart = StoreViewSelection(g_app.hwndStoreView, &selEnd);
+    } else {
+        DWORD start = 0, end = 0;
+        SendMessageW(hwndEdit, EM_GETSEL, (WPARAM)&start, (LPARAM)&end);
+        selStart = start;
+        selEnd = end;
+    }
+    if (selStart == selEnd) return;
+    if (!OpenClipboard(g_app.hwndMain)) return;
+
+    EmptyClipboard(); // clears any earlier pending copy via WM_DESTROYCLIPBOARD
+    SetClipboardData(CF_UNICODETEXT, NULL);
+    CloseClipboard();
+    g_app.copyStart = selStart;
+    g_app.copyEnd = selEnd;
+    g_app.copyFromStore = g_app.storeViewMode;
+    g_app.copyPending = TRUE;
+}
+
+static void FlushPendingCopy(void) {
+    if (!g_app.copyPending) return;
+    g_app.copyPending = FALSE;
+    if (!OpenClipboard(g_app.hwndMain)) return;
+
+    if (GetClipboardOwner() == g_app.hwndMain) {
+        HANDLE data = RenderPendingCopy();
+        if (data && !SetClipboardData(CF_UNICODETEXT, data)) {
+            GlobalFree(data);
+        }
+    }
+    CloseClipboard();
+}
+
+static void ShowPasteProgress(size_t done, size_t total) {
+    WCHAR status[64];
+    StringCchPrintfW(status, ARRAYSIZE(status), L"Pasting... %u%%", (unsigned)(done * 100 / total));
+    SendMessageW(g_app.hwndStatus, SB_SETTEXT, 0, (LPARAM)status);
+    UpdateWindow(g_app.hwndStatus);
+}
+
+// Next chunk length, never splitting a CRLF pair or a surrogate pair
+static size_t PasteChunkLength(const WCHAR *text, size_t remaining) {
+    if (remaining <= PASTE_CHUNK_CHARS) return remaining;
+    size_t n = PASTE_CHUNK_CHARS;
+    if ((text[n - 1] == L'\r' && text[n] == L'\n') || IS_HIGH_SURROGATE(text[n - 1])) {
+        ++n;
+    }
+    return n;
+}
+
 static void DoPasteWithNormalizedLineEndings(HWND hwnd) {
     if (!OpenClipboard(hwnd)) {
         return;
@@ -322,26 +651,69 @@ static void DoPasteWithNormalizedLineEndings(HWND hwnd) {
         return;
     }
 
-    WCHAR *clipText = (WCHAR *)GlobalLock(clipData);
+    const WCHAR *clipText = (const WCHAR *)GlobalLock(clipData);
     if (!clipText) {
         CloseClipboard();
         return;
     }
 
-    // Normalize the clipboard text
-    size_t normLen = 0;
-    WCHAR *normalized = NormalizeLineEndings(clipText, &normLen);
+    TRACE_BEGIN(span, "Paste");
+    size_t len = TextLength((const TextChar *)clipText);
+    BOOL crlfOnly = TextIsCrlfOnly((const TextChar *)clipText, len);
+    BOOL chunked = len > PASTE_CHUNK_CHARS;
+
+    // Pure CRLF text that fits in one chunk goes straight from the clipboard to the control
+    WCHAR *buffer = NULL;
+    if (!crlfOnly || chunked) {
+        size_t bufferChars = crlfOnly ? PASTE_CHUNK_CHARS + 2 : 2 * (PASTE_CHUNK_CHARS + 1) + 1;
+        buffer = (WCHAR *)ScratchAlloc(bufferChars * sizeof(WCHAR));
+        if (!buffer) {
+            TRACE_END(span);
+            GlobalUnlock(clipData);
+            CloseClipboard();
+            return;
+        }
+    }
+
+    BOOL progress = len >= PASTE_PROGRESS_MIN_CHARS && g_app.statusVisible;
+    HCURSOR oldCursor = chunked ? SetCursor(LoadCursorW(NULL, IDC_WAIT)) : NULL;
+    if (chunked) {
+        SendMessageW(g_app.hwndEdit, WM_SETREDRAW, FALSE, 0);
+    }
+
+    size_t pos = 0;
+    do {
+        size_t n = PasteChunkLength(clipText + pos, len - pos);
+        const WCHAR *piece = clipText;
+        if (!crlfOnly) {
+            size_t out = TextNormalizeLineEndings((const TextChar *)(clipText + pos), n, (TextChar *)buffer);
+            buffer[out] = L'\0';
+            piece = buffer;
+        } else if (chunked) {
+            CopyMemory(buffer, clipText + pos, n * sizeof(WCHAR));
+            buffer[n] = L'\0';
+            piece = buffer;
+        }
+        // Consecutive inserts at the caret coalesce into one undo step in the EDIT control
+        SendMessageW(g_app.hwndEdit, EM_REPLACESEL, TRUE, (LPARAM)piece);
+        pos += n;
+        if (progress) ShowPasteProgress(pos, len);
+    } while (pos < len);
+
     GlobalUnlock(clipData);
     CloseClipboard();
 
-    if (normalized) {
-        // Insert the normalized text at the current cursor position
-        SendMessageW(g_app.hwndEdit, EM_REPLACESEL, TRUE, (LPARAM)normalized);
-        g_app.modified = TRUE;
-        UpdateTitle(hwnd);
-        UpdateStatusBar(hwnd);
-        HeapFree(GetProcessHeap(), 0, normalized);
+    if (chunked) {
+        SendMessageW(g_app.hwndEdit, WM_SETREDRAW, TRUE, 0);
+        InvalidateRect(g_app.hwndEdit, NULL, TRUE);
+        SendMessageW(g_app.hwndEdit, EM_SCROLLCARET, 0, 0);
+        SetCursor(oldCursor);
     }
+    TRACE_END_BYTES(span, len * sizeof(WCHAR));
+
+    g_app.modified = TRUE;
+    UpdateTitle(hwnd);
+    UpdateStatusBar(hwnd);
 }
 
 static void CreateEditControl(HWND hwnd) {
@@ -396,6 +768,12 @@ static void UpdateLayout(HWND hwnd) {
     if (g_app.hwndEdit) {
         MoveWindow(g_app.hwndEdit, 0, 0, rc.right, rc.bottom - statusHeight, TRUE);
     }
+    if (g_app.hwndHex) {
+        MoveWindow(g_app.hwndHex, 0, 0, rc.right, rc.bottom - statusHeight, TRUE);
+    }
+    if (g_app.hwndStoreView) {
+        MoveWindow(g_app.hwndStoreView, 0, 0, rc.right, rc.bottom - statusHeight, TRUE);
+    }
 }
 
 static BOOL PromptSaveChanges(HWND hwnd) {
@@ -411,27 +789,260 @@ static BOOL PromptSaveChanges(HWND hwnd) {
     return res == IDNO;
 }
 
-static BOOL LoadDocumentFromPath(HWND hwnd, LPCWSTR path) {
-    WCHAR *text = NULL;
-    TextEncoding enc = ENC_UTF8;
-    if (!LoadTextFile(hwnd, path, &text, NULL, &enc)) {
+// Job pool notify: runs on a worker, so it only wakes the UI thread to drain
+static void PostJobsDone(void *context) {
+    PostMessageW((HWND)context, WM_APP_JOBS_DONE, 0, 0);
+}
+
+static void TraceJobStats(void) {
+    if (!g_traceEnabled || !g_app.jobs) return;
+    JobPoolStats stats;
+    JobPoolGetStats(g_app.jobs, &stats);
+    TraceCounter("jobs interactive", (LONGLONG)stats.completed[JOB_INTERACTIVE]);
+    TraceCounter("jobs bulk", (LONGLONG)stats.completed[JOB_BULK]);
+    TraceCounter("jobs skipped", (LONGLONG)(stats.skipped[JOB_INTERACTIVE] + stats.skipped[JOB_BULK]));
+    TraceCounter("jobs max wait us", (LONGLONG)(stats.maxWaitNanos[JOB_BULK] / 1000));
+    TraceCounter("jobs run us", (LONGLONG)((stats.runNanos[JOB_INTERACTIVE] + stats.runNanos[JOB_BULK]) / 1000));
+}
+
+// Drops the pending hash, if any; its completion still runs and frees it
+static void CancelHashCheck(void) {
+    if (!g_app.hashCheck) return;
+    JobTokenCancel(g_app.hashToken);
+    JobTokenRelease(g_app.hashToken);
+    g_app.hashToken = NULL;
+    g_app.hashCheck = NULL;
+}
+
+// Records what the open file holds now and watches its folder for other programs' writes
+static void WatchCurrentFile(HWND hwnd, const FileStamp *stamp) {
+    CancelHashCheck();
+    g_app.diskStamp = *stamp;
+    g_app.diskStampValid = TRUE;
+    FileWatchStart(hwnd, WM_APP_FILE_CHANGED, g_app.currentPath);
+}
+
+static void StartHashCheck(HWND hwnd, const FileStamp *stamp, BOOL record);
+
+static void AskReloadChangedFile(HWND hwnd) {
+    WCHAR prompt[MAX_PATH_BUFFER + 128];
+    StringCchPrintfW(prompt, ARRAYSIZE(prompt),
+                     g_app.modified ? L"%s has been changed by another program.\n\nReload it and lose your changes?"
+                                    : L"%s has been changed by another program.\n\nReload it?",
+                     g_app.currentPath);
+    g_app.checkingDisk = TRUE;
+    int res = MessageBoxW(hwnd, prompt, APP_TITLE, MB_YESNO | MB_ICONQUESTION);
+    g_app.checkingDisk = FALSE;
+    FileStamp now;
+    if (res == IDYES) {
+        // Detection finds a new BOM or UTF-8; only a chosen code page has to be kept
+        FileEncoding forced = g_app.encoding;
+        WCHAR path[MAX_PATH_BUFFER];
+        StringCchCopyW(path, ARRAYSIZE(path), g_app.currentPath);
+        LoadDocumentFromPath(hwnd, path, forced.encoding == ENC_ANSI ? &forced : NULL);
+    } else if (g_app.diskStampValid && QueryFileStamp(g_app.currentPath, &now)) {
+        // Keep the edited text; only a further change asks again
+        StartHashCheck(hwnd, &now, TRUE);
+    }
+}
+
+static void FinishHashCheck(HashCheck *check) {
+    if (!check->ok || g_app.checkingDisk) return;
+    if (check->record || check->stamp.hash == g_app.diskStamp.hash) {
+        g_app.diskStamp = check->stamp;
+        return;
+    }
+    AskReloadChangedFile(check->hwnd);
+}
+
+static void HashFileJob(JobContext *context, void *arg) {
+    (void)context;
+    HashCheck *check = (HashCheck *)arg;
+    check->ok = HashFileContents(check->path, &check->stamp.hash);
+    ScratchReset(); // the read buffer came from this worker's arena
+}
+
+static void HashFileDone(const JobResult *result, void *arg) {
+    HashCheck *check = (HashCheck *)arg;
+    // A newer check, a reload, a save or File > New makes this one stale
+    if (check == g_app.hashCheck) {
+        JobTokenRelease(g_app.hashToken);
+        g_app.hashToken = NULL;
+        g_app.hashCheck = NULL;
+        if (!result->cancelled) FinishHashCheck(check);
+    }
+    free(check);
+}
+
+// Hashes currentPath on the job pool and finishes the check when it's done
+static void StartHashCheck(HWND hwnd, const FileStamp *stamp, BOOL record) {
+    CancelHashCheck();
+    HashCheck *check = (HashCheck *)calloc(1, sizeof(HashCheck));
+    if (!check) return;
+    check->hwnd = hwnd;
+    StringCchCopyW(check->path, ARRAYSIZE(check->path), g_app.currentPath);
+    check->stamp = *stamp;
+    check->record = record;
+    JobToken *token = g_app.jobs ? JobTokenCreate() : NULL;
+    if (token && JobSubmit(g_app.jobs, JOB_BULK, token, HashFileJob, HashFileDone, check)) {
+        g_app.hashCheck = check;
+        g_app.hashToken = token;
+        return;
+    }
+    JobTokenRelease(token);
+    check->ok = HashFileContents(check->path, &check->stamp.hash);
+    FinishHashCheck(check);
+    free(check);
+}
+
+// Runs once a burst of changes in the file's folder has settled. Size and write time
+// rule out most notifications (other files); a new time with the same size is only a
+// change if the bytes' hash differs, so a touch or an identical rewrite is ignored.
+static void CheckFileOnDisk(HWND hwnd) {
+    if (!g_app.diskStampValid || g_app.checkingDisk || !g_app.currentPath[0]) return;
+    FileStamp now;
+    // Gone or locked mid-write: the next notification tries again
+    if (!QueryFileStamp(g_app.currentPath, &now)) return;
+    if (now.size == g_app.diskStamp.size && now.writeTime == g_app.diskStamp.writeTime) return;
+    if (now.size == g_app.diskStamp.size) {
+        StartHashCheck(hwnd, &now, FALSE);
+        return;
+    }
+    AskReloadChangedFile(hwnd);
+}
+
+// Empties the document and forgets its file, as File > New does
+static void ClearDocument(HWND hwnd) {
+    SetEditText(g_app.hwndEdit, L"");
+    g_app.currentPath[0] = L'\0';
+    g_app.diskStampValid = FALSE;
+    CancelHashCheck();
+    FileWatchStop();
+    g_app.encoding.encoding = ENC_UTF8;
+    g_app.encoding.codePage = 0;
+    g_app.encoding.eol = TEXT_EOL_CRLF;
+    g_app.encoding.eolMixed = FALSE;
+    SendMessageW(g_app.hwndEdit, EM_SETMODIFY, FALSE, 0);
+    g_app.modified = FALSE;
+    UpdateTitle(hwnd);
+    UpdateStatusBar(hwnd);
+}
+
+// Shows `path` as bytes in place of the document, which is cleared; the caller has
+// already asked about unsaved changes
+static BOOL ShowHexView(HWND hwnd, LPCWSTR path) {
+    if (!g_app.hwndHex) g_app.hwndHex = HexViewCreate(hwnd, g_hInst, WM_APP_HEX_SELECTION);
+    if (!g_app.hwndHex || !HexViewOpen(g_app.hwndHex, path)) {
+        MessageBoxW(hwnd, L"Unable to open the file in hex view.", APP_TITLE, MB_ICONERROR);
         return FALSE;
     }
+    // Find and Replace would work on the hidden, empty document
+    if (g_app.hFindDlg) DestroyWindow(g_app.hFindDlg);
+    if (g_app.hReplaceDlg) DestroyWindow(g_app.hReplaceDlg);
+    g_app.hFindDlg = NULL;
+    g_app.hReplaceDlg = NULL;
+
+    StringCchCopyW(g_app.hexPath, ARRAYSIZE(g_app.hexPath), path);
+    g_app.hexMode = TRUE;
+    HideStoreView();
+    ClearDocument(hwnd);
+    ShowWindow(g_app.hwndEdit, SW_HIDE);
+    ShowWindow(g_app.hwndHex, SW_SHOW);
+    UpdateLayout(hwnd);
+    SetFocus(g_app.hwndHex);
+    return TRUE;
+}
+
+// Back to the document; the caller fills it
+static void HideHexView(void) {
+    if (!g_app.hexMode) return;
+    g_app.hexMode = FALSE;
+    HexViewClose(g_app.hwndHex);
+    ShowWindow(g_app.hwndHex, SW_HIDE);
+    ShowWindow(g_app.hwndEdit, SW_SHOW);
+    SetFocus(g_app.hwndEdit);
+}
 
-    // Normalize line endings to Windows style
-    size_t normLen = 0;
-    WCHAR *normalized = NormalizeLineEndings(text, &normLen);
-    HeapFree(GetProcessHeap(), 0, text);
-    
-    if (!normalized) {
-        MessageBoxW(hwnd, L"Failed to normalize line endings.", L"retropad", MB_ICONERROR);
+// Shows a document read-only without the EDIT control, painted straight from its
+// store so no second copy of the text is made. Takes ownership of `store`.
+static BOOL ShowStoreView(HWND hwnd, DocStore *store) {
+    if (!g_app.hwndStoreView) g_app.hwndStoreView = StoreViewCreate(hwnd, g_hInst, WM_APP_STORE_SELECTION);
+    if (!g_app.hwndStoreView) {
+        DocStoreDestroy(store);
         return FALSE;
     }
+    if (!DocumentAdopt(g_app.hwndEdit, store)) return FALSE;
+    // Replace would work on the hidden, empty control; Find searches the store
+    if (g_app.hReplaceDlg) DestroyWindow(g_app.hReplaceDlg);
+    g_app.hReplaceDlg = NULL;
+
+    StoreViewOpen(g_app.hwndStoreView, DocumentStore());
+    g_app.storeViewMode = TRUE;
+    ShowWindow(g_app.hwndEdit, SW_HIDE);
+    ShowWindow(g_app.hwndStoreView, SW_SHOW);
+    UpdateLayout(hwnd);
+    SetFocus(g_app.hwndStoreView);
+    return TRUE;
+}
+
+// Back to an empty document in the control; the caller fills it
+static void HideStoreView(void) {
+    if (!g_app.storeViewMode) return;
+    FlushPendingCopy();     // a deferred copy reads the store about to be freed
+    g_app.storeViewMode = FALSE;
+    StoreViewClose(g_app.hwndStoreView);
+    ShowWindow(g_app.hwndStoreView, SW_HIDE);
+    DocumentReplace(g_app.hwndEdit, DocumentNewStore());
+    ShowWindow(g_app.hwndEdit, SW_SHOW);
+    SetFocus(g_app.hwndEdit);
+}
+
+// Asked before a file that looks binary, or is too big for the text loader, is opened:
+// IDYES for hex view, IDNO for text, IDCANCEL to open nothing
+static int OfferHexView(HWND hwnd, LPCWSTR path, BOOL tooLarge) {
+    WCHAR prompt[MAX_PATH_BUFFER + 128];
+    if (tooLarge) {
+        StringCchPrintfW(prompt, ARRAYSIZE(prompt), L"%s is too large to open as text.\n\nShow it in hex view?", path);
+        return MessageBoxW(hwnd, prompt, APP_TITLE, MB_ICONQUESTION | MB_OKCANCEL) == IDOK ? IDYES : IDCANCEL;
+    }
+    StringCchPrintfW(prompt, ARRAYSIZE(prompt),
+                     L"%s looks like a binary file.\n\nShow it in hex view? Choose No to open it as text.", path);
+    return MessageBoxW(hwnd, prompt, APP_TITLE, MB_ICONQUESTION | MB_YESNOCANCEL);
+}
+
+static BOOL LoadTextDocument(HWND hwnd, LPCWSTR path, const FileEncoding *forced) {
+    DocStore *store = DocumentNewStore();
+    if (!store) {
+        MessageBoxW(hwnd, L"Not enough memory to open the file.", L"retropad", MB_ICONERROR);
+        return FALSE;
+    }
+    FileEncoding enc = {ENC_UTF8, 0, TEXT_EOL_CRLF, FALSE};
+    FileStamp stamp;
+    // Decodes straight into the store with line endings normalized on the way
+    if (!LoadTextFile(hwnd, path, store, forced, &enc, &stamp)) {
+        DocStoreDestroy(store);
+        return FALSE;
+    }
+    HideHexView();
+    FlushPendingCopy();     // a deferred copy refers to the text being replaced
+    // The control holds a second, UTF-16 copy of the text; a document it can't hold, or
+    // above ReadOnlyAboveMB, is shown from the store alone
+    BOOL shown;
+    if (DocumentFitsEdit(store, (size_t)g_app.readOnlyAboveMB << 20)) {
+        HideStoreView();
+        shown = DocumentReplace(g_app.hwndEdit, store);
+    } else {
+        shown = ShowStoreView(hwnd, store);
+    }
+    if (!shown) {
+        MessageBoxW(hwnd, L"Not enough memory to show the file.", L"retropad", MB_ICONERROR);
+        return FALSE;
+    }
+    SetTimer(hwnd, IDT_DOC_IDLE, DOC_IDLE_MS, NULL);
 
-    SetWindowTextW(g_app.hwndEdit, normalized);
-    HeapFree(GetProcessHeap(), 0, normalized);
     StringCchCopyW(g_app.currentPath, ARRAYSIZE(g_app.currentPath), path);
     g_app.encoding = enc;
+    WatchCurrentFile(hwnd, &stamp);
     SendMessageW(g_app.hwndEdit, EM_SETMODIFY, FALSE, 0);
     g_app.modified = FALSE;
     UpdateTitle(hwnd);
@@ -439,24 +1050,100 @@ static BOOL LoadDocumentFromPath(HWND hwnd, LPCWSTR path) {
     return TRUE;
 }
 
+// Files that look binary, or are too big to load as text, may be shown as bytes instead.
+// A chosen encoding means the user wants text.
+static BOOL LoadDocumentFromPath(HWND hwnd, LPCWSTR path, const FileEncoding *forced) {
+    ULONGLONG size = 0;
+    BOOL binary = FALSE;
+    if ((!forced || !forced->encoding) && ProbeFile(path, &size, &binary) && (binary || size > UINT_MAX)) {
+        int answer = OfferHexView(hwnd, path, size > UINT_MAX);
+        if (answer == IDCANCEL) return FALSE;
+        if (answer == IDYES) return ShowHexView(hwnd, path);
+    }
+    return LoadTextDocument(hwnd, path, forced);
+}
+
+// View > Hex View: the open file as bytes, or the file in hex view back as text
+static void ToggleHexView(HWND hwnd) {
+    WCHAR path[MAX_PATH_BUFFER];
+    if (g_app.hexMode) {
+        StringCchCopyW(path, ARRAYSIZE(path), g_app.hexPath);
+        LoadTextDocument(hwnd, path, NULL);
+    } else if (g_app.currentPath[0] && PromptSaveChanges(hwnd)) {
+        StringCchCopyW(path, ARRAYSIZE(path), g_app.currentPath);
+        ShowHexView(hwnd, path);
+    }
+}
+
 static BOOL DoFileOpen(HWND hwnd) {
     if (!PromptSaveChanges(hwnd)) return FALSE;
 
     WCHAR path[MAX_PATH_BUFFER] = L"";
-    if (!OpenFileDialog(hwnd, path, ARRAYSIZE(path))) {
+    FileEncoding encoding;
+    if (!OpenFileDialog(hwnd, path, ARRAYSIZE(path), &encoding)) {
         return FALSE;
     }
-    return LoadDocumentFromPath(hwnd, path);
+    return LoadDocumentFromPath(hwnd, path, &encoding);
+}
+
+static BOOL IsRecentFileCommand(UINT id) {
+    return id >= IDM_FILE_RECENT_FIRST && id < IDM_FILE_RECENT_FIRST + RECENT_FILES_MAX;
+}
+
+// Refills File > Recent Files from the file cache each time it opens, so files opened
+// in other windows show up too
+static void FillRecentMenu(HMENU menu) {
+    while (GetMenuItemCount(menu) > 0) DeleteMenu(menu, 0, MF_BYPOSITION);
+    g_app.recentCount = FileCacheRecent(g_app.recentPaths, RECENT_FILES_MAX);
+    if (g_app.recentCount == 0) {
+        AppendMenuW(menu, MF_STRING | MF_GRAYED, IDM_FILE_RECENT_NONE, L"(none)");
+        return;
+    }
+    for (size_t i = 0; i < g_app.recentCount; ++i) {
+        WCHAR label[MAX_PATH + 8];
+        StringCchPrintfW(label, ARRAYSIZE(label), L"&%u %s", (unsigned)(i + 1), g_app.recentPaths[i]);
+        AppendMenuW(menu, MF_STRING, IDM_FILE_RECENT_FIRST + (UINT)i, label);
+    }
+}
+
+static void DoOpenRecent(HWND hwnd, size_t index) {
+    if (index >= g_app.recentCount || !PromptSaveChanges(hwnd)) return;
+    WCHAR path[MAX_PATH];
+    StringCchCopyW(path, ARRAYSIZE(path), g_app.recentPaths[index]);
+    if (GetFileAttributesW(path) == INVALID_FILE_ATTRIBUTES) {
+        WCHAR prompt[MAX_PATH + 64];
+        StringCchPrintfW(prompt, ARRAYSIZE(prompt), L"%s no longer exists.\n\nRemove it from Recent Files?", path);
+        if (MessageBoxW(hwnd, prompt, APP_TITLE, MB_ICONQUESTION | MB_YESNO) == IDYES) FileCacheForget(path);
+        return;
+    }
+    LoadDocumentFromPath(hwnd, path, NULL);
+}
+
+// Encodes the control's text and writes it to `path`
+static BOOL SaveEditText(HWND hwnd, LPCWSTR path, const FileEncoding *encoding, FileStamp *stampOut) {
+    // The control's buffer stays locked only while encoding: the prompts and error
+    // boxes that saving can show run a message loop
+    DocView view;
+    if (!BeginDocView(g_app.hwndEdit, &view)) return FALSE;
+    EncodedFile encoded;
+    BOOL ok = EncodeTextFile(view.text, (size_t)view.length, encoding, &encoded);
+    EndDocView(&view);
+    if (!ok) {
+        MessageBoxW(hwnd, L"Unable to encode the text for saving.", L"retropad", MB_ICONERROR);
+        return FALSE;
+    }
+    return SaveEncodedFile(hwnd, path, &encoded, encoding, stampOut);
 }
 
 static BOOL DoFileSave(HWND hwnd, BOOL saveAs) {
     WCHAR path[MAX_PATH_BUFFER];
+    FileEncoding encoding = g_app.encoding;
     if (saveAs || g_app.currentPath[0] == L'\0') {
         path[0] = L'\0';
         if (g_app.currentPath[0]) {
             StringCchCopyW(path, ARRAYSIZE(path), g_app.currentPath);
         }
-        if (!SaveFileDialog(hwnd, path, ARRAYSIZE(path))) {
+        if (!SaveFileDialog(hwnd, path, ARRAYSIZE(path), &encoding)) {
             return FALSE;
         }
         StringCchCopyW(g_app.currentPath, ARRAYSIZE(g_app.currentPath), path);
@@ -464,14 +1151,14 @@ static BOOL DoFileSave(HWND hwnd, BOOL saveAs) {
         StringCchCopyW(path, ARRAYSIZE(path), g_app.currentPath);
     }
 
-    int len = GetWindowTextLengthW(g_app.hwndEdit);
-    WCHAR *buffer = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, (len + 1) * sizeof(WCHAR));
-    if (!buffer) return FALSE;
-    GetWindowTextW(g_app.hwndEdit, buffer, len + 1);
-
-    BOOL ok = SaveTextFile(hwnd, path, buffer, len, g_app.encoding);
-    HeapFree(GetProcessHeap(), 0, buffer);
+    // A document in the store view is too big to encode in one piece; it is written from
+    // the store block by block
+    FileStamp stamp;
+    BOOL ok = g_app.storeViewMode ? SaveStoreFile(hwnd, path, DocumentStore(), &encoding, &stamp)
+                                  : SaveEditText(hwnd, path, &encoding, &stamp);
     if (ok) {
+        g_app.encoding = encoding;
+        WatchCurrentFile(hwnd, &stamp);
         SendMessageW(g_app.hwndEdit, EM_SETMODIFY, FALSE, 0);
         g_app.modified = FALSE;
         UpdateTitle(hwnd);
@@ -481,11 +1168,76 @@ static BOOL DoFileSave(HWND hwnd, BOOL saveAs) {
 
 static void DoFileNew(HWND hwnd) {
     if (!PromptSaveChanges(hwnd)) return;
-    SetWindowTextW(g_app.hwndEdit, L"");
-    g_app.currentPath[0] = L'\0';
-    g_app.encoding = ENC_UTF8;
-    SendMessageW(g_app.hwndEdit, EM_SETMODIFY, FALSE, 0);
-    g_app.modified = FALSE;
+    HideHexView();
+    HideStoreView();
+    ClearDocument(hwnd);
+}
+
+// Diffs a file on disk (old) against the document (new) by line and shows the result
+// as a unified diff
+static void DoCompareWithFile(HWND hwnd) {
+    WCHAR path[MAX_PATH_BUFFER] = L"";
+    FileEncoding encoding;
+    if (!OpenFileDialog(hwnd, path, ARRAYSIZE(path), &encoding)) return;
+
+    DocStore *other = DocStoreCreate();
+    FileEncoding found;
+    if (!other || !LoadTextFile(hwnd, path, other, &encoding, &found, NULL)) {
+        if (other) DocStoreDestroy(other);
+        return;
+    }
+    DocView view;
+    if (!BeginDocView(g_app.hwndEdit, &view)) {
+        DocStoreDestroy(other);
+        return;
+    }
+
+    TRACE_BEGIN(span, "CompareWithFile");
+    HCURSOR oldCursor = SetCursor(LoadCursorW(NULL, IDC_WAIT));
+    size_t otherLen = DocStoreLength(other);
+    WCHAR *otherText = (WCHAR *)ScratchAlloc((otherLen + 1) * sizeof(WCHAR));
+    if (otherText) DocStoreCopy(other, 0, otherLen, (TextChar *)otherText);
+    DocStoreDestroy(other);
+
+    CompareView compare = {NULL, {NULL, 0, 0, 0, FALSE}, NULL, 0};
+    size_t unifiedLen = 0;
+    TextChar *unified = NULL;
+    BOOL ok = otherText && TextDiffLines((const TextChar *)otherText, otherLen, (const TextChar *)view.text,
+                                         (size_t)view.length, 0, &compare.diff);
+    if (ok && compare.diff.count > 0) {
+        size_t *offsets = (size_t *)ScratchAlloc(compare.diff.count * sizeof(size_t));
+        const WCHAR *newName = g_app.currentPath[0] ? g_app.currentPath : UNTITLED_NAME;
+        unified = offsets ? TextDiffUnified((const TextChar *)otherText, otherLen, (const TextChar *)view.text,
+                                            (size_t)view.length, &compare.diff, (const TextChar *)path,
+                                            (const TextChar *)newName, 3, offsets, &unifiedLen)
+                          : NULL;
+        compare.text = (const WCHAR *)unified;
+        compare.offsets = offsets;
+        compare.current = compare.diff.count;
+        ok = unified != NULL;
+    }
+    EndDocView(&view);
+    SetCursor(oldCursor);
+    TRACE_END_BYTES(span, (otherLen + (size_t)view.length) * sizeof(WCHAR));
+
+    if (!ok) {
+        MessageBoxW(hwnd, L"Not enough memory to compare the files.", APP_TITLE, MB_ICONERROR);
+    } else if (compare.diff.count == 0) {
+        MessageBoxW(hwnd, L"The file and the document have the same lines.", APP_TITLE, MB_ICONINFORMATION);
+    } else {
+        DialogBoxParamW(g_hInst, MAKEINTRESOURCE(IDD_COMPARE), hwnd, CompareDlgProc, (LPARAM)&compare);
+    }
+    free(unified);
+    TextDiffFree(&compare.diff);
+}
+
+// Changes how line breaks are written on the next save; the text itself stays CRLF
+static void SetLineEndings(HWND hwnd, TextEol eol) {
+    if (g_app.encoding.eol == eol && !g_app.encoding.eolMixed) return;
+    g_app.encoding.eol = eol;
+    g_app.encoding.eolMixed = FALSE;
+    SendMessageW(g_app.hwndEdit, EM_SETMODIFY, TRUE, 0);
+    g_app.modified = TRUE;
     UpdateTitle(hwnd);
     UpdateStatusBar(hwnd);
 }
@@ -494,18 +1246,20 @@ static void SetWordWrap(HWND hwnd, BOOL enabled) {
     if (g_app.wordWrap == enabled) return;
     g_app.wordWrap = enabled;
     HWND edit = g_app.hwndEdit;
+    // The new control is refilled from the document store; only copy when it's out of step
     WCHAR *text = NULL;
     int len = 0;
-    if (!GetEditText(edit, &text, &len)) {
+    if (!DocumentStore() && !GetEditText(edit, &text, &len)) {
         return;
     }
     DWORD start = 0, end = 0;
     SendMessageW(edit, EM_GETSEL, (WPARAM)&start, (LPARAM)&end);
 
     CreateEditControl(hwnd);
-    SetWindowTextW(g_app.hwndEdit, text);
+    if (text || !DocumentShow(g_app.hwndEdit)) {
+        SetEditText(g_app.hwndEdit, text ? text : L"");
+    }
     SendMessageW(g_app.hwndEdit, EM_SETSEL, start, end);
-    HeapFree(GetProcessHeap(), 0, text);
 
     if (enabled) {
         g_app.statusBeforeWrap = g_app.statusVisible;
@@ -523,17 +1277,82 @@ static void SetWordWrap(HWND hwnd, BOOL enabled) {
 
 static void UpdateStatusBar(HWND hwnd) {
     if (!g_app.statusVisible || !g_app.hwndStatus) return;
-    DWORD selStart = 0, selEnd = 0;
-    SendMessageW(g_app.hwndEdit, EM_GETSEL, (WPARAM)&selStart, (LPARAM)&selEnd);
-    int line = (int)SendMessageW(g_app.hwndEdit, EM_LINEFROMCHAR, selStart, 0) + 1;
-    int col = (int)(selStart - SendMessageW(g_app.hwndEdit, EM_LINEINDEX, line - 1, 0)) + 1;
-    int lines = (int)SendMessageW(g_app.hwndEdit, EM_GETLINECOUNT, 0, 0);
+    if (g_app.hexMode) {
+        ULONGLONG length = 0;
+        ULONGLONG offset = HexViewSelection(g_app.hwndHex, &length);
+        WCHAR status[192];
+        StringCchPrintfW(status, ARRAYSIZE(status), L"Offset 0x%llX (%llu)    Selected: %llu    Size: %llu bytes    Hex view (read-only)",
+                         offset, offset, length, HexViewSize(g_app.hwndHex));
+        SendMessageW(g_app.hwndStatus, SB_SETTEXT, 0, (LPARAM)status);
+        return;
+    }
+    size_t selStart = 0;
+    if (g_app.storeViewMode) {
+        size_t selEnd = 0;
+        selStart = StoreViewSelection(g_app.hwndStoreView, &selEnd);
+    } else {
+        DWORD start = 0, end = 0;
+        SendMessageW(g_app.hwndEdit, EM_GETSEL, (WPARAM)&start, (LPARAM)&end);
+        selStart = start;
+    }
+    int line, col, lines;
+    const DocStore *store = DocumentStore();
+    if (store) {
+        size_t index = DocStoreLineFromOffset(store, selStart);
+        line = (int)index + 1;
+        col = (int)(selStart - DocStoreLineStart(store, index)) + 1;
+        lines = (int)DocStoreLineCount(store);
+    } else {
+        line = (int)SendMessageW(g_app.hwndEdit, EM_LINEFROMCHAR, selStart, 0) + 1;
+        col = (int)(selStart - SendMessageW(g_app.hwndEdit, EM_LINEINDEX, line - 1, 0)) + 1;
+        lines = (int)SendMessageW(g_app.hwndEdit, EM_GETLINECOUNT, 0, 0);
+    }
+
+    // Only the chunks edited since the last update are counted again
+    TextStats stats;
+    DocumentGetTextStats(g_app.hwndEdit, &stats);
 
-    WCHAR status[128];
-    StringCchPrintfW(status, ARRAYSIZE(status), L"Ln %d, Col %d    Lines: %d", line, col, lines);
+    WCHAR status[192];
+    StringCchPrintfW(status, ARRAYSIZE(status), L"Ln %d, Col %d    Lines: %d    Words: %llu    Chars: %llu    %s%s%s",
+                     line, col, lines, (unsigned long long)stats.words, (unsigned long long)stats.chars,
+                     g_app.encoding.eolMixed ? L"Mixed, saving as " : L"", g_eolNames[g_app.encoding.eol],
+                     g_app.storeViewMode ? L"    Read-only" : L"");
     SendMessageW(g_app.hwndStatus, SB_SETTEXT, 0, (LPARAM)status);
 }
 
+// Adds an "In selection" box under Match case in the stock Find and Replace dialogs,
+// growing the dialog when there is no room for it
+static UINT_PTR CALLBACK FindDlgHook(HWND dlg, UINT msg, WPARAM wParam, LPARAM lParam) {
+    (void)lParam;
+    if (msg == WM_COMMAND && LOWORD(wParam) == IDC_FIND_IN_SELECTION && HIWORD(wParam) == BN_CLICKED) {
+        // Turning it on takes the selection as it is now
+        g_app.findInSelection = IsDlgButtonChecked(dlg, IDC_FIND_IN_SELECTION) == BST_CHECKED;
+        g_app.foundStart = g_app.foundEnd = MAXDWORD;
+        return TRUE;
+    }
+    if (msg != WM_INITDIALOG) return 0;
+    RECT rc;
+    GetWindowRect(GetDlgItem(dlg, chx2), &rc);
+    MapWindowPoints(NULL, dlg, (POINT *)&rc, 2);
+    int height = rc.bottom - rc.top;
+    int top = rc.bottom + height / 2;
+    HWND box = CreateWindowExW(0, L"BUTTON", L"In s&election", WS_CHILD | WS_VISIBLE | WS_TABSTOP | BS_AUTOCHECKBOX,
+                               rc.left, top, rc.right - rc.left, height, dlg, (HMENU)(INT_PTR)IDC_FIND_IN_SELECTION,
+                               g_hInst, NULL);
+    SendMessageW(box, WM_SETFONT, (WPARAM)SendMessageW(dlg, WM_GETFONT, 0, 0), FALSE);
+    CheckDlgButton(dlg, IDC_FIND_IN_SELECTION, g_app.findInSelection ? BST_CHECKED : BST_UNCHECKED);
+
+    RECT client, window;
+    GetClientRect(dlg, &client);
+    int needed = top + height + height / 2;
+    if (needed > client.bottom) {
+        GetWindowRect(dlg, &window);
+        SetWindowPos(dlg, NULL, 0, 0, window.right - window.left, window.bottom - window.top + needed - client.bottom,
+                     SWP_NOMOVE | SWP_NOZORDER | SWP_NOACTIVATE);
+    }
+    return TRUE;
+}
+
 static void ShowFindDialog(HWND hwnd) {
     if (g_app.hFindDlg) {
         SetForegroundWindow(g_app.hFindDlg);
@@ -545,7 +1364,8 @@ static void ShowFindDialog(HWND hwnd) {
     g_app.find.hwndOwner = hwnd;
     g_app.find.lpstrFindWhat = g_app.findText;
     g_app.find.wFindWhatLen = ARRAYSIZE(g_app.findText);
-    g_app.find.Flags = g_app.findFlags;
+    g_app.find.Flags = g_app.findFlags | FR_ENABLEHOOK;
+    g_app.find.lpfnHook = FindDlgHook;
 
     g_app.hFindDlg = FindTextW(&g_app.find);
 }
@@ -563,7 +1383,8 @@ static void ShowReplaceDialog(HWND hwnd) {
     g_app.find.lpstrReplaceWith = g_app.replaceText;
     g_app.find.wFindWhatLen = ARRAYSIZE(g_app.findText);
     g_app.find.wReplaceWithLen = ARRAYSIZE(g_app.replaceText);
-    g_app.find.Flags = g_app.findFlags;
+    g_app.find.Flags = g_app.findFlags | FR_ENABLEHOOK;
+    g_app.find.lpfnHook = FindDlgHook;
 
     g_app.hReplaceDlg = ReplaceTextW(&g_app.find);
 }
@@ -576,20 +1397,32 @@ static BOOL DoFindNext(BOOL reverse) {
 
     DWORD start = 0, end = 0;
     SendMessageW(g_app.hwndEdit, EM_GETSEL, (WPARAM)&start, (LPARAM)&end);
-    BOOL matchCase = (g_app.findFlags & FR_MATCHCASE) != 0;
+    unsigned options = FindOptions(g_app.findFlags);
     BOOL down = (g_app.findFlags & FR_DOWN) != 0;
     if (reverse) down = !down;
-    DWORD searchStart = down ? end : start;
-    DWORD outStart = 0, outEnd = 0;
-    if (FindInEdit(g_app.hwndEdit, g_app.findText, matchCase, down, searchStart, &outStart, &outEnd)) {
-        SendMessageW(g_app.hwndEdit, EM_SETSEL, outStart, outEnd);
-        SendMessageW(g_app.hwndEdit, EM_SCROLLCARET, 0, 0);
-        return TRUE;
-    }
+    if (g_app.storeViewMode ? FindInStoreView(options, down) : FindAndSelect(options, down, down ? end : start)) return TRUE;
     MessageBoxW(g_app.hwndMain, L"Cannot find the text.", APP_TITLE, MB_ICONINFORMATION);
     return FALSE;
 }
 
+// Puts the caret at the start of 1-based `line`, or of the last line when there are fewer
+static void GoToLine(UINT line) {
+    const DocStore *store = DocumentStore();
+    if (g_app.storeViewMode) {
+        size_t index = min((size_t)line, DocStoreLineCount(store)) - 1;
+        size_t start = DocStoreLineStart(store, index);
+        StoreViewSelect(g_app.hwndStoreView, start, start);
+        return;
+    }
+    int maxLine = store ? (int)DocStoreLineCount(store) : (int)SendMessageW(g_app.hwndEdit, EM_GETLINECOUNT, 0, 0);
+    if ((int)line > maxLine) line = (UINT)maxLine;
+    int charIndex = store ? (int)DocStoreLineStart(store, line - 1) : (int)SendMessageW(g_app.hwndEdit, EM_LINEINDEX, line - 1, 0);
+    if (charIndex >= 0) {
+        SendMessageW(g_app.hwndEdit, EM_SETSEL, charIndex, charIndex);
+        SendMessageW(g_app.hwndEdit, EM_SCROLLCARET, 0, 0);
+    }
+}
+
 static INT_PTR CALLBACK GoToDlgProc(HWND dlg, UINT msg, WPARAM wParam, LPARAM lParam) {
     switch (msg) {
     case WM_INITDIALOG: {
@@ -607,13 +1440,7 @@ static INT_PTR CALLBACK GoToDlgProc(HWND dlg, UINT msg, WPARAM wParam, LPARAM lP
                 MessageBoxW(dlg, L"Enter a valid line number.", APP_TITLE, MB_ICONWARNING);
                 return TRUE;
             }
-            int maxLine = (int)SendMessageW(g_app.hwndEdit, EM_GETLINECOUNT, 0, 0);
-            if ((int)line > maxLine) line = (UINT)maxLine;
-            int charIndex = (int)SendMessageW(g_app.hwndEdit, EM_LINEINDEX, line - 1, 0);
-            if (charIndex >= 0) {
-                SendMessageW(g_app.hwndEdit, EM_SETSEL, charIndex, charIndex);
-                SendMessageW(g_app.hwndEdit, EM_SCROLLCARET, 0, 0);
-            }
+            GoToLine(line);
             EndDialog(dlg, IDOK);
             return TRUE;
         }
@@ -626,6 +1453,91 @@ static INT_PTR CALLBACK GoToDlgProc(HWND dlg, UINT msg, WPARAM wParam, LPARAM lP
     return FALSE;
 }
 
+static INT_PTR CALLBACK HexInputDlgProc(HWND dlg, UINT msg, WPARAM wParam, LPARAM lParam) {
+    HexPrompt *prompt = (HexPrompt *)GetWindowLongPtrW(dlg, GWLP_USERDATA);
+    switch (msg) {
+    case WM_INITDIALOG:
+        prompt = (HexPrompt *)lParam;
+        SetWindowLongPtrW(dlg, GWLP_USERDATA, (LONG_PTR)prompt);
+        SetWindowTextW(dlg, prompt->title);
+        SetDlgItemTextW(dlg, IDC_HEX_LABEL, prompt->label);
+        SetDlgItemTextW(dlg, IDC_HEX_EDIT, prompt->text);
+        SendDlgItemMessageW(dlg, IDC_HEX_EDIT, EM_SETLIMITTEXT, ARRAYSIZE(prompt->text) - 1, 0);
+        SendDlgItemMessageW(dlg, IDC_HEX_EDIT, EM_SETSEL, 0, -1);
+        return TRUE;
+    case WM_COMMAND:
+        switch (LOWORD(wParam)) {
+        case IDOK:
+            GetDlgItemTextW(dlg, IDC_HEX_EDIT, prompt->text, ARRAYSIZE(prompt->text));
+            EndDialog(dlg, IDOK);
+            return TRUE;
+        case IDCANCEL:
+            EndDialog(dlg, IDCANCEL);
+            return TRUE;
+        }
+        break;
+    }
+    return FALSE;
+}
+
+// Offsets are decimal, or hex with a 0x prefix
+static BOOL ParseOffset(const WCHAR *text, ULONGLONG *offsetOut) {
+    while (*text == L' ') ++text;
+    int base = 10;
+    if (text[0] == L'0' && (text[1] == L'x' || text[1] == L'X')) {
+        base = 16;
+        text += 2;
+    }
+    WCHAR lower = (WCHAR)(*text | 0x20);
+    BOOL digit = (*text >= L'0' && *text <= L'9') || (base == 16 && lower >= L'a' && lower <= L'f');
+    if (!digit) return FALSE;
+    WCHAR *end = NULL;
+    *offsetOut = wcstoull(text, &end, base);
+    while (*end == L' ') ++end;
+    return *end == L'\0';
+}
+
+// Edit > Go To in hex view
+static void DoHexGoTo(HWND hwnd) {
+    HexPrompt prompt = {L"Go To Offset", L"Offset (decimal, or hex with 0x):", L""};
+    ULONGLONG length = 0;
+    StringCchPrintfW(prompt.text, ARRAYSIZE(prompt.text), L"0x%llX", HexViewSelection(g_app.hwndHex, &length));
+    while (DialogBoxParamW(g_hInst, MAKEINTRESOURCE(IDD_HEX_INPUT), hwnd, HexInputDlgProc, (LPARAM)&prompt) == IDOK) {
+        ULONGLONG offset = 0;
+        if (ParseOffset(prompt.text, &offset)) {
+            HexViewGoTo(g_app.hwndHex, offset);
+            return;
+        }
+        MessageBoxW(hwnd, L"Enter an offset such as 4096 or 0x1000.", APP_TITLE, MB_ICONWARNING);
+    }
+}
+
+// Edit > Find and Find Next in hex view; Find Next only asks when nothing was searched yet
+static void DoHexFind(HWND hwnd, BOOL ask) {
+    if (ask || g_app.hexPatternLength == 0) {
+        HexPrompt prompt = {L"Find Bytes", L"Hex bytes and \"quoted text\", e.g. 4D 5A or \"PK\" 03 04:", L""};
+        StringCchCopyW(prompt.text, ARRAYSIZE(prompt.text), g_app.hexFindText);
+        for (;;) {
+            if (DialogBoxParamW(g_hInst, MAKEINTRESOURCE(IDD_HEX_INPUT), hwnd, HexInputDlgProc, (LPARAM)&prompt) != IDOK) {
+                return;
+            }
+            size_t length = HexParsePattern((const TextChar *)prompt.text, wcslen(prompt.text), g_app.hexPattern, HEX_PATTERN_MAX);
+            if (length > 0) {
+                StringCchCopyW(g_app.hexFindText, ARRAYSIZE(g_app.hexFindText), prompt.text);
+                g_app.hexPatternLength = length;
+                break;
+            }
+            MessageBoxW(hwnd, L"Enter pairs of hex digits and \"quoted text\", up to 256 bytes.", APP_TITLE,
+                        MB_ICONWARNING);
+        }
+    }
+    if (!HexViewFind(g_app.hwndHex, g_app.hexPattern, g_app.hexPatternLength)) {
+        WCHAR msg[192];
+        StringCchPrintfW(msg, ARRAYSIZE(msg), L"Cannot find %s after the selection.", g_app.hexFindText);
+        MessageBoxW(hwnd, msg, APP_TITLE, MB_ICONINFORMATION);
+    }
+}
+
 static void DoSelectFont(HWND hwnd) {
     LOGFONTW lf = {0};
     if (g_app.hFont) {
@@ -649,67 +1561,31 @@ static void DoSelectFont(HWND hwnd) {
             LOGFONTW lfcurrent = {0}; // Save current font
             if (g_app.hFont) {
                 GetObjectW(g_app.hFont, sizeof(LOGFONTW), &lfcurrent);
-                SaveFontToIni(&lfcurrent);
+                SaveFontToSettings(&lfcurrent);
             }
             UpdateLayout(hwnd);
         }
     }
 }
-static BOOL LoadFontFromIni(void) {
-    WCHAR exePath[MAX_PATH_BUFFER];
-    if (GetModuleFileNameW(NULL, exePath, ARRAYSIZE(exePath)) == 0) return FALSE;
-
-    WCHAR *dot = wcsrchr(exePath, L'.');
-    WCHAR *slash = wcsrchr(exePath, L'\\');
-    if (dot && (!slash || dot > slash)) *dot = L'\0';
-    StringCchCatW(exePath, ARRAYSIZE(exePath), L".ini");
-
-    WCHAR buf[256];
+static BOOL LoadFontFromSettings(void) {
     LOGFONTW lf = {0};
-
-    if (!GetPrivateProfileStringW(L"Font", L"FaceName", L"", lf.lfFaceName, ARRAYSIZE(lf.lfFaceName), exePath)) {
+    if (!SettingsGetString(L"Font", L"FaceName", lf.lfFaceName, ARRAYSIZE(lf.lfFaceName)) || lf.lfFaceName[0] == L'\0') {
         return FALSE;
     }
 
-    if (GetPrivateProfileStringW(L"Font", L"Height", L"0", buf, ARRAYSIZE(buf), exePath)) {
-        lf.lfHeight = (LONG)wcstol(buf, NULL, 10);
-    }
-    if (GetPrivateProfileStringW(L"Font", L"Width", L"0", buf, ARRAYSIZE(buf), exePath)) {
-        lf.lfWidth = (LONG)wcstol(buf, NULL, 10);
-    }
-    if (GetPrivateProfileStringW(L"Font", L"Escapement", L"0", buf, ARRAYSIZE(buf), exePath)) {
-        lf.lfEscapement = (LONG)wcstol(buf, NULL, 10);
-    }
-    if (GetPrivateProfileStringW(L"Font", L"Orientation", L"0", buf, ARRAYSIZE(buf), exePath)) {
-        lf.lfOrientation = (LONG)wcstol(buf, NULL, 10);
-    }
-    if (GetPrivateProfileStringW(L"Font", L"Weight", L"0", buf, ARRAYSIZE(buf), exePath)) {
-        lf.lfWeight = (LONG)wcstol(buf, NULL, 10);
-    }
-    if (GetPrivateProfileStringW(L"Font", L"Italic", L"0", buf, ARRAYSIZE(buf), exePath)) {
-        lf.lfItalic = (BYTE)wcstol(buf, NULL, 10);
-    }
-    if (GetPrivateProfileStringW(L"Font", L"Underline", L"0", buf, ARRAYSIZE(buf), exePath)) {
-        lf.lfUnderline = (BYTE)wcstol(buf, NULL, 10);
-    }
-    if (GetPrivateProfileStringW(L"Font", L"StrikeOut", L"0", buf, ARRAYSIZE(buf), exePath)) {
-        lf.lfStrikeOut = (BYTE)wcstol(buf, NULL, 10);
-    }
-    if (GetPrivateProfileStringW(L"Font", L"CharSet", L"1", buf, ARRAYSIZE(buf), exePath)) {
-        lf.lfCharSet = (BYTE)wcstol(buf, NULL, 10);
-    }
-    if (GetPrivateProfileStringW(L"Font", L"OutPrecision", L"0", buf, ARRAYSIZE(buf), exePath)) {
-        lf.lfOutPrecision = (BYTE)wcstol(buf, NULL, 10);
-    }
-    if (GetPrivateProfileStringW(L"Font", L"ClipPrecision", L"0", buf, ARRAYSIZE(buf), exePath)) {
-        lf.lfClipPrecision = (BYTE)wcstol(buf, NULL, 10);
-    }
-    if (GetPrivateProfileStringW(L"Font", L"Quality", L"0", buf, ARRAYSIZE(buf), exePath)) {
-        lf.lfQuality = (BYTE)wcstol(buf, NULL, 10);
-    }
-    if (GetPrivateProfileStringW(L"Font", L"PitchAndFamily", L"0", buf, ARRAYSIZE(buf), exePath)) {
-        lf.lfPitchAndFamily = (BYTE)wcstol(buf, NULL, 10);
-    }
+    lf.lfHeight = (LONG)SettingsGetInt(L"Font", L"Height", 0);
+    lf.lfWidth = (LONG)SettingsGetInt(L"Font", L"Width", 0);
+    lf.lfEscapement = (LONG)SettingsGetInt(L"Font", L"Escapement", 0);
+    lf.lfOrientation = (LONG)SettingsGetInt(L"Font", L"Orientation", 0);
+    lf.lfWeight = (LONG)SettingsGetInt(L"Font", L"Weight", 0);
+    lf.lfItalic = (BYTE)SettingsGetInt(L"Font", L"Italic", 0);
+    lf.lfUnderline = (BYTE)SettingsGetInt(L"Font", L"Underline", 0);
+    lf.lfStrikeOut = (BYTE)SettingsGetInt(L"Font", L"StrikeOut", 0);
+    lf.lfCharSet = (BYTE)SettingsGetInt(L"Font", L"CharSet", 1);
+    lf.lfOutPrecision = (BYTE)SettingsGetInt(L"Font", L"OutPrecision", 0);
+    lf.lfClipPrecision = (BYTE)SettingsGetInt(L"Font", L"ClipPrecision", 0);
+    lf.lfQuality = (BYTE)SettingsGetInt(L"Font", L"Quality", 0);
+    lf.lfPitchAndFamily = (BYTE)SettingsGetInt(L"Font", L"PitchAndFamily", 0);
 
     HFONT hNewFont = CreateFontIndirectW(&lf);
     if (!hNewFont) return FALSE;
@@ -719,44 +1595,61 @@ static BOOL LoadFontFromIni(void) {
     return TRUE;
 }
 
-static void SaveFontToIni(const LOGFONTW *lf) {
+// Only updates the in-memory store; the ini is written once on exit
+static void SaveFontToSettings(const LOGFONTW *lf) {
     if (!lf) return;
-    WCHAR exePath[MAX_PATH_BUFFER];
-    if (GetModuleFileNameW(NULL, exePath, ARRAYSIZE(exePath)) == 0) return;
-
-    WCHAR *dot = wcsrchr(exePath, L'.');
-    WCHAR *slash = wcsrchr(exePath, L'\\');
-    if (dot && (!slash || dot > slash)) *dot = L'\0';
-    StringCchCatW(exePath, ARRAYSIZE(exePath), L".ini");
-
-    WCHAR buf[64];
-    StringCchPrintfW(buf, ARRAYSIZE(buf), L"%d", lf->lfHeight);
-    WritePrivateProfileStringW(L"Font", L"Height", buf, exePath);
-    StringCchPrintfW(buf, ARRAYSIZE(buf), L"%d", lf->lfWidth);
-    WritePrivateProfileStringW(L"Font", L"Width", buf, exePath);
-    StringCchPrintfW(buf, ARRAYSIZE(buf), L"%d", lf->lfEscapement);
-    WritePrivateProfileStringW(L"Font", L"Escapement", buf, exePath);
-    StringCchPrintfW(buf, ARRAYSIZE(buf), L"%d", lf->lfOrientation);
-    WritePrivateProfileStringW(L"Font", L"Orientation", buf, exePath);
-    StringCchPrintfW(buf, ARRAYSIZE(buf), L"%d", lf->lfWeight);
-    WritePrivateProfileStringW(L"Font", L"Weight", buf, exePath);
-    StringCchPrintfW(buf, ARRAYSIZE(buf), L"%d", lf->lfItalic);
-    WritePrivateProfileStringW(L"Font", L"Italic", buf, exePath);
-    StringCchPrintfW(buf, ARRAYSIZE(buf), L"%d", lf->lfUnderline);
-    WritePrivateProfileStringW(L"Font", L"Underline", buf, exePath);
-    StringCchPrintfW(buf, ARRAYSIZE(buf), L"%d", lf->lfStrikeOut);
-    WritePrivateProfileStringW(L"Font", L"StrikeOut", buf, exePath);
-    StringCchPrintfW(buf, ARRAYSIZE(buf), L"%d", lf->lfCharSet);
-    WritePrivateProfileStringW(L"Font", L"CharSet", buf, exePath);
-    StringCchPrintfW(buf, ARRAYSIZE(buf), L"%d", lf->lfOutPrecision);
-    WritePrivateProfileStringW(L"Font", L"OutPrecision", buf, exePath);
-    StringCchPrintfW(buf, ARRAYSIZE(buf), L"%d", lf->lfClipPrecision);
-    WritePrivateProfileStringW(L"Font", L"ClipPrecision", buf, exePath);
-    StringCchPrintfW(buf, ARRAYSIZE(buf), L"%d", lf->lfQuality);
-    WritePrivateProfileStringW(L"Font", L"Quality", buf, exePath);
-    StringCchPrintfW(buf, ARRAYSIZE(buf), L"%d", lf->lfPitchAndFamily);
-    WritePrivateProfileStringW(L"Font", L"PitchAndFamily", buf, exePath);
-    WritePrivateProfileStringW(L"Font", L"FaceName", lf->lfFaceName, exePath);
+    SettingsSetInt(L"Font", L"Height", lf->lfHeight);
+    SettingsSetInt(L"Font", L"Width", lf->lfWidth);
+    SettingsSetInt(L"Font", L"Escapement", lf->lfEscapement);
+    SettingsSetInt(L"Font", L"Orientation", lf->lfOrientation);
+    SettingsSetInt(L"Font", L"Weight", lf->lfWeight);
+    SettingsSetInt(L"Font", L"Italic", lf->lfItalic);
+    SettingsSetInt(L"Font", L"Underline", lf->lfUnderline);
+    SettingsSetInt(L"Font", L"StrikeOut", lf->lfStrikeOut);
+    SettingsSetInt(L"Font", L"CharSet", lf->lfCharSet);
+    SettingsSetInt(L"Font", L"OutPrecision", lf->lfOutPrecision);
+    SettingsSetInt(L"Font", L"ClipPrecision", lf->lfClipPrecision);
+    SettingsSetInt(L"Font", L"Quality", lf->lfQuality);
+    SettingsSetInt(L"Font", L"PitchAndFamily", lf->lfPitchAndFamily);
+    SettingsSetString(L"Font", L"FaceName", lf->lfFaceName);
+}
+
+static BOOL RestoreWindowPlacement(HWND hwnd, int nCmdShow) {
+    RECT rc;
+    rc.left = SettingsGetInt(L"Window", L"Left", 0);
+    rc.top = SettingsGetInt(L"Window", L"Top", 0);
+    rc.right = SettingsGetInt(L"Window", L"Right", 0);
+    rc.bottom = SettingsGetInt(L"Window", L"Bottom", 0);
+    if (rc.right <= rc.left || rc.bottom <= rc.top) return FALSE;
+
+    WINDOWPLACEMENT wp = {0};
+    wp.length = sizeof(wp);
+    wp.rcNormalPosition = rc;
+    wp.showCmd = nCmdShow;
+    // Respect an explicit minimize/maximize request from the launcher
+    if (SettingsGetBool(L"Window", L"Maximized", FALSE) && (nCmdShow == SW_SHOWNORMAL || nCmdShow == SW_SHOWDEFAULT)) {
+        wp.showCmd = SW_SHOWMAXIMIZED;
+    }
+    return SetWindowPlacement(hwnd, &wp);
+}
+
+static void SaveViewSettings(HWND hwnd) {
+    WINDOWPLACEMENT wp = {0};
+    wp.length = sizeof(wp);
+    if (GetWindowPlacement(hwnd, &wp)) {
+        SettingsSetInt(L"Window", L"Left", wp.rcNormalPosition.left);
+        SettingsSetInt(L"Window", L"Top", wp.rcNormalPosition.top);
+        SettingsSetInt(L"Window", L"Right", wp.rcNormalPosition.right);
+        SettingsSetInt(L"Window", L"Bottom", wp.rcNormalPosition.bottom);
+        SettingsSetBool(L"Window", L"Maximized", wp.showCmd == SW_SHOWMAXIMIZED ||
+                        (wp.showCmd == SW_SHOWMINIMIZED && (wp.flags & WPF_RESTORETOMAXIMIZED)));
+    }
+    SettingsSetBool(L"View", L"WordWrap", g_app.wordWrap);
+    // While wrapped the status bar is force-hidden; persist the user's own choice
+    SettingsSetBool(L"View", L"StatusBar", g_app.wordWrap ? g_app.statusBeforeWrap : g_app.statusVisible);
+    SettingsSetInt(L"Memory", L"DocumentBudgetMB", g_app.budgetMB);
+    SettingsSetInt(L"Memory", L"ReadOnlyAboveMB", g_app.readOnlyAboveMB);
+    SettingsSave();
 }
 
 static void InsertTimeDate(HWND hwnd) {
@@ -769,6 +1662,198 @@ static void InsertTimeDate(HWND hwnd) {
     SendMessageW(g_app.hwndEdit, EM_REPLACESEL, TRUE, (LPARAM)stamp);
 }
 
+// Sorts, dedupes, trims or reverses the selected lines (all of them when nothing is
+// selected) as a single undoable replacement
+static void ApplyLineOperation(HWND hwnd, TextLineOp op) {
+    DWORD selStart = 0, selEnd = 0;
+    SendMessageW(g_app.hwndEdit, EM_GETSEL, (WPARAM)&selStart, (LPARAM)&selEnd);
+
+    DocView view;
+    if (!BeginDocView(g_app.hwndEdit, &view)) return;
+    TRACE_BEGIN(span, "LineOperation");
+    HCURSOR oldCursor = SetCursor(LoadCursorW(NULL, IDC_WAIT));
+
+    // Widen the selection to whole lines, taking the break after the last one along
+    DWORD length = (DWORD)view.length;
+    DWORD start = 0, end = length;
+    if (selStart != selEnd) {
+        start = selStart;
+        end = selEnd;
+        while (start > 0 && view.text[start - 1] != L'\n') --start;
+        if (view.text[end - 1] != L'\n') {
+            while (end < length && view.text[end] != L'\n') ++end;
+            if (end < length) ++end;
+        }
+    }
+
+    size_t resultLen = 0;
+    TextChar *result = TextLinesApply((const TextChar *)view.text + start, end - start, op, 0, &resultLen);
+    BOOL changed = result && (resultLen != end - start ||
+                              memcmp(result, view.text + start, resultLen * sizeof(WCHAR)) != 0);
+    EndDocView(&view);
+
+    if (changed) {
+        SendMessageW(g_app.hwndEdit, EM_SETSEL, start, end);
+        SendMessageW(g_app.hwndEdit, EM_REPLACESEL, TRUE, (LPARAM)result);
+        SendMessageW(g_app.hwndEdit, EM_SETSEL, start, start + (DWORD)resultLen);
+        SendMessageW(g_app.hwndEdit, EM_SCROLLCARET, 0, 0);
+        g_app.modified = TRUE;
+        UpdateTitle(hwnd);
+        UpdateStatusBar(hwnd);
+    }
+    free(result);
+    SetCursor(oldCursor);
+    TRACE_END_BYTES(span, (end - start) * sizeof(WCHAR));
+
+    if (!result) {
+        MessageBoxW(hwnd, L"Not enough memory to rearrange these lines.", APP_TITLE, MB_ICONERROR);
+    }
+}
+
+// Turns highlighting on for `language`, or off with HIGHLIGHT_NONE
+static void SetHighlighting(HWND hwnd, HighlightLanguage language) {
+    HighlighterDestroy(g_app.highlighter);
+    g_app.highlighter = NULL;
+    DocumentDamage damage;
+    DocumentTakeDamage(&damage);    // a new highlighter starts from the current text
+    if (language != HIGHLIGHT_NONE) {
+        g_app.highlighter = HighlighterCreate(language);
+        if (!g_app.highlighter) {
+            MessageBoxW(hwnd, L"Not enough memory to highlight this document.", APP_TITLE, MB_ICONERROR);
+        }
+    }
+    InvalidateRect(g_app.hwndEdit, NULL, TRUE);
+}
+
+// Line height of the font selected into `dc`
+static int EditLineHeight(HDC dc) {
+    TEXTMETRICW tm;
+    GetTextMetricsW(dc, &tm);
+    return tm.tmHeight > 0 ? tm.tmHeight : 1;
+}
+
+// Repaints the visible part of lines first..last (SIZE_MAX: to the bottom)
+static void RepaintEditLines(HWND hwndEdit, size_t first, size_t last) {
+    RECT rc;
+    SendMessageW(hwndEdit, EM_GETRECT, 0, (LPARAM)&rc);
+    HDC dc = GetDC(hwndEdit);
+    HFONT font = (HFONT)SendMessageW(hwndEdit, WM_GETFONT, 0, 0);
+    HGDIOBJ oldFont = font ? SelectObject(dc, font) : NULL;
+    int height = EditLineHeight(dc);
+    if (oldFont) SelectObject(dc, oldFont);
+    ReleaseDC(hwndEdit, dc);
+
+    size_t top = (size_t)SendMessageW(hwndEdit, EM_GETFIRSTVISIBLELINE, 0, 0);
+    size_t shown = (size_t)((rc.bottom - rc.top) / height + 1);
+    if (last < top || first >= top + shown) return;
+    if (first > top) rc.top += (int)(first - top) * height;
+    if (last < top + shown) rc.bottom = min(rc.bottom, rc.top + (int)(last - max(first, top) + 1) * height);
+    InvalidateRect(hwndEdit, &rc, FALSE);
+}
+
+// Hands the document's changed lines to the highlighter, which retokenizes only up
+// to the first checkpoint that comes out the same
+static void ApplyHighlightDamage(HWND hwndEdit, BOOL repaint) {
+    DocumentDamage damage;
+    if (!DocumentTakeDamage(&damage) || !g_app.highlighter) return;
+    const DocStore *store = DocumentStore();
+    if (!store) return;     // highlights wait until the store is rebuilt, which damages everything
+    TRACE_BEGIN(span, "HighlightEdit");
+    HighlighterEdit(g_app.highlighter, store, damage.firstLine, damage.oldLastLine, damage.newLastLine);
+    TRACE_END(span);
+    // Colors below the edit can change too (an opened comment), and moved lines were drawn plain
+    if (repaint && !g_app.wordWrap) RepaintEditLines(hwndEdit, damage.firstLine, SIZE_MAX);
+}
+
+static void RepaintChangedSelection(HWND hwndEdit) {
+    if (!g_app.highlighter || g_app.wordWrap) return;
+    DWORD start = 0, end = 0;
+    SendMessageW(hwndEdit, EM_GETSEL, (WPARAM)&start, (LPARAM)&end);
+    if (start == g_app.paintedSelStart && end == g_app.paintedSelEnd) return;
+    DWORD lo = min(start, g_app.paintedSelStart);
+    DWORD hi = max(end, g_app.paintedSelEnd);
+    g_app.paintedSelStart = start;
+    g_app.paintedSelEnd = end;
+    RepaintEditLines(hwndEdit, (size_t)SendMessageW(hwndEdit, EM_LINEFROMCHAR, lo, 0),
+                     (size_t)SendMessageW(hwndEdit, EM_LINEFROMCHAR, hi, 0));
+}
+
+// Draws text[0..length), which starts at document offset `offset`, where the control
+// put it; tabs are left to the control and each stretch between them placed on its own
+static void DrawEditSpan(HWND hwndEdit, HDC dc, const RECT *clip, size_t offset, const WCHAR *text, size_t length) {
+    size_t i = 0;
+    while (i < length) {
+        if (text[i] == L'\t') {
+            ++i;
+            continue;
+        }
+        size_t end = i;
+        while (end < length && text[end] != L'\t') ++end;
+        LRESULT pos = SendMessageW(hwndEdit, EM_POSFROMCHAR, (WPARAM)(offset + i), 0);
+        if (pos == -1) return;
+        int x = (short)LOWORD(pos);
+        if (x >= clip->right) return;
+        ExtTextOutW(dc, x, (short)HIWORD(pos), ETO_CLIPPED, clip, text + i, (UINT)(end - i), NULL);
+        i = end;
+    }
+}
+
+// Redraws the highlighted runs of the lines inside `update` over the control's plain
+// text. Only these lines are tokenized (plus the walk from the checkpoint above the
+// first), so the cost follows the window size, not the file size.
+static void PaintHighlights(HWND hwndEdit, const RECT *update) {
+    const DocStore *store = DocumentStore();
+    if (!store || g_app.wordWrap) return;
+    ApplyHighlightDamage(hwndEdit, FALSE);
+
+    RECT clip;
+    SendMessageW(hwndEdit, EM_GETRECT, 0, (LPARAM)&clip);
+    int formatTop = clip.top;
+    if (!IntersectRect(&clip, &clip, update)) return;
+
+    TRACE_BEGIN(span, "PaintHighlights");
+    HDC dc = GetDC(hwndEdit);
+    HFONT font = (HFONT)SendMessageW(hwndEdit, WM_GETFONT, 0, 0);
+    HGDIOBJ oldFont = font ? SelectObject(dc, font) : NULL;
+    int height = EditLineHeight(dc);
+    SetBkMode(dc, OPAQUE);
+    SetBkColor(dc, GetSysColor(COLOR_WINDOW));
+    HideCaret(hwndEdit);
+
+    // Selected text keeps the control's selection colors
+    DWORD selStart = 0, selEnd = 0;
+    SendMessageW(hwndEdit, EM_GETSEL, (WPARAM)&selStart, (LPARAM)&selEnd);
+    g_app.paintedSelStart = selStart;
+    g_app.paintedSelEnd = selEnd;
+
+    size_t top = (size_t)SendMessageW(hwndEdit, EM_GETFIRSTVISIBLELINE, 0, 0);
+    size_t first = top + (size_t)max(0, clip.top - formatTop) / (size_t)height;
+    size_t last = top + (size_t)max(0, clip.bottom - formatTop - 1) / (size_t)height;
+    WCHAR text[HIGHLIGHT_MAX_LINE];
+    for (size_t line = first; line <= last; ++line) {
+        size_t lineStart = DocStoreLineStart(store, line);
+        if (lineStart == TEXT_ERROR) break;
+        const HighlightRun *runs;
+        size_t count = HighlighterLine(g_app.highlighter, store, line, &runs);
+        for (size_t r = 0; r < count; ++r) {
+            size_t start = lineStart + runs[r].start;
+            size_t end = start + runs[r].length;
+            DocStoreCopy(store, start, runs[r].length, (TextChar *)text);
+            SetTextColor(dc, g_tokenColors[runs[r].token]);
+            size_t before = min(end, max(start, (size_t)selStart));
+            size_t after = max(start, min(end, (size_t)selEnd));
+            if (selStart == selEnd) before = after = end;
+            DrawEditSpan(hwndEdit, dc, &clip, start, text, before - start);
+            DrawEditSpan(hwndEdit, dc, &clip, after, text + (after - start), end - after);
+        }
+    }
+
+    ShowCaret(hwndEdit);
+    if (oldFont) SelectObject(dc, oldFont);
+    ReleaseDC(hwndEdit, dc);
+    TRACE_END(span);
+}
+
 static void HandleFindReplace(LPFINDREPLACE lpfr) {
     if (lpfr->Flags & FR_DIALOGTERM) {
         g_app.hFindDlg = NULL;
@@ -784,41 +1869,194 @@ static void HandleFindReplace(LPFINDREPLACE lpfr) {
         StringCchCopyW(g_app.replaceText, ARRAYSIZE(g_app.replaceText), lpfr->lpstrReplaceWith);
     }
 
-    BOOL matchCase = (lpfr->Flags & FR_MATCHCASE) != 0;
+    unsigned options = FindOptions(lpfr->Flags);
     BOOL down = (lpfr->Flags & FR_DOWN) != 0;
 
     if (lpfr->Flags & FR_FINDNEXT) {
         DWORD start = 0, end = 0;
         SendMessageW(g_app.hwndEdit, EM_GETSEL, (WPARAM)&start, (LPARAM)&end);
-        DWORD searchStart = down ? end : start;
-        DWORD outStart = 0, outEnd = 0;
-        if (FindInEdit(g_app.hwndEdit, g_app.findText, matchCase, down, searchStart, &outStart, &outEnd)) {
-            SendMessageW(g_app.hwndEdit, EM_SETSEL, outStart, outEnd);
-            SendMessageW(g_app.hwndEdit, EM_SCROLLCARET, 0, 0);
-        } else {
+        BOOL found = g_app.storeViewMode ? FindInStoreView(options, down) : FindAndSelect(options, down, down ? end : start);
+        if (!found) {
             MessageBoxW(g_app.hwndMain, L"Cannot find the text.", APP_TITLE, MB_ICONINFORMATION);
         }
     } else if (lpfr->Flags & FR_REPLACE) {
         DWORD start = 0, end = 0;
         SendMessageW(g_app.hwndEdit, EM_GETSEL, (WPARAM)&start, (LPARAM)&end);
-        DWORD outStart = 0, outEnd = 0;
-        if (FindInEdit(g_app.hwndEdit, g_app.findText, matchCase, down, start, &outStart, &outEnd)) {
-            SendMessageW(g_app.hwndEdit, EM_SETSEL, outStart, outEnd);
+        if (FindAndSelect(options, down, start)) {
             SendMessageW(g_app.hwndEdit, EM_REPLACESEL, TRUE, (LPARAM)g_app.replaceText);
             SendMessageW(g_app.hwndEdit, EM_SCROLLCARET, 0, 0);
+            // The scope grows or shrinks with the replacement and still holds the caret
+            DWORD caret = g_app.foundStart + (DWORD)wcslen(g_app.replaceText);
+            g_app.scopeEnd = g_app.scopeEnd + caret - g_app.foundEnd;
+            g_app.foundStart = g_app.foundEnd = caret;
             g_app.modified = TRUE;
             UpdateTitle(g_app.hwndMain);
         } else {
             MessageBoxW(g_app.hwndMain, L"Cannot find the text.", APP_TITLE, MB_ICONINFORMATION);
         }
     } else if (lpfr->Flags & FR_REPLACEALL) {
-        int replaced = ReplaceAllOccurrences(g_app.hwndEdit, g_app.findText, g_app.replaceText, matchCase);
+        int replaced = g_app.findInSelection
+                           ? ReplaceAllInScope(g_app.hwndEdit, g_app.findText, g_app.replaceText, options)
+                           : ReplaceAllOccurrences(g_app.hwndEdit, g_app.findText, g_app.replaceText, options);
         WCHAR msg[64];
         StringCchPrintfW(msg, ARRAYSIZE(msg), L"Replaced %d occurrence%s.", replaced, replaced == 1 ? L"" : L"s");
         MessageBoxW(g_app.hwndMain, msg, APP_TITLE, MB_OK | MB_ICONINFORMATION);
     }
 }
 
+static void EnsureTracePath(void) {
+    if (g_tracePath[0] != L'\0') return;
+    DWORD len = GetTempPathW(ARRAYSIZE(g_tracePath), g_tracePath);
+    if (len == 0 || len >= ARRAYSIZE(g_tracePath)) g_tracePath[0] = L'\0';
+    StringCchCatW(g_tracePath, ARRAYSIZE(g_tracePath), L"retropad-trace.json");
+}
+
+// Hidden Ctrl+Alt+Shift+T: first press starts capturing, second press writes the trace
+static void ToggleTraceCapture(HWND hwnd) {
+    if (!g_traceEnabled) {
+        TraceEnable(TRUE);
+        MessageBoxW(hwnd, L"Tracing enabled. Press Ctrl+Alt+Shift+T again to write the trace.", APP_TITLE, MB_ICONINFORMATION);
+        return;
+    }
+
+    EnsureTracePath();
+    TraceEnable(FALSE);
+
+    WCHAR msg[MAX_PATH_BUFFER + 64];
+    if (TraceDumpJson(g_tracePath)) {
+        StringCchPrintfW(msg, ARRAYSIZE(msg), L"Trace written to %s", g_tracePath);
+        MessageBoxW(hwnd, msg, APP_TITLE, MB_ICONINFORMATION);
+    } else {
+        StringCchPrintfW(msg, ARRAYSIZE(msg), L"Unable to write trace to %s", g_tracePath);
+        MessageBoxW(hwnd, msg, APP_TITLE, MB_ICONERROR);
+    }
+}
+
+// /trace or --trace[=path] records from startup and writes the trace on exit
+static void ParseTraceSwitch(void) {
+    int argc = 0;
+    LPWSTR *argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    if (!argv) return;
+    for (int i = 1; i < argc; ++i) {
+        if (lstrcmpiW(argv[i], L"/trace") == 0 || lstrcmpiW(argv[i], L"--trace") == 0) {
+            g_traceDumpOnExit = TRUE;
+        } else if (wcsncmp(argv[i], L"--trace=", 8) == 0 && argv[i][8]) {
+            g_traceDumpOnExit = TRUE;
+            StringCchCopyW(g_tracePath, ARRAYSIZE(g_tracePath), argv[i] + 8);
+        }
+    }
+    LocalFree(argv);
+
+    if (g_traceDumpOnExit) {
+        EnsureTracePath();
+        TraceEnable(TRUE);
+    }
+}
+
+// The first argument that isn't a switch names a file to open and --line=N puts the caret
+// on its line N; --new-window opens it here even in single-instance mode
+static void ParseOpenRequest(OpenRequest *request, BOOL *newWindow) {
+    int argc = 0;
+    LPWSTR *argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    if (!argv) return;
+    for (int i = 1; i < argc; ++i) {
+        if (wcsncmp(argv[i], L"--line=", 7) == 0) {
+            request->line = (UINT)wcstoul(argv[i] + 7, NULL, 10);
+        } else if (lstrcmpiW(argv[i], L"--new-window") == 0) {
+            *newWindow = TRUE;
+        } else if (argv[i][0] != L'-' && argv[i][0] != L'/' && !request->path[0]) {
+            // Made absolute here: the running instance has its own current directory
+            DWORD length = GetFullPathNameW(argv[i], ARRAYSIZE(request->path), request->path, NULL);
+            if (length == 0 || length >= ARRAYSIZE(request->path)) request->path[0] = L'\0';
+        }
+    }
+    LocalFree(argv);
+}
+
+// Single-instance mode: hands the request to a running instance's window, waiting for
+// one that is still starting up to create it. FALSE to open the file here.
+static BOOL ForwardToRunningInstance(const OpenRequest *request) {
+    HWND target = FindWindowW(MAIN_CLASS_NAME, NULL);
+    for (DWORD waited = 0; !target && waited < INSTANCE_WAIT_MS; waited += 50) {
+        Sleep(50);
+        target = FindWindowW(MAIN_CLASS_NAME, NULL);
+    }
+    if (!target) return FALSE;
+
+    // Lets the running instance come to the front, which it couldn't do on its own
+    DWORD processId = 0;
+    GetWindowThreadProcessId(target, &processId);
+    AllowSetForegroundWindow(processId);
+    COPYDATASTRUCT data;
+    data.dwData = COPYDATA_OPEN_REQUEST;
+    data.cbData = sizeof(*request);
+    data.lpData = (PVOID)request;
+    DWORD_PTR accepted = 0;
+    return SendMessageTimeoutW(target, WM_COPYDATA, 0, (LPARAM)&data, SMTO_ABORTIFHUNG, INSTANCE_WAIT_MS,
+                               &accepted) && accepted;
+}
+
+// Opens a command line's file, this process's own or another instance's. The trace span
+// runs from that process's start to the file on screen, so a handoff can be compared
+// with a cold start.
+static void OpenRequestedFile(HWND hwnd, const OpenRequest *request) {
+    if (PromptSaveChanges(hwnd) && LoadDocumentFromPath(hwnd, request->path, NULL) && request->line &&
+        !g_app.hexMode) {
+        GoToLine(request->line);
+    }
+    if (g_traceEnabled) TraceRecord("OpenRequest", request->startedAt, TraceNow(), 0);
+}
+
+// Another instance's request waits while a modal dialog is up, since answering the
+// dialog may change the document
+static void OpenPendingRequest(HWND hwnd) {
+    if (!g_app.openPending) return;
+    if (!IsWindowEnabled(hwnd)) {
+        SetTimer(hwnd, IDT_OPEN_REQUEST, OPEN_RETRY_MS, NULL);
+        return;
+    }
+    g_app.openPending = FALSE;
+    OpenRequest request = g_app.openRequest;
+    OpenRequestedFile(hwnd, &request);
+}
+
+// Commands that act on the document, so have nothing to do while the hex view shows
+static const UINT g_textOnlyCommands[] = {
+    IDM_FILE_SAVE,          IDM_FILE_SAVE_AS,          IDM_FILE_PAGE_SETUP,         IDM_FILE_PRINT,
+    IDM_FILE_PROPERTIES,    IDM_FILE_COMPARE,          IDM_EDIT_UNDO,               IDM_EDIT_CUT,
+    IDM_EDIT_COPY,          IDM_EDIT_PASTE,            IDM_EDIT_DELETE,             IDM_EDIT_REPLACE,
+    IDM_EDIT_SELECT_ALL,    IDM_EDIT_TIME_DATE,        IDM_EDIT_LINES_SORT,         IDM_EDIT_LINES_SORT_NOCASE,
+    IDM_EDIT_LINES_SORT_NUMERIC, IDM_EDIT_LINES_DEDUPE, IDM_EDIT_LINES_TRIM,        IDM_EDIT_LINES_REVERSE,
+    IDM_FORMAT_WORD_WRAP,   IDM_FORMAT_FONT,           IDM_FORMAT_EOL_CRLF,         IDM_FORMAT_EOL_LF,
+    IDM_FORMAT_EOL_CR,      IDM_VIEW_HIGHLIGHT_NONE,   IDM_VIEW_HIGHLIGHT_LOG,      IDM_VIEW_HIGHLIGHT_INI,
+    IDM_VIEW_HIGHLIGHT_JSON,
+};
+
+// Commands that need the document in the EDIT control, so have nothing to do while the
+// store view shows it read-only
+static const UINT g_editOnlyCommands[] = {
+    IDM_FILE_PAGE_SETUP,    IDM_FILE_PRINT,            IDM_FILE_COMPARE,            IDM_EDIT_UNDO,
+    IDM_EDIT_CUT,           IDM_EDIT_PASTE,            IDM_EDIT_DELETE,             IDM_EDIT_REPLACE,
+    IDM_EDIT_TIME_DATE,     IDM_EDIT_LINES_SORT,       IDM_EDIT_LINES_SORT_NOCASE,  IDM_EDIT_LINES_SORT_NUMERIC,
+    IDM_EDIT_LINES_DEDUPE,  IDM_EDIT_LINES_TRIM,       IDM_EDIT_LINES_REVERSE,      IDM_FORMAT_WORD_WRAP,
+    IDM_FORMAT_FONT,        IDM_VIEW_HIGHLIGHT_NONE,   IDM_VIEW_HIGHLIGHT_LOG,      IDM_VIEW_HIGHLIGHT_INI,
+    IDM_VIEW_HIGHLIGHT_JSON,
+};
+
+static BOOL IsTextOnlyCommand(UINT id) {
+    for (size_t i = 0; i < ARRAYSIZE(g_textOnlyCommands); ++i) {
+        if (g_textOnlyCommands[i] == id) return TRUE;
+    }
+    return FALSE;
+}
+
+static BOOL IsEditOnlyCommand(UINT id) {
+    for (size_t i = 0; i < ARRAYSIZE(g_editOnlyCommands); ++i) {
+        if (g_editOnlyCommands[i] == id) return TRUE;
+    }
+    return FALSE;
+}
+
 static void UpdateMenuStates(HWND hwnd) {
     HMENU menu = GetMenu(hwnd);
     if (!menu) return;
@@ -827,8 +2065,21 @@ static void UpdateMenuStates(HWND hwnd) {
     UINT statusState = g_app.statusVisible ? MF_CHECKED : MF_UNCHECKED;
     CheckMenuItem(menu, IDM_FORMAT_WORD_WRAP, MF_BYCOMMAND | wrapState);
     CheckMenuItem(menu, IDM_VIEW_STATUS_BAR, MF_BYCOMMAND | statusState);
+    CheckMenuRadioItem(menu, IDM_FORMAT_EOL_CRLF, IDM_FORMAT_EOL_CR, IDM_FORMAT_EOL_CRLF + g_app.encoding.eol, MF_BYCOMMAND);
+    HighlightLanguage language = g_app.highlighter ? HighlighterLanguage(g_app.highlighter) : HIGHLIGHT_NONE;
+    CheckMenuRadioItem(menu, IDM_VIEW_HIGHLIGHT_NONE, IDM_VIEW_HIGHLIGHT_JSON, IDM_VIEW_HIGHLIGHT_NONE + language,
+                       MF_BYCOMMAND);
+
+    CheckMenuItem(menu, IDM_VIEW_HEX, MF_BYCOMMAND | (g_app.hexMode ? MF_CHECKED : MF_UNCHECKED));
+    EnableMenuItem(menu, IDM_VIEW_HEX, MF_BYCOMMAND | (g_app.hexMode || g_app.currentPath[0] ? MF_ENABLED : MF_GRAYED));
+    for (size_t i = 0; i < ARRAYSIZE(g_textOnlyCommands); ++i) {
+        EnableMenuItem(menu, g_textOnlyCommands[i], MF_BYCOMMAND | (g_app.hexMode ? MF_GRAYED : MF_ENABLED));
+    }
+    for (size_t i = 0; g_app.storeViewMode && i < ARRAYSIZE(g_editOnlyCommands); ++i) {
+        EnableMenuItem(menu, g_editOnlyCommands[i], MF_BYCOMMAND | MF_GRAYED);
+    }
 
-    BOOL canGoTo = !g_app.wordWrap;
+    BOOL canGoTo = g_app.hexMode || g_app.storeViewMode || !g_app.wordWrap;
     EnableMenuItem(menu, IDM_EDIT_GOTO, MF_BYCOMMAND | (canGoTo ? MF_ENABLED : MF_GRAYED));
     if (g_app.wordWrap) {
         EnableMenuItem(menu, IDM_VIEW_STATUS_BAR, MF_BYCOMMAND | MF_GRAYED);
@@ -837,10 +2088,13 @@ static void UpdateMenuStates(HWND hwnd) {
     }
 
     BOOL modified = (SendMessageW(g_app.hwndEdit, EM_GETMODIFY, 0, 0) != 0);
-    EnableMenuItem(menu, IDM_FILE_SAVE, MF_BYCOMMAND | (modified ? MF_ENABLED : MF_GRAYED));
+    EnableMenuItem(menu, IDM_FILE_SAVE, MF_BYCOMMAND | (modified && !g_app.hexMode ? MF_ENABLED : MF_GRAYED));
 }
 
 static void HandleCommand(HWND hwnd, WPARAM wParam, LPARAM lParam) {
+    // Accelerators still arrive for grayed items
+    if (g_app.hexMode && IsTextOnlyCommand(LOWORD(wParam))) return;
+    if (g_app.storeViewMode && IsEditOnlyCommand(LOWORD(wParam))) return;
     switch (LOWORD(wParam)) {
     case IDM_FILE_NEW:
         DoFileNew(hwnd);
@@ -854,6 +2108,12 @@ static void HandleCommand(HWND hwnd, WPARAM wParam, LPARAM lParam) {
     case IDM_FILE_SAVE_AS:
         DoFileSave(hwnd, TRUE);
         break;
+    case IDM_FILE_PROPERTIES:
+        DialogBoxW(g_hInst, MAKEINTRESOURCE(IDD_PROPERTIES), hwnd, PropertiesDlgProc);
+        break;
+    case IDM_FILE_COMPARE:
+        DoCompareWithFile(hwnd);
+        break;
     case IDM_FILE_PAGE_SETUP:
     case IDM_FILE_PRINT:
         MessageBoxW(hwnd, L"Printing is not implemented in retropad.", APP_TITLE, MB_ICONINFORMATION);
@@ -869,7 +2129,11 @@ static void HandleCommand(HWND hwnd, WPARAM wParam, LPARAM lParam) {
         SendMessageW(g_app.hwndEdit, WM_CUT, 0, 0);
         break;
     case IDM_EDIT_COPY:
-        SendMessageW(g_app.hwndEdit, WM_COPY, 0, 0);
+        if (g_app.storeViewMode) {
+            CopySelectionDeferred(g_app.hwndEdit);
+        } else {
+            SendMessageW(g_app.hwndEdit, WM_COPY, 0, 0);
+        }
         break;
     case IDM_EDIT_PASTE:
         DoPasteWithNormalizedLineEndings(hwnd);
@@ -878,27 +2142,49 @@ static void HandleCommand(HWND hwnd, WPARAM wParam, LPARAM lParam) {
         SendMessageW(g_app.hwndEdit, WM_CLEAR, 0, 0);
         break;
     case IDM_EDIT_FIND:
-        ShowFindDialog(hwnd);
+        if (g_app.hexMode) {
+            DoHexFind(hwnd, TRUE);
+        } else {
+            ShowFindDialog(hwnd);
+        }
         break;
     case IDM_EDIT_FIND_NEXT:
-        DoFindNext(FALSE);
+        if (g_app.hexMode) {
+            DoHexFind(hwnd, FALSE);
+        } else {
+            DoFindNext(FALSE);
+        }
         break;
     case IDM_EDIT_REPLACE:
         ShowReplaceDialog(hwnd);
         break;
     case IDM_EDIT_GOTO:
-        if (g_app.wordWrap) {
+        if (g_app.hexMode) {
+            DoHexGoTo(hwnd);
+        } else if (g_app.wordWrap && !g_app.storeViewMode) {
             MessageBoxW(hwnd, L"Go To is unavailable when Word Wrap is on.", APP_TITLE, MB_ICONINFORMATION);
         } else {
             DialogBoxW(g_hInst, MAKEINTRESOURCE(IDD_GOTO), hwnd, GoToDlgProc);
         }
         break;
     case IDM_EDIT_SELECT_ALL:
-        SendMessageW(g_app.hwndEdit, EM_SETSEL, 0, -1);
+        if (g_app.storeViewMode) {
+            StoreViewSelect(g_app.hwndStoreView, SIZE_MAX, 0);
+        } else {
+            SendMessageW(g_app.hwndEdit, EM_SETSEL, 0, -1);
+        }
         break;
     case IDM_EDIT_TIME_DATE:
         InsertTimeDate(hwnd);
         break;
+    case IDM_EDIT_LINES_SORT:
+    case IDM_EDIT_LINES_SORT_NOCASE:
+    case IDM_EDIT_LINES_SORT_NUMERIC:
+    case IDM_EDIT_LINES_DEDUPE:
+    case IDM_EDIT_LINES_TRIM:
+    case IDM_EDIT_LINES_REVERSE:
+        ApplyLineOperation(hwnd, (TextLineOp)(LOWORD(wParam) - IDM_EDIT_LINES_SORT));
+        break;
 
     case IDM_FORMAT_WORD_WRAP:
         SetWordWrap(hwnd, !g_app.wordWrap);
@@ -906,10 +2192,24 @@ static void HandleCommand(HWND hwnd, WPARAM wParam, LPARAM lParam) {
     case IDM_FORMAT_FONT:
         DoSelectFont(hwnd);
         break;
+    case IDM_FORMAT_EOL_CRLF:
+    case IDM_FORMAT_EOL_LF:
+    case IDM_FORMAT_EOL_CR:
+        SetLineEndings(hwnd, (TextEol)(LOWORD(wParam) - IDM_FORMAT_EOL_CRLF));
+        break;
 
     case IDM_VIEW_STATUS_BAR:
         ToggleStatusBar(hwnd, !g_app.statusVisible);
         break;
+    case IDM_VIEW_HEX:
+        ToggleHexView(hwnd);
+        break;
+    case IDM_VIEW_HIGHLIGHT_NONE:
+    case IDM_VIEW_HIGHLIGHT_LOG:
+    case IDM_VIEW_HIGHLIGHT_INI:
+    case IDM_VIEW_HIGHLIGHT_JSON:
+        SetHighlighting(hwnd, (HighlightLanguage)(LOWORD(wParam) - IDM_VIEW_HIGHLIGHT_NONE));
+        break;
 
     case IDM_HELP_VIEW_HELP:
         MessageBoxW(hwnd, L"No help file is available for retropad.", APP_TITLE, MB_ICONINFORMATION);
@@ -917,6 +2217,14 @@ static void HandleCommand(HWND hwnd, WPARAM wParam, LPARAM lParam) {
     case IDM_HELP_ABOUT:
         DialogBoxW(g_hInst, MAKEINTRESOURCE(IDD_ABOUT), hwnd, AboutDlgProc);
         break;
+
+    case IDM_DEBUG_TRACE:
+        ToggleTraceCapture(hwnd);
+        break;
+
+    default:
+        if (IsRecentFileCommand(LOWORD(wParam))) DoOpenRecent(hwnd, LOWORD(wParam) - IDM_FILE_RECENT_FIRST);
+        break;
     }
 }
 
@@ -934,6 +2242,107 @@ static INT_PTR CALLBACK AboutDlgProc(HWND dlg, UINT msg, WPARAM wParam, LPARAM l
     return FALSE;
 }
 
+static void SetDlgItemCount(HWND dlg, int id, ULONGLONG value) {
+    WCHAR text[32];
+    StringCchPrintfW(text, ARRAYSIZE(text), L"%llu", value);
+    SetDlgItemTextW(dlg, id, text);
+}
+
+// Selects change `index` in the diff and puts the document's caret on its first line
+static void ShowCompareChange(HWND dlg, CompareView *compare, size_t index) {
+    compare->current = index;
+    size_t start = compare->offsets[index];
+    size_t end = start;
+    while (compare->text[end] && compare->text[end] != L'\r') ++end;
+    HWND text = GetDlgItem(dlg, IDC_COMPARE_TEXT);
+    SendMessageW(text, EM_SETSEL, (WPARAM)start, (LPARAM)end);
+    SendMessageW(text, EM_SCROLLCARET, 0, 0);
+
+    const DocStore *store = DocumentStore();
+    size_t line = compare->diff.hunks[index].newLine;
+    int charIndex = store ? (int)DocStoreLineStart(store, line) : (int)SendMessageW(g_app.hwndEdit, EM_LINEINDEX, line, 0);
+    if (charIndex < 0) charIndex = GetWindowTextLengthW(g_app.hwndEdit);
+    SendMessageW(g_app.hwndEdit, EM_SETSEL, charIndex, charIndex);
+    SendMessageW(g_app.hwndEdit, EM_SCROLLCARET, 0, 0);
+
+    EnableWindow(GetDlgItem(dlg, IDC_COMPARE_PREV), index > 0);
+    EnableWindow(GetDlgItem(dlg, IDC_COMPARE_NEXT), index + 1 < compare->diff.count);
+}
+
+static INT_PTR CALLBACK CompareDlgProc(HWND dlg, UINT msg, WPARAM wParam, LPARAM lParam) {
+    CompareView *compare = (CompareView *)GetWindowLongPtrW(dlg, GWLP_USERDATA);
+    switch (msg) {
+    case WM_INITDIALOG: {
+        compare = (CompareView *)lParam;
+        SetWindowLongPtrW(dlg, GWLP_USERDATA, (LONG_PTR)compare);
+        size_t removed = 0, added = 0;
+        for (size_t i = 0; i < compare->diff.count; ++i) {
+            removed += compare->diff.hunks[i].oldCount;
+            added += compare->diff.hunks[i].newCount;
+        }
+        WCHAR summary[160];
+        StringCchPrintfW(summary, ARRAYSIZE(summary), L"%zu changes: %zu lines removed, %zu added%s",
+                         compare->diff.count, removed, added,
+                         compare->diff.approximate ? L" (approximate: the files differ too much for a minimal diff)" : L"");
+        SetDlgItemTextW(dlg, IDC_COMPARE_SUMMARY, summary);
+        HWND text = GetDlgItem(dlg, IDC_COMPARE_TEXT);
+        SendMessageW(text, EM_SETLIMITTEXT, 0, 0);
+        if (g_app.hFont) SendMessageW(text, WM_SETFONT, (WPARAM)g_app.hFont, FALSE);
+        SetWindowTextW(text, compare->text);
+        ShowCompareChange(dlg, compare, 0);
+        return TRUE;
+    }
+    case WM_COMMAND:
+        switch (LOWORD(wParam)) {
+        case IDC_COMPARE_NEXT:
+            if (compare->current + 1 < compare->diff.count) ShowCompareChange(dlg, compare, compare->current + 1);
+            return TRUE;
+        case IDC_COMPARE_PREV:
+            if (compare->current > 0) ShowCompareChange(dlg, compare, compare->current - 1);
+            return TRUE;
+        case IDOK:
+        case IDCANCEL:
+            EndDialog(dlg, LOWORD(wParam));
+            return TRUE;
+        }
+        break;
+    }
+    return FALSE;
+}
+
+// File > Properties: all figures come from the document's running counts
+static INT_PTR CALLBACK PropertiesDlgProc(HWND dlg, UINT msg, WPARAM wParam, LPARAM lParam) {
+    (void)lParam;
+    switch (msg) {
+    case WM_INITDIALOG: {
+        TextStats stats;
+        DocumentGetTextStats(g_app.hwndEdit, &stats);
+        WCHAR text[128];
+        SetDlgItemTextW(dlg, IDC_PROP_PATH, g_app.currentPath[0] ? g_app.currentPath : L"(not saved)");
+        EncodingDisplayName(&g_app.encoding, text, ARRAYSIZE(text));
+        SetDlgItemTextW(dlg, IDC_PROP_ENCODING, text);
+        StringCchPrintfW(text, ARRAYSIZE(text), L"%s%s", g_app.encoding.eolMixed ? L"Mixed, saving as " : L"",
+                         g_eolNames[g_app.encoding.eol]);
+        SetDlgItemTextW(dlg, IDC_PROP_EOL, text);
+        SetDlgItemCount(dlg, IDC_PROP_LINES, (ULONGLONG)stats.lineBreaks + 1);
+        SetDlgItemCount(dlg, IDC_PROP_WORDS, stats.words);
+        SetDlgItemCount(dlg, IDC_PROP_CHARS, stats.chars);
+        ULONGLONG size = 0;
+        BOOL exact = EncodedTextSize(&stats, &g_app.encoding, &size);
+        StringCchPrintfW(text, ARRAYSIZE(text), L"%s%llu bytes", exact ? L"" : L"about ", size);
+        SetDlgItemTextW(dlg, IDC_PROP_SIZE, text);
+        return TRUE;
+    }
+    case WM_COMMAND:
+        if (LOWORD(wParam) == IDOK || LOWORD(wParam) == IDCANCEL) {
+            EndDialog(dlg, LOWORD(wParam));
+            return TRUE;
+        }
+        break;
+    }
+    return FALSE;
+}
+
 static LRESULT CALLBACK MainWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
     if (msg == g_findMsg) {
         HandleFindReplace((LPFINDREPLACE)lParam);
@@ -945,14 +2354,22 @@ static LRESULT CALLBACK MainWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM l
         INITCOMMONCONTROLSEX icc = { sizeof(icc), ICC_BAR_CLASSES };
         InitCommonControlsEx(&icc);
         CreateEditControl(hwnd);
-        ToggleStatusBar(hwnd, TRUE);
+        DocumentReplace(g_app.hwndEdit, DocumentNewStore());
+        ToggleStatusBar(hwnd, g_app.wordWrap ? FALSE : g_app.statusBeforeWrap);
         UpdateTitle(hwnd);
         UpdateStatusBar(hwnd);
         DragAcceptFiles(hwnd, TRUE);
+        g_app.jobs = JobPoolCreate(0, PostJobsDone, hwnd);
         return 0;
     }
     case WM_SETFOCUS:
-        if (g_app.hwndEdit) SetFocus(g_app.hwndEdit);
+        if (g_app.hexMode) {
+            SetFocus(g_app.hwndHex);
+        } else if (g_app.storeViewMode) {
+            SetFocus(g_app.hwndStoreView);
+        } else if (g_app.hwndEdit) {
+            SetFocus(g_app.hwndEdit);
+        }
         return 0;
     case WM_SIZE:
         UpdateLayout(hwnd);
@@ -963,7 +2380,7 @@ static LRESULT CALLBACK MainWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM l
         WCHAR path[MAX_PATH_BUFFER];
         if (DragQueryFileW(hDrop, 0, path, ARRAYSIZE(path))) {
             if (PromptSaveChanges(hwnd)) {
-                LoadDocumentFromPath(hwnd, path);
+                LoadDocumentFromPath(hwnd, path, NULL);
             }
         }
         DragFinish(hDrop);
@@ -971,6 +2388,9 @@ static LRESULT CALLBACK MainWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM l
     }
     case WM_COMMAND:
         if (HIWORD(wParam) == EN_CHANGE && (HWND)lParam == g_app.hwndEdit) {
+            DocumentNoteChange(g_app.hwndEdit);
+            // Restarts the countdown; cold chunks are packed once editing pauses
+            SetTimer(hwnd, IDT_DOC_IDLE, DOC_IDLE_MS, NULL);
             g_app.modified = (SendMessageW(g_app.hwndEdit, EM_GETMODIFY, 0, 0) != 0);
             UpdateTitle(hwnd);
             UpdateStatusBar(hwnd);
@@ -981,15 +2401,95 @@ static LRESULT CALLBACK MainWndProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM l
         }
         HandleCommand(hwnd, wParam, lParam);
         return 0;
-    case WM_INITMENUPOPUP:
+    case WM_INITMENUPOPUP: {
+        // Recent Files is the popup whose first item is one of its commands
+        UINT first = GetMenuItemID((HMENU)wParam, 0);
+        if (first == IDM_FILE_RECENT_NONE || IsRecentFileCommand(first)) FillRecentMenu((HMENU)wParam);
         UpdateMenuStates(hwnd);
         return 0;
+    }
     case WM_CLOSE:
         if (PromptSaveChanges(hwnd)) {
+            SaveViewSettings(hwnd);
             DestroyWindow(hwnd);
         }
         return 0;
+    case WM_RENDERFORMAT:
+        if (wParam == CF_UNICODETEXT && g_app.copyPending) {
+            HANDLE data = RenderPendingCopy();
+            if (data && !SetClipboardData(CF_UNICODETEXT, data)) {
+                GlobalFree(data);
+            }
+            g_app.copyPending = FALSE;
+        }
+        return 0;
+    case WM_RENDERALLFORMATS:
+        FlushPendingCopy();
+        return 0;
+    case WM_DESTROYCLIPBOARD:
+        g_app.copyPending = FALSE;
+        return 0;
+    case WM_COMPACTING:
+        ScratchTrim();
+        DocumentCompactIdle();
+        return 0;
+    case WM_TIMER:
+        if (wParam == IDT_DOC_IDLE) {
+            KillTimer(hwnd, IDT_DOC_IDLE);
+            DocumentCompactIdle();
+            return 0;
+        }
+        if (wParam == IDT_FILE_CHANGED) {
+            KillTimer(hwnd, IDT_FILE_CHANGED);
+            CheckFileOnDisk(hwnd);
+            return 0;
+        }
+        if (wParam == IDT_OPEN_REQUEST) {
+            KillTimer(hwnd, IDT_OPEN_REQUEST);
+            OpenPendingRequest(hwnd);
+            return 0;
+        }
+        break;
+    case WM_COPYDATA: {
+        const COPYDATASTRUCT *data = (const COPYDATASTRUCT *)lParam;
+        if (data->dwData != COPYDATA_OPEN_REQUEST || data->cbData != sizeof(OpenRequest)) return FALSE;
+        // Copied and opened after replying, so the other process can exit right away
+        CopyMemory(&g_app.openRequest, data->lpData, sizeof(OpenRequest));
+        g_app.openRequest.path[ARRAYSIZE(g_app.openRequest.path) - 1] = L'\0';
+        g_app.openPending = TRUE;
+        PostMessageW(hwnd, WM_APP_OPEN_REQUEST, 0, 0);
+        return TRUE;
+    }
+    case WM_APP_OPEN_REQUEST:
+        if (IsIconic(hwnd)) ShowWindow(hwnd, SW_RESTORE);
+        SetForegroundWindow(hwnd);
+        OpenPendingRequest(hwnd);
+        return 0;
+    case WM_APP_HEX_SELECTION:
+    case WM_APP_STORE_SELECTION:
+        UpdateStatusBar(hwnd);
+        return 0;
+    case WM_APP_JOBS_DONE:
+        JobPoolDrain(g_app.jobs);
+        TraceJobStats();
+        return 0;
+    case WM_APP_FILE_CHANGED:
+        // Restarts the countdown, so a large write is checked once, after it ends
+        SetTimer(hwnd, IDT_FILE_CHANGED, FILE_SETTLE_MS, NULL);
+        return 0;
+    case WM_ENDSESSION:
+        if (wParam) {
+            SaveViewSettings(hwnd);
+        }
+        return 0;
     case WM_DESTROY:
+        FileWatchStop();
+        CancelHashCheck();
+        JobPoolDestroy(g_app.jobs);
+        g_app.jobs = NULL;
+        HighlighterDestroy(g_app.highlighter);
+        g_app.highlighter = NULL;
+        DocumentFree();
         PostQuitMessage(0);
         return 0;
     }
@@ -1001,11 +2501,42 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmd
     (void)lpCmdLine;
 
     g_hInst = hInstance;
+    OpenRequest request = {TraceNow(), 0, L""};
+    // retropad --convert ... runs headless and never creates a window
+    int argc = 0;
+    LPWSTR *argv = CommandLineToArgvW(GetCommandLineW(), &argc);
+    if (argv && argc > 1 && lstrcmpiW(argv[1], L"--convert") == 0) {
+        int code = BatchConvertMain(argc - 2, argv + 2);
+        LocalFree(argv);
+        return code;
+    }
+    if (argv) LocalFree(argv);
+    // Every instance holds the mutex (until exit), so when it is new no other instance
+    // runs and there is no window to look for
+    HANDLE instanceMutex = CreateMutexW(NULL, FALSE, INSTANCE_MUTEX_NAME);
+    BOOL othersRunning = instanceMutex && GetLastError() == ERROR_ALREADY_EXISTS;
+    BOOL newWindow = FALSE;
+    ParseOpenRequest(&request, &newWindow);
+    SettingsLoad(); // Single read of retropad.ini; everything below uses the in-memory table
+    // Checked first so a handed-off file skips the rest of startup
+    if (request.path[0] && othersRunning && !newWindow && SettingsGetBool(L"General", L"SingleInstance", FALSE) &&
+        ForwardToRunningInstance(&request)) {
+        SettingsFree();
+        return 0;
+    }
     g_findMsg = RegisterWindowMessageW(FINDMSGSTRINGW);
-    g_app.wordWrap = FALSE;
-    g_app.statusVisible = TRUE;
-    g_app.statusBeforeWrap = TRUE;
-    g_app.encoding = ENC_UTF8;
+    ParseTraceSwitch();
+    g_app.wordWrap = SettingsGetBool(L"View", L"WordWrap", FALSE);
+    g_app.statusVisible = FALSE;
+    g_app.statusBeforeWrap = SettingsGetBool(L"View", L"StatusBar", TRUE);
+    g_app.budgetMB = SettingsGetInt(L"Memory", L"DocumentBudgetMB", DEFAULT_BUDGET_MB);
+    if (g_app.budgetMB < 0) g_app.budgetMB = 0;
+    DocumentSetBudget((size_t)g_app.budgetMB << 20);
+    g_app.readOnlyAboveMB = SettingsGetInt(L"Memory", L"ReadOnlyAboveMB", 0);
+    if (g_app.readOnlyAboveMB < 0) g_app.readOnlyAboveMB = 0;
+    g_app.encoding.encoding = ENC_UTF8;
+    g_app.encoding.codePage = 0;
+    g_app.encoding.eol = TEXT_EOL_CRLF;
     g_app.findFlags = FR_DOWN;
 
 
@@ -1018,10 +2549,10 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmd
     wc.hIconSm = wc.hIcon;
     wc.hCursor = LoadCursorW(NULL, IDC_IBEAM);
     wc.hbrBackground = (HBRUSH)(COLOR_WINDOW + 1);
-    wc.lpszClassName = L"RETROPAD_WINDOW";
+    wc.lpszClassName = MAIN_CLASS_NAME;
     wc.lpszMenuName = MAKEINTRESOURCE(IDC_RETROPAD);
 
-    if (!RegisterClassExW(&wc)) {
+    if (!RegisterClassExW(&wc) || !HexViewRegister(hInstance) || !StoreViewRegister(hInstance)) {
         MessageBoxW(NULL, L"Failed to register window class.", APP_TITLE, MB_ICONERROR);
         return 0;
     }
@@ -1035,38 +2566,37 @@ int APIENTRY wWinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmd
     }
 
     g_app.hwndMain = hwnd;
-    ShowWindow(hwnd, nCmdShow);
+    if (!RestoreWindowPlacement(hwnd, nCmdShow)) {
+        ShowWindow(hwnd, nCmdShow);
+    }
 
-    LoadFontFromIni(); // Try loading persisted font 
+    LoadFontFromSettings(); // Try loading persisted font
     UpdateWindow(hwnd);
+    if (request.path[0]) OpenRequestedFile(hwnd, &request);
 
     HACCEL accel = LoadAcceleratorsW(hInstance, MAKEINTRESOURCE(IDC_RETROPAD));
 
     MSG msg;
     while (GetMessageW(&msg, NULL, 0, 0)) {
-        // Handle DEL key specially when the edit control has focus
         if (msg.message == WM_KEYDOWN && msg.wParam == VK_DELETE && msg.hwnd == g_app.hwndEdit) {
+            // Handle DEL key specially when the edit control has focus
             HandleDeleteKey(g_app.hwndEdit);
-            continue;
-        }
-
-        // Handle Ctrl+V (Paste) with normalized line endings
-        if (msg.message == WM_KEYDOWN && msg.wParam == 'V' && (GetKeyState(VK_CONTROL) & 0x8000) && msg.hwnd == g_app.hwndEdit) {
+        } else if (msg.message == WM_KEYDOWN && msg.wParam == 'V' && (GetKeyState(VK_CONTROL) & 0x8000) && msg.hwnd == g_app.hwndEdit) {
+            // Handle Ctrl+V (Paste) with normalized line endings
             DoPasteWithNormalizedLineEndings(g_app.hwndMain);
-            continue;
-        }
-
-        // Handle Ctrl+A (Select All) when edit control has focus
-        if (msg.message == WM_KEYDOWN && (msg.wParam == 'A' || msg.wParam == 'a') && (GetKeyState(VK_CONTROL) & 0x8000) && msg.hwnd == g_app.hwndEdit) {
+        } else if (msg.message == WM_KEYDOWN && (msg.wParam == 'A' || msg.wParam == 'a') && (GetKeyState(VK_CONTROL) & 0x8000) && msg.hwnd == g_app.hwndEdit) {
+            // Handle Ctrl+A (Select All) when edit control has focus
             SendMessageW(g_app.hwndEdit, EM_SETSEL, 0, -1);
-            continue;
-        }
-
-        if (!accel || !TranslateAcceleratorW(hwnd, accel, &msg)) {
+        } else if (!accel || !TranslateAcceleratorW(hwnd, accel, &msg)) {
             TranslateMessage(&msg);
             DispatchMessageW(&msg);
         }
+        ScratchReset(); // Command finished; nothing holds scratch memory past this point
     }
 
+    if (g_traceDumpOnExit) {
+        TraceDumpJson(g_tracePath);
+    }
+    SettingsFree();
     return (int)msg.wParam;
 }
@@ -0,0 +1,120 @@
+// Scratch arena for retropad. Find, replace, paste, load and save each need a few
+// document-sized temporaries; carving them from blocks that survive between commands
+// keeps large buffers out of the process heap and avoids re-faulting fresh pages.
+#include "scratch.h"
+#include "trace.h"
+
+#if defined(_MSC_VER)
+#define SCRATCH_THREAD_LOCAL __declspec(thread)
+#else
+#define SCRATCH_THREAD_LOCAL __thread
+#endif
+
+#define SCRATCH_ALIGN 16
+#define SCRATCH_MIN_BLOCK (1u << 20)        // smallest block requested from the OS
+#define SCRATCH_GRANULE (64u << 10)         // VirtualAlloc reservation granularity
+
+typedef struct ScratchBlock {
+    struct ScratchBlock *next;
+    size_t capacity;    // usable bytes after the header
+    size_t used;
+} ScratchBlock;
+
+#define SCRATCH_HEADER ((sizeof(ScratchBlock) + SCRATCH_ALIGN - 1) & ~(size_t)(SCRATCH_ALIGN - 1))
+
+typedef struct ScratchArena {
+    ScratchBlock *blocks;
+    size_t retained;        // bytes held across commands
+    LONGLONG allocs;        // since the last reset
+    LONGLONG bytes;
+    LONGLONG osAllocs;
+} ScratchArena;
+
+static SCRATCH_THREAD_LOCAL ScratchArena t_scratch;
+static HANDLE g_lowMemory = NULL;
+static volatile LONG g_lowMemoryInit = 0;
+
+static BOOL MemoryIsLow(void) {
+    if (InterlockedCompareExchange(&g_lowMemoryInit, 1, 0) == 0) {
+        g_lowMemory = CreateMemoryResourceNotification(LowMemoryResourceNotification);
+    }
+    BOOL low = FALSE;
+    return g_lowMemory && QueryMemoryResourceNotification(g_lowMemory, &low) && low;
+}
+
+static ScratchBlock *NewBlock(size_t bytes) {
+    size_t size = bytes + SCRATCH_HEADER;
+    if (size < bytes) return NULL;
+    if (size < SCRATCH_MIN_BLOCK) size = SCRATCH_MIN_BLOCK;
+    size = (size + SCRATCH_GRANULE - 1) & ~(size_t)(SCRATCH_GRANULE - 1);
+
+    ScratchBlock *block = (ScratchBlock *)VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+    if (!block) return NULL;
+    block->capacity = size - SCRATCH_HEADER;
+    block->used = 0;
+    block->next = t_scratch.blocks;
+    t_scratch.blocks = block;
+    t_scratch.retained += size;
+    t_scratch.osAllocs++;
+    return block;
+}
+
+void *ScratchAlloc(size_t bytes) {
+    bytes = (bytes + SCRATCH_ALIGN - 1) & ~(size_t)(SCRATCH_ALIGN - 1);
+    if (bytes == 0) bytes = SCRATCH_ALIGN;
+
+    // Best fit keeps the big blocks free for the document-sized requests
+    ScratchBlock *best = NULL;
+    for (ScratchBlock *b = t_scratch.blocks; b; b = b->next) {
+        size_t room = b->capacity - b->used;
+        if (room >= bytes && (!best || room < best->capacity - best->used)) {
+            best = b;
+        }
+    }
+    if (!best) {
+        best = NewBlock(bytes);
+        if (!best) return NULL;
+    }
+
+    void *p = (BYTE *)best + SCRATCH_HEADER + best->used;
+    best->used += bytes;
+    t_scratch.allocs++;
+    t_scratch.bytes += (LONGLONG)bytes;
+    return p;
+}
+
+void ScratchReset(void) {
+    if (t_scratch.allocs == 0) return;
+
+    TraceCounter("scratch allocs", t_scratch.allocs);
+    TraceCounter("scratch bytes", t_scratch.bytes);
+    TraceCounter("scratch os allocs", t_scratch.osAllocs);
+
+    for (ScratchBlock *b = t_scratch.blocks; b; b = b->next) {
+        b->used = 0;
+    }
+    t_scratch.allocs = 0;
+    t_scratch.bytes = 0;
+    t_scratch.osAllocs = 0;
+
+    if (MemoryIsLow()) {
+        ScratchTrim();
+    } else {
+        TraceCounter("scratch retained", (LONGLONG)t_scratch.retained);
+    }
+}
+
+void ScratchTrim(void) {
+    ScratchBlock **link = &t_scratch.blocks;
+    while (*link) {
+        ScratchBlock *b = *link;
+        if (b->used == 0) {
+            *link = b->next;
+            t_scratch.retained -= b->capacity + SCRATCH_HEADER;
+            VirtualFree(b, 0, MEM_RELEASE);
+        } else {
+            link = &b->next;
+        }
+    }
+    TraceCounter("scratch retained", (LONGLONG)t_scratch.retained);
+}
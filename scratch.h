@@ -0,0 +1,15 @@
+// Per-thread scratch arena for retropad: temporary buffers live until the current
+// command finishes, then the whole arena is rewound in one step.
+#pragma once
+
+#include <windows.h>
+
+// 16-byte aligned, uninitialized. Returns NULL only when the OS refuses a new block.
+void *ScratchAlloc(size_t bytes);
+
+// Rewinds the calling thread's arena. Blocks stay committed for the next command
+// unless the system has signalled low memory, in which case they are released.
+void ScratchReset(void);
+
+// Hands every idle block back to the OS (WM_COMPACTING, low-memory notification).
+void ScratchTrim(void);
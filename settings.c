@@ -0,0 +1,349 @@
+// Settings store for retropad: retropad.ini is read once into a table and written back in one go.
+#include "settings.h"
+#include <strsafe.h>
+#include <stdlib.h>
+
+#define SETTINGS_PATH_MAX 1024
+#define SETTINGS_NAME_MAX 256
+
+typedef struct SettingsEntry {
+    WCHAR *section;   // section, key and value share one allocation owned by section
+    WCHAR *key;
+    WCHAR *value;
+} SettingsEntry;
+
+typedef struct SettingsStore {
+    WCHAR path[SETTINGS_PATH_MAX];
+    SettingsEntry *entries;
+    size_t count;
+    size_t capacity;
+    BOOL dirty;
+} SettingsStore;
+
+typedef struct TextBuilder {
+    WCHAR *data;
+    size_t length;
+    size_t capacity;
+} TextBuilder;
+
+static SettingsStore g_settings = {0};
+
+static BOOL BuildIniPath(WCHAR *path, size_t pathLen) {
+    if (GetModuleFileNameW(NULL, path, (DWORD)pathLen) == 0) return FALSE;
+
+    WCHAR *dot = wcsrchr(path, L'.');
+    WCHAR *slash = wcsrchr(path, L'\\');
+    if (dot && (!slash || dot > slash)) *dot = L'\0';
+    return SUCCEEDED(StringCchCatW(path, pathLen, L".ini"));
+}
+
+static SettingsEntry *FindEntry(LPCWSTR section, LPCWSTR key) {
+    for (size_t i = 0; i < g_settings.count; ++i) {
+        SettingsEntry *entry = &g_settings.entries[i];
+        if (lstrcmpiW(entry->section, section) == 0 && lstrcmpiW(entry->key, key) == 0) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static BOOL FillEntry(SettingsEntry *entry, LPCWSTR section, LPCWSTR key, LPCWSTR value) {
+    size_t sectionLen = wcslen(section) + 1;
+    size_t keyLen = wcslen(key) + 1;
+    size_t valueLen = wcslen(value) + 1;
+    WCHAR *block = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, (sectionLen + keyLen + valueLen) * sizeof(WCHAR));
+    if (!block) return FALSE;
+
+    CopyMemory(block, section, sectionLen * sizeof(WCHAR));
+    CopyMemory(block + sectionLen, key, keyLen * sizeof(WCHAR));
+    CopyMemory(block + sectionLen + keyLen, value, valueLen * sizeof(WCHAR));
+    entry->section = block;
+    entry->key = block + sectionLen;
+    entry->value = block + sectionLen + keyLen;
+    return TRUE;
+}
+
+static BOOL PutEntry(LPCWSTR section, LPCWSTR key, LPCWSTR value) {
+    SettingsEntry *existing = FindEntry(section, key);
+    if (existing) {
+        if (lstrcmpW(existing->value, value) == 0) return TRUE;
+        SettingsEntry updated;
+        // Keep the stored spelling of section/key so rewrites don't churn the file
+        if (!FillEntry(&updated, existing->section, existing->key, value)) return FALSE;
+        HeapFree(GetProcessHeap(), 0, existing->section);
+        *existing = updated;
+        g_settings.dirty = TRUE;
+        return TRUE;
+    }
+
+    if (g_settings.count == g_settings.capacity) {
+        size_t newCapacity = g_settings.capacity ? g_settings.capacity * 2 : 32;
+        SettingsEntry *grown = g_settings.entries
+            ? (SettingsEntry *)HeapReAlloc(GetProcessHeap(), 0, g_settings.entries, newCapacity * sizeof(SettingsEntry))
+            : (SettingsEntry *)HeapAlloc(GetProcessHeap(), 0, newCapacity * sizeof(SettingsEntry));
+        if (!grown) return FALSE;
+        g_settings.entries = grown;
+        g_settings.capacity = newCapacity;
+    }
+
+    if (!FillEntry(&g_settings.entries[g_settings.count], section, key, value)) return FALSE;
+    g_settings.count++;
+    g_settings.dirty = TRUE;
+    return TRUE;
+}
+
+// Trim spaces/tabs in place; returns the new start and NUL-terminates the end
+static WCHAR *TrimInPlace(WCHAR *start, size_t length) {
+    while (length > 0 && (start[0] == L' ' || start[0] == L'\t')) {
+        ++start;
+        --length;
+    }
+    while (length > 0 && (start[length - 1] == L' ' || start[length - 1] == L'\t')) {
+        --length;
+    }
+    start[length] = L'\0';
+    return start;
+}
+
+static BOOL ParseIni(WCHAR *text, size_t length) {
+    WCHAR section[SETTINGS_NAME_MAX] = L"";
+    size_t pos = 0;
+
+    while (pos < length) {
+        size_t lineEnd = pos;
+        while (lineEnd < length && text[lineEnd] != L'\r' && text[lineEnd] != L'\n') {
+            ++lineEnd;
+        }
+        size_t next = lineEnd;
+        while (next < length && (text[next] == L'\r' || text[next] == L'\n')) {
+            ++next;
+        }
+
+        WCHAR *line = TrimInPlace(text + pos, lineEnd - pos);
+        pos = next;
+
+        if (line[0] == L'\0' || line[0] == L';' || line[0] == L'#') {
+            continue;
+        }
+        if (line[0] == L'[') {
+            WCHAR *close = wcschr(line, L']');
+            if (close) {
+                WCHAR *name = TrimInPlace(line + 1, (size_t)(close - line - 1));
+                StringCchCopyW(section, ARRAYSIZE(section), name);
+            }
+            continue;
+        }
+
+        WCHAR *equals = wcschr(line, L'=');
+        if (!equals || section[0] == L'\0') {
+            continue;
+        }
+        WCHAR *key = TrimInPlace(line, (size_t)(equals - line));
+        WCHAR *value = TrimInPlace(equals + 1, wcslen(equals + 1));
+        if (key[0] && !PutEntry(section, key, value)) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+// Accept the UTF-16LE files we write as well as ANSI/UTF-8 files written by
+// older builds through WritePrivateProfileStringW or by hand.
+static WCHAR *DecodeIniBytes(const BYTE *data, DWORD size, size_t *lengthOut) {
+    WCHAR *text = NULL;
+    size_t length = 0;
+
+    if (size >= 2 && data[0] == 0xFF && data[1] == 0xFE) {
+        length = (size - 2) / sizeof(WCHAR);
+        text = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, (length + 1) * sizeof(WCHAR));
+        if (!text) return NULL;
+        CopyMemory(text, data + 2, length * sizeof(WCHAR));
+    } else {
+        DWORD offset = (size >= 3 && data[0] == 0xEF && data[1] == 0xBB && data[2] == 0xBF) ? 3 : 0;
+        UINT codePage = CP_UTF8;
+        int chars = MultiByteToWideChar(CP_UTF8, MB_ERR_INVALID_CHARS, (LPCSTR)(data + offset), size - offset, NULL, 0);
+        if (chars <= 0) {
+            codePage = CP_ACP;
+            chars = MultiByteToWideChar(CP_ACP, 0, (LPCSTR)(data + offset), size - offset, NULL, 0);
+        }
+        if (chars <= 0) return NULL;
+        text = (WCHAR *)HeapAlloc(GetProcessHeap(), 0, ((size_t)chars + 1) * sizeof(WCHAR));
+        if (!text) return NULL;
+        MultiByteToWideChar(codePage, 0, (LPCSTR)(data + offset), size - offset, text, chars);
+        length = (size_t)chars;
+    }
+
+    text[length] = L'\0';
+    *lengthOut = length;
+    return text;
+}
+
+BOOL SettingsLoad(void) {
+    SettingsFree();
+    if (!BuildIniPath(g_settings.path, ARRAYSIZE(g_settings.path))) {
+        g_settings.path[0] = L'\0';
+        return TRUE;
+    }
+
+    HANDLE file = CreateFileW(g_settings.path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+                              FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        return TRUE;
+    }
+
+    LARGE_INTEGER size = {0};
+    if (!GetFileSizeEx(file, &size) || size.QuadPart == 0 || size.QuadPart > 1024 * 1024) {
+        CloseHandle(file);
+        return TRUE;
+    }
+
+    DWORD bytes = (DWORD)size.QuadPart;
+    BYTE *raw = (BYTE *)HeapAlloc(GetProcessHeap(), 0, bytes);
+    if (!raw) {
+        CloseHandle(file);
+        return FALSE;
+    }
+
+    DWORD read = 0;
+    BOOL ok = ReadFile(file, raw, bytes, &read, NULL);
+    CloseHandle(file);
+    if (!ok || read == 0) {
+        HeapFree(GetProcessHeap(), 0, raw);
+        return TRUE;
+    }
+
+    size_t length = 0;
+    WCHAR *text = DecodeIniBytes(raw, read, &length);
+    HeapFree(GetProcessHeap(), 0, raw);
+    if (!text) {
+        return TRUE;
+    }
+
+    ok = ParseIni(text, length);
+    HeapFree(GetProcessHeap(), 0, text);
+    g_settings.dirty = FALSE;
+    return ok;
+}
+
+static BOOL AppendText(TextBuilder *sb, LPCWSTR text) {
+    size_t len = wcslen(text);
+    if (sb->length + len > sb->capacity) {
+        size_t newCapacity = sb->capacity ? sb->capacity : 1024;
+        while (newCapacity < sb->length + len) newCapacity *= 2;
+        WCHAR *grown = sb->data
+            ? (WCHAR *)HeapReAlloc(GetProcessHeap(), 0, sb->data, newCapacity * sizeof(WCHAR))
+            : (WCHAR *)HeapAlloc(GetProcessHeap(), 0, newCapacity * sizeof(WCHAR));
+        if (!grown) return FALSE;
+        sb->data = grown;
+        sb->capacity = newCapacity;
+    }
+    CopyMemory(sb->data + sb->length, text, len * sizeof(WCHAR));
+    sb->length += len;
+    return TRUE;
+}
+
+// Serialize grouped by section, in the order sections were first seen
+static BOOL SerializeSettings(TextBuilder *sb) {
+    for (size_t i = 0; i < g_settings.count; ++i) {
+        LPCWSTR section = g_settings.entries[i].section;
+        BOOL seen = FALSE;
+        for (size_t j = 0; j < i && !seen; ++j) {
+            seen = lstrcmpiW(g_settings.entries[j].section, section) == 0;
+        }
+        if (seen) continue;
+
+        if (sb->length > 0 && !AppendText(sb, L"\r\n")) return FALSE;
+        if (!AppendText(sb, L"[") || !AppendText(sb, section) || !AppendText(sb, L"]\r\n")) return FALSE;
+        for (size_t j = i; j < g_settings.count; ++j) {
+            const SettingsEntry *entry = &g_settings.entries[j];
+            if (lstrcmpiW(entry->section, section) != 0) continue;
+            if (!AppendText(sb, entry->key) || !AppendText(sb, L"=") ||
+                !AppendText(sb, entry->value) || !AppendText(sb, L"\r\n")) {
+                return FALSE;
+            }
+        }
+    }
+    return TRUE;
+}
+
+BOOL SettingsSave(void) {
+    if (!g_settings.dirty) return TRUE;
+    if (g_settings.path[0] == L'\0') return FALSE;
+
+    TextBuilder sb = {0};
+    if (!SerializeSettings(&sb)) {
+        if (sb.data) HeapFree(GetProcessHeap(), 0, sb.data);
+        return FALSE;
+    }
+
+    // Write a sibling temp file and swap it in so a crash never leaves a half-written ini
+    WCHAR tempPath[SETTINGS_PATH_MAX + 8];
+    StringCchPrintfW(tempPath, ARRAYSIZE(tempPath), L"%s.tmp", g_settings.path);
+    HANDLE file = CreateFileW(tempPath, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+        if (sb.data) HeapFree(GetProcessHeap(), 0, sb.data);
+        return FALSE;
+    }
+
+    static const BYTE bom[] = {0xFF, 0xFE};
+    DWORD written = 0;
+    BOOL ok = WriteFile(file, bom, sizeof(bom), &written, NULL);
+    if (ok && sb.length > 0) {
+        ok = WriteFile(file, sb.data, (DWORD)(sb.length * sizeof(WCHAR)), &written, NULL);
+    }
+    CloseHandle(file);
+    if (sb.data) HeapFree(GetProcessHeap(), 0, sb.data);
+
+    if (ok) {
+        ok = MoveFileExW(tempPath, g_settings.path, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH);
+    }
+    if (!ok) {
+        DeleteFileW(tempPath);
+        return FALSE;
+    }
+    g_settings.dirty = FALSE;
+    return TRUE;
+}
+
+void SettingsFree(void) {
+    for (size_t i = 0; i < g_settings.count; ++i) {
+        HeapFree(GetProcessHeap(), 0, g_settings.entries[i].section);
+    }
+    if (g_settings.entries) {
+        HeapFree(GetProcessHeap(), 0, g_settings.entries);
+    }
+    g_settings.entries = NULL;
+    g_settings.count = 0;
+    g_settings.capacity = 0;
+    g_settings.dirty = FALSE;
+}
+
+BOOL SettingsGetString(LPCWSTR section, LPCWSTR key, WCHAR *out, size_t outLen) {
+    const SettingsEntry *entry = FindEntry(section, key);
+    if (!entry) return FALSE;
+    return SUCCEEDED(StringCchCopyW(out, outLen, entry->value));
+}
+
+int SettingsGetInt(LPCWSTR section, LPCWSTR key, int defaultValue) {
+    const SettingsEntry *entry = FindEntry(section, key);
+    if (!entry || entry->value[0] == L'\0') return defaultValue;
+    return (int)wcstol(entry->value, NULL, 10);
+}
+
+BOOL SettingsGetBool(LPCWSTR section, LPCWSTR key, BOOL defaultValue) {
+    return SettingsGetInt(section, key, defaultValue ? 1 : 0) != 0;
+}
+
+void SettingsSetString(LPCWSTR section, LPCWSTR key, LPCWSTR value) {
+    PutEntry(section, key, value ? value : L"");
+}
+
+void SettingsSetInt(LPCWSTR section, LPCWSTR key, int value) {
+    WCHAR buf[32];
+    StringCchPrintfW(buf, ARRAYSIZE(buf), L"%d", value);
+    PutEntry(section, key, buf);
+}
+
+void SettingsSetBool(LPCWSTR section, LPCWSTR key, BOOL value) {
+    PutEntry(section, key, value ? L"1" : L"0");
+}
@@ -0,0 +1,22 @@
+// In-memory settings store for retropad backed by retropad.ini
+#pragma once
+
+#include <windows.h>
+
+// Read the ini file next to the executable once into memory.
+// Missing or unreadable files leave an empty store; returns FALSE only on allocation failure.
+BOOL SettingsLoad(void);
+
+// Write the whole table back in one atomic replace if anything changed since load/save.
+BOOL SettingsSave(void);
+void SettingsFree(void);
+
+// Typed getters; the string getter returns FALSE when the key is absent.
+BOOL SettingsGetString(LPCWSTR section, LPCWSTR key, WCHAR *out, size_t outLen);
+int SettingsGetInt(LPCWSTR section, LPCWSTR key, int defaultValue);
+BOOL SettingsGetBool(LPCWSTR section, LPCWSTR key, BOOL defaultValue);
+
+// Setters only mark the store dirty when the stored value actually changes.
+void SettingsSetString(LPCWSTR section, LPCWSTR key, LPCWSTR value);
+void SettingsSetInt(LPCWSTR section, LPCWSTR key, int value);
+void SettingsSetBool(LPCWSTR section, LPCWSTR key, BOOL value);
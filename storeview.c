@@ -0,0 +1,570 @@
+// Store view for retropad: lines are formatted and painted straight from the document
+// store, a screenful of columns at a time; nothing else of the text is copied or kept.
+#include "storeview.h"
+
+#define STORE_CLASS_NAME L"RetropadStoreView"
+#define STORE_SCROLL_MAX 0x3FFFFFFF     // scroll bar positions are ints; beyond this lines are scaled
+#define STORE_WHEEL_LINES 3
+#define STORE_TAB_COLUMNS 8
+#define STORE_MAX_COLUMNS 1024          // columns formatted per line on screen
+#define STORE_READ_UNITS 256            // copied from the store at a time while walking a line
+
+typedef struct StoreView {
+    HWND hwnd;
+    HWND parent;
+    UINT msg;
+    const DocStore *store;      // NULL when nothing is shown
+    size_t length;
+    size_t lines;
+    size_t topLine;
+    int leftColumn;             // first character column shown
+    int widest;                 // columns of the widest line painted so far
+    size_t anchor;              // the selection runs from anchor to caret
+    size_t caret;
+    int goalColumn;             // column Up, Down and the page keys keep to
+    unsigned scrollShift;       // lines >> scrollShift fit the scroll bar
+    BOOL focused;
+    HFONT font;
+    BOOL ownFont;
+    int charWidth;
+    int lineHeight;
+} StoreView;
+
+// Walks one line's units in blocks copied out of the store
+typedef struct LineReader {
+    const DocStore *store;
+    size_t pos;
+    size_t end;
+    size_t blockStart;
+    size_t blockLength;
+    TextChar block[STORE_READ_UNITS];
+} LineReader;
+
+static StoreView *GetView(HWND hwnd) {
+    return (StoreView *)GetWindowLongPtrW(hwnd, GWLP_USERDATA);
+}
+
+static void ReaderInit(LineReader *r, const DocStore *store, size_t start, size_t end) {
+    r->store = store;
+    r->pos = start;
+    r->end = end;
+    r->blockStart = start;
+    r->blockLength = 0;
+}
+
+// The next unit of the line, or -1 at its end
+static int ReaderNext(LineReader *r) {
+    if (r->pos >= r->end) return -1;
+    size_t index = r->pos - r->blockStart;
+    if (index >= r->blockLength) {
+        size_t want = r->end - r->pos < STORE_READ_UNITS ? r->end - r->pos : STORE_READ_UNITS;
+        r->blockStart = r->pos;
+        r->blockLength = DocStoreCopy(r->store, r->pos, want, r->block);
+        if (r->blockLength == 0) return -1;
+        index = 0;
+    }
+    r->pos++;
+    return r->block[index];
+}
+
+// Tabs run to the next multiple of STORE_TAB_COLUMNS; everything else takes one column
+static int CellWidth(int c, int column) {
+    return c == '\t' ? STORE_TAB_COLUMNS - column % STORE_TAB_COLUMNS : 1;
+}
+
+static size_t LineStart(const StoreView *v, size_t line) {
+    return DocStoreLineStart(v->store, line);
+}
+
+// End of the line's text, before its CRLF
+static size_t LineEnd(const StoreView *v, size_t line, size_t start) {
+    size_t end = line + 1 < v->lines ? LineStart(v, line + 1) : v->length;
+    if (end > start && DocStoreCharAt(v->store, end - 1) == '\n') end--;
+    if (end > start && DocStoreCharAt(v->store, end - 1) == '\r') end--;
+    return end;
+}
+
+// Formats columns [first, first + max) of the text [start, end) into text/offsets (the
+// unit each column shows); returns the column the walk stopped at, which is the line's
+// width unless *moreOut says the line goes on past the columns asked for
+static int FormatLine(const StoreView *v, size_t start, size_t end, int first, int max, TextChar *text,
+                      size_t *offsets, int *countOut, BOOL *moreOut) {
+    LineReader reader;
+    ReaderInit(&reader, v->store, start, end);
+    int column = 0, count = 0, c;
+    *moreOut = FALSE;
+    while ((c = ReaderNext(&reader)) >= 0) {
+        size_t pos = reader.pos - 1;
+        int width = CellWidth(c, column);
+        for (int k = column; k < column + width; ++k) {
+            if (k >= first && k < first + max) {
+                text[k - first] = c == '\t' ? ' ' : (TextChar)c;
+                offsets[k - first] = pos;
+                count = k - first + 1;
+            }
+        }
+        column += width;
+        if (column >= first + max || column >= STORE_SCROLL_MAX) {
+            *moreOut = reader.pos < end;
+            break;
+        }
+    }
+    *countOut = count;
+    return column;
+}
+
+// Column where the unit at `pos` of the line [start, ...) begins
+static int ColumnOf(const StoreView *v, size_t start, size_t pos) {
+    LineReader reader;
+    ReaderInit(&reader, v->store, start, pos);
+    int column = 0, c;
+    while ((c = ReaderNext(&reader)) >= 0 && column < STORE_SCROLL_MAX) column += CellWidth(c, column);
+    return column;
+}
+
+// First unit of `line` that starts at or after `column`, or the line's end
+static size_t OffsetAtColumn(const StoreView *v, size_t line, int column) {
+    size_t start = LineStart(v, line);
+    LineReader reader;
+    ReaderInit(&reader, v->store, start, LineEnd(v, line, start));
+    int at = 0, c;
+    while (at < column && (c = ReaderNext(&reader)) >= 0) at += CellWidth(c, at);
+    return reader.pos;
+}
+
+// Whole lines that fit in the window, at least one
+static size_t PageLines(const StoreView *v) {
+    RECT rc;
+    GetClientRect(v->hwnd, &rc);
+    int lines = rc.bottom / v->lineHeight;
+    return lines > 0 ? (size_t)lines : 1;
+}
+
+static int PageColumns(const StoreView *v) {
+    RECT rc;
+    GetClientRect(v->hwnd, &rc);
+    int columns = rc.right / v->charWidth;
+    return columns > 0 ? columns : 1;
+}
+
+static size_t MaxTopLine(const StoreView *v) {
+    size_t page = PageLines(v);
+    return v->lines > page ? v->lines - page : 0;
+}
+
+static void UpdateScrollBars(StoreView *v) {
+    v->scrollShift = 0;
+    while ((v->lines >> v->scrollShift) > STORE_SCROLL_MAX) v->scrollShift++;
+
+    SCROLLINFO si = {0};
+    si.cbSize = sizeof(si);
+    si.fMask = SIF_RANGE | SIF_PAGE | SIF_POS;
+    si.nMax = v->lines ? (int)((v->lines - 1) >> v->scrollShift) : 0;
+    si.nPage = (UINT)(PageLines(v) >> v->scrollShift);
+    if (si.nPage == 0) si.nPage = 1;
+    si.nPos = (int)(v->topLine >> v->scrollShift);
+    SetScrollInfo(v->hwnd, SB_VERT, &si, TRUE);
+
+    si.nMax = v->widest > 0 ? v->widest - 1 : 0;
+    si.nPage = (UINT)PageColumns(v);
+    si.nPos = v->leftColumn;
+    SetScrollInfo(v->hwnd, SB_HORZ, &si, TRUE);
+}
+
+static void ScrollToLine(StoreView *v, size_t line) {
+    size_t maxTop = MaxTopLine(v);
+    if (line > maxTop) line = maxTop;
+    if (line == v->topLine) return;
+    v->topLine = line;
+    UpdateScrollBars(v);
+    InvalidateRect(v->hwnd, NULL, FALSE);
+}
+
+static void ScrollToColumn(StoreView *v, int column) {
+    int maxLeft = v->widest - PageColumns(v);
+    if (column > maxLeft) column = maxLeft;
+    if (column < 0) column = 0;
+    if (column == v->leftColumn) return;
+    v->leftColumn = column;
+    UpdateScrollBars(v);
+    InvalidateRect(v->hwnd, NULL, FALSE);
+}
+
+// Moves the system caret to the caret's cell, or out of sight when it is scrolled away
+static void UpdateCaret(StoreView *v) {
+    if (!v->focused) return;
+    int x = -2 * v->charWidth, y = -2 * v->lineHeight;
+    if (v->store) {
+        size_t line = DocStoreLineFromOffset(v->store, v->caret);
+        if (line >= v->topLine && line - v->topLine <= PageLines(v)) {
+            int column = ColumnOf(v, LineStart(v, line), v->caret);
+            if (column >= v->leftColumn && column - v->leftColumn <= PageColumns(v)) {
+                x = (column - v->leftColumn) * v->charWidth;
+                y = (int)(line - v->topLine) * v->lineHeight;
+            }
+        }
+    }
+    SetCaretPos(x, y);
+}
+
+static void ScrollToCaret(StoreView *v) {
+    size_t line = DocStoreLineFromOffset(v->store, v->caret), page = PageLines(v);
+    if (line < v->topLine) {
+        ScrollToLine(v, line);
+    } else if (line >= v->topLine + page) {
+        ScrollToLine(v, line - page + 1);
+    }
+    int column = ColumnOf(v, LineStart(v, line), v->caret), columns = PageColumns(v);
+    if (column >= v->widest) {
+        v->widest = column + 1;
+        UpdateScrollBars(v);
+    }
+    if (column < v->leftColumn) {
+        ScrollToColumn(v, column);
+    } else if (column >= v->leftColumn + columns) {
+        ScrollToColumn(v, column - columns + 1);
+    }
+}
+
+// Puts the caret at `pos`, extending the selection or collapsing it there; Up, Down and
+// the page keys keep the column they started from
+static void MoveCaret(StoreView *v, size_t pos, BOOL extend, BOOL keepGoal) {
+    if (pos > v->length) pos = v->length;
+    v->caret = pos;
+    if (!extend) v->anchor = pos;
+    if (!keepGoal) {
+        size_t line = DocStoreLineFromOffset(v->store, pos);
+        v->goalColumn = ColumnOf(v, LineStart(v, line), pos);
+    }
+    ScrollToCaret(v);
+    InvalidateRect(v->hwnd, NULL, FALSE);
+    UpdateCaret(v);
+    SendMessageW(v->parent, v->msg, 0, 0);
+}
+
+// Paints the rows in `clip`; returns TRUE when a line turned out wider than any before,
+// so the horizontal scroll bar needs its range updated
+static BOOL Paint(StoreView *v, HDC dc, const RECT *clip) {
+    RECT rc;
+    GetClientRect(v->hwnd, &rc);
+    HGDIOBJ oldFont = SelectObject(dc, v->font);
+    COLORREF window = GetSysColor(COLOR_WINDOW), text = GetSysColor(COLOR_WINDOWTEXT);
+    COLORREF highlight = GetSysColor(COLOR_HIGHLIGHT), highlightText = GetSysColor(COLOR_HIGHLIGHTTEXT);
+
+    int rows = (rc.bottom + v->lineHeight - 1) / v->lineHeight;
+    int columns = PageColumns(v) + 1;
+    if (columns > STORE_MAX_COLUMNS) columns = STORE_MAX_COLUMNS;
+    size_t selStart = min(v->anchor, v->caret), selEnd = max(v->anchor, v->caret);
+    TextChar cells[STORE_MAX_COLUMNS];
+    size_t offsets[STORE_MAX_COLUMNS];
+    BOOL widened = FALSE;
+    for (int r = 0; r < rows; ++r) {
+        RECT rowRect = {0, r * v->lineHeight, rc.right, (r + 1) * v->lineHeight};
+        if (rowRect.bottom <= clip->top || rowRect.top >= clip->bottom) continue;
+        size_t line = v->topLine + (size_t)r;
+        SetBkColor(dc, window);
+        SetTextColor(dc, text);
+        if (!v->store || line >= v->lines) {
+            ExtTextOutW(dc, 0, 0, ETO_OPAQUE, &rowRect, NULL, 0, NULL);
+            continue;
+        }
+        size_t start = LineStart(v, line), end = LineEnd(v, line, start);
+        int count = 0;
+        BOOL more = FALSE;
+        int width = FormatLine(v, start, end, v->leftColumn, columns, cells, offsets, &count, &more);
+        // A line cut off at the window's edge lets the scroll bar reach one more page
+        if (more) width += columns;
+        if (width > v->widest) {
+            v->widest = width < STORE_SCROLL_MAX ? width : STORE_SCROLL_MAX;
+            widened = TRUE;
+        }
+        ExtTextOutW(dc, 0, rowRect.top, ETO_OPAQUE, &rowRect, (const WCHAR *)cells, (UINT)count, NULL);
+
+        // Selected runs are drawn again over the row
+        if (selEnd <= start || selStart >= end) continue;
+        SetBkColor(dc, highlight);
+        SetTextColor(dc, highlightText);
+        for (int i = 0; i < count;) {
+            if (offsets[i] < selStart || offsets[i] >= selEnd) {
+                ++i;
+                continue;
+            }
+            int j = i;
+            while (j < count && offsets[j] >= selStart && offsets[j] < selEnd) ++j;
+            ExtTextOutW(dc, i * v->charWidth, rowRect.top, 0, NULL, (const WCHAR *)cells + i, (UINT)(j - i), NULL);
+            i = j;
+        }
+    }
+    SelectObject(dc, oldFont);
+    return widened;
+}
+
+static void CreateViewFont(StoreView *v) {
+    HDC dc = GetDC(v->hwnd);
+    int height = -MulDiv(10, GetDeviceCaps(dc, LOGPIXELSY), 72);
+    v->font = CreateFontW(height, 0, 0, 0, FW_NORMAL, FALSE, FALSE, FALSE, DEFAULT_CHARSET, OUT_DEFAULT_PRECIS,
+                          CLIP_DEFAULT_PRECIS, DEFAULT_QUALITY, FIXED_PITCH | FF_MODERN, L"Consolas");
+    v->ownFont = v->font != NULL;
+    if (!v->font) v->font = (HFONT)GetStockObject(ANSI_FIXED_FONT);
+    HGDIOBJ old = SelectObject(dc, v->font);
+    TEXTMETRICW tm;
+    GetTextMetricsW(dc, &tm);
+    SelectObject(dc, old);
+    ReleaseDC(v->hwnd, dc);
+    v->charWidth = tm.tmAveCharWidth > 0 ? tm.tmAveCharWidth : 8;
+    v->lineHeight = tm.tmHeight > 0 ? tm.tmHeight : 16;
+}
+
+// Line scrolled to by a scroll bar action; thumb positions come from SIF_TRACKPOS, which
+// unlike the message's own is 32 bits
+static size_t ScrollLineFor(StoreView *v, WORD action) {
+    size_t page = PageLines(v);
+    switch (action) {
+    case SB_LINEUP:
+        return v->topLine ? v->topLine - 1 : 0;
+    case SB_LINEDOWN:
+        return v->topLine + 1;
+    case SB_PAGEUP:
+        return v->topLine > page ? v->topLine - page : 0;
+    case SB_PAGEDOWN:
+        return v->topLine + page;
+    case SB_TOP:
+        return 0;
+    case SB_BOTTOM:
+        return MaxTopLine(v);
+    case SB_THUMBTRACK:
+    case SB_THUMBPOSITION: {
+        SCROLLINFO si = {0};
+        si.cbSize = sizeof(si);
+        si.fMask = SIF_TRACKPOS;
+        GetScrollInfo(v->hwnd, SB_VERT, &si);
+        return (size_t)si.nTrackPos << v->scrollShift;
+    }
+    default:
+        return v->topLine;
+    }
+}
+
+// Arrows, pages and Home/End move the caret as in the editor; Shift extends the selection
+static void HandleKey(StoreView *v, WPARAM key) {
+    if (!v->store) return;
+    BOOL control = (GetKeyState(VK_CONTROL) & 0x8000) != 0;
+    BOOL shift = (GetKeyState(VK_SHIFT) & 0x8000) != 0;
+    size_t line = DocStoreLineFromOffset(v->store, v->caret);
+    size_t start = LineStart(v, line), end = LineEnd(v, line, start);
+    size_t page = PageLines(v);
+    size_t target = v->caret;
+    size_t targetLine = line;
+    BOOL vertical = FALSE;
+    switch (key) {
+    case VK_LEFT:
+        if (v->caret > start) {
+            target = v->caret - 1;
+        } else if (line > 0) {
+            target = LineEnd(v, line - 1, LineStart(v, line - 1));
+        }
+        break;
+    case VK_RIGHT:
+        if (v->caret < end) {
+            target = v->caret + 1;
+        } else if (line + 1 < v->lines) {
+            target = LineStart(v, line + 1);
+        }
+        break;
+    case VK_UP:
+        targetLine = line ? line - 1 : 0;
+        vertical = TRUE;
+        break;
+    case VK_DOWN:
+        targetLine = line + 1 < v->lines ? line + 1 : line;
+        vertical = TRUE;
+        break;
+    case VK_PRIOR:
+        targetLine = line > page ? line - page : 0;
+        ScrollToLine(v, v->topLine > page ? v->topLine - page : 0);
+        vertical = TRUE;
+        break;
+    case VK_NEXT:
+        targetLine = line + page < v->lines ? line + page : v->lines - 1;
+        ScrollToLine(v, v->topLine + page);
+        vertical = TRUE;
+        break;
+    case VK_HOME:
+        target = control ? 0 : start;
+        break;
+    case VK_END:
+        target = control ? v->length : end;
+        break;
+    default:
+        return;
+    }
+    if (vertical) target = OffsetAtColumn(v, targetLine, v->goalColumn);
+    MoveCaret(v, target, shift, vertical);
+}
+
+// Offset under a client point; points above or below the window reach one line past it,
+// so dragging there scrolls
+static size_t OffsetAtPoint(const StoreView *v, int x, int y) {
+    size_t line;
+    if (y < 0) {
+        line = v->topLine ? v->topLine - 1 : 0;
+    } else {
+        line = v->topLine + (size_t)(y / v->lineHeight);
+    }
+    if (line >= v->lines) line = v->lines - 1;
+    int column = v->leftColumn + (x > 0 ? (x + v->charWidth / 2) / v->charWidth : 0);
+    return OffsetAtColumn(v, line, column);
+}
+
+static LRESULT CALLBACK StoreViewProc(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam) {
+    StoreView *v = GetView(hwnd);
+    if (!v && msg != WM_CREATE) return DefWindowProcW(hwnd, msg, wParam, lParam);
+    switch (msg) {
+    case WM_CREATE:
+        v = (StoreView *)((CREATESTRUCTW *)lParam)->lpCreateParams;
+        v->hwnd = hwnd;
+        SetWindowLongPtrW(hwnd, GWLP_USERDATA, (LONG_PTR)v);
+        CreateViewFont(v);
+        return 0;
+    case WM_DESTROY:
+        if (v->ownFont) DeleteObject(v->font);
+        SetWindowLongPtrW(hwnd, GWLP_USERDATA, 0);
+        HeapFree(GetProcessHeap(), 0, v);
+        return 0;
+    case WM_SIZE:
+        UpdateScrollBars(v);
+        ScrollToLine(v, v->topLine);
+        ScrollToColumn(v, v->leftColumn);
+        InvalidateRect(hwnd, NULL, FALSE);
+        UpdateCaret(v);
+        return 0;
+    case WM_ERASEBKGND:
+        return 1;   // every pixel is painted by the rows
+    case WM_PAINT: {
+        PAINTSTRUCT ps;
+        HDC dc = BeginPaint(hwnd, &ps);
+        BOOL widened = Paint(v, dc, &ps.rcPaint);
+        EndPaint(hwnd, &ps);
+        if (widened) UpdateScrollBars(v);
+        return 0;
+    }
+    case WM_SETFOCUS:
+        v->focused = TRUE;
+        CreateCaret(hwnd, NULL, 0, v->lineHeight);
+        UpdateCaret(v);
+        ShowCaret(hwnd);
+        return 0;
+    case WM_KILLFOCUS:
+        v->focused = FALSE;
+        DestroyCaret();
+        return 0;
+    case WM_VSCROLL:
+        ScrollToLine(v, ScrollLineFor(v, LOWORD(wParam)));
+        UpdateCaret(v);
+        return 0;
+    case WM_HSCROLL: {
+        int page = PageColumns(v);
+        int column = v->leftColumn;
+        switch (LOWORD(wParam)) {
+        case SB_LINEUP: column -= 1; break;
+        case SB_LINEDOWN: column += 1; break;
+        case SB_PAGEUP: column -= page; break;
+        case SB_PAGEDOWN: column += page; break;
+        case SB_THUMBTRACK:
+        case SB_THUMBPOSITION: column = HIWORD(wParam); break;
+        }
+        ScrollToColumn(v, column);
+        UpdateCaret(v);
+        return 0;
+    }
+    case WM_MOUSEWHEEL: {
+        int notches = GET_WHEEL_DELTA_WPARAM(wParam) / WHEEL_DELTA;
+        size_t lines = (size_t)(notches < 0 ? -notches : notches) * STORE_WHEEL_LINES;
+        ScrollToLine(v, notches > 0 ? (v->topLine > lines ? v->topLine - lines : 0) : v->topLine + lines);
+        UpdateCaret(v);
+        return 0;
+    }
+    case WM_KEYDOWN:
+        HandleKey(v, wParam);
+        return 0;
+    case WM_LBUTTONDOWN:
+        SetFocus(hwnd);
+        if (!v->store) return 0;
+        SetCapture(hwnd);
+        MoveCaret(v, OffsetAtPoint(v, (short)LOWORD(lParam), (short)HIWORD(lParam)), (wParam & MK_SHIFT) != 0, FALSE);
+        return 0;
+    case WM_MOUSEMOVE:
+        if (GetCapture() == hwnd && v->store) {
+            size_t pos = OffsetAtPoint(v, (short)LOWORD(lParam), (short)HIWORD(lParam));
+            if (pos != v->caret) MoveCaret(v, pos, TRUE, FALSE);
+        }
+        return 0;
+    case WM_LBUTTONUP:
+        if (GetCapture() == hwnd) ReleaseCapture();
+        return 0;
+    case WM_GETDLGCODE:
+        return DLGC_WANTARROWS;
+    }
+    return DefWindowProcW(hwnd, msg, wParam, lParam);
+}
+
+BOOL StoreViewRegister(HINSTANCE instance) {
+    WNDCLASSEXW wc = {0};
+    wc.cbSize = sizeof(wc);
+    wc.lpfnWndProc = StoreViewProc;
+    wc.hInstance = instance;
+    wc.hCursor = LoadCursorW(NULL, IDC_IBEAM);
+    wc.lpszClassName = STORE_CLASS_NAME;
+    return RegisterClassExW(&wc) != 0;
+}
+
+HWND StoreViewCreate(HWND parent, HINSTANCE instance, UINT msg) {
+    StoreView *v = (StoreView *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(StoreView));
+    if (!v) return NULL;
+    v->parent = parent;
+    v->msg = msg;
+    HWND hwnd = CreateWindowExW(WS_EX_CLIENTEDGE, STORE_CLASS_NAME, NULL, WS_CHILD | WS_VSCROLL | WS_HSCROLL | WS_TABSTOP,
+                                0, 0, 0, 0, parent, NULL, instance, v);
+    if (!hwnd) HeapFree(GetProcessHeap(), 0, v);
+    return hwnd;
+}
+
+void StoreViewOpen(HWND hwnd, const DocStore *store) {
+    StoreView *v = GetView(hwnd);
+    if (!v) return;
+    StoreViewClose(hwnd);
+    v->store = store;
+    v->length = DocStoreLength(store);
+    v->lines = DocStoreLineCount(store);
+    UpdateScrollBars(v);
+    InvalidateRect(hwnd, NULL, FALSE);
+    UpdateCaret(v);
+    SendMessageW(v->parent, v->msg, 0, 0);
+}
+
+void StoreViewClose(HWND hwnd) {
+    StoreView *v = GetView(hwnd);
+    if (!v) return;
+    v->store = NULL;
+    v->length = 0;
+    v->lines = 0;
+    v->topLine = 0;
+    v->leftColumn = 0;
+    v->widest = 0;
+    v->anchor = 0;
+    v->caret = 0;
+    v->goalColumn = 0;
+}
+
+size_t StoreViewSelection(HWND hwnd, size_t *endOut) {
+    StoreView *v = GetView(hwnd);
+    *endOut = v ? max(v->anchor, v->caret) : 0;
+    return v ? min(v->anchor, v->caret) : 0;
+}
+
+void StoreViewSelect(HWND hwnd, size_t anchor, size_t caret) {
+    StoreView *v = GetView(hwnd);
+    if (!v || !v->store) return;
+    v->anchor = anchor < v->length ? anchor : v->length;
+    MoveCaret(v, caret, TRUE, FALSE);
+}
@@ -0,0 +1,22 @@
+// Read-only text view for retropad. A child window paints a DocStore's lines straight
+// from its chunks, copying out only the columns on screen, so a document shown here
+// has no second copy of its text the way the EDIT control's UTF-16 buffer would be.
+#pragma once
+
+#include <windows.h>
+#include "core/docstore.h"
+
+// Registers the window class; call once before StoreViewCreate
+BOOL StoreViewRegister(HINSTANCE instance);
+// Creates the (hidden) view. `msg` is sent to `parent` whenever the selection changes.
+HWND StoreViewCreate(HWND parent, HINSTANCE instance, UINT msg);
+
+// Shows `store` from its start, replacing whatever the view showed. The view only reads
+// it; it must stay alive and unchanged until StoreViewClose or the next StoreViewOpen.
+void StoreViewOpen(HWND view, const DocStore *store);
+void StoreViewClose(HWND view);
+
+// The selection in code units, start <= end; the caret is at one of its ends
+size_t StoreViewSelection(HWND view, size_t *endOut);
+// Selects from `anchor` to `caret` (clamped to the text) and scrolls the caret into view
+void StoreViewSelect(HWND view, size_t anchor, size_t caret);
@@ -0,0 +1,175 @@
+// Trace recorder for retropad. Each thread owns a fixed ring of events that only it
+// writes, so recording needs no locks; rings are published on a lock-free list.
+#include "trace.h"
+#include <strsafe.h>
+
+#if defined(_MSC_VER)
+#define TRACE_THREAD_LOCAL __declspec(thread)
+#else
+#define TRACE_THREAD_LOCAL __thread
+#endif
+
+#define TRACE_RING_SIZE 8192   // events per thread, power of two
+#define TRACE_OUT_BUFFER 65536
+
+typedef struct TraceEvent {
+    const char *name;
+    LONGLONG start;
+    LONGLONG duration;
+    LONGLONG value;     // bytes for spans, sample for counters
+    char phase;         // 'X' complete span, 'C' counter
+} TraceEvent;
+
+typedef struct TraceRing {
+    struct TraceRing *next;
+    DWORD threadId;
+    volatile LONG head;        // total events ever written; slot = head % TRACE_RING_SIZE
+    TraceEvent events[TRACE_RING_SIZE];
+} TraceRing;
+
+typedef struct TraceWriter {
+    HANDLE file;
+    char buffer[TRACE_OUT_BUFFER];
+    size_t used;
+    BOOL ok;
+} TraceWriter;
+
+volatile LONG g_traceEnabled = 0;
+
+static TraceRing *volatile g_traceRings = NULL;
+static LONGLONG g_traceFrequency = 0;
+static LONGLONG g_traceOrigin = 0;
+static TRACE_THREAD_LOCAL TraceRing *t_traceRing = NULL;
+
+LONGLONG TraceNow(void) {
+    LARGE_INTEGER now;
+    QueryPerformanceCounter(&now);
+    return now.QuadPart;
+}
+
+void TraceEnable(BOOL enabled) {
+    if (enabled && g_traceFrequency == 0) {
+        LARGE_INTEGER freq;
+        QueryPerformanceFrequency(&freq);
+        g_traceFrequency = freq.QuadPart;
+        g_traceOrigin = TraceNow();
+    }
+    InterlockedExchange(&g_traceEnabled, enabled ? 1 : 0);
+}
+
+static TraceRing *AcquireThreadRing(void) {
+    if (t_traceRing) return t_traceRing;
+
+    TraceRing *ring = (TraceRing *)HeapAlloc(GetProcessHeap(), HEAP_ZERO_MEMORY, sizeof(TraceRing));
+    if (!ring) return NULL;
+    ring->threadId = GetCurrentThreadId();
+
+    // Rings outlive their threads so events from finished workers still get exported
+    TraceRing *head;
+    do {
+        head = g_traceRings;
+        ring->next = head;
+    } while (InterlockedCompareExchangePointer((void *volatile *)&g_traceRings, ring, head) != head);
+
+    t_traceRing = ring;
+    return ring;
+}
+
+static void PushEvent(const char *name, char phase, LONGLONG start, LONGLONG duration, LONGLONG value) {
+    TraceRing *ring = AcquireThreadRing();
+    if (!ring) return;
+
+    LONG index = ring->head;
+    TraceEvent *ev = &ring->events[index & (TRACE_RING_SIZE - 1)];
+    ev->name = name;
+    ev->start = start;
+    ev->duration = duration;
+    ev->value = value;
+    ev->phase = phase;
+    InterlockedExchange(&ring->head, index + 1);
+}
+
+void TraceRecord(const char *name, LONGLONG start, LONGLONG end, LONGLONG bytes) {
+    PushEvent(name, 'X', start, end - start, bytes);
+}
+
+void TraceCounter(const char *name, LONGLONG value) {
+    if (!g_traceEnabled) return;
+    PushEvent(name, 'C', TraceNow(), 0, value);
+}
+
+static void WriterFlush(TraceWriter *w) {
+    if (w->ok && w->used > 0) {
+        DWORD written = 0;
+        w->ok = WriteFile(w->file, w->buffer, (DWORD)w->used, &written, NULL);
+    }
+    w->used = 0;
+}
+
+static void WriterAppend(TraceWriter *w, const char *text) {
+    size_t len = strlen(text);
+    if (w->used + len > sizeof(w->buffer)) {
+        WriterFlush(w);
+    }
+    CopyMemory(w->buffer + w->used, text, len);
+    w->used += len;
+}
+
+static double TicksToMicros(LONGLONG ticks) {
+    return (double)ticks * 1000000.0 / (double)g_traceFrequency;
+}
+
+BOOL TraceDumpJson(LPCWSTR path) {
+    if (g_traceFrequency == 0) return FALSE;
+
+    TraceWriter *w = (TraceWriter *)HeapAlloc(GetProcessHeap(), 0, sizeof(TraceWriter));
+    if (!w) return FALSE;
+    w->file = CreateFileW(path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+    if (w->file == INVALID_HANDLE_VALUE) {
+        HeapFree(GetProcessHeap(), 0, w);
+        return FALSE;
+    }
+    w->used = 0;
+    w->ok = TRUE;
+
+    DWORD pid = GetCurrentProcessId();
+    BOOL first = TRUE;
+    char line[512];
+    WriterAppend(w, "{\"traceEvents\":[\n");
+
+    for (TraceRing *ring = g_traceRings; ring; ring = ring->next) {
+        LONG head = ring->head;
+        LONG begin = head > TRACE_RING_SIZE ? head - TRACE_RING_SIZE : 0;
+        StringCchPrintfA(line, ARRAYSIZE(line),
+                         "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%lu,\"tid\":%lu,\"args\":{\"name\":\"%s\"}}",
+                         first ? "" : ",\n", (unsigned long)pid, (unsigned long)ring->threadId,
+                         ring->threadId == GetCurrentThreadId() ? "ui" : "worker");
+        WriterAppend(w, line);
+        first = FALSE;
+
+        for (LONG i = begin; i < head; ++i) {
+            const TraceEvent *ev = &ring->events[i & (TRACE_RING_SIZE - 1)];
+            if (ev->phase == 'C') {
+                StringCchPrintfA(line, ARRAYSIZE(line),
+                                 ",\n{\"name\":\"%s\",\"cat\":\"retropad\",\"ph\":\"C\",\"ts\":%.3f,"
+                                 "\"pid\":%lu,\"tid\":%lu,\"args\":{\"value\":%lld}}",
+                                 ev->name, TicksToMicros(ev->start - g_traceOrigin),
+                                 (unsigned long)pid, (unsigned long)ring->threadId, ev->value);
+            } else {
+                StringCchPrintfA(line, ARRAYSIZE(line),
+                                 ",\n{\"name\":\"%s\",\"cat\":\"retropad\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,"
+                                 "\"pid\":%lu,\"tid\":%lu,\"args\":{\"bytes\":%lld}}",
+                                 ev->name, TicksToMicros(ev->start - g_traceOrigin), TicksToMicros(ev->duration),
+                                 (unsigned long)pid, (unsigned long)ring->threadId, ev->value);
+            }
+            WriterAppend(w, line);
+        }
+    }
+
+    WriterAppend(w, "\n]}\n");
+    WriterFlush(w);
+    BOOL ok = w->ok;
+    CloseHandle(w->file);
+    HeapFree(GetProcessHeap(), 0, w);
+    return ok;
+}
@@ -0,0 +1,26 @@
+// Lightweight hot-path tracing for retropad: per-thread ring buffers exported as Chrome trace JSON
+#pragma once
+
+#include <windows.h>
+
+typedef struct TraceSpan {
+    const char *name;   // must be a string literal (stored by pointer)
+    LONGLONG start;     // QPC ticks, 0 when tracing was off at begin time
+} TraceSpan;
+
+extern volatile LONG g_traceEnabled;
+
+void TraceEnable(BOOL enabled);
+LONGLONG TraceNow(void);
+void TraceRecord(const char *name, LONGLONG start, LONGLONG end, LONGLONG bytes);
+// Counter sample shown as its own track; cheap no-op while tracing is off.
+void TraceCounter(const char *name, LONGLONG value);
+
+// Writes every thread's ring as {"traceEvents":[...]} for chrome://tracing or Perfetto.
+BOOL TraceDumpJson(LPCWSTR path);
+
+// Scoped timers. When tracing is off the cost is one load and a branch on each side.
+#define TRACE_BEGIN(span, label) TraceSpan span = { (label), g_traceEnabled ? TraceNow() : 0 }
+#define TRACE_END(span) TRACE_END_BYTES(span, 0)
+#define TRACE_END_BYTES(span, byteCount) \
+    do { if ((span).start) TraceRecord((span).name, (span).start, TraceNow(), (LONGLONG)(byteCount)); } while (0)